@@ -0,0 +1,160 @@
+/***********************************************
+*
+* @Proposito:  Mide las implementaciones de la suma de bytes del checksum de
+*               las tramas (SWAR, SSE2 y AVX2) contra la escalar de referencia
+*               y comprueba que todas dan exactamente el mismo resultado
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../modules/trama.h"
+
+#define BENCH_BUFFER_SIZE (1024 * 1024)
+#define BENCH_CHECK_CASES 100000
+#define BENCH_FRAME_SIZE 250            // Bytes de datos de una trama pequeña
+#define BENCH_FRAME_ROUNDS 2000000
+#define BENCH_BUFFER_ROUNDS 500
+
+// Evita que el compilador descarte las sumas que solo se miden
+static volatile uint64_t BENCH_sink;
+
+/**************************************************
+ *
+ * @Finalidad: Obtener el instante actual en segundos, con un reloj monótono.
+ * @Parametros: ----.
+ * @Retorno:    Segundos desde un origen arbitrario.
+ *
+ **************************************************/
+static double BENCH_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**************************************************
+ *
+ * @Finalidad: Comprobar que una implementación da la misma suma que la
+ *             escalar con longitudes, alineaciones y sumas previas al azar,
+ *             incluidos los bloques vacíos y los que acaban a media palabra.
+ * @Parametros: in: kernel    = implementación a comprobar.
+ *              in: reference = implementación escalar.
+ *              in: buffer    = datos aleatorios de BENCH_BUFFER_SIZE bytes.
+ * @Retorno:    0 si coinciden siempre, 1 en caso contrario.
+ *
+ **************************************************/
+static int BENCH_check(const TramaSumKernel *kernel, const TramaSumKernel *reference, const char *buffer) {
+    for (int i = 0; i < BENCH_CHECK_CASES; i++) {
+        size_t offset = rand() % 64;
+        // Todas las longitudes cortas, la mayoría del tamaño de una trama y
+        // unas pocas de hasta el bloque entero
+        size_t size;
+        if (i < 1024) {
+            size = i;
+        } else if (i % 1000 == 0) {
+            size = (size_t)rand() % (BENCH_BUFFER_SIZE - offset);
+        } else {
+            size = (size_t)rand() % 4096;
+        }
+        uint64_t start = (uint64_t)rand() * rand();
+
+        uint64_t expected = reference->sum(start, buffer + offset, size);
+        uint64_t obtained = kernel->sum(start, buffer + offset, size);
+        if (expected != obtained) {
+            char *msg;
+            asprintf(&msg, "%s: mismatch at offset %zu size %zu (%llu != %llu)\n", kernel->name, offset, size,
+                     (unsigned long long)obtained, (unsigned long long)expected);
+            write(STDOUT_FILENO, msg, strlen(msg));
+            free(msg);
+            return 1;
+        }
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Medir el tiempo de una implementación sobre muchas tramas
+ *             pequeñas y sobre un bloque grande.
+ * @Parametros: in: kernel = implementación a medir.
+ *              in: buffer = datos de BENCH_BUFFER_SIZE bytes.
+ *              out: frameNs = nanosegundos por trama.
+ *              out: gbps    = GB/s sobre el bloque grande.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void BENCH_time(const TramaSumKernel *kernel, const char *buffer, double *frameNs, double *gbps) {
+    uint64_t sum = 0;
+
+    double start = BENCH_now();
+    for (int i = 0; i < BENCH_FRAME_ROUNDS; i++) {
+        sum = kernel->sum(sum, buffer + (i & 1023), BENCH_FRAME_SIZE);
+    }
+    *frameNs = (BENCH_now() - start) * 1e9 / BENCH_FRAME_ROUNDS;
+
+    start = BENCH_now();
+    for (int i = 0; i < BENCH_BUFFER_ROUNDS; i++) {
+        sum = kernel->sum(sum, buffer, BENCH_BUFFER_SIZE);
+    }
+    *gbps = (double)BENCH_BUFFER_SIZE * BENCH_BUFFER_ROUNDS / (BENCH_now() - start) / 1e9;
+
+    BENCH_sink = sum;
+}
+
+int main(void) {
+    int count;
+    const TramaSumKernel *kernels = TRAMA_getSumKernels(&count);
+    char *buffer = malloc(BENCH_BUFFER_SIZE);
+    char *msg;
+    int failed = 0;
+    double scalarFrame = 0, scalarGbps = 0;
+
+    if (buffer == NULL) {
+        write(STDOUT_FILENO, "Error: Could not allocate the benchmark buffer\n", 47);
+        return 1;
+    }
+
+    srand(2025);
+    for (int i = 0; i < BENCH_BUFFER_SIZE; i++) {
+        buffer[i] = (char)rand();
+    }
+
+    write(STDOUT_FILENO, "kernel   ns/frame   GB/s   speedup\n", 35);
+    for (int i = 0; i < count; i++) {
+        double frameNs, gbps;
+
+        if (!kernels[i].supported) {
+            asprintf(&msg, "%-6s   not supported by this CPU\n", kernels[i].name);
+            write(STDOUT_FILENO, msg, strlen(msg));
+            free(msg);
+            continue;
+        }
+        if (i > 0 && BENCH_check(&kernels[i], &kernels[0], buffer)) {
+            failed = 1;
+            continue;
+        }
+
+        BENCH_time(&kernels[i], buffer, &frameNs, &gbps);
+        if (i == 0) {
+            scalarFrame = frameNs;
+            scalarGbps = gbps;
+        }
+        asprintf(&msg, "%-6s   %8.1f   %5.2f   %5.2fx frame, %5.2fx block\n", kernels[i].name, frameNs, gbps,
+                 scalarFrame / frameNs, gbps / scalarGbps);
+        write(STDOUT_FILENO, msg, strlen(msg));
+        free(msg);
+    }
+
+    free(buffer);
+    if (failed) {
+        write(STDOUT_FILENO, "Error: Some kernels do not match the scalar checksum\n", 53);
+        return 1;
+    }
+    write(STDOUT_FILENO, "All kernels match the scalar checksum\n", 38);
+    return 0;
+}
@@ -9,11 +9,20 @@
 #define _GNU_SOURCE
 #include "../modules/project.h"
 
+// Veces que se pide otro worker a Gotham si el asignado está saturado (BUSY)
+#define FLECK_BUSY_RETRIES 5
+
+// Pool de distorsiones: como mucho una de Media y una de Text a la vez; el
+// resto de peticiones esperan en cola hasta que termine una de ellas
+#define FLECK_POOL_THREADS 2
+#define FLECK_POOL_CAPACITY 8
+
 // Variable global para almacenar la configuración
 FleckConfig config;
 // Variable global para almacenar el comando leído
 char *global_cmd = NULL;
 int sockfd_G = -1, sockfd_E = -1, sockfd_H = -1;
+TramaReader *reader_G = NULL;
 
 // Variable global para almacenar el estado de las distorsiones
 int ongoing_media_distortion = 0;
@@ -22,7 +31,11 @@ int ongoing_text_distortion = 0;
 int connected = 0;
 
 pthread_mutex_t myMutex = PTHREAD_MUTEX_INITIALIZER;
+// Las distorsiones de Media y Text comparten el socket y el lector de
+// Gotham: cada petición y su respuesta van juntas bajo este mutex
+pthread_mutex_t gotham_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_t watcher_thread;
+ThreadPool *distortion_pool = NULL;
 
 LinkedList2 distortionsList; 
 
@@ -95,15 +108,17 @@ int connectToGotham() {
     write(STDOUT_FILENO, "Connected to Gotham\n", 21);
     TRAMA_sendMessageToSocket(sockfd_G, 0x01, (int16_t)strlen(config.username), config.username);
 
+    reader_G = TRAMA_createReader(sockfd_G);
     struct trama ftrama;
-    if (TRAMA_readMessageFromSocket(sockfd_G, &ftrama) < 0) {
+    if (TRAMA_readFrame(reader_G, &ftrama) != TRAMA_OK) {
         write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
+        TRAMA_destroyReader(reader_G);
+        reader_G = NULL;
         close(sockfd_G);
         free(message);  // Liberar antes de retornar
         return 0;
     }
 
-    free(ftrama.data);
     free(message);  // Liberar antes de retornar
     return 1;
 }
@@ -126,6 +141,7 @@ int connectToGotham() {
  *               6. Finalizar con TYPE=0x06 CHECK_OK o gestionar error
  *                  en caso de CHECK_KO.
  * @Parametros: in: sockfd     = descriptor de socket conectado al worker.
+ *              in: reader     = lector de tramas del socket del worker.
  *              in: fileName   = nombre del fichero a distorsionar.
  *              in: fileSize   = cadena con el tamaño original en bytes.
  *              in/out: element = puntero a la estructura de estado que
@@ -134,11 +150,11 @@ int connectToGotham() {
  *             se completó correctamente; < 0 si ocurre cualquier error.
  *
  **************************************************/
-int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2* element) {
+int realFileDistorsion(int sockfd, TramaReader* reader, char* fileName, char* fileSize, listElement2* element) {
     // Crear path del archivo
     char* path = NULL;
     if (asprintf(&path, "%s/%s", config.directory, fileName) == -1) return 1;
-    char* fileSize2;
+    char* fileSize2 = NULL;
     int fd = open(path, O_RDONLY);
     if (fd < 0) {
         write(STDOUT_FILENO, "Error: Cannot open file..\n", 27);
@@ -154,10 +170,20 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
 
     element->bytes_to_writeF1 = atoi(fileSize);
 
+    // Desde TRAMA_PROTOCOL_RESUME se continúa desde el byte que ha indicado
+    // el worker; a uno antiguo se le reenvía el fichero entero
     int bytes_written = 0, bytes_to_write = element->bytes_to_writeF1;
+    if (element->protocol >= TRAMA_PROTOCOL_RESUME && element->bytes_writtenF1 < bytes_to_write) {
+        bytes_written = element->bytes_writtenF1;
+    }
     element->bytes_writtenF1 = bytes_written;
-    char* buf = (char*)malloc(sizeof(char) * 247);
-    char* message = (char*)malloc(sizeof(char) * 256);
+    uint32_t dataSize = TRAMA_getDataSize(element->protocol);
+    off_t offset = bytes_written;
+    char* buf = NULL;
+    if (element->protocol < TRAMA_PROTOCOL_STREAM) {
+        buf = (char*)malloc(sizeof(char) * dataSize);
+        lseek(fd, offset, SEEK_SET);
+    }
     struct trama ftrama;
     int sizeOfBuf = 0;
 
@@ -165,12 +191,16 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
     if(element->status == 0 || element->status == 1) {
         element->status = 1;
         while (bytes_to_write > bytes_written) {
-            memset(buf, '\0', 247);
-            memset(message, '\0', 256);
-            sizeOfBuf = read(fd, buf, 247);
-            memcpy(message, buf, sizeOfBuf);
-            bytes_written += sizeOfBuf;
-            element->bytes_writtenF1 = bytes_written;
+            if (element->protocol >= TRAMA_PROTOCOL_STREAM) {
+                // Con sendfile los datos no se leen: solo se calcula el tamaño de la trama
+                sizeOfBuf = (uint32_t)(bytes_to_write - bytes_written) < dataSize ? bytes_to_write - bytes_written : (int)dataSize;
+            } else {
+                sizeOfBuf = read(fd, buf, dataSize);
+                if (sizeOfBuf <= 0) {
+                    write(STDOUT_FILENO, "Error: Cannot read file.\n", 26);
+                    return 1;
+                }
+            }
 
             pthread_mutex_lock(&myMutex);
 
@@ -189,15 +219,26 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
                 return 0;
             }
 
-            //Enviar datos al worker (sin modificar TRAMA_sendMessageToSocket())
-            TRAMA_sendMessageToSocket(sockfd, 0x03, sizeOfBuf, message);
+            //Enviar datos al worker con el formato de trama negociado
+            int error;
+            if (element->protocol >= TRAMA_PROTOCOL_STREAM) {
+                error = TRAMA_sendFileToSocket(sockfd, 0x03, fd, &offset, sizeOfBuf);
+            } else {
+                error = TRAMA_sendDataToSocket(sockfd, 0x03, sizeOfBuf, buf, element->protocol);
+            }
 
             pthread_mutex_unlock(&myMutex);
+            if (error < 0) {
+                write(STDOUT_FILENO, "Worker connection closed.\n", 26);
+                return 0;
+            }
+            bytes_written += sizeOfBuf;
+            element->bytes_writtenF1 = bytes_written;
             usleep(1);
         }
         element->status = 2;
 
-        if (TRAMA_readMessageFromSocket(sockfd, &ftrama) < 0) {
+        if (TRAMA_readFrame(reader, &ftrama) != TRAMA_OK) {
             write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
             return 1;
         } else if (ftrama.tipo == 0x06 && strcmp((const char *)ftrama.data, "CHECK_OK") == 0) {
@@ -209,22 +250,19 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
             return 0;
         } else {
             write(STDOUT_FILENO, "Error: Invalid trama type. 1\n", 29);
-            free(ftrama.data);
             return 1;
         }
-        free(ftrama.data);
     }
     close(fd);
     free(buf);
 
     if(element->status == 2) {
 
-        if (TRAMA_readMessageFromSocket(sockfd, &ftrama) < 0) {
+        if (TRAMA_readFrame(reader, &ftrama) != TRAMA_OK) {
             write(STDOUT_FILENO, "Error: Checksum not validated. 2\n", 32);
             return 1;
         } else if (ftrama.tipo != 0x04 && ftrama.tipo != 0x07) {
             write(STDOUT_FILENO, "Error: Invalid trama type. 2\n", 29);
-            free(ftrama.data);
             return 1;
         } else if (ftrama.tipo == 0x07) {
             write(STDOUT_FILENO, "Worker received a CTRL+C.\n", 26);
@@ -233,15 +271,36 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
         fileSize2 = STRING_getXFromMessage((const char *)ftrama.data, 0);
         element->bytes_to_writeF2 = atoi(fileSize2);
         element->distortedMd5 = STRING_getXFromMessage((const char *)ftrama.data, 1);
-        free(ftrama.data);
     }
 
     char* path2 = NULL;
     if (asprintf(&path2, "%s/D%s", config.directory, fileName) == -1) return 1;
     
-    
-    // Verificar si el archivo ya existe y eliminarlo
-    if (access(path2, F_OK) == 0) { // F_OK verifica si el archivo existe
+    // Una descarga que se reanuda con TRAMA_PROTOCOL_RESUME sigue tras los
+    // bytes que ya están en disco (los anunciados en sendSongInfo); si no,
+    // se vuelve a descargar entera
+    int bytes_written2 = 0, bytes_to_write2 = element->bytes_to_writeF2;
+    if (element->status == 3 && element->protocol >= TRAMA_PROTOCOL_RESUME && element->bytes_writtenF2 < bytes_to_write2) {
+        bytes_written2 = element->bytes_writtenF2;
+    }
+    element->bytes_writtenF2 = bytes_written2;
+    // El MD5 se calcula sobre los datos a medida que llegan, sin releer el fichero
+    Md5Context md5;
+    MD5_init(&md5);
+
+    int fd2 = -1;
+    if (bytes_written2 > 0) {
+        fd2 = open(path2, O_RDWR);
+        if (fd2 < 0 || MD5_updateFromFile(&md5, fd2, bytes_written2) != MD5_OK ||
+            ftruncate(fd2, bytes_written2) != 0 || lseek(fd2, bytes_written2, SEEK_SET) < 0) {
+            write(STDOUT_FILENO, "Error: Cannot resume distorted file.\n", 37);
+            if (fd2 >= 0) {
+                close(fd2);
+            }
+            free(path2);
+            return 1;
+        }
+    } else if (access(path2, F_OK) == 0) { // Verificar si el archivo ya existe y eliminarlo
         if (remove(path2) == 0) {
             write(STDOUT_FILENO, "Existing file deleted successfully.\n", 36);
         } else {
@@ -251,16 +310,23 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
         }
     }    
 
-    int fd2 = open(path2, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd2 < 0) {
+        fd2 = open(path2, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
     if (fd2 < 0) {
         perror("Failed to open file.");
         exit(EXIT_FAILURE);
     }
 
-    int bytes_written2 = 0, bytes_to_write2 = element->bytes_to_writeF2;
     element->status = 3;
     while (bytes_written2 < bytes_to_write2) {
-        if (TRAMA_readMessageFromSocket(sockfd, &ftrama) < 0) {
+        int result = TRAMA_readFrame(reader, &ftrama);
+        // Un worker que se cae corta la conexión a mitad de trama: se
+        // reanuda la descarga en otro igual que si se hubiera cerrado
+        if (result == TRAMA_EOF || result == TRAMA_ERROR_CLOSED || result == TRAMA_ERROR_READ) {
+            write(STDOUT_FILENO, "Worker connection closed.\n", 26);
+            return 0;
+        } else if (result != TRAMA_OK) {
             write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
             return 1;
         } else if (ftrama.tipo == 0x07) {
@@ -271,28 +337,25 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
             return 1;
         }
 
-        char* incoming_Info = NULL;
-        if(bytes_written2 < element->bytes_writtenF2) {
-            bytes_written2 += 247;
-        } else if (bytes_to_write2 - bytes_written2 < 247) {
-            incoming_Info = STRING_getSongCode((const char *)ftrama.data, bytes_to_write2 - bytes_written2);
-            bytes_written2 += write(fd2, incoming_Info, bytes_to_write2 - bytes_written2);
-            element->bytes_writtenF2 = bytes_written2;
-        } else {
-            incoming_Info = STRING_getSongCode((const char *)ftrama.data, 247);
-            bytes_written2 += write(fd2, incoming_Info, 247);
-            element->bytes_writtenF2 = bytes_written2;
+        // Las tramas pueden ser clásicas (247 bytes) o grandes según el protocolo
+        int chunk = ftrama.longitud;
+        if (chunk > bytes_to_write2 - bytes_written2) {
+            chunk = bytes_to_write2 - bytes_written2;
         }
-        if (bytes_written2 < 0) {
+        MD5_update(&md5, ftrama.data, chunk);
+
+        // Los datos se escriben directamente desde el buffer del lector
+        if (TRAMA_writeData(fd2, &ftrama, chunk) < 0) {
             perror("Failed to write to file.");
             exit(EXIT_FAILURE);
         }
-        free(incoming_Info);
-        free(ftrama.data);
+        bytes_written2 += chunk;
+        element->bytes_writtenF2 = bytes_written2;
         usleep(1);
     }
 
-    char* actualMd5 = DISTORSION_getMD5SUM(path2);
+    char actualMd5[MD5_HEX_SIZE];
+    MD5_finalHex(&md5, actualMd5);
 
     if (strcmp(element->distortedMd5, actualMd5) == 0) {
         TRAMA_sendMessageToSocket(sockfd, 0x06, (int16_t)strlen("CHECK_OK"), "CHECK_OK");
@@ -307,7 +370,6 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
     free(path);
     free(path2);
     free(fileSize2);
-    free(actualMd5);
 
     element->status = 4;
     return 1;
@@ -317,44 +379,30 @@ int realFileDistorsion(int sockfd, char* fileName, char* fileSize, listElement2*
  *
  * @Finalidad: Enviar la trama de metadatos del fichero
  *             al socket del worker, incluyendo el MD5
- *             original y el factor de distorsión.
+ *             original, el factor de distorsión y los bytes del
+ *             resultado que ya se tienen en disco (al reanudar una
+ *             descarga).
  * @Parametros: in: sockfd    = descriptor de socket conectado al worker.
  *              in: filename  = nombre del fichero a distorsionar.
  *              in: factor    = factor de distorsión.
  *              in: fileSize  = tamaño del fichero en bytes.
  *              in: path      = ruta completa del fichero a distorsionar.
+ *              in: downloaded = bytes del resultado ya descargados.
  * @Retorno:    Ninguno.
  *
  **************************************************/
-void sendSongInfo(int sockfd, char* filename, char* factor, char* fileSize, char* path) {
-    int fds[2];
-    pipe(fds);
-    pid_t childPid = fork();
-
-    if (childPid == 0) {
-        close(fds[0]);
-        dup2(fds[1], STDOUT_FILENO);
-        close(fds[1]);
-
-        char *cmd = NULL;
-        asprintf(&cmd, "md5sum %s", path);
-        
-        execlp("/bin/sh", "sh", "-c", cmd, NULL);
-        exit(EXIT_FAILURE);
-    } else {
-        close(fds[1]);
-        wait(NULL); 
-
-        char actualMd5[33];
-        read(fds[0], actualMd5, 32); 
-        actualMd5[32] = '\0';
-
-        close(fds[0]);
-        char* data = (char*)malloc(256 * sizeof(char));
-        sprintf(data, "%s&%s&%s&%s&%s", config.username, filename, fileSize, actualMd5, factor);
-        TRAMA_sendMessageToSocket(sockfd, 0x03, (int16_t)strlen(data), data);
-        free(data);
+void sendSongInfo(int sockfd, char* filename, char* factor, char* fileSize, char* path, int downloaded) {
+    char actualMd5[MD5_HEX_SIZE];
+
+    if (MD5_hashFile(path, actualMd5) != MD5_OK) {
+        write(STDOUT_FILENO, "Error: Cannot compute MD5 of file.\n", 36);
+        actualMd5[0] = '\0';
     }
+
+    char* data = (char*)malloc(256 * sizeof(char));
+    sprintf(data, "%s&%s&%s&%s&%s&%d&%d", config.username, filename, fileSize, actualMd5, factor, TRAMA_PROTOCOL_VERSION, downloaded);
+    TRAMA_sendMessageToSocket(sockfd, 0x03, (int16_t)strlen(data), data);
+    free(data);
 }
 /**************************************************
  *
@@ -373,6 +421,34 @@ void sendSongInfo(int sockfd, char* filename, char* factor, char* fileSize, char
  * @Retorno:    ----.
  *
  **************************************************/
+/**************************************************
+ *
+ * @Finalidad: Enviar una petición a Gotham y leer su respuesta sin que otra
+ *             distorsión use el lector a la vez. La respuesta se copia
+ *             antes de soltar el mutex, porque la trama apunta al buffer
+ *             del lector.
+ * @Parametros: in:  type    = tipo de la trama (0x10 o 0x11).
+ *              in:  request = datos de la petición.
+ *              out: reply   = copia de los datos de la respuesta (memoria
+ *                             dinámica); NULL si no se pudo leer.
+ * @Retorno:    TRAMA_OK si se leyó la respuesta; el error de
+ *              TRAMA_readFrame en caso contrario.
+ *
+ **************************************************/
+int askGotham(char type, char* request, char** reply) {
+    struct trama ftrama;
+
+    pthread_mutex_lock(&gotham_mutex);
+    TRAMA_sendMessageToSocket(sockfd_G, type, (int16_t)strlen(request), request);
+    int result = TRAMA_readFrame(reader_G, &ftrama);
+    *reply = result == TRAMA_OK ? strndup((const char *)ftrama.data, ftrama.longitud) : NULL;
+    pthread_mutex_unlock(&gotham_mutex);
+
+    if (result == TRAMA_OK && *reply == NULL) {
+        result = TRAMA_ERROR_READ;
+    }
+    return result;
+}
 void distortFile (char* type, char* filename, char* factor, listElement2* element) {
     if (strcmp(type, "Media") == 0) {
         if (ongoing_media_distortion) {
@@ -398,55 +474,96 @@ void distortFile (char* type, char* filename, char* factor, listElement2* elemen
     char* filename_copy = strdup(filename); 
     if (asprintf(&data, "%s&%s", type, filename_copy) == -1) return;
     write(STDOUT_FILENO, data, strlen(data));
-    TRAMA_sendMessageToSocket(sockfd_G, 0x10, (int16_t)strlen(data), data);
+    char* reply = NULL;
+    int result = askGotham(0x10, data, &reply);
     free(data);
 
     struct trama ftrama;
+    int busyRetries = 0, retry = 0;
     while(1) {
-        if(TRAMA_readMessageFromSocket(sockfd_G, &ftrama) < 0) {
+        if(result != TRAMA_OK) {
             write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
             return;
         }
-        if(strcmp((const char *)ftrama.data, "DISTORT_KO") == 0) {
+        if(strcmp(reply, "DISTORT_KO") == 0) {
             write(STDOUT_FILENO, "ERROR: No worker for this type available.\n", 43);
-            free(ftrama.data);
             ongoing_media_distortion = 0;
+            free(reply);
+            break;
         } else {
-            char *port = STRING_getXFromMessage((const char *)ftrama.data, 1);
-            char *ip = STRING_getXFromMessage((const char *)ftrama.data, 0);
+            char *port = STRING_getXFromMessage(reply, 1);
+            char *ip = STRING_getXFromMessage(reply, 0);
+            int continued = 0;
             int s_fd = -1;
             s_fd = SOCKET_createSocket(port, ip);
+            TramaReader *reader = TRAMA_createReader(s_fd);
             if(strcmp (type, "Media") == 0) {
                 sockfd_H = s_fd;
             } else if(strcmp (type, "Text") == 0) {
                 sockfd_E = s_fd;
             }
-            free(ftrama.data);  
             char* path = NULL;
             if (asprintf(&path, "%s/%s", config.directory, filename_copy) == -1) return;
 
             char* fileSize = FILES_get_size_of_file(path);
-            sendSongInfo(s_fd, filename_copy, factor, fileSize, path);
+            if (element->status == 3) {
+                // Solo se anuncian los bytes del resultado que ya están en disco
+                char* path2 = NULL;
+                if (asprintf(&path2, "%s/D%s", config.directory, filename_copy) == -1) return;
+                element->bytes_writtenF2 = FILES_get_durable_size(path2, element->bytes_to_writeF2);
+                free(path2);
+            }
+            sendSongInfo(s_fd, filename_copy, factor, fileSize, path, element->status == 3 ? element->bytes_writtenF2 : 0);
             free(path);
-            if(TRAMA_readMessageFromSocket(s_fd, &ftrama) < 0) {
+            if(TRAMA_readFrame(reader, &ftrama) != TRAMA_OK) {
                 write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
+                TRAMA_destroyReader(reader);
+                free(reply);
                 return;
             }
             if(strcmp((const char *)ftrama.data, "CON_KO") == 0) {
                 write(STDOUT_FILENO, "ERROR: File could not be distorted\n", 36);
+            } else if(ftrama.tipo == 0x03 && strcmp((const char *)ftrama.data, TRAMA_BUSY) == 0) {
+                busyRetries++;
+                if (busyRetries <= FLECK_BUSY_RETRIES) {
+                    write(STDOUT_FILENO, "Worker busy, asking Gotham for another worker...\n", 50);
+                    retry = 1;
+                } else {
+                    write(STDOUT_FILENO, "ERROR: All workers are busy, try again later.\n", 47);
+                }
             } else {
                 if(ftrama.tipo == 0x03) {
+                    // Un worker antiguo responde sin versión: se mantiene el protocolo clásico
+                    element->protocol = TRAMA_negotiateProtocol((const char *)ftrama.data);
+                    char* answer = STRING_getXFromMessage((const char *)ftrama.data, 1);
+                    char* resumeAt = STRING_getXFromMessage((const char *)ftrama.data, 2);
+                    if (element->protocol >= TRAMA_PROTOCOL_CACHE && answer != NULL && strcmp(answer, TRAMA_HAVE_IT) == 0) {
+                        // El worker ya tiene el fichero: no se sube
+                        write(STDOUT_FILENO, "Worker already has the file, skipping upload.\n", 46);
+                        element->status = 2;
+                    } else if (element->protocol >= TRAMA_PROTOCOL_RESUME && answer != NULL && resumeAt != NULL && strcmp(answer, TRAMA_RESUME) == 0) {
+                        // El worker ya tiene el principio del fichero: se envía el resto
+                        write(STDOUT_FILENO, "Resuming upload where the worker left it.\n", 42);
+                        element->bytes_writtenF1 = atoi(resumeAt);
+                    } else {
+                        element->bytes_writtenF1 = 0;
+                    }
+                    free(answer);
+                    free(resumeAt);
                     write(STDOUT_FILENO, "File starting to distort.\n", 27);
-                    if(realFileDistorsion(s_fd, filename_copy, fileSize, element) == 0) {
+                    if(realFileDistorsion(s_fd, reader, filename_copy, fileSize, element) == 0) {
                         char* data2 = NULL;
                         if (asprintf(&data2, "%s&%s", type, filename_copy) == -1) return;
-                        TRAMA_sendMessageToSocket(sockfd_G, 0x11, (int16_t)strlen(data2), data2);
+                        // La respuesta es el worker con el que se continúa
+                        free(reply);
+                        result = askGotham(0x11, data2, &reply);
+                        continued = 1;
                         free(data2);
                         sleep(1);
                     } else {
-                        free(ftrama.data);
                         free(port);
                         free(ip);
+                        TRAMA_destroyReader(reader);
                         close(s_fd);
                         s_fd = -1;
                         if(strcmp (type, "Media") == 0) {
@@ -456,13 +573,14 @@ void distortFile (char* type, char* filename, char* factor, listElement2* elemen
                             sockfd_E = s_fd;
                             ongoing_text_distortion = 0;
                         }
+                        free(reply);
                         break;
                     }
                 }
             }
-            free(ftrama.data);
             free(port);
             free(ip);
+            TRAMA_destroyReader(reader);
             close(s_fd);
             s_fd = -1;
             if(strcmp (type, "Media") == 0) {
@@ -472,6 +590,25 @@ void distortFile (char* type, char* filename, char* factor, listElement2* elemen
                 sockfd_E = s_fd;
                 ongoing_text_distortion = 0;
             }
+            if (busyRetries > FLECK_BUSY_RETRIES || (!retry && !continued)) {
+                // Sin una nueva petición a Gotham no hay respuesta que esperar
+                free(reply);
+                break;
+            }
+            if (retry) {
+                // Se espera un poco más en cada intento y se vuelve a pedir worker
+                retry = 0;
+                sleep(busyRetries);
+                if(strcmp (type, "Media") == 0) {
+                    ongoing_media_distortion = 1;
+                } else if(strcmp (type, "Text") == 0) {
+                    ongoing_text_distortion = 1;
+                }
+                if (asprintf(&data, "%s&%s", type, filename_copy) == -1) return;
+                free(reply);
+                result = askGotham(0x10, data, &reply);
+                free(data);
+            }
         }
     }
 
@@ -494,18 +631,21 @@ void doLogout () {
     write(STDOUT_FILENO, "Logging out...\n", 15);
     if (SOCKET_isSocketOpen(sockfd_G)) {
         TRAMA_sendMessageToSocket(sockfd_G, 0x07, (int16_t)strlen(config.username), config.username);
+        // shutdown despierta a las distorsiones bloqueadas leyendo del socket
+        shutdown(sockfd_G, SHUT_RDWR);
         close(sockfd_G);
         sockfd_G = -1;
         write(STDOUT_FILENO, "Sending logout message to Gotham server...\n", 43);
     }
     if (SOCKET_isSocketOpen(sockfd_H)) {
-        shutdown(sockfd_H, SHUT_WR);
+        shutdown(sockfd_H, SHUT_RDWR);
         close(sockfd_H);
         sockfd_H = -1;
     }
     if(SOCKET_isSocketOpen(sockfd_E)) {
         write(STDOUT_FILENO, "Sending logout message to Enigma server...\n", 43);
         TRAMA_sendMessageToSocket(sockfd_E, 0x07, (int16_t)strlen("CON_KO"), "CON_KO"); 
+        shutdown(sockfd_E, SHUT_RDWR);
         close(sockfd_E);
         sockfd_E = -1;
     }
@@ -529,7 +669,12 @@ void CTRLC(int signum) {
         free(global_cmd);
         global_cmd = NULL;
     }
+    // Las distorsiones en curso usan la configuración, el lector de Gotham y
+    // la lista: con los sockets cerrados acaban enseguida y se esperan
+    THREADPOOL_destroy(distortion_pool);
+    distortion_pool = NULL;
     free_config();
+    TRAMA_destroyReader(reader_G);
     LINKEDLIST2_destroy(&distortionsList);
     pthread_cancel(watcher_thread);
     pthread_join(watcher_thread, NULL);
@@ -654,6 +799,23 @@ void CHECK_STATUS() {
     }
 }
 
+/**************************************************
+ *
+ * @Finalidad: Quitar una distorsión de la lista (sin liberarla).
+ * @Parametros: in: element = distorsión a quitar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void removeDistortion(listElement2* element) {
+    LINKEDLIST2_goToHead(distortionsList);
+    while (!LINKEDLIST2_isAtEnd(distortionsList)) {
+        if (LINKEDLIST2_get(distortionsList) == element) {
+            LINKEDLIST2_remove(distortionsList);
+            return;
+        }
+        LINKEDLIST2_next(distortionsList);
+    }
+}
 /**************************************************
  *
  * @Finalidad: Eliminar de la lista interna de tareas de distorsión
@@ -693,19 +855,18 @@ void CLEAR_ALL() {
 
 /**************************************************
  *
- * @Finalidad: Hilo destinado a gestionar la distorsión
+ * @Finalidad: Tarea del pool destinada a gestionar la distorsión
  *               completa de un fichero solicitado por Fleck.
  * @Parametros: in: arg = puntero a la estructura `listElement2` que contiene
  *                     toda la información de la tarea a procesar.
  * @Retorno:    ----.
  *
  **************************************************/
-void* distortFileThread(void* arg) {
+void distortFileTask(void* arg) {
     DistortionThreadParams* params = (DistortionThreadParams*)arg;
     distortFile(params->type, params->filename, params->factor, params->element);
 
     free(params);
-    return NULL;
 }
 
 /**************************************************
@@ -765,7 +926,7 @@ void terminal() {
                     factor_copy = strdup(factor);
 
                     //  Crear el nuevo elemento y agregarlo a la LinkedList ANTES de lanzar el hilo
-                    listElement2* newElement = (listElement2*)malloc(sizeof(listElement2));
+                    listElement2* newElement = (listElement2*)calloc(1, sizeof(listElement2));
                     if (newElement == NULL) {
                         write(STDOUT_FILENO, "Error: Memory allocation failed for listElement.\n", 50);
                         return;
@@ -778,6 +939,9 @@ void terminal() {
                     newElement->bytes_writtenF2 = 0;
                     newElement->bytes_to_writeF1 = 0;
                     newElement->bytes_to_writeF2 = 0;
+                    newElement->protocol = TRAMA_PROTOCOL_LEGACY;
+                    newElement->fused = 0;
+                    newElement->inPipeline = 0;
 
 
                     // Agregarlo a la LinkedList
@@ -785,17 +949,25 @@ void terminal() {
 
                     // Preparar los parámetros del hilo
                     DistortionThreadParams* params = (DistortionThreadParams*)malloc(sizeof(DistortionThreadParams));
-                    params->type = type_copy;
-                    params->filename = extracted_copy;
-                    params->factor = factor_copy;
-                    params->element = newElement;  // Pasamos el puntero del nuevo elemento
-
-                    // Crear el hilo que ejecutará `distortFileThread`
-                    pthread_t thread_id;
-                    if(pthread_create(&thread_id, NULL, distortFileThread, params) < 0) {
-                        write(STDOUT_FILENO, "Error: Cannot create thread\n", 29);
-                    } else {
-                        pthread_detach(thread_id);
+                    if (params != NULL) {
+                        params->type = type_copy;
+                        params->filename = extracted_copy;
+                        params->factor = factor_copy;
+                        params->element = newElement;  // Pasamos el puntero del nuevo elemento
+                    }
+
+                    // Enviar al pool la tarea que ejecutará `distortFileTask`. Si
+                    // no cabe, la distorsión no llega a existir: se quita de la lista
+                    if (params == NULL || THREADPOOL_submit(distortion_pool, distortFileTask, params) != THREADPOOL_OK) {
+                        write(STDOUT_FILENO, "Error: Cannot start distortion, too many in progress\n", 54);
+                        free(params);
+                        removeDistortion(newElement);
+                        free(newElement);
+                        free(extracted_copy);
+                        free(type_copy);
+                        free(factor_copy);
+                        type_copy = NULL;
+                        factor_copy = NULL;
                     }
                 }
                 if (factor != factor_copy) free(factor);  
@@ -864,6 +1036,19 @@ int main(int argc, char *argv[]) {
     config = READCONFIG_read_config_fleck(argv[1]);
 
     distortionsList = LINKEDLIST2_create();
+    // Los hilos del pool no atienden SIGINT: CTRLC los espera y no puede
+    // ejecutarse en uno de ellos
+    sigset_t block, previous;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &previous);
+    distortion_pool = THREADPOOL_create(FLECK_POOL_THREADS, FLECK_POOL_CAPACITY);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (distortion_pool == NULL) {
+        write(STDOUT_FILENO, "Error: Cannot create thread pool\n", 33);
+        free_config();
+        exit(1);
+    }
 
     char* msg;
 
@@ -873,7 +1058,10 @@ int main(int argc, char *argv[]) {
 
     terminal();
 
+    THREADPOOL_destroy(distortion_pool);
+    distortion_pool = NULL;
     free_config();
+    TRAMA_destroyReader(reader_G);
     LINKEDLIST2_destroy(&distortionsList);
     return 0;
 }
\ No newline at end of file
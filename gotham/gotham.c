@@ -12,7 +12,7 @@
 // Variable global para almacenar la configuración
 GothamConfig config;
 
-LinkedList listW; 
+WorkerRegistry registry;
 LinkedList listF;
 
 int gotham_flag = 0;
@@ -21,8 +21,41 @@ int gotham_flag = 0;
 int pipe_fds[2];
 pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-int fleck_connecter_fd = -1, worker_connecter_fd = -1;
-
+// Tipos de descriptor registrados en el epoll de cada reactor
+#define GOTHAM_FLECK_LISTENER 0
+#define GOTHAM_WORKER_LISTENER 1
+#define GOTHAM_SHUTDOWN 2
+#define GOTHAM_FLECK 3
+#define GOTHAM_WORKER 4
+
+#define GOTHAM_MAX_REACTORS 4
+#define GOTHAM_MAX_EVENTS 64
+
+// Estado de un descriptor atendido por los reactores
+typedef struct GothamConnection {
+    int kind;
+    int fd;
+    TramaReader* reader;
+    listElement* element;   // Fleck registrado (NULL hasta su registro)
+    int worker;             // Worker registrado en el registro (-1 hasta su registro)
+    struct GothamConnection* prev;      // Conexiones aceptadas por el mismo reactor
+    struct GothamConnection* next;
+} GothamConnection;
+
+// Reactor: su epoll y las conexiones que ha aceptado, que solo atiende él
+typedef struct {
+    int epfd;
+    GothamConnection* connections;
+} GothamReactor;
+
+GothamConnection fleckListener = { GOTHAM_FLECK_LISTENER, -1, NULL, NULL, -1, NULL, NULL };
+GothamConnection workerListener = { GOTHAM_WORKER_LISTENER, -1, NULL, NULL, -1, NULL, NULL };
+GothamConnection shutdownNotifier = { GOTHAM_SHUTDOWN, -1, NULL, NULL, -1, NULL, NULL };
+
+// Protege listF (y su cursor) entre los reactores
+pthread_mutex_t lists_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Pipe de aviso de cierre para los reactores
 int pipefd[2];
 
 /**************************************************
@@ -72,10 +105,10 @@ void log_event(const char *event) {
 /**************************************************
  *
  * @Finalidad: Atender en Gotham la solicitud de distorsión de un cliente Fleck.
- *             Busca un worker del tipo indicado (Media o Texto) entre los
- *             trabajadores activos y envía al cliente la dirección (IP y puerto)
- *             del worker principal en una trama de respuesta. Si no hay ningún
- *             worker disponible, envía un mensaje de error (DISTORT_KO).
+ *             Escoge en el registro, sin bloquear, un worker del tipo indicado
+ *             (Media o Texto) de los que atienden Flecks y envía al cliente su
+ *             dirección (IP y puerto) en una trama de respuesta. Si no hay
+ *             ningún worker disponible, envía un mensaje de error (DISTORT_KO).
  * @Parametros: in: fleckSock = descriptor del socket conectado con el cliente Fleck.
  *              in: type      = cadena que indica el tipo de worker solicitado.
  *                              (Media o Texto).
@@ -86,71 +119,124 @@ void log_event(const char *event) {
  *
  **************************************************/
 void searchWorkerAndSendInfo(int fleckSock, char* type, uint16_t longitud) {
-    listElement* element = NULL;
+    RegistryWorker worker;
     char* message = (char*)malloc(sizeof(char) * 256);
-    
-    if (LINKEDLIST_isEmpty(listW)) {
-        write(STDOUT_FILENO, "No workers available\n", 21);
-        TRAMA_sendMessageToSocket(fleckSock, 0x10, (int16_t)strlen("DISTORT_KO"), "DISTORT_KO");
-        free(message);
-        return;
-    }
-
-    LINKEDLIST_goToHead(listW);
 
-    while(!LINKEDLIST_isAtEnd(listW)) {
-        listElement* currentElement = LINKEDLIST_get(listW);
-        if(strcmp(currentElement->worker_type, type) == 0) {
-            element = currentElement;
-            break;
-        }
-        LINKEDLIST_next(listW);
-    }
-
-    if(element == NULL) {
+    if (REGISTRY_select(&registry, type, &worker) != REGISTRY_OK) {
         sprintf(message, "\nNo workers of type %s available.\n\n", type);
         write(STDOUT_FILENO, message, strlen(message));
         TRAMA_sendMessageToSocket(fleckSock, longitud, (int16_t)strlen("DISTORT_KO"), "DISTORT_KO");
     } else {
         write(STDOUT_FILENO, "Worker found, sending to Fleck.\n\n", 33);
-        sprintf(message, "%s&%s", element->ip, element->port);  
+        sprintf(message, "%s&%s", worker.ip, worker.port);  
         TRAMA_sendMessageToSocket(fleckSock, longitud, (int16_t)strlen(message), message);
     }
     free(message);
 }
 /**************************************************
  *
- * @Finalidad: Función que se ejecuta en un hilo para gestionar de forma concurrente
- *             la sesión de un cliente Fleck conectado a Gotham. Atiende todas las
- *             solicitudes de ese cliente, incluyendo comandos de LIST, DISTORT y LOGOUT,
- *             redirigiendo las peticiones al worker correspondiente y enviando las respuestas.
- * @Parametros: in: arg = puntero a un entero (o estructura) que contiene el descriptor
- *                     de socket del cliente Fleck aceptado por Gotham.
+ * @Finalidad: Cerrar una conexión atendida por un reactor: la quita de su
+ *             epoll y de sus conexiones, cierra el socket y libera el
+ *             lector y el estado.
+ * @Parametros: in/out: reactor = reactor que atiende la conexión.
+ *              in:     conn    = conexión a cerrar.
  * @Retorno:    ----.
  *
  **************************************************/
-void* threadFleck(void* arg) {
-    int fleckSock = *(int*)arg;
-    struct trama gtrama;
+void closeConnection(GothamReactor* reactor, GothamConnection* conn) {
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        reactor->connections = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    TRAMA_destroyReader(conn->reader);
+    close(conn->fd);
+    free(conn);
+}
 
-    // First message read from Fleck
-    if (TRAMA_readMessageFromSocket(fleckSock, &gtrama) < 0) {
-        write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
-        return NULL;
+/**************************************************
+ *
+ * @Finalidad: Eliminar de la lista de Flecks el cliente registrado
+ *             en una conexión y registrar su desconexión.
+ * @Parametros: in/out: conn = conexión del Fleck.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void removeFleck(GothamConnection* conn) {
+    pthread_mutex_lock(&lists_mutex);
+    LINKEDLIST_goToHead(listF);
+    while (!LINKEDLIST_isAtEnd(listF)) {
+        listElement* currentElement = LINKEDLIST_get(listF);
+        if (currentElement == conn->element) {
+            char* data = (char*)malloc(sizeof(char) * 256);
+            sprintf(data, "Fleck disconnected: username=%s", currentElement->fleck_username);
+            log_event(data);
+            free(data);
+            free(currentElement->fleck_username);
+            free(currentElement);
+            LINKEDLIST_remove(listF);
+            break;
+        }
+        LINKEDLIST_next(listF);
     }
-    
-    // Process the first message
-    if (gtrama.tipo == 0x01) {
-        char* username = STRING_getXFromMessage((const char *)gtrama.data, 0);
-        
-        free(gtrama.data); 
-        gtrama.data = NULL;
+    pthread_mutex_unlock(&lists_mutex);
+    conn->element = NULL;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Eliminar del registro el worker registrado en una conexión
+ *             y registrar su desconexión.
+ * @Parametros: in/out: conn = conexión del worker.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void removeWorker(GothamConnection* conn) {
+    RegistryWorker removed;
+
+    int result = REGISTRY_remove(&registry, conn->worker, &removed);
+    conn->worker = -1;
+    if (result == REGISTRY_ERROR_NOT_FOUND) {
+        return;
+    }
+
+    char* data = (char*)malloc(sizeof(char) * 256);
+    sprintf(data, "%s disconnected: IP:%s:%s", removed.type, removed.ip, removed.port);
+    log_event(data);
+    write(STDOUT_FILENO, "Worker was disconnected.\n\n", 27);
+    free(data);
+}
+
+/**************************************************
+ *
+ * @Finalidad: Procesar una trama recibida de un cliente Fleck. La primera
+ *             trama debe ser el registro (0x01); después se atienden las
+ *             peticiones de distorsión (0x10, 0x11) y la desconexión (0x07).
+ * @Parametros: in/out: conn  = conexión del Fleck.
+ *              in:     gtrama = trama recibida.
+ * @Retorno:    0 si la conexión sigue abierta; -1 si se debe cerrar.
+ *
+ **************************************************/
+int handleFleckFrame(GothamConnection* conn, struct trama* gtrama) {
+    if (conn->element == NULL) {
+        if (gtrama->tipo != 0x01) {
+            return -1;
+        }
+        char* username = STRING_getXFromMessage((const char *)gtrama->data, 0);
 
         listElement* element = (listElement*)malloc(sizeof(listElement));
-        element->sockfd = fleckSock;
+        element->sockfd = conn->fd;
         element->fleck_username = username;
         element->thread_id = pthread_self();
+        pthread_mutex_lock(&lists_mutex);
         LINKEDLIST_add(listF, element);
+        pthread_mutex_unlock(&lists_mutex);
+        conn->element = element;
+
         char* data = (char*)malloc(sizeof(char) * 256);
         sprintf(data, "Fleck connected: username=%s", username);
         log_event(data);
@@ -158,353 +244,290 @@ void* threadFleck(void* arg) {
         memset(data, '\0', 256);
         sprintf(data, "\nWelcome %s, you are connected to Gotham.\n\n", username);
         write(STDOUT_FILENO, data, strlen(data));
-        TRAMA_sendMessageToSocket(fleckSock, 0x01, 0, "");
+        TRAMA_sendMessageToSocket(conn->fd, 0x01, 0, "");
         free(data);
+        return 0;
+    }
 
-        //Ahora entra al bucle para leer los mensajes siguientes
-        while (1) {
-            int result = TRAMA_readMessageFromSocket(fleckSock, &gtrama);
-            if(result == -2) {
-                write(STDOUT_FILENO, "Thread Worker OUT.\n", strlen("Thread Worker OUT.\n"));
-                return NULL;
-            }
-            if (result < 0) {
-                write(STDOUT_FILENO, "Error: Checksum not validated....\n", 35);
-                free(gtrama.data);
-                break;  // Salir del bucle
-            }
-            
-            // Procesar mensajes
-            if (gtrama.tipo == 0x10 || gtrama.tipo == 0x11) {
-                if (strcmp((const char *)gtrama.data, "CON_KO") == 0) {
-                    write(STDOUT_FILENO, "Error: Distortion of this type already in progress.\n", 53);
-                    free(gtrama.data); 
-                    gtrama.data = NULL;
-                } else {
-                    char* type = STRING_getXFromMessage((const char *)gtrama.data, 0);
-                    char* filename = STRING_getXFromMessage((const char *)gtrama.data, 1);
-                    char* data = (char*)malloc(sizeof(char) * 256); 
-                    if (gtrama.tipo == 0x10) {
-                        sprintf(data, "Fleck requested distortion: username=%s, mediaType=%s, filename=%s", username, type, filename);
-                    } else if (gtrama.tipo == 0x11) {
-                        sprintf(data, "Fleck requested continue distortion: username=%s, textType=%s, filename=%s", username, type, filename);
-                    }
-                    log_event(data);
-                    free(data);
-                    free(filename);
-
-                    free(gtrama.data); 
-                    gtrama.data = NULL;
-                    
-                    searchWorkerAndSendInfo(fleckSock, type, gtrama.tipo);
-                    
-                    free(type);
-                }
-            } else if (gtrama.tipo == 0x07) {
-                LINKEDLIST_goToHead(listF);
-                while(!LINKEDLIST_isAtEnd(listF)) {
-                    listElement* currentElement = LINKEDLIST_get(listF);
-                    if(strcmp(currentElement->fleck_username, (const char *)gtrama.data) == 0 && currentElement->sockfd == fleckSock) {
-                        free(gtrama.data); 
-                        gtrama.data = NULL;
-                        char* data = (char*)malloc(sizeof(char) * 256);
-                        sprintf(data, "Fleck disconnected: username=%s", currentElement->fleck_username);
-                        log_event(data);
-                        free(data);
-                        free(currentElement->fleck_username);
-                        free(currentElement);
-                        LINKEDLIST_remove(listF);
-                        break;
-                    }
-                    LINKEDLIST_next(listF);
-                }
-                write(STDOUT_FILENO, "Fleck was disconnected.\n\n", 26);
-                break;
+    if (gtrama->tipo == 0x10 || gtrama->tipo == 0x11) {
+        if (strcmp((const char *)gtrama->data, "CON_KO") == 0) {
+            write(STDOUT_FILENO, "Error: Distortion of this type already in progress.\n", 53);
+        } else {
+            char* type = STRING_getXFromMessage((const char *)gtrama->data, 0);
+            char* filename = STRING_getXFromMessage((const char *)gtrama->data, 1);
+            char* data = (char*)malloc(sizeof(char) * 256); 
+            if (gtrama->tipo == 0x10) {
+                sprintf(data, "Fleck requested distortion: username=%s, mediaType=%s, filename=%s", conn->element->fleck_username, type, filename);
             } else {
-                free(gtrama.data);
-                gtrama.data = NULL;
+                sprintf(data, "Fleck requested continue distortion: username=%s, textType=%s, filename=%s", conn->element->fleck_username, type, filename);
             }
-        }
-    } else {
-        // Si el primer mensaje no es 0x01, lo hemos leído pero no hemos utilizado gtrama.data:
-        free(gtrama.data);
-        gtrama.data = NULL;
-    }
-
-    close(fleckSock);
-    return NULL;
-}
-
-/**************************************************
- *
- * @Finalidad: Hilo encargado de escuchar continuamente en el socket
- *             de Gotham para nuevas conexiones de clientes Fleck.
- *             Por cada conexión entrante, acepta el socket y lanza
- *             un nuevo hilo (threadFleck) para atender la sesión del cliente.
- * @Parametros: ----.
- * @Retorno:    ----.
- *
- **************************************************/
-void* funcThreadFleckConnecter() {
-    fleck_connecter_fd = SOCKET_initSocket(config.fleck_server_port, config.fleck_server_ip);
-    
-    int newsock;
-    struct sockaddr_in c_addr;
-    socklen_t c_len = sizeof(c_addr);
+            log_event(data);
+            free(data);
+            free(filename);
 
-    // Poner el socket en modo NO BLOQUEANTE
-    fcntl(fleck_connecter_fd, F_SETFL, O_NONBLOCK);
+            searchWorkerAndSendInfo(conn->fd, type, gtrama->tipo);
 
-    while (1) {
-        usleep(10000);  //Pequeña pausa para evitar alto consumo de CPU
-
-        newsock = accept(fleck_connecter_fd, (struct sockaddr*)&c_addr, &c_len);
-        if (newsock < 0) {
-            if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                if(gotham_flag == 1) {
-                    write(STDOUT_FILENO, "Thread Fleck Connecter OUT.\n", strlen("Thread Fleck Connecter OUT.\n"));
-                    return NULL;
-                }
-                continue;
-            } else {
-                perror("Error: Cannot accept connection");
-                exit(EXIT_FAILURE);
-            }
+            free(type);
         }
-
-        pthread_t thread_newFleck;
-        pthread_create(&thread_newFleck, NULL, threadFleck, &newsock);
+    } else if (gtrama->tipo == 0x07) {
+        removeFleck(conn);
+        write(STDOUT_FILENO, "Fleck was disconnected.\n\n", 26);
+        return -1;
     }
+    return 0;
 }
 
 /**************************************************
  *
- * @Finalidad: Función que se ejecuta en un hilo para gestionar la sesión
- *             de un worker (Enigma o Harley) conectado a Gotham. Entre sus
- *             responsabilidades están:
- *             - Leer el frame de registro inicial (TYPE=0x02) y añadir
- *               el worker a la lista de activos.
- *             - Mantener el estado del worker, atendiendo
- *               o detectando desconexiones inesperadas.
- *             - Al recibir una desconexión
- *               remueve el worker de la lista.
- * @Parametros: in: arg = puntero a entero que contiene el descriptor
- *                     de socket del worker aceptado por el socket
- *                     de escucha de Gotham.
- * @Retorno:    Devuelve NULL cuando el worker se desconecta o se produce
- *             un error de comunicación, indicando el fin de la ejecución
- *             del hilo.
+ * @Finalidad: Procesar una trama recibida de un worker. La primera trama
+ *             debe ser el registro (0x02): el worker se añade al registro y
+ *             se le activa (0x08) para que atienda Flecks. Después se reciben
+ *             sus informes de carga (0x12) y la desconexión (0x07).
+ * @Parametros: in/out: conn  = conexión del worker.
+ *              in:     gtrama = trama recibida.
+ * @Retorno:    0 si la conexión sigue abierta; -1 si se debe cerrar.
  *
  **************************************************/
-void* threadWorker(void* arg) {
-    write(STDOUT_FILENO, "Worker connected\n\n", 19);
-    int principal = 0;
-    int newsock = *(int*)arg;
-    char* aux = (char*)malloc(sizeof(char) * 256);  // Para mensajes temporales
-    if (!aux) {
-        perror("Error: Memory allocation for aux failed");
-        return NULL;
-    }
-
-    struct trama gtrama;
-
-    // Leer el primer mensaje
-    if (TRAMA_readMessageFromSocket(newsock, &gtrama) < 0) {
-        write(STDOUT_FILENO, "Error: Checksum not validated...\n", 34);
-        free(aux);                          // Liberar aux antes de salir
-        return NULL;
-    }
+int handleWorkerFrame(GothamConnection* conn, struct trama* gtrama) {
+    if (conn->worker < 0) {
+        if (gtrama->tipo != 0x02) {
+            return -1;
+        }
 
-    if (gtrama.tipo == 0x02) {
         // Parsear los campos
-        char* worker_type = STRING_getXFromMessage((const char *)gtrama.data, 0);
-        char* ip          = STRING_getXFromMessage((const char *)gtrama.data, 1);
-        char* port        = STRING_getXFromMessage((const char *)gtrama.data, 2);
-
-        free(gtrama.data);                  // Liberar gtrama.data después de usarlo
-        gtrama.data = NULL;
+        char* worker_type = STRING_getXFromMessage((const char *)gtrama->data, 0);
+        char* ip          = STRING_getXFromMessage((const char *)gtrama->data, 1);
+        char* port        = STRING_getXFromMessage((const char *)gtrama->data, 2);
 
         if (!worker_type || !ip || !port) {  // Validar asignación de campos
             write(STDOUT_FILENO, "Error: Invalid worker message.\n", 32);
             free(worker_type);
             free(ip);
             free(port);
-            free(aux);
-            close(newsock);
-            return NULL;
+            return -1;
         }
 
-        // Crear y añadir elemento a la lista
-        listElement* element = (listElement*)malloc(sizeof(listElement));
-        if (!element) {
-            perror("Error: Memory allocation for listElement failed");
+        conn->worker = REGISTRY_add(&registry, worker_type, ip, port, conn->fd);
+        if (conn->worker < 0) {
+            write(STDOUT_FILENO, "Error: Worker registry is full.\n", 33);
             free(worker_type);
             free(ip);
             free(port);
-            free(aux);
-            close(newsock);
-            return NULL;
+            return -1;
         }
 
-        element->sockfd = newsock;
-        element->ip = ip;
-        element->port = port;
-        element->worker_type = worker_type;
-        element->principal = 0;
-        element->thread_id = pthread_self();
-        LINKEDLIST_add(listW, element);
         char* data = (char*)malloc(sizeof(char) * 256);
         sprintf(data, "%s connected: IP:%s:%s", worker_type, ip, port);
         log_event(data);
+        sprintf(data, "Worker of type %s added\n\n", worker_type);
+        write(STDOUT_FILENO, data, strlen(data));
         free(data);
-        sprintf(aux, "Worker of type %s added\n\n", worker_type);
-        write(STDOUT_FILENO, aux, strlen(aux));
-        TRAMA_sendMessageToSocket(newsock, 0x02, 0, "");
+        free(worker_type);
+        free(ip);
+        free(port);
 
-        int isFirst = 1;
-        LINKEDLIST_goToHead(listW);
-        while (!LINKEDLIST_isAtEnd(listW)) {
-            listElement* worker = LINKEDLIST_get(listW);
+        TRAMA_sendMessageToSocket(conn->fd, 0x02, 0, "");
+        TRAMA_sendMessageToSocket(conn->fd, 0x08, 0, "");
+        return 0;
+    }
 
-            if (worker == element) {
-                break;
-            }
-            if (strcmp(worker->worker_type, element->worker_type) == 0) {
-                isFirst = 0;
-                break;
-            }
-            LINKEDLIST2_next(listW);
+    if (gtrama->tipo == 0x12) {
+        // Informe de carga: trabajos activos & bytes en cola & carga de CPU [& capacidad]
+        char* jobs     = STRING_getXFromMessage((const char *)gtrama->data, 0);
+        char* bytes    = STRING_getXFromMessage((const char *)gtrama->data, 1);
+        char* load     = STRING_getXFromMessage((const char *)gtrama->data, 2);
+        char* capacity = STRING_getXFromMessage((const char *)gtrama->data, 3);
+        if (jobs && bytes && load) {
+            REGISTRY_updateLoad(&registry, conn->worker, atoi(jobs), atoll(bytes), atoi(load), capacity ? atoi(capacity) : 0);
         }
-        if (isFirst) {
-            element->principal = 1;
-            TRAMA_sendMessageToSocket(element->sockfd, 0x08, 0, "");
-        }
-
-    } else {
-        free(gtrama.data);
-        gtrama.data = NULL;
-        free(aux);
-        close(newsock);
-        return NULL;
+        free(jobs);
+        free(bytes);
+        free(load);
+        free(capacity);
+    } else if (gtrama->tipo == 0x07) {
+        removeWorker(conn);
+        return -1;
     }
+    return 0;
+}
 
-    free(aux);  // Liberar aux tras el uso inicial
+/**************************************************
+ *
+ * @Finalidad: Atender una conexión con datos pendientes: procesa todas las
+ *             tramas completas disponibles sin bloquear y cierra la conexión
+ *             si el otro extremo se desconecta o envía una trama inválida.
+ * @Parametros: in/out: reactor = reactor que atiende la conexión.
+ *              in:     conn    = conexión de un Fleck o de un worker.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void handleConnection(GothamReactor* reactor, GothamConnection* conn) {
+    struct trama gtrama;
 
     while (1) {
-        int result = TRAMA_readMessageFromSocket(newsock, &gtrama);
-        if(result == -2) {
-            write(STDOUT_FILENO, "Thread Worker OUT.\n", strlen("Thread Worker OUT.\n"));
-            return NULL;
-        }
-        if (result < 0) {
-            write(STDOUT_FILENO, "Error: Checksum not validated....\n", 35);
-            free(gtrama.data);
-            break;  // Salir del bucle
+        int result = TRAMA_readFrame(conn->reader, &gtrama);
+        if (result == TRAMA_WOULD_BLOCK) {
+            return;
         }
 
-        if (gtrama.tipo == 0x07) {
-            // Buscar y eliminar el elemento de la lista
-            LINKEDLIST_goToHead(listW);
-            while (!LINKEDLIST_isAtEnd(listW)) {
-                listElement* currentElement = LINKEDLIST_get(listW);
-                if (strcmp(currentElement->worker_type, (const char *)gtrama.data) == 0 
-                    && currentElement->sockfd == newsock) {
-                    char* data = (char*)malloc(sizeof(char) * 256);
-                    principal = currentElement->principal;
-                    sprintf(data, "%s disconnected: IP:%s:%s", currentElement->worker_type, currentElement->ip, currentElement->port);
-                    log_event(data);
-                    free(data);
-                    free(currentElement->ip);
-                    free(currentElement->port);
-                    free(currentElement->worker_type);
-                    free(currentElement);
-                    LINKEDLIST_remove(listW);
-                    break;
-                }
-                LINKEDLIST_next(listW);
+        int keep = -1;
+        if (result == TRAMA_OK) {
+            if (conn->kind == GOTHAM_FLECK) {
+                keep = handleFleckFrame(conn, &gtrama);
+            } else {
+                keep = handleWorkerFrame(conn, &gtrama);
             }
-            write(STDOUT_FILENO, "Worker was disconnected.\n\n", 27);
-            LINKEDLIST_shuffle(listW);
-            if (!LINKEDLIST_isEmpty(listW) && principal == 1) {
-                LINKEDLIST_goToHead(listW);
-                while (!LINKEDLIST_isAtEnd(listW)) {
-                    listElement* firstWorker = LINKEDLIST_get(listW);
-                    if (strcmp(firstWorker->worker_type, (const char *)gtrama.data) == 0) {
-                        TRAMA_sendMessageToSocket(firstWorker->sockfd, 0x08, 0, "");
-                        char* data = (char*)malloc(sizeof(char) * 256);
-                        sprintf(data, "%s is now the principal worker: IP:%s:%s", firstWorker->worker_type, firstWorker->ip, firstWorker->port);
-                        log_event(data);
-                        free(data);
-                        break;
-                    }
-                    LINKEDLIST_next(listW);
-                }
+        } else if (result == TRAMA_EOF) {
+            if (conn->kind == GOTHAM_FLECK) {
+                write(STDOUT_FILENO, "Fleck closed the connection.\n", 29);
+            } else {
+                write(STDOUT_FILENO, "Worker closed the connection.\n", 30);
             }
-            free(gtrama.data);  // Liberar gtrama.data tras procesar
-            gtrama.data = NULL;
-            break;              // Salir del bucle
+        } else if (result != TRAMA_ERROR_OUT) {
+            write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
         }
 
-        free(gtrama.data);      // Liberar gtrama.data tras procesar
-        gtrama.data = NULL;
+        if (keep < 0) {
+            // Desconexión sin trama 0x07: también se elimina de las listas
+            if (conn->kind == GOTHAM_FLECK && conn->element != NULL) {
+                removeFleck(conn);
+            } else if (conn->kind == GOTHAM_WORKER && conn->worker >= 0) {
+                removeWorker(conn);
+            }
+            closeConnection(reactor, conn);
+            return;
+        }
     }
+}
 
-    close(newsock);             // Cerrar el socket al final
-    return NULL;
+/**************************************************
+ *
+ * @Finalidad: Aceptar todas las conexiones pendientes de un socket de escucha
+ *             y registrarlas, en modo no bloqueante, en el epoll del reactor.
+ * @Parametros: in/out: reactor  = reactor que atenderá las conexiones.
+ *              in:     listener = socket de escucha de Flecks o de workers.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void acceptConnections(GothamReactor* reactor, GothamConnection* listener) {
+    while (1) {
+        int newsock = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newsock < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Error: Cannot accept connection");
+            }
+            return;
+        }
+
+        GothamConnection* conn = (GothamConnection*)malloc(sizeof(GothamConnection));
+        if (!conn) {
+            perror("Error: Memory allocation for connection failed");
+            close(newsock);
+            continue;
+        }
+        conn->kind = (listener->kind == GOTHAM_FLECK_LISTENER) ? GOTHAM_FLECK : GOTHAM_WORKER;
+        conn->fd = newsock;
+        conn->element = NULL;
+        conn->worker = -1;
+        conn->reader = TRAMA_createReader(newsock);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (!conn->reader || epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, newsock, &event) < 0) {
+            perror("Error: Cannot register connection");
+            TRAMA_destroyReader(conn->reader);
+            close(newsock);
+            free(conn);
+            continue;
+        }
+        conn->prev = NULL;
+        conn->next = reactor->connections;
+        if (reactor->connections != NULL) {
+            reactor->connections->prev = conn;
+        }
+        reactor->connections = conn;
+
+        if (conn->kind == GOTHAM_WORKER) {
+            write(STDOUT_FILENO, "Worker connected\n\n", 19);
+        }
+    }
 }
+
 /**************************************************
  *
- * @Finalidad: Hilo encargado de escuchar de forma continua
- *             en el socket de Gotham para nuevas conexiones
- *             de workers (Enigma o Harley). Por cada conexión entrante:
- *               - Acepta el socket.
- *               - Lanza un hilo (threadWorker) para gestionar la sesión
- *                 de ese worker.
+ * @Finalidad: Hilo reactor de Gotham. Cada reactor tiene su propio epoll en el
+ *             que escucha los dos sockets de escucha (con EPOLLEXCLUSIVE, para
+ *             que cada conexión nueva despierte a un solo reactor), el aviso de
+ *             cierre y las conexiones que ha aceptado, a las que atiende sin
+ *             bloquear hasta que se cierran. Al recibir el aviso de cierre
+ *             cierra y libera las que siguen abiertas, registradas o no.
  * @Parametros: ----.
- * @Retorno:    Devuelve NULL al finalizar.
+ * @Retorno:    NULL al recibir el aviso de cierre.
  *
  **************************************************/
-void* funcThreadWorkerConnecter() {
-    worker_connecter_fd = SOCKET_initSocket(config.external_server_port, config.external_server_ip);
-    
-    int newsock;
-    struct sockaddr_in c_addr;
-    socklen_t c_len = sizeof(c_addr);
-
-    //Establecer el socket en modo NO BLOQUEANTE
-    fcntl(worker_connecter_fd, F_SETFL, O_NONBLOCK);
+void* reactorThread() {
+    struct epoll_event events[GOTHAM_MAX_EVENTS];
+    struct epoll_event event;
+    GothamReactor reactor;
+
+    reactor.connections = NULL;
+    reactor.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor.epfd < 0) {
+        perror("Error: Cannot create epoll");
+        return NULL;
+    }
 
-    while (1) {
-        usleep(10000);  // Pequeña espera para no consumir CPU constantemente
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = &fleckListener;
+    epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, fleckListener.fd, &event);
+    event.data.ptr = &workerListener;
+    epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, workerListener.fd, &event);
+
+    // El aviso de cierre no se consume: despierta a todos los reactores
+    event.events = EPOLLIN;
+    event.data.ptr = &shutdownNotifier;
+    epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, shutdownNotifier.fd, &event);
+
+    int running = 1;
+    while (running) {
+        int n = epoll_wait(reactor.epfd, events, GOTHAM_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error: epoll_wait failed");
+            break;
+        }
 
-        newsock = accept(worker_connecter_fd, (struct sockaddr*)&c_addr, &c_len);
-        if (newsock < 0) {
-            if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                if(gotham_flag == 1) {
-                    write(STDOUT_FILENO, "Thread Worker Connecter OUT.\n", strlen("Thread Worker Connecter OUT.\n"));
-                    return NULL;
-                }
-                continue;
+        for (int j = 0; j < n && running; j++) {
+            GothamConnection* conn = (GothamConnection*)events[j].data.ptr;
+            if (conn->kind == GOTHAM_SHUTDOWN) {
+                write(STDOUT_FILENO, "Thread Reactor OUT.\n", strlen("Thread Reactor OUT.\n"));
+                running = 0;
+            } else if (conn->kind == GOTHAM_FLECK_LISTENER || conn->kind == GOTHAM_WORKER_LISTENER) {
+                acceptConnections(&reactor, conn);
             } else {
-                perror("Error: Cannot accept connection");
-                exit(EXIT_FAILURE);
+                handleConnection(&reactor, conn);
             }
         }
+    }
 
-        pthread_t thread_newWorker;
-        pthread_create(&thread_newWorker, NULL, threadWorker, &newsock);
+    // Los Flecks y workers registrados se quitan de las listas en doLogout,
+    // cuando ya no queda ningún reactor que las use
+    while (reactor.connections != NULL) {
+        shutdown(reactor.connections->fd, SHUT_WR);
+        closeConnection(&reactor, reactor.connections);
     }
+    close(reactor.epfd);
+    return NULL;
 }
 
 /**************************************************
  *
- * @Finalidad: Detiene el servidor Gotham y desconectar
- *             todas las sesiones activas de Fleck y de workers.
- *             Para cada conexión:
- *               1. Envía la cadena "OUT" directamente por el socket.
- *               2. Realiza shutdown(SHUT_WR) y close() del descriptor.
- *               3. Espera a la terminación del hilo asociado (pthread_join).
- *               4. Libera los recursos de memoria y elimina el nodo de la lista.
+ * @Finalidad: Detiene el servidor Gotham y olvidar todas las sesiones
+ *             de Fleck y de workers una vez parados los reactores, que ya
+ *             han cerrado sus sockets: libera los nodos de la lista de
+ *             Flecks y vacía el registro de workers.
  * @Parametros: ----
  * @Retorno:    ----.
  *
@@ -518,15 +541,6 @@ void doLogout() {
     while (!LINKEDLIST_isAtEnd(listF)) {
         listElement* currentElement = LINKEDLIST_get(listF);
 
-        // Cerrar el socket de manera ordenada
-        shutdown(currentElement->sockfd, SHUT_WR);
-        close(currentElement->sockfd);
-        write(STDOUT_FILENO, "[DEBUG] doLogout: Shutting down Fleck socket...\n", 48);
-
-        // Detach el hilo asociado
-        pthread_detach(currentElement->thread_id);
-        write(STDOUT_FILENO, "[DEBUG] doLogout: Detaching thread for Fleck socket...\n", 55);
-
         // Liberar memoria asociada al elemento
         free(currentElement->fleck_username);
         free(currentElement);
@@ -534,28 +548,18 @@ void doLogout() {
         write(STDOUT_FILENO, "[DEBUG] doLogout: Removed Fleck connection from list.\n", 54);
     }
 
-    // Procesar la lista de conexiones de Workers
+    // Procesar el registro de Workers
     write(STDOUT_FILENO, "[DEBUG] doLogout: Processing Worker connections...\n", 51);
-    LINKEDLIST_goToHead(listW);
-    while (!LINKEDLIST_isAtEnd(listW)) {
-        listElement* currentElement = LINKEDLIST_get(listW);
-
-        // Cerrar el socket de manera ordenada
-        shutdown(currentElement->sockfd, SHUT_WR);
-        close(currentElement->sockfd);
-        write(STDOUT_FILENO, "[DEBUG] doLogout: Shutting down Worker socket...\n", 49);
-
-        // Detach el hilo asociado
-        pthread_detach(currentElement->thread_id);
-        write(STDOUT_FILENO, "[DEBUG] doLogout: Detaching thread for Worker socket...\n", 56);
-
-        // Liberar memoria asociada al elemento
-        free(currentElement->ip);
-        free(currentElement->port);
-        free(currentElement->worker_type);
-        free(currentElement);
-        LINKEDLIST_remove(listW);
-        write(STDOUT_FILENO, "[DEBUG] doLogout: Removed Worker connection from list.\n", 55);
+    int numTypes = atomic_load(&registry.numTypes);
+    for (int t = 0; t < numTypes; t++) {
+        for (int w = 0; w < REGISTRY_MAX_WORKERS; w++) {
+            RegistryWorker removed;
+            if (!registry.types[t].slots[w].used) {
+                continue;
+            }
+            REGISTRY_remove(&registry, t * REGISTRY_MAX_WORKERS + w, &removed);
+            write(STDOUT_FILENO, "[DEBUG] doLogout: Removed Worker connection from registry.\n", 59);
+        }
     }
 
     write(STDOUT_FILENO, "All connections closed.\n", 24);
@@ -563,25 +567,16 @@ void doLogout() {
 /**************************************************
  *
  * @Finalidad: Manejador de la señal SIGINT (CTRL+C) para el servidor Gotham.
- *             Se invoca al recibir la señal.
+ *             Solo avisa a los reactores por la pipe de cierre: la
+ *             desconexión y la liberación de recursos las hace main
+ *             cuando los reactores han terminado.
  * @Parametros: in: signum = número de la señal capturada (debe ser SIGINT).
  * @Retorno:    ----.
  *
  **************************************************/
 void CTRLC(int signum) {
     print_text("\nInterrupt signal CTRL+C received\n");
-    close(pipe_fds[1]); // Close the write end of the pipe
-    doLogout();
-    close(fleck_connecter_fd);
-    close(worker_connecter_fd);
-    LINKEDLIST_destroy(&listF);
-    LINKEDLIST_destroy(&listW);
-    free_config();
-
-    wait(NULL);
-
-    signal(SIGINT, SIG_DFL);
-    raise(SIGINT);
+    write(pipefd[1], "X", 1);
 }
 
 /**************************************************
@@ -635,11 +630,10 @@ void write_to_log(int pipe_fd) {
  *             - Validar argumentos (ruta al fichero de configuración).
  *             - Leer y parsear la configuración de Gotham (IPs y puertos de Fleck y workers).
  *             - Iniciar el logger Arkham (fork y pipe).
- *             - Crear y lanzar hilos para:
- *                 * Aceptar conexiones de clientes Fleck (funcThreadFleckConnecter).
- *                 * Aceptar conexiones de workers (funcThreadWorkerConnecter).
+ *             - Crear los reactores (epoll), que aceptan y atienden sin
+ *               bloquear las conexiones de clientes Fleck y de workers.
  *             - Mantener el servicio activo hasta recibir SIGINT.
- *             - Al cerrar, invocar doLogout() y esperar a que terminen los hilos.
+ *             - Al cerrar, esperar a los reactores e invocar doLogout().
  * @Parametros: in: argc = número de argumentos (debe ser 2).
  *              in: argv = vector de cadenas:
  *                     argv[0] = nombre del ejecutable,
@@ -654,8 +648,6 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    signal(SIGINT, CTRLC);
-
     config = READCONFIG_read_config_gotham(argv[1]);
     if (pipe(pipe_fds) == -1) {
         perror("Error creating pipe");
@@ -666,6 +658,9 @@ int main(int argc, char *argv[]) {
         perror("[ERROR] No se pudo crear la pipe");
         exit(EXIT_FAILURE);
     }
+    signal(SIGINT, CTRLC);
+    // Un Fleck o worker que se cierra no debe terminar Gotham al escribirle
+    signal(SIGPIPE, SIG_IGN);
 
     // Fork to create Arkham process
     pid_t pid = fork();
@@ -688,35 +683,42 @@ int main(int argc, char *argv[]) {
         asprintf(&msg, "\nGotham server initialized.\nWaiting for connections...\n\n");
         print_text(msg);
         free(msg);
-        listW = LINKEDLIST_create();
+        REGISTRY_init(&registry);
         listF = LINKEDLIST_create();
 
-        pthread_t thread_WorkerConnecter;
-        pthread_t thread_FleckConnecter;
-
-        if (pthread_create(&thread_WorkerConnecter, NULL, funcThreadWorkerConnecter, NULL) != 0) {
-            write(STDOUT_FILENO, "Error: Cannot create thread\n", 29);
-            return 1;
-        }
-
-        if(pthread_create(&thread_FleckConnecter, NULL, funcThreadFleckConnecter, NULL) != 0) {
-            write(STDOUT_FILENO, "Error: Cannot create thread\n", 29);
-            return 1;
+        fleckListener.fd = SOCKET_initSocket(config.fleck_server_port, config.fleck_server_ip);
+        workerListener.fd = SOCKET_initSocket(config.external_server_port, config.external_server_ip);
+        fcntl(fleckListener.fd, F_SETFL, O_NONBLOCK);
+        fcntl(workerListener.fd, F_SETFL, O_NONBLOCK);
+        shutdownNotifier.fd = pipefd[0];
+
+        // Un reactor por núcleo, con un máximo de GOTHAM_MAX_REACTORS
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int numReactors = (cores < 1) ? 1 : (cores > GOTHAM_MAX_REACTORS ? GOTHAM_MAX_REACTORS : (int)cores);
+        pthread_t reactors[GOTHAM_MAX_REACTORS];
+
+        for (int j = 0; j < numReactors; j++) {
+            if (pthread_create(&reactors[j], NULL, reactorThread, NULL) != 0) {
+                write(STDOUT_FILENO, "Error: Cannot create thread\n", 29);
+                return 1;
+            }
         }
 
-        if (pthread_join(thread_WorkerConnecter, NULL) != 0) {
-            write(STDOUT_FILENO, "Error: Cannot join thread\n", 27);
-            return 1; 
+        for (int j = 0; j < numReactors; j++) {
+            if (pthread_join(reactors[j], NULL) != 0) {
+                write(STDOUT_FILENO, "Error: Cannot join thread\n", 27);
+                return 1; 
+            }
         }
 
-        if (pthread_join(thread_FleckConnecter, NULL) != 0) {
-            write(STDOUT_FILENO, "Error: Cannot join thread\n", 27);
-            return 1; 
-        }
-        
+        close(pipe_fds[1]); // Cerrar la pipe de Arkham para que termine
+        doLogout();
+        close(fleckListener.fd);
+        close(workerListener.fd);
         LINKEDLIST_destroy(&listF);
-        LINKEDLIST_destroy(&listW);
+        REGISTRY_destroy(&registry);
         free_config();
+        wait(NULL);
     }
 
     return 0;
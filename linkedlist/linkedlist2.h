@@ -20,6 +20,8 @@
 #define LIST_ERROR_MALLOC 3	
 #define LIST_ERROR_END 4
 
+struct trama_reader;
+
 typedef struct {
     char *fileName;
     char *username;
@@ -30,10 +32,14 @@ typedef struct {
     int bytes_writtenF2;
     int bytes_to_writeF2;
     int fd;
+    struct trama_reader *reader; // Lector de tramas del socket 'fd'
     char* MD5SUM;
     char* distortedMd5;
     char *directory;
     pthread_t thread_id;
+    int protocol; // Versión de protocolo negociada con el otro extremo
+    int fused; // 1 si el fichero ya está distorsionado (al recibirlo o desde la caché)
+    int inPipeline; // 1 mientras el pipeline del worker la procesa (usa 'fd' y 'reader')
     int status; //0: No empezada, 1: Transfiriendo1 , 2: Distorsionando, 3: Transfiriendo2, 4: Completada
 } listElement2;
 
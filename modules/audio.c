@@ -0,0 +1,455 @@
+/***********************************************
+*
+* @Proposito:  Implementa el motor de distorsión de audio: recorre un WAV
+*               por bloques y salta una de cada dos ventanas de interval_ms
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "audio.h"
+
+/**************************************************
+ *
+ * @Finalidad: Leer y escribir enteros de 16 y 32 bits en little endian.
+ * @Parametros: in/out: p     = bytes del entero.
+ *              in:     value = valor a escribir.
+ * @Retorno:    Valor leído.
+ *
+ **************************************************/
+static uint32_t AUDIO_le16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+static uint32_t AUDIO_le32(const uint8_t *p) {
+    return AUDIO_le16(p) | (AUDIO_le16(p + 2) << 16);
+}
+static void AUDIO_putLe32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir con pwrite un tramo completo, reintentando si una
+ *             escritura se queda a medias.
+ * @Parametros: in: fd     = fichero de salida.
+ *              in: data   = bytes a escribir.
+ *              in: size   = número de bytes.
+ *              in: offset = posición del fichero.
+ * @Retorno:    0 en caso de éxito; -1 si no se ha podido escribir.
+ *
+ **************************************************/
+static int AUDIO_pwriteAll(int fd, const uint8_t *data, size_t size, off_t offset) {
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = pwrite(fd, data + done, size - done, offset + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir en el fichero de salida los bytes del buffer.
+ * @Parametros: in/out: filter = filtro de audio.
+ * @Retorno:    0 en caso de éxito; -1 si no se ha podido escribir.
+ *
+ **************************************************/
+static int AUDIO_flush(AudioFilter *filter) {
+    if (AUDIO_pwriteAll(filter->fd, filter->buffer, filter->used, filter->length - (off_t)filter->used) != 0) {
+        return -1;
+    }
+    filter->used = 0;
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir bytes a la salida, escribiendo el buffer en el
+ *             fichero cada vez que se llena.
+ * @Parametros: in/out: filter = filtro de audio.
+ *              in:     data   = bytes a añadir.
+ *              in:     size   = número de bytes.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+static int AUDIO_emit(AudioFilter *filter, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        if (filter->used == AUDIO_CHUNK && AUDIO_flush(filter) != 0) {
+            return ERROR_CREATING_FINAL_FILE;
+        }
+        size_t n = AUDIO_CHUNK - filter->used < size ? AUDIO_CHUNK - filter->used : size;
+        memcpy(filter->buffer + filter->used, data, n);
+        filter->used += n;
+        filter->length += (off_t)n;
+        data += n;
+        size -= n;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Dejar de interpretar el fichero y copiarlo tal cual desde
+ *             aquí. Todo lo escrito hasta ahora es igual que la entrada.
+ * @Parametros: in/out: filter = filtro de audio.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+static int AUDIO_startRaw(AudioFilter *filter) {
+    filter->state = AUDIO_STATE_RAW;
+    size_t pending = filter->headerLength;
+    filter->headerLength = 0;
+    return AUDIO_emit(filter, filter->header, pending);
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular cuántos bytes de un bloque de muestras quedan al
+ *             alternar ventanas guardadas y saltadas, empezando por una
+ *             guardada.
+ * @Parametros: in: size        = bytes de muestras.
+ *              in: windowBytes = bytes de cada ventana.
+ * @Retorno:    Bytes que se guardan.
+ *
+ **************************************************/
+static uint64_t AUDIO_keptBytes(uint64_t size, uint64_t windowBytes) {
+    uint64_t rest = size % (windowBytes * 2);
+    return size / (windowBytes * 2) * windowBytes + (rest < windowBytes ? rest : windowBytes);
+}
+/**************************************************
+ *
+ * @Finalidad: Procesar la cabecera de un bloque del WAV. El bloque data se
+ *             filtra y su tamaño pasa a ser el del resultado; el resto se
+ *             copia tal cual. Del bloque fmt se guarda el inicio para
+ *             conocer la frecuencia y el tamaño de cada trama.
+ * @Parametros: in/out: filter = filtro de audio con la cabecera leída.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+static int AUDIO_startChunk(AudioFilter *filter) {
+    uint64_t size = AUDIO_le32(filter->header + 4);
+
+    if (memcmp(filter->header, "data", 4) == 0 && filter->dataSizeAt < 0) {
+        if (filter->windowBytes == 0) {
+            // Sin un fmt válido no se sabe dónde empieza cada trama
+            return AUDIO_startRaw(filter);
+        }
+        filter->headerLength = 0;
+        filter->dataSizeAt = filter->length + 4;
+        uint64_t kept = AUDIO_keptBytes(size, filter->windowBytes);
+        AUDIO_putLe32(filter->header + 4, (uint32_t)kept);
+        filter->state = AUDIO_STATE_DATA;
+        filter->remaining = size;
+        filter->pad = (int)(size & 1);
+    } else {
+        filter->headerLength = 0;
+        filter->inFormat = memcmp(filter->header, "fmt ", 4) == 0;
+        filter->formatLength = 0;
+        filter->state = AUDIO_STATE_CHUNK;
+        filter->remaining = size + (size & 1);
+    }
+    return AUDIO_emit(filter, filter->header, 8);
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular el tamaño de cada ventana con el inicio del bloque
+ *             fmt: interval_ms de tramas enteras (como mínimo una).
+ * @Parametros: in/out: filter = filtro de audio con el fmt leído.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void AUDIO_readFormat(AudioFilter *filter) {
+    uint64_t sampleRate = AUDIO_le32(filter->format + 4);
+    uint64_t blockAlign = AUDIO_le16(filter->format + 12);
+    uint64_t frames = sampleRate * (uint64_t)filter->interval_ms / 1000;
+
+    filter->windowBytes = (frames > 0 ? frames : 1) * blockAlign;
+}
+/**************************************************
+ *
+ * @Finalidad: Filtrar un tramo de muestras: se guardan los bytes de las
+ *             ventanas pares y se saltan los de las impares.
+ * @Parametros: in/out: filter = filtro de audio.
+ *              in:     data   = muestras.
+ *              in:     size   = número de bytes.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+static int AUDIO_filterSamples(AudioFilter *filter, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        uint64_t left = filter->windowBytes - filter->dataPos % filter->windowBytes;
+        size_t span = left < size ? (size_t)left : size;
+        if ((filter->dataPos / filter->windowBytes) % 2 == 0) {
+            if (AUDIO_emit(filter, data, span) != NO_ERROR) {
+                return ERROR_CREATING_FINAL_FILE;
+            }
+            filter->dataKept += span;
+        }
+        filter->dataPos += span;
+        data += span;
+        size -= span;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Cerrar el bloque de muestras del resultado con su byte de
+ *             relleno si ha quedado con un tamaño impar.
+ * @Parametros: in/out: filter = filtro de audio.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+static int AUDIO_endData(AudioFilter *filter) {
+    static const uint8_t zero = 0;
+
+    if (filter->dataKept % 2 == 1) {
+        return AUDIO_emit(filter, &zero, 1);
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Preparar el filtro de audio para escribir su resultado,
+ *             desde el principio, en un fichero ya abierto.
+ * @Parametros: out: filter      = filtro a preparar.
+ *              in:  fd          = fichero de salida (abierto para escritura).
+ *              in:  interval_ms = duración de cada ventana; con un valor
+ *                                 < 1 el fichero se copia tal cual.
+ * @Retorno:    0 en caso de éxito; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+int AUDIO_initFilter(AudioFilter *filter, int fd, int interval_ms) {
+    memset(filter, 0, sizeof(AudioFilter));
+    filter->fd = fd;
+    filter->interval_ms = interval_ms;
+    filter->state = interval_ms > 0 ? AUDIO_STATE_RIFF : AUDIO_STATE_RAW;
+    filter->dataSizeAt = -1;
+    filter->buffer = (uint8_t *)malloc(AUDIO_CHUNK);
+    return filter->buffer ? NO_ERROR : ERROR_MEM_ALLOC;
+}
+/**************************************************
+ *
+ * @Finalidad: Pasar un bloque del fichero WAV por el filtro de audio. Las
+ *             cabeceras y las tramas pueden quedar partidas entre bloques.
+ *             La memoria usada no depende de la longitud del fichero.
+ * @Parametros: in/out: filter = filtro de audio.
+ *              in:     data   = bloque del fichero.
+ *              in:     size   = número de bytes del bloque.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_FINAL_FILE si no se ha
+ *              podido escribir.
+ *
+ **************************************************/
+int AUDIO_filter(AudioFilter *filter, const uint8_t *data, size_t size) {
+    int error = NO_ERROR;
+
+    while (size > 0 && error == NO_ERROR) {
+        size_t n = size;
+        switch (filter->state) {
+            case AUDIO_STATE_RIFF:
+            case AUDIO_STATE_HEADER: {
+                size_t total = filter->state == AUDIO_STATE_RIFF ? 12 : 8;
+                n = total - filter->headerLength < size ? total - filter->headerLength : size;
+                memcpy(filter->header + filter->headerLength, data, n);
+                filter->headerLength += n;
+                if (filter->headerLength < total) {
+                    break;
+                }
+                if (filter->state == AUDIO_STATE_HEADER) {
+                    error = AUDIO_startChunk(filter);
+                } else if (memcmp(filter->header, "RIFF", 4) == 0 && memcmp(filter->header + 8, "WAVE", 4) == 0) {
+                    filter->headerLength = 0;
+                    filter->state = AUDIO_STATE_HEADER;
+                    error = AUDIO_emit(filter, filter->header, 12);
+                } else {
+                    error = AUDIO_startRaw(filter);
+                }
+                break;
+            }
+            case AUDIO_STATE_CHUNK:
+                n = filter->remaining < size ? (size_t)filter->remaining : size;
+                if (filter->inFormat && filter->formatLength < sizeof(filter->format)) {
+                    size_t copy = sizeof(filter->format) - filter->formatLength < n ? sizeof(filter->format) - filter->formatLength : n;
+                    memcpy(filter->format + filter->formatLength, data, copy);
+                    filter->formatLength += copy;
+                    if (filter->formatLength == sizeof(filter->format)) {
+                        AUDIO_readFormat(filter);
+                    }
+                }
+                error = AUDIO_emit(filter, data, n);
+                filter->remaining -= n;
+                if (filter->remaining == 0) {
+                    filter->state = AUDIO_STATE_HEADER;
+                }
+                break;
+            case AUDIO_STATE_DATA:
+                n = filter->remaining < size ? (size_t)filter->remaining : size;
+                error = AUDIO_filterSamples(filter, data, n);
+                filter->remaining -= n;
+                if (error == NO_ERROR && filter->remaining == 0) {
+                    error = AUDIO_endData(filter);
+                    filter->remaining = (uint64_t)filter->pad;
+                    filter->state = filter->pad ? AUDIO_STATE_PAD : AUDIO_STATE_HEADER;
+                }
+                break;
+            case AUDIO_STATE_PAD:
+                // El relleno de la entrada ya lo ha sustituido el de la salida
+                n = filter->remaining < size ? (size_t)filter->remaining : size;
+                filter->remaining -= n;
+                if (filter->remaining == 0) {
+                    filter->state = AUDIO_STATE_HEADER;
+                }
+                break;
+            case AUDIO_STATE_RAW:
+                error = AUDIO_emit(filter, data, n);
+                break;
+        }
+        data += n;
+        size -= n;
+    }
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Terminar el filtro de audio: escribir lo pendiente, poner en
+ *             la cabecera los tamaños reales del resultado (la entrada
+ *             puede acabar antes de lo que anunciaba) y dejar el fichero
+ *             de salida con su longitud.
+ * @Parametros: in/out: filter = filtro de audio.
+ * @Retorno:    0 en caso de éxito; ERROR_NOT_WAV si no era un WAV que se
+ *              sepa tratar (la salida es una copia de la entrada);
+ *              ERROR_CREATING_FINAL_FILE si no se ha podido escribir.
+ *
+ **************************************************/
+int AUDIO_finishFilter(AudioFilter *filter) {
+    int error = NO_ERROR;
+
+    if (filter->state == AUDIO_STATE_DATA) {
+        error = AUDIO_endData(filter);
+    } else if (filter->state == AUDIO_STATE_RIFF) {
+        error = AUDIO_startRaw(filter);
+    } else if (filter->state == AUDIO_STATE_HEADER && filter->headerLength > 0) {
+        // Restos tras el último bloque: se conservan
+        size_t pending = filter->headerLength;
+        filter->headerLength = 0;
+        error = AUDIO_emit(filter, filter->header, pending);
+    }
+    if (error != NO_ERROR || AUDIO_flush(filter) != 0) {
+        return ERROR_CREATING_FINAL_FILE;
+    }
+
+    if (filter->state != AUDIO_STATE_RAW && filter->dataSizeAt >= 0) {
+        uint8_t size[4];
+        AUDIO_putLe32(size, (uint32_t)filter->dataKept);
+        if (AUDIO_pwriteAll(filter->fd, size, 4, filter->dataSizeAt) != 0) {
+            return ERROR_CREATING_FINAL_FILE;
+        }
+        AUDIO_putLe32(size, (uint32_t)(filter->length - 8));
+        if (AUDIO_pwriteAll(filter->fd, size, 4, 4) != 0) {
+            return ERROR_CREATING_FINAL_FILE;
+        }
+    }
+    if (ftruncate(filter->fd, filter->length) != 0) {
+        return ERROR_CREATING_FINAL_FILE;
+    }
+    return filter->state == AUDIO_STATE_RAW ? ERROR_NOT_WAV : NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar la memoria del filtro de audio. El fichero de salida
+ *             lo cierra quien lo abrió.
+ * @Parametros: in/out: filter = filtro de audio.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void AUDIO_freeFilter(AudioFilter *filter) {
+    free(filter->buffer);
+    filter->buffer = NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Distorsionar un fichero WAV saltando una de cada dos
+ *             ventanas de interval_ms, con la misma semántica que
+ *             SO_compressAudio. Se lee por bloques de AUDIO_CHUNK bytes,
+ *             se escribe en un temporal y se renombra sobre el original.
+ * @Parametros: in: input_file  = ruta del fichero WAV.
+ *              in: interval_ms = duración de cada ventana.
+ * @Retorno:    0 en caso de éxito; ERROR_NOT_WAV si no es un WAV que se
+ *              sepa tratar (se puede recurrir a SO_compressAudio); <0 si
+ *              ocurrió algún otro error.
+ *
+ **************************************************/
+int AUDIO_compressAudio(char *input_file, int interval_ms) {
+    int in = open(input_file, O_RDONLY);
+    if (in < 0) {
+        return ERROR_NOT_WAV;
+    }
+    struct stat info;
+    if (fstat(in, &info) != 0) {
+        close(in);
+        return ERROR_NOT_WAV;
+    }
+
+    char *tmp_path = NULL;
+    if (asprintf(&tmp_path, "%s.XXXXXX", input_file) == -1) {
+        close(in);
+        return ERROR_MEM_ALLOC;
+    }
+    int out = mkstemp(tmp_path);
+    if (out < 0) {
+        free(tmp_path);
+        close(in);
+        return ERROR_CREATING_TMP_FILE;
+    }
+
+    AudioFilter filter;
+    uint8_t *chunk = (uint8_t *)malloc(AUDIO_CHUNK);
+    int error = AUDIO_initFilter(&filter, out, interval_ms);
+    if (chunk == NULL) {
+        error = ERROR_MEM_ALLOC;
+    }
+    while (error == NO_ERROR) {
+        ssize_t n = read(in, chunk, AUDIO_CHUNK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            error = ERROR_NOT_WAV;
+        } else if (n == 0) {
+            break;
+        } else {
+            error = AUDIO_filter(&filter, chunk, (size_t)n);
+        }
+    }
+    if (error == NO_ERROR) {
+        error = AUDIO_finishFilter(&filter);
+    }
+    AUDIO_freeFilter(&filter);
+    free(chunk);
+    close(in);
+
+    if (error == NO_ERROR && fchmod(out, info.st_mode & 0777) != 0) {
+        error = ERROR_CREATING_TMP_FILE;
+    }
+    if (close(out) != 0 && error == NO_ERROR) {
+        error = ERROR_CREATING_TMP_FILE;
+    }
+    if (error == NO_ERROR && rename(tmp_path, input_file) != 0) {
+        error = ERROR_CREATING_FINAL_FILE;
+    }
+    if (error != NO_ERROR) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return error;
+}
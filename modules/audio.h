@@ -0,0 +1,65 @@
+/***********************************************
+*
+* @Proposito:  Declara el motor de distorsión de audio: recorre un WAV por
+*               bloques y salta una de cada dos ventanas de interval_ms
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "so_compression.h"
+
+// Los errores son los de SO_compressAudio (so_compression.h). Con
+// ERROR_NOT_WAV el fichero se deja igual y se puede recurrir a él
+#define AUDIO_CHUNK (256 * 1024)        // Bytes que se leen y se escriben de cada vez
+
+typedef enum {
+    AUDIO_STATE_RIFF,                   // Cabecera RIFF/WAVE (12 bytes)
+    AUDIO_STATE_HEADER,                 // Cabecera de un bloque (8 bytes)
+    AUDIO_STATE_CHUNK,                  // Bloque que se copia tal cual (fmt, LIST...)
+    AUDIO_STATE_DATA,                   // Muestras: se alternan ventanas que se guardan y que se saltan
+    AUDIO_STATE_PAD,                    // Byte de relleno tras un bloque data impar
+    AUDIO_STATE_RAW                     // No es un WAV que se sepa tratar: se copia todo
+} AudioState;
+
+// Filtro de audio por bloques: la cabecera y las muestras pueden llegar
+// partidas en bloques de cualquier tamaño
+typedef struct {
+    int fd;                             // Fichero de salida
+    AudioState state;
+    int interval_ms;
+    uint8_t header[12];                 // Cabecera que se está leyendo
+    size_t headerLength;
+    uint8_t format[16];                 // Inicio del bloque fmt
+    size_t formatLength;
+    int inFormat;                       // 1 si el bloque que se copia es fmt
+    uint64_t remaining;                 // Bytes del bloque actual por procesar
+    int pad;                            // 1 si el bloque data de la entrada lleva byte de relleno
+    uint64_t windowBytes;               // Bytes de cada ventana (tramas enteras)
+    uint64_t dataPos;                   // Bytes de muestras ya procesados
+    uint64_t dataKept;                  // Bytes de muestras guardados
+    off_t dataSizeAt;                   // Posición de la salida del tamaño del bloque data (-1 sin él)
+    uint8_t *buffer;                    // Bytes de la salida aún no escritos
+    size_t used;
+    off_t length;                       // Longitud de la salida
+} AudioFilter;
+
+int AUDIO_initFilter(AudioFilter *filter, int fd, int interval_ms);
+int AUDIO_filter(AudioFilter *filter, const uint8_t *data, size_t size);
+int AUDIO_finishFilter(AudioFilter *filter);
+void AUDIO_freeFilter(AudioFilter *filter);
+int AUDIO_compressAudio(char *input_file, int interval_ms);
+
+#endif // AUDIO_H
@@ -0,0 +1,380 @@
+/***********************************************
+*
+* @Proposito:  Implementa la caché en disco de resultados de distorsión del
+*               worker, indexada por MD5 de origen, tipo y factor
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "cache.h"
+
+/**************************************************
+ *
+ * @Finalidad: Construir la ruta del fichero de una entrada.
+ * @Parametros: in: cache = caché.
+ *              in: key   = clave de la entrada.
+ * @Retorno:    Ruta (memoria dinámica); NULL si no hay memoria.
+ *
+ **************************************************/
+static char *CACHE_entryPath(ResultCache *cache, const char *key) {
+    char *path = NULL;
+    if (asprintf(&path, "%s/%s", cache->directory, key) == -1) {
+        return NULL;
+    }
+    return path;
+}
+/**************************************************
+ *
+ * @Finalidad: Buscar una entrada por su clave. Se llama con el mutex tomado.
+ * @Parametros: in: cache = caché.
+ *              in: key   = clave.
+ * @Retorno:    La entrada; NULL si no está.
+ *
+ **************************************************/
+static CacheEntry *CACHE_find(ResultCache *cache, const char *key) {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        if (cache->entries[i].used && strcmp(cache->entries[i].key, key) == 0) {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Quitar una entrada y borrar su fichero. Los envíos en curso
+ *             desde un enlace a ese fichero no se ven afectados. Se llama
+ *             con el mutex tomado.
+ * @Parametros: in/out: cache = caché.
+ *              in/out: entry = entrada a quitar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void CACHE_drop(ResultCache *cache, CacheEntry *entry) {
+    char *path = CACHE_entryPath(cache, entry->key);
+    if (path != NULL) {
+        unlink(path);
+        free(path);
+    }
+    cache->totalBytes -= entry->size;
+    cache->count--;
+    entry->used = 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Expulsar las entradas usadas hace más tiempo hasta que
+ *             quepa una de 'size' bytes. Se llama con el mutex tomado.
+ * @Parametros: in/out: cache = caché.
+ *              in:     size  = bytes que se quieren añadir.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void CACHE_evict(ResultCache *cache, long long size) {
+    while (cache->count > 0 && (cache->count >= CACHE_MAX_ENTRIES || cache->totalBytes + size > CACHE_MAX_BYTES)) {
+        CacheEntry *oldest = NULL;
+        for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+            if (cache->entries[i].used && (oldest == NULL || cache->entries[i].lastUse < oldest->lastUse)) {
+                oldest = &cache->entries[i];
+            }
+        }
+        CACHE_drop(cache, oldest);
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir una entrada al índice, expulsando otras si hace
+ *             falta. Se llama con el mutex tomado.
+ * @Parametros: in/out: cache   = caché.
+ *              in:     key     = clave.
+ *              in:     size    = tamaño del resultado.
+ *              in:     lastUse = momento del último uso.
+ * @Retorno:    La entrada añadida.
+ *
+ **************************************************/
+static CacheEntry *CACHE_insert(ResultCache *cache, const char *key, long long size, unsigned long long lastUse) {
+    CACHE_evict(cache, size);
+
+    CacheEntry *entry = NULL;
+    for (int i = 0; i < CACHE_MAX_ENTRIES && entry == NULL; i++) {
+        if (!cache->entries[i].used) {
+            entry = &cache->entries[i];
+        }
+    }
+    entry->used = 1;
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    entry->size = size;
+    entry->lastUse = lastUse;
+    cache->count++;
+    cache->totalBytes += size;
+    return entry;
+}
+/**************************************************
+ *
+ * @Finalidad: Abrir la caché de una carpeta de worker: crea la subcarpeta
+ *             CACHE_DIR si no existe y carga las entradas que ya tenía,
+ *             ordenadas por su fecha de modificación (que se actualiza en
+ *             cada uso).
+ * @Parametros: out: cache     = caché a inicializar.
+ *              in:  directory = carpeta del worker.
+ * @Retorno:    CACHE_OK en caso de éxito; CACHE_ERROR_FILE si no se puede
+ *              usar la carpeta (la caché queda vacía y desactivada).
+ *
+ **************************************************/
+int CACHE_init(ResultCache *cache, const char *directory) {
+    memset(cache, 0, sizeof(ResultCache));
+    pthread_mutex_init(&cache->mutex, NULL);
+    if (asprintf(&cache->directory, "%s/%s", directory, CACHE_DIR) == -1) {
+        cache->directory = NULL;
+        return CACHE_ERROR_FILE;
+    }
+    if (mkdir(cache->directory, 0777) != 0 && errno != EEXIST) {
+        free(cache->directory);
+        cache->directory = NULL;
+        return CACHE_ERROR_FILE;
+    }
+
+    DIR *dir = opendir(cache->directory);
+    if (dir == NULL) {
+        free(cache->directory);
+        cache->directory = NULL;
+        return CACHE_ERROR_FILE;
+    }
+    struct dirent *item;
+    while ((item = readdir(dir)) != NULL) {
+        struct stat info;
+        if (strncmp(item->d_name, CACHE_INCOMING, strlen(CACHE_INCOMING)) == 0) {
+            // Copia a medias de una recepción que no acabó
+            unlinkat(dirfd(dir), item->d_name, 0);
+            continue;
+        }
+        if (item->d_name[0] == '.' || strlen(item->d_name) >= CACHE_KEY_SIZE ||
+            fstatat(dirfd(dir), item->d_name, &info, 0) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        unsigned long long mtime = (unsigned long long)info.st_mtime;
+        CACHE_insert(cache, item->d_name, (long long)info.st_size, mtime);
+        if (mtime > cache->clock) {
+            cache->clock = mtime;
+        }
+    }
+    closedir(dir);
+    return CACHE_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar los recursos de la caché. Los ficheros se conservan.
+ * @Parametros: in/out: cache = caché.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void CACHE_destroy(ResultCache *cache) {
+    free(cache->directory);
+    cache->directory = NULL;
+    pthread_mutex_destroy(&cache->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Construir la clave de un resultado: MD5 del fichero de
+ *             origen, tipo de worker, factor y extensión del fichero (de
+ *             ella depende cómo se distorsiona un fichero Media).
+ * @Parametros: out: key      = clave.
+ *              in:  md5      = MD5 del fichero de origen.
+ *              in:  type     = tipo de worker.
+ *              in:  factor   = factor de distorsión.
+ *              in:  fileName = nombre del fichero.
+ * @Retorno:    CACHE_OK en caso de éxito; CACHE_ERROR_INVALID si el
+ *              resultado no se puede guardar (MD5 o tipo no válidos).
+ *
+ **************************************************/
+int CACHE_makeKey(char key[CACHE_KEY_SIZE], const char *md5, const char *type, const char *factor, const char *fileName) {
+    if (strlen(md5) != 32 || strspn(md5, "0123456789abcdef") != 32) {
+        return CACHE_ERROR_INVALID;
+    }
+    for (const char *c = type; *c != '\0'; c++) {
+        if (!isalnum((unsigned char)*c)) {
+            return CACHE_ERROR_INVALID;
+        }
+    }
+
+    // Solo letras y números de la extensión, en minúsculas
+    char extension[9] = "";
+    const char *dot = strrchr(fileName, '.');
+    for (size_t i = 0, j = 0; dot != NULL && dot[i + 1] != '\0' && j < sizeof(extension) - 1; i++) {
+        if (isalnum((unsigned char)dot[i + 1])) {
+            extension[j++] = (char)tolower((unsigned char)dot[i + 1]);
+            extension[j] = '\0';
+        }
+    }
+    int written = snprintf(key, CACHE_KEY_SIZE, "%s_%s_%d_%s", md5, type, atoi(factor), extension);
+    return written > 0 && written < CACHE_KEY_SIZE ? CACHE_OK : CACHE_ERROR_INVALID;
+}
+/**************************************************
+ *
+ * @Finalidad: Construir la clave de un fichero de origen, que solo depende
+ *             de su contenido.
+ * @Parametros: out: key = clave.
+ *              in:  md5 = MD5 del fichero.
+ * @Retorno:    CACHE_OK en caso de éxito; CACHE_ERROR_INVALID si el MD5 no
+ *              es válido.
+ *
+ **************************************************/
+int CACHE_makeSourceKey(char key[CACHE_KEY_SIZE], const char *md5) {
+    if (strlen(md5) != 32 || strspn(md5, "0123456789abcdef") != 32) {
+        return CACHE_ERROR_INVALID;
+    }
+    snprintf(key, CACHE_KEY_SIZE, "%s_source", md5);
+    return CACHE_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Buscar un resultado y, si está, enlazarlo en 'path' para
+ *             enviarlo desde allí. Marca la entrada como usada.
+ * @Parametros: in/out: cache = caché.
+ *              in:     key   = clave del resultado.
+ *              in:     path  = ruta donde dejar el resultado (se sustituye).
+ * @Retorno:    CACHE_OK si estaba; CACHE_ERROR_MISS si no.
+ *
+ **************************************************/
+int CACHE_lookup(ResultCache *cache, const char *key, const char *path) {
+    if (cache->directory == NULL) {
+        return CACHE_ERROR_MISS;
+    }
+
+    int error = CACHE_ERROR_MISS;
+    pthread_mutex_lock(&cache->mutex);
+    CacheEntry *entry = CACHE_find(cache, key);
+    char *entryPath = entry != NULL ? CACHE_entryPath(cache, key) : NULL;
+    if (entryPath != NULL) {
+        unlink(path);
+        if (link(entryPath, path) == 0) {
+            entry->lastUse = ++cache->clock;
+            utimensat(AT_FDCWD, entryPath, NULL, 0);
+            error = CACHE_OK;
+        } else {
+            // El fichero ya no está: se olvida la entrada
+            CACHE_drop(cache, entry);
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    free(entryPath);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Buscar un fichero y, si está, copiarlo en 'path'. A
+ *             diferencia de CACHE_lookup, la copia se puede modificar (se
+ *             usa para los ficheros de origen, que se distorsionan en su
+ *             sitio). Marca la entrada como usada.
+ * @Parametros: in/out: cache = caché.
+ *              in:     key   = clave del fichero.
+ *              in:     path  = ruta donde dejar la copia (se sustituye).
+ * @Retorno:    CACHE_OK si estaba; CACHE_ERROR_MISS si no;
+ *              CACHE_ERROR_FILE si no se ha podido copiar.
+ *
+ **************************************************/
+int CACHE_fetch(ResultCache *cache, const char *key, const char *path) {
+    if (cache->directory == NULL) {
+        return CACHE_ERROR_MISS;
+    }
+
+    // El descriptor mantiene el fichero aunque se expulse durante la copia
+    int in = -1;
+    pthread_mutex_lock(&cache->mutex);
+    CacheEntry *entry = CACHE_find(cache, key);
+    char *entryPath = entry != NULL ? CACHE_entryPath(cache, key) : NULL;
+    if (entryPath != NULL) {
+        in = open(entryPath, O_RDONLY);
+        if (in >= 0) {
+            entry->lastUse = ++cache->clock;
+            futimens(in, NULL);
+        } else {
+            CACHE_drop(cache, entry);
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    free(entryPath);
+    if (in < 0) {
+        return CACHE_ERROR_MISS;
+    }
+
+    unlink(path);
+    int out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    struct stat info;
+    int error = out < 0 || fstat(in, &info) != 0 ? CACHE_ERROR_FILE : CACHE_OK;
+    off_t offset = 0;
+    while (error == CACHE_OK && offset < info.st_size) {
+        if (sendfile(out, in, &offset, info.st_size - offset) <= 0) {
+            error = CACHE_ERROR_FILE;
+        }
+    }
+    close(in);
+    if (out >= 0) {
+        close(out);
+    }
+    if (error != CACHE_OK) {
+        unlink(path);
+    }
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Crear en la carpeta de la caché un fichero temporal donde
+ *             copiar un fichero de origen mientras se recibe. Si la caché
+ *             se cierra con él a medias, se borra en CACHE_init.
+ * @Parametros: in/out: cache = caché.
+ *              out:    path  = ruta del fichero (memoria dinámica).
+ * @Retorno:    Descriptor abierto para escribir; -1 en caso de error.
+ *
+ **************************************************/
+int CACHE_createIncoming(ResultCache *cache, char **path) {
+    *path = NULL;
+    if (cache->directory == NULL || asprintf(path, "%s/%sXXXXXX", cache->directory, CACHE_INCOMING) == -1) {
+        *path = NULL;
+        return -1;
+    }
+    int fd = mkstemp(*path);
+    if (fd < 0) {
+        free(*path);
+        *path = NULL;
+    }
+    return fd;
+}
+/**************************************************
+ *
+ * @Finalidad: Guardar un fichero (un resultado o un origen) enlazándolo,
+ *             sin copiarlo. Se expulsan las entradas usadas hace más
+ *             tiempo si no cabe. Un fichero mayor que toda la caché no se
+ *             guarda.
+ * @Parametros: in/out: cache = caché.
+ *              in:     key   = clave del fichero.
+ *              in:     path  = fichero a guardar.
+ * @Retorno:    CACHE_OK si se ha guardado; CACHE_ERROR_FILE si no.
+ *
+ **************************************************/
+int CACHE_store(ResultCache *cache, const char *key, const char *path) {
+    struct stat info;
+    if (cache->directory == NULL || stat(path, &info) != 0 || info.st_size > CACHE_MAX_BYTES) {
+        return CACHE_ERROR_FILE;
+    }
+    char *entryPath = CACHE_entryPath(cache, key);
+    if (entryPath == NULL) {
+        return CACHE_ERROR_FILE;
+    }
+
+    int error = CACHE_OK;
+    pthread_mutex_lock(&cache->mutex);
+    CacheEntry *entry = CACHE_find(cache, key);
+    if (entry != NULL) {
+        CACHE_drop(cache, entry);
+    }
+    unlink(entryPath);
+    if (link(path, entryPath) == 0) {
+        CACHE_insert(cache, key, (long long)info.st_size, ++cache->clock);
+    } else {
+        error = CACHE_ERROR_FILE;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    free(entryPath);
+    return error;
+}
@@ -0,0 +1,64 @@
+/***********************************************
+*
+* @Proposito:  Declara la caché en disco de resultados de distorsión del
+*               worker, indexada por MD5 de origen, tipo y factor
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#define CACHE_DIR ".cache"              // Subcarpeta de la carpeta del worker
+#define CACHE_MAX_ENTRIES 256
+#define CACHE_MAX_BYTES (512LL * 1024 * 1024)
+#define CACHE_KEY_SIZE 96
+#define CACHE_INCOMING ".incoming_"     // Prefijo de las copias de origen que aún se reciben
+
+#define CACHE_OK 0
+#define CACHE_ERROR_MISS -1
+#define CACHE_ERROR_INVALID -2
+#define CACHE_ERROR_FILE -3
+
+// Resultado guardado: el fichero se llama como la clave
+typedef struct {
+    int used;
+    char key[CACHE_KEY_SIZE];
+    long long size;
+    unsigned long long lastUse;         // Para expulsar el menos usado recientemente
+} CacheEntry;
+
+// Caché LRU de resultados (y de ficheros de origen) limitada en entradas y
+// en bytes. Los ficheros se enlazan (link) en lugar de copiarse
+typedef struct {
+    pthread_mutex_t mutex;
+    char *directory;                    // <carpeta del worker>/.cache
+    int count;
+    long long totalBytes;
+    unsigned long long clock;
+    CacheEntry entries[CACHE_MAX_ENTRIES];
+} ResultCache;
+
+int CACHE_init(ResultCache *cache, const char *directory);
+void CACHE_destroy(ResultCache *cache);
+int CACHE_makeKey(char key[CACHE_KEY_SIZE], const char *md5, const char *type, const char *factor, const char *fileName);
+int CACHE_makeSourceKey(char key[CACHE_KEY_SIZE], const char *md5);
+int CACHE_lookup(ResultCache *cache, const char *key, const char *path);
+int CACHE_fetch(ResultCache *cache, const char *key, const char *path);
+int CACHE_store(ResultCache *cache, const char *key, const char *path);
+int CACHE_createIncoming(ResultCache *cache, char **path);
+
+#endif // CACHE_H
@@ -11,46 +11,548 @@
 #include "distorsion.h"
 /**************************************************
  *
- * @Finalidad: Calcular el hash MD5 de un fichero
- *             ejecutando la herramienta del sistema (md5sum)
- *             y devolver su valor como cadena hexadecimal.
+ * @Finalidad: Calcular el hash MD5 de un fichero con el módulo
+ *             MD5 (sin crear procesos) y devolver su valor como
+ *             cadena hexadecimal.
  * @Parametros: in: path = ruta completa al fichero
  *                         del cual se quiere obtener el MD5.
  * @Retorno:    Puntero a una cadena dinámica (char*) con los
- *             32 caracteres hexadecimales del MD5 sum. 
+ *             32 caracteres hexadecimales del MD5 sum; NULL si
+ *             el fichero no se pudo leer.
  *
  **************************************************/
 char* DISTORSION_getMD5SUM(const char* path) {
-    int fds[2];
-    pipe(fds);
-    pid_t childPid = fork();
-
-    if (childPid == 0) {
-        close(fds[0]);
-        dup2(fds[1], STDOUT_FILENO);
-        close(fds[1]);
-
-        char *cmd = NULL;
-        asprintf(&cmd, "md5sum %s", path);
-        
-        execlp("/bin/sh", "sh", "-c", cmd, NULL);
-        exit(EXIT_FAILURE);
+    char actualMd5[MD5_HEX_SIZE];
+
+    if (MD5_hashFile(path, actualMd5) != MD5_OK) {
+        return NULL;
+    }
+    return strdup(actualMd5);
+}
+/**************************************************
+ *
+ * @Finalidad: Clasificar un bloque de hasta 64 bytes: marcar qué bytes son
+ *             letras (isalpha en la locale C, solo A-Z y a-z).
+ * @Parametros: in: data = bloque de bytes.
+ *              in: size = número de bytes del bloque (<= 64).
+ * @Retorno:    Máscara con el bit i activo si data[i] es una letra.
+ *
+ **************************************************/
+static uint64_t DISTORSION_alphaMaskScalar(const char *data, size_t size) {
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        // Con el bit 0x20 las mayúsculas pasan a minúsculas
+        unsigned char lower = (unsigned char)data[i] | 0x20;
+        mask |= (uint64_t)((unsigned char)(lower - 'a') < 26) << i;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DISTORSION_HAVE_X86 1
+
+/**************************************************
+ *
+ * @Finalidad: Clasificar un bloque de hasta 64 bytes de 16 en 16 con SSE2.
+ *             La comparación sin signo (c | 0x20) - 'a' < 26 se hace con
+ *             signo desplazando ambos lados 0x80.
+ * @Parametros: in: data = bloque de bytes.
+ *              in: size = número de bytes del bloque (<= 64).
+ * @Retorno:    Máscara con el bit i activo si data[i] es una letra.
+ *
+ **************************************************/
+__attribute__((target("sse2")))
+static uint64_t DISTORSION_alphaMaskSse2(const char *data, size_t size) {
+    if (size < 64) {
+        return DISTORSION_alphaMaskScalar(data, size);
+    }
+
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i bias = _mm_set1_epi8((char)(0x80 - 'a'));
+    const __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+    uint64_t mask = 0;
+
+    for (int i = 0; i < 4; i++) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + i * 16));
+        __m128i shifted = _mm_add_epi8(_mm_or_si128(block, caseBit), bias);
+        uint64_t bits = (uint16_t)_mm_movemask_epi8(_mm_cmplt_epi8(shifted, limit));
+        mask |= bits << (i * 16);
+    }
+    return mask;
+}
+/**************************************************
+ *
+ * @Finalidad: Clasificar un bloque de hasta 64 bytes de 32 en 32 con AVX2.
+ * @Parametros: in: data = bloque de bytes.
+ *              in: size = número de bytes del bloque (<= 64).
+ * @Retorno:    Máscara con el bit i activo si data[i] es una letra.
+ *
+ **************************************************/
+__attribute__((target("avx2")))
+static uint64_t DISTORSION_alphaMaskAvx2(const char *data, size_t size) {
+    if (size < 64) {
+        return DISTORSION_alphaMaskScalar(data, size);
+    }
+
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i bias = _mm256_set1_epi8((char)(0x80 - 'a'));
+    const __m256i limit = _mm256_set1_epi8((char)(0x80 + 26));
+
+    __m256i low = _mm256_loadu_si256((const __m256i *)data);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(data + 32));
+    low = _mm256_add_epi8(_mm256_or_si256(low, caseBit), bias);
+    high = _mm256_add_epi8(_mm256_or_si256(high, caseBit), bias);
+    // AVX2 solo compara "mayor que": limit > x equivale a x < limit
+    uint64_t lowBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, low));
+    uint64_t highBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, high));
+    _mm256_zeroupper();
+    return lowBits | (highBits << 32);
+}
+#endif
+
+// Clasificador elegido según la CPU en la primera llamada
+static uint64_t (*DISTORSION_alphaKernel)(const char *, size_t) = DISTORSION_alphaMaskScalar;
+
+#ifdef DISTORSION_HAVE_X86
+static pthread_once_t DISTORSION_alphaOnce = PTHREAD_ONCE_INIT;
+
+/**************************************************
+ *
+ * @Finalidad: Escoger la implementación más rápida del clasificador de
+ *             letras que soporte la CPU en la que se ejecuta el programa.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void DISTORSION_selectAlphaKernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        DISTORSION_alphaKernel = DISTORSION_alphaMaskAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        DISTORSION_alphaKernel = DISTORSION_alphaMaskSse2;
+    }
+}
+#endif
+/**************************************************
+ *
+ * @Finalidad: Escribir en el fichero de salida los bytes del buffer del
+ *             filtro de texto que aún no se han escrito. Los que quedan
+ *             más allá de 'end' no forman parte del resultado y no se
+ *             escriben.
+ * @Parametros: in/out: out = salida del filtro.
+ * @Retorno:    0 en caso de éxito; -1 si no se ha podido escribir.
+ *
+ **************************************************/
+static int DISTORSION_flushText(TextOutput *out) {
+    off_t last = out->end >= 0 && out->end < out->length ? out->end : out->length;
+    size_t pending = last > out->flushed ? (size_t)(last - out->flushed) : 0;
+    size_t done = 0;
+
+    while (out->fd >= 0 && done < pending) {
+        ssize_t n = pwrite(out->fd, out->buffer + done, pending - done, out->base + out->flushed + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    out->flushed = out->length;
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un tramo de bytes a la salida del filtro de texto,
+ *             escribiendo el buffer en el fichero cada vez que se llena.
+ *             Sin fichero de salida solo se cuenta la longitud.
+ * @Parametros: in/out: out  = salida del filtro.
+ *              in:     data = bytes a añadir.
+ *              in:     size = número de bytes.
+ * @Retorno:    0 en caso de éxito; -1 si no se ha podido escribir.
+ *
+ **************************************************/
+static int DISTORSION_appendText(TextOutput *out, const char *data, size_t size) {
+    if (out->fd < 0) {
+        out->length += (off_t)size;
+        return 0;
+    }
+    while (size > 0) {
+        size_t used = (size_t)(out->length - out->flushed);
+        if (used == DISTORSION_TEXT_CHUNK) {
+            if (DISTORSION_flushText(out) != 0) {
+                return -1;
+            }
+            used = 0;
+        }
+        size_t n = DISTORSION_TEXT_CHUNK - used < size ? DISTORSION_TEXT_CHUNK - used : size;
+        memcpy(out->buffer + used, data, n);
+        out->length += (off_t)n;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Retroceder la salida del filtro de texto hasta una posición
+ *             para descartar lo escrito a partir de ella.
+ * @Parametros: in/out: out      = salida del filtro.
+ *              in:     position = nueva longitud de la salida.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void DISTORSION_retractText(TextOutput *out, off_t position) {
+    if (position >= out->flushed) {
+        out->length = position;
     } else {
-        close(fds[1]);
-        wait(NULL); 
+        // Ya estaba escrita en parte: se sobrescribirá o se truncará al final
+        out->length = out->flushed = position;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Preparar el filtro de palabras para escribir su resultado,
+ *             desde el principio, en un fichero ya abierto.
+ * @Parametros: out: filter     = filtro a preparar.
+ *              in:  fd         = fichero de salida (abierto para escritura);
+ *                                -1 para solo contar la longitud del resultado.
+ *              in:  word_limit = longitud mínima de palabra (> 0).
+ * @Retorno:    0 en caso de éxito; ERROR_MEMORY_ALLOCATION si no hay memoria.
+ *
+ **************************************************/
+int DISTORSION_initTextFilter(TextFilter *filter, int fd, int word_limit) {
+#ifdef DISTORSION_HAVE_X86
+    pthread_once(&DISTORSION_alphaOnce, DISTORSION_selectAlphaKernel);
+#endif
 
-        char actualMd5[33];
-        read(fds[0], actualMd5, 32); 
-        actualMd5[32] = '\0';
+    memset(filter, 0, sizeof(TextFilter));
+    filter->out.fd = fd;
+    filter->out.end = -1;
+    filter->word_limit = word_limit;
+    if (fd < 0) {
+        return NO_ERROR;
+    }
+    filter->out.buffer = (char *)malloc(DISTORSION_TEXT_CHUNK);
+    return filter->out.buffer ? NO_ERROR : ERROR_MEMORY_ALLOCATION;
+}
+/**************************************************
+ *
+ * @Finalidad: Pasar un bloque de texto por el filtro de palabras. Las
+ *             palabras y los separadores pueden quedar partidos entre
+ *             bloques: el estado de la palabra actual se conserva. Cada
+ *             palabra se escribe a medida que llega y, si resulta ser
+ *             corta, se retrocede la salida hasta donde empezaba.
+ * @Parametros: in/out: filter = filtro de palabras.
+ *              in:     data   = bloque de texto.
+ *              in:     size   = número de bytes del bloque.
+ * @Retorno:    0 en caso de éxito; ERROR_WRITING_FILE si no se ha podido escribir.
+ *
+ **************************************************/
+int DISTORSION_filterText(TextFilter *filter, const char *data, size_t size) {
+    TextOutput *out = &filter->out;
 
-        close(fds[0]);
+    // Se recorre el bloque de 64 en 64 bytes por tramos de letras y de
+    // separadores, localizados con la máscara de letras
+    for (size_t offset = 0; offset < size; offset += 64) {
+        const char *block = data + offset;
+        size_t blockSize = size - offset < 64 ? size - offset : 64;
+        uint64_t alpha = DISTORSION_alphaKernel(block, blockSize);
+        size_t pos = 0;
 
-        char *md5sum = (char *)malloc(33 * sizeof(char));
-        if (md5sum != NULL) {
-            strcpy(md5sum, actualMd5);
+        while (pos < blockSize) {
+            int isLetter = (alpha >> pos) & 1;
+            uint64_t rest = (isLetter ? ~alpha : alpha) >> pos;
+            size_t run = rest ? (size_t)__builtin_ctzll(rest) : 64 - pos;
+            if (run > blockSize - pos) {
+                run = blockSize - pos;
+            }
+
+            const char *span = block + pos;
+            pos += run;
+            if (isLetter) {
+                if (filter->word_length == 0) {
+                    filter->word_start = out->length;
+                }
+                filter->word_length += run;
+            } else {
+                if (filter->word_length > 0 && filter->word_length < (size_t)filter->word_limit) {
+                    // Palabra corta: se descarta junto con el separador que la sigue
+                    DISTORSION_retractText(out, filter->word_start);
+                    span++;
+                    run--;
+                }
+                filter->word_length = 0;
+            }
+            if (DISTORSION_appendText(out, span, run) != 0) {
+                return ERROR_WRITING_FILE;
+            }
         }
-        return md5sum;
     }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Terminar el filtro de palabras: descartar la última palabra
+ *             si no tiene separador detrás, escribir lo pendiente y dejar
+ *             el fichero de salida con la longitud del resultado.
+ * @Parametros: in/out: filter = filtro de palabras.
+ * @Retorno:    0 en caso de éxito; ERROR_WRITING_FILE si no se ha podido escribir.
+ *
+ **************************************************/
+int DISTORSION_finishTextFilter(TextFilter *filter) {
+    if (filter->word_length > 0) {
+        DISTORSION_retractText(&filter->out, filter->word_start);
+        filter->word_length = 0;
+    }
+    if (DISTORSION_flushText(&filter->out) != 0 || ftruncate(filter->out.fd, filter->out.length) != 0) {
+        return ERROR_WRITING_FILE;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar la memoria del filtro de palabras. El fichero de
+ *             salida lo cierra quien lo abrió.
+ * @Parametros: in/out: filter = filtro de palabras.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void DISTORSION_freeTextFilter(TextFilter *filter) {
+    free(filter->out.buffer);
+    filter->out.buffer = NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Filtrar un fichero de texto leyéndolo por bloques de
+ *             DISTORSION_TEXT_CHUNK bytes, con memoria constante.
+ * @Parametros: in: in         = fichero de entrada.
+ *              in: out        = fichero de salida.
+ *              in: word_limit = longitud mínima de palabra.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int DISTORSION_filterTextSequential(int in, int out, int word_limit) {
+    char *chunk = (char *)malloc(DISTORSION_TEXT_CHUNK);
+    if (!chunk) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    TextFilter filter;
+    int error = DISTORSION_initTextFilter(&filter, out, word_limit);
+    ssize_t read_size;
+
+    while (error == NO_ERROR && (read_size = read(in, chunk, DISTORSION_TEXT_CHUNK)) != 0) {
+        if (read_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = ERROR_READING_FILE;
+            break;
+        }
+        error = DISTORSION_filterText(&filter, chunk, (size_t)read_size);
+    }
+    if (error == NO_ERROR) {
+        error = DISTORSION_finishTextFilter(&filter);
+    }
+
+    DISTORSION_freeTextFilter(&filter);
+    free(chunk);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Procesar un trozo de un texto grande: en la fase de conteo,
+ *             calcular la longitud de su resultado; en la de escritura,
+ *             escribirlo en su posición del fichero de salida.
+ * @Parametros: in/out: job   = trabajo de filtrado en paralelo.
+ *              in:     index = trozo a procesar.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int DISTORSION_runTextChunk(ParallelText *job, int index) {
+    TextChunk *chunk = &job->chunks[index];
+    TextFilter filter;
+    int error = DISTORSION_initTextFilter(&filter, job->writing ? job->out : -1, job->word_limit);
+
+    if (error == NO_ERROR) {
+        // Cada trozo escribe solo en su tramo, que otros hilos escriben a la vez
+        filter.out.base = chunk->output;
+        filter.out.end = chunk->length;
+        error = DISTORSION_filterText(&filter, job->data + chunk->start, chunk->size);
+    }
+    if (error == NO_ERROR) {
+        // Solo el último trozo puede acabar a media palabra
+        if (filter.word_length > 0) {
+            DISTORSION_retractText(&filter.out, filter.word_start);
+        }
+        if (DISTORSION_flushText(&filter.out) != 0) {
+            error = ERROR_WRITING_FILE;
+        }
+        chunk->length = filter.out.length;
+    }
+    DISTORSION_freeTextFilter(&filter);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Repartir los trozos pendientes de la fase actual. Lo ejecutan
+ *             a la vez los hilos del pool y el hilo que espera el resultado.
+ * @Parametros: in/out: job = trabajo de filtrado en paralelo.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void DISTORSION_drainTextChunks(ParallelText *job) {
+    int index;
+
+    while ((index = atomic_fetch_add(&job->next, 1)) < job->count) {
+        int error = DISTORSION_runTextChunk(job, index);
+        if (error != NO_ERROR) {
+            atomic_store(&job->error, error);
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Tarea del pool que ayuda a procesar los trozos de un texto
+ *             grande y avisa al terminar.
+ * @Parametros: in: arg = ParallelText del trabajo.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void DISTORSION_textChunkTask(void *arg) {
+    ParallelText *job = (ParallelText *)arg;
+
+    DISTORSION_drainTextChunks(job);
+
+    pthread_mutex_lock(&job->mutex);
+    job->helpers--;
+    pthread_cond_signal(&job->done);
+    pthread_mutex_unlock(&job->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Ejecutar una fase del filtrado en paralelo. El hilo que
+ *             llama también procesa trozos, así la fase termina aunque el
+ *             pool esté ocupado; después espera a los hilos que le han
+ *             ayudado, que no bloquean nunca a otras tareas del pool.
+ * @Parametros: in/out: job = trabajo de filtrado en paralelo.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void DISTORSION_runTextPhase(ParallelText *job) {
+    atomic_store(&job->next, 0);
+
+    int wanted = job->count - 1 < job->pool->numThreads ? job->count - 1 : job->pool->numThreads;
+    for (int i = 0; i < wanted; i++) {
+        pthread_mutex_lock(&job->mutex);
+        job->helpers++;
+        pthread_mutex_unlock(&job->mutex);
+        if (THREADPOOL_submit(job->pool, DISTORSION_textChunkTask, job) != THREADPOOL_OK) {
+            pthread_mutex_lock(&job->mutex);
+            job->helpers--;
+            pthread_mutex_unlock(&job->mutex);
+            break;
+        }
+    }
+
+    DISTORSION_drainTextChunks(job);
+
+    pthread_mutex_lock(&job->mutex);
+    while (job->helpers > 0) {
+        pthread_cond_wait(&job->done, &job->mutex);
+    }
+    pthread_mutex_unlock(&job->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Filtrar un fichero de texto grande en paralelo. El fichero
+ *             se proyecta en memoria y se parte en trozos que empiezan
+ *             justo después de un separador, donde el filtro siempre está
+ *             fuera de una palabra. Primero se cuenta cuánto ocupa el
+ *             resultado de cada trozo, la suma de prefijos da su posición
+ *             en la salida y después cada trozo se escribe con pwrite en su
+ *             posición. El resultado es idéntico al del filtro secuencial.
+ * @Parametros: in: in         = fichero de entrada.
+ *              in: out        = fichero de salida.
+ *              in: size       = tamaño del fichero de entrada.
+ *              in: word_limit = longitud mínima de palabra.
+ *              in: pool       = pool de los hilos que ayudan (o NULL).
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error;
+ *              DISTORSION_PARALLEL_UNAVAILABLE si hay que filtrarlo de
+ *              forma secuencial.
+ *
+ **************************************************/
+static int DISTORSION_filterTextParallel(int in, int out, off_t size, int word_limit, ThreadPool *pool) {
+    // Con un solo core las dos pasadas solo añaden trabajo
+    if (pool == NULL || pool->numThreads < 2) {
+        return DISTORSION_PARALLEL_UNAVAILABLE;
+    }
+
+    const char *data = (const char *)mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, in, 0);
+    if (data == MAP_FAILED) {
+        return DISTORSION_PARALLEL_UNAVAILABLE;
+    }
+    madvise((void *)data, (size_t)size, MADV_SEQUENTIAL);
+
+    ParallelText job;
+    memset(&job, 0, sizeof(ParallelText));
+    job.data = data;
+    job.out = out;
+    job.word_limit = word_limit;
+    job.pool = pool;
+    job.chunks = (TextChunk *)malloc(sizeof(TextChunk) * (size_t)(size / DISTORSION_PARALLEL_CHUNK + 1));
+    if (job.chunks == NULL) {
+        munmap((void *)data, (size_t)size);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.done, NULL);
+
+    // Cada corte se mueve hasta después del siguiente separador; una palabra
+    // más larga que un trozo lo une con el siguiente
+    off_t start = 0;
+    while (start < size) {
+        off_t cut = start + DISTORSION_PARALLEL_CHUNK;
+        while (cut < size && isalpha((unsigned char)data[cut - 1])) {
+            cut++;
+        }
+        if (cut > size) {
+            cut = size;
+        }
+        job.chunks[job.count].start = start;
+        job.chunks[job.count].size = (size_t)(cut - start);
+        job.chunks[job.count].output = 0;
+        job.chunks[job.count].length = -1;
+        job.count++;
+        start = cut;
+    }
+
+    DISTORSION_runTextPhase(&job);
+
+    off_t total = 0;
+    for (int i = 0; i < job.count; i++) {
+        job.chunks[i].output = total;
+        total += job.chunks[i].length;
+    }
+
+    if (atomic_load(&job.error) == NO_ERROR) {
+        job.writing = 1;
+        DISTORSION_runTextPhase(&job);
+    }
+
+    int error = atomic_load(&job.error);
+    if (error == NO_ERROR && ftruncate(out, total) != 0) {
+        error = ERROR_WRITING_FILE;
+    }
+
+    pthread_mutex_destroy(&job.mutex);
+    pthread_cond_destroy(&job.done);
+    free(job.chunks);
+    munmap((void *)data, (size_t)size);
+    return error;
 }
 /**************************************************
  *
@@ -58,280 +560,431 @@ char* DISTORSION_getMD5SUM(const char* path) {
  *             eliminando todas las palabras cuya longitud
  *             sea menor que el umbral especificado, y
  *             generar el fichero resultante con la reducción
- *             de contenido.
+ *             de contenido. Los ficheros de al menos
+ *             DISTORSION_PARALLEL_MIN bytes se filtran por trozos en
+ *             paralelo si hay pool; el resto, por bloques con memoria constante. El
+ *             resultado se escribe en un fichero temporal que después
+ *             sustituye al original.
  * @Parametros: in: input_file_path = ruta al fichero de texto
  *                                   que se va a distorsionar.
  *              in: word_limit      = longitud mínima de palabra;
  *                                  cualquier palabra más corta se elimina.
+ *              in: pool            = pool que ayuda con los textos grandes (o NULL).
  * @Retorno:    0 si la operación se completó correctamente;
  *             <0 si ocurrió algún error.
  *
  **************************************************/
-int DISTORSION_compressText(char *input_file_path, int word_limit) {
+int DISTORSION_compressText(char *input_file_path, int word_limit, ThreadPool *pool) {
     if (word_limit <= 0) {
         return ERROR_INVALID_LIMIT; // El límite debe ser mayor que 0
     }
 
-    FILE *file = fopen(input_file_path, "r+");
-    if (!file) {
+    int in = open(input_file_path, O_RDONLY);
+    if (in < 0) {
         perror("Error al abrir el archivo");
         return ERROR_OPENING_FILE;
     }
-
-    // Lee todo el contenido del archivo en memoria
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
-
-    char *buffer = (char *)malloc(file_size + 1);
-    if (!buffer) {
-        fclose(file);
-        return ERROR_MEMORY_ALLOCATION;
-    }
-
-    size_t read_size = fread(buffer, 1, file_size, file);
-    if (read_size != file_size) {
-        free(buffer);
-        fclose(file);
+    struct stat info;
+    if (fstat(in, &info) != 0) {
+        close(in);
         return ERROR_READING_FILE;
     }
-    buffer[file_size] = '\0'; // Asegura que la cadena está terminada
 
-    // Filtrar las palabras según el límite de longitud
-    char *filtered_text = (char *)malloc(file_size + 1); // Espacio para el texto filtrado
-    if (!filtered_text) {
-        free(buffer);
-        fclose(file);
+    // El temporal va en la misma carpeta para poder sustituir el original con rename
+    char *tmp_path = NULL;
+    if (asprintf(&tmp_path, "%s.XXXXXX", input_file_path) == -1) {
+        close(in);
         return ERROR_MEMORY_ALLOCATION;
     }
-
-    size_t filtered_index = 0;
-    size_t word_length = 0;
-    char *start = buffer;
-
-    for (size_t i = 0; i < file_size; i++) {  // Aquí está la corrección
-        if (isalpha(buffer[i])) {
-            word_length++;
-        } else {
-            if (word_length >= (size_t)word_limit) {
-                while (start <= &buffer[i] && filtered_index < file_size) {
-                    filtered_text[filtered_index++] = *start++;
-                }
-            } else {
-                while (!isalpha(*start) && start <= &buffer[i] && filtered_index < file_size) {
-                    filtered_text[filtered_index++] = *start++;
-                }
-                start = &buffer[i + 1];
-            }
-            word_length = 0;
-        }
-    }
-
-    // Asegurar terminador nulo en `filtered_text`
-    if (filtered_index < file_size) {
-        filtered_text[filtered_index] = '\0';
-    } else {
-        filtered_text[file_size - 1] = '\0';
-    }
-    // Sobrescribe el archivo con el texto filtrado
-    rewind(file);
-    if (fwrite(filtered_text, 1, filtered_index, file) != filtered_index) {
-        free(buffer);
-        free(filtered_text);
-        fclose(file);
+    int out = mkstemp(tmp_path);
+    if (out < 0) {
+        perror("Error creando el archivo temporal");
+        free(tmp_path);
+        close(in);
         return ERROR_WRITING_FILE;
     }
 
-    // Trunca el archivo si el texto filtrado es más corto
-    if (ftruncate(fileno(file), filtered_index) != 0) {
-        perror("Error truncando el archivo");
-        free(buffer);
-        free(filtered_text);
-        fclose(file);
-        return ERROR_WRITING_FILE;
+    int error = DISTORSION_PARALLEL_UNAVAILABLE;
+    if (info.st_size >= DISTORSION_PARALLEL_MIN) {
+        error = DISTORSION_filterTextParallel(in, out, info.st_size, word_limit, pool);
+    }
+    if (error == DISTORSION_PARALLEL_UNAVAILABLE) {
+        error = DISTORSION_filterTextSequential(in, out, word_limit);
     }
 
+    if (error == NO_ERROR && fchmod(out, info.st_mode & 0777) != 0) {
+        error = ERROR_WRITING_FILE;
+    }
+    if (error != NO_ERROR) {
+        perror("Error escribiendo el archivo");
+    }
+    if (close(out) != 0 && error == NO_ERROR) {
+        error = ERROR_WRITING_FILE;
+    }
+    if (error == NO_ERROR && rename(tmp_path, input_file_path) != 0) {
+        perror("Error sustituyendo el archivo");
+        error = ERROR_WRITING_FILE;
+    }
+    if (error != NO_ERROR) {
+        unlink(tmp_path);
+    }
 
     // Limpieza
-    free(buffer);
-    free(filtered_text);
-    fclose(file);
-    
+    free(tmp_path);
+    close(in);
 
-    return NO_ERROR; // Todo salió bien
+    return error;
 }
-
 /**************************************************
  *
- * @Finalidad: Ejecutar la distorsión de un fichero
- *             (imagen, audio o texto) representado por el elemento de la lista,
- *             gestionando la transferencia de tramas, el procesamiento
- *             con el factor indicado y respondiendo a señales de parada.
- * @Parametros: in/out: element     = puntero a la estructura que contiene los metadatos
- *                                 de la tarea (nombre de fichero, tamaño total,
- *                                 MD5 original, factor de distorsión, socket,
- *                                 desplazamiento de bytes, etc.).
- *              in:     stop_signal = puntero a una sig atómica que, si se activa,
- *                                 indica interrupción inmediata del proceso.
- * @Retorno:    0 en caso de éxito completo;
- *             <0 en caso de error
+ * @Finalidad: Saber si una tarea nueva se distorsiona mientras se recibe
+ *             (textos y WAV con factor positivo).
+ * @Parametros: in: element = tarea.
+ * @Retorno:    1 si se distorsiona al recibirla; 0 si no.
+ *
  **************************************************/
-int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_signal) {
-    pthread_mutex_t myMutex = PTHREAD_MUTEX_INITIALIZER;
+int DISTORSION_fusesOnReceive(const listElement2* element) {
+    return atoi(element->factor) > 0 && (strcmp(element->worker_type, "Text") == 0 ||
+        FILES_has_extension(element->fileName, (const char *[]) { ".wav", NULL }));
+}
+/**************************************************
+ *
+ * @Finalidad: Etapa de recepción: recibir del Fleck el fichero a
+ *             distorsionar y guardarlo en la carpeta del worker. El MD5
+ *             se calcula sobre los datos a medida que llegan. Si el
+ *             fichero ya se había recibido en parte, los bytes repetidos
+ *             solo se cuentan para el MD5. Un texto o un WAV se distorsiona a
+ *             medida que llega (element->fused) y en disco solo queda el
+ *             resultado. Si se pide, los datos recibidos también se copian
+ *             tal cual en sourceFd.
+ * @Parametros: in/out: element     = tarea (fichero, tamaño, socket, bytes
+ *                                    ya recibidos, estado...).
+ *              in:     stop_signal = si se activa, se interrumpe la recepción.
+ *              out:    md5         = MD5 de los datos recibidos.
+ *              in/out: sourceFd    = fichero donde copiar los datos (NULL o
+ *                                    -1 sin copia). Si falla la copia se
+ *                                    cierra y se pone a -1.
+ * @Retorno:    0 si se ha recibido todo (estado 2); 1 en caso de error.
+ *
+ **************************************************/
+int DISTORSION_receiveFile(listElement2* element, volatile sig_atomic_t *stop_signal, char md5[MD5_HEX_SIZE], int *sourceFd) {
     char* path = NULL;
     asprintf(&path, "%s/%s", element->directory, element->fileName);
     write(STDOUT_FILENO, path, strlen(path));
-    char* fileSize3;
-    char* actualMd5;
+    Md5Context ctx;
 
-    int fd = open(path, O_WRONLY | O_CREAT, 0666);
+    // Una tarea nueva escribe siempre en un fichero nuevo: el que hubiera
+    // con ese nombre puede ser un enlace a un resultado de la caché
+    if (element->status == 0) {
+        unlink(path);
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
     if (fd < 0) {
         perror("Failed to open file.");
         exit(EXIT_FAILURE);
     }
+    free(path);
 
-    struct trama htrama;
-    int bytes_written = 0, bytes_to_write = element->bytes_to_writeF1; 
-    if(element->status == 0 || element->status == 1) {
-        element->status = 1;
-        while (bytes_written < bytes_to_write) {  
-            if (*stop_signal) {  
-                write(STDOUT_FILENO, "Stopping file reception due to signal...\n", 42);
-                close(fd);
-                free(path);
-                return 1;
-            }
-            if(TRAMA_readMessageFromSocket(element->fd, &htrama) < 0) {
-                write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
-                return 1;
-            } else if (htrama.tipo == 0x07) {
-                write(STDOUT_FILENO, "Fleck received a CTRL+C.\n", 26);
-                return 1;
-            } else if (htrama.tipo != 0x03) {
-                write(STDOUT_FILENO, "Error: Invalid trama type.\n", 28);
-                return 1;
+    // Un texto o un WAV que empieza a recibirse se distorsiona mientras
+    // llega. Si se reanuda, el filtro vuelve a empezar desde el byte 0
+    int factor = atoi(element->factor);
+    int isText = strcmp(element->worker_type, "Text") == 0;
+    if (element->status == 0 && DISTORSION_fusesOnReceive(element)) {
+        element->fused = 1;
+    }
+    TextFilter filter;
+    AudioFilter audio;
+    if (element->fused) {
+        int initError = isText ? DISTORSION_initTextFilter(&filter, fd, factor) : AUDIO_initFilter(&audio, fd, factor);
+        if (initError != NO_ERROR) {
+            if (isText) {
+                DISTORSION_freeTextFilter(&filter);
+            } else {
+                AUDIO_freeFilter(&audio);
             }
+            close(fd);
+            return 1;
+        }
+    }
 
-            char* incoming_Info = NULL;
-            if(bytes_written < element->bytes_writtenF1) {
-                bytes_written += 247;
-            } else if (bytes_to_write - bytes_written < 247) {
-                incoming_Info = STRING_getSongCode((const char *)htrama.data, bytes_to_write - bytes_written);
-                bytes_written += write(fd, incoming_Info, bytes_to_write - bytes_written);
-                element->bytes_writtenF1 = bytes_written;
-            } else {
-                incoming_Info = STRING_getSongCode((const char *)htrama.data, 247);
-                bytes_written += write(fd, incoming_Info, 247);
-                element->bytes_writtenF1 = bytes_written;
+    struct trama htrama;
+    int bytes_written = 0, bytes_to_write = element->bytes_to_writeF1, error = 0; 
+    element->status = 1;
+    MD5_init(&ctx);
+
+    // Se sigue escribiendo tras los bytes ya recibidos y se descarta lo
+    // que hubiera detrás. Desde TRAMA_PROTOCOL_RESUME el Fleck envía solo
+    // lo que falta y el MD5 del principio se calcula leyendo el disco; un
+    // Fleck antiguo lo reenvía todo
+    off_t resumeFrom = element->fused ? 0 : element->bytes_writtenF1;
+    if (ftruncate(fd, resumeFrom) != 0 || lseek(fd, resumeFrom, SEEK_SET) < 0) {
+        write(STDOUT_FILENO, "Error: Cannot resume file.\n", 27);
+        error = 1;
+    } else if (element->protocol >= TRAMA_PROTOCOL_RESUME && resumeFrom > 0) {
+        if (MD5_updateFromFile(&ctx, fd, resumeFrom) != MD5_OK) {
+            write(STDOUT_FILENO, "Error: Cannot resume file.\n", 27);
+            error = 1;
+        }
+        bytes_written = resumeFrom;
+    }
+    while (!error && bytes_written < bytes_to_write) {  
+        if (*stop_signal) {  
+            write(STDOUT_FILENO, "Stopping file reception due to signal...\n", 42);
+            error = 1;
+            break;
+        }
+        int result = TRAMA_readFrame(element->reader, &htrama);
+        if (result == TRAMA_EOF) {
+            write(STDOUT_FILENO, "Fleck closed the connection.\n", 29);
+            error = 1;
+            break;
+        } else if (result != TRAMA_OK) {
+            write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
+            error = 1;
+            break;
+        } else if (htrama.tipo == 0x07) {
+            write(STDOUT_FILENO, "Fleck received a CTRL+C.\n", 26);
+            error = 1;
+            break;
+        } else if (htrama.tipo != 0x03) {
+            write(STDOUT_FILENO, "Error: Invalid trama type.\n", 28);
+            error = 1;
+            break;
+        }
+
+        // Las tramas pueden ser clásicas (247 bytes) o grandes según el protocolo
+        int chunk = htrama.longitud;
+        if (chunk > bytes_to_write - bytes_written) {
+            chunk = bytes_to_write - bytes_written;
+        }
+        // Un Fleck antiguo reenvía el fichero desde el principio: también se cuentan los bytes ya escritos
+        MD5_update(&ctx, htrama.data, chunk);
+        if (sourceFd != NULL && *sourceFd >= 0 && TRAMA_writeData(*sourceFd, &htrama, chunk) < 0) {
+            // Sin copia del origen la distorsión sigue igual
+            close(*sourceFd);
+            *sourceFd = -1;
+        }
+
+        if (element->fused) {
+            // Solo se escribe el resultado de la distorsión
+            int result = isText ? DISTORSION_filterText(&filter, (const char *)htrama.data, chunk)
+                                : AUDIO_filter(&audio, htrama.data, chunk);
+            if (result != NO_ERROR) {
+                write(STDOUT_FILENO, "Error: Cannot write distorted data.\n", 36);
+                error = 1;
+                break;
             }
-            if (bytes_written < 0) {
+            bytes_written += chunk;
+            element->bytes_writtenF1 = bytes_written;
+        } else if(bytes_written < element->bytes_writtenF1) {
+            bytes_written += chunk;
+        } else {
+            // Los datos se escriben directamente desde el buffer del lector
+            if (TRAMA_writeData(fd, &htrama, chunk) < 0) {
                 perror("Failed to write to file.");
                 exit(EXIT_FAILURE);
             }
-            free(incoming_Info);
-            free(htrama.data);
-            usleep(1); 
+            bytes_written += chunk;
+            element->bytes_writtenF1 = bytes_written;
         }
-        element->status = 2;
-
-        actualMd5 = DISTORSION_getMD5SUM(path);
-    
-        if(strcmp(element->MD5SUM, actualMd5) == 0) {
-            TRAMA_sendMessageToSocket(element->fd, 0x06, (int16_t)strlen("CHECK_OK"), "CHECK_OK");  
-        } else {
-            TRAMA_sendMessageToSocket(element->fd, 0x06, (int16_t)strlen("CHECK_KO"), "CHECK_KO");  
-            write(STDOUT_FILENO, "Error: CHECK_KO.\n", 18);
-            return 1;
+        usleep(1); 
+    }
+    if (element->fused && isText) {
+        if (!error && DISTORSION_finishTextFilter(&filter) != NO_ERROR) {
+            write(STDOUT_FILENO, "Error: Cannot write distorted data.\n", 36);
+            error = 1;
         }
-        free(actualMd5);
-
-    } 
+        DISTORSION_freeTextFilter(&filter);
+    } else if (element->fused) {
+        int result = error ? NO_ERROR : AUDIO_finishFilter(&audio);
+        if (result == ERROR_NOT_WAV) {
+            // Se ha guardado tal cual: se distorsiona después con SO_compressAudio
+            element->fused = 0;
+        } else if (result != NO_ERROR) {
+            write(STDOUT_FILENO, "Error: Cannot write distorted data.\n", 36);
+            error = 1;
+        }
+        AUDIO_freeFilter(&audio);
+    }
     close(fd);
+    if (error) {
+        return 1;
+    }
+    element->status = 2;
 
+    MD5_finalHex(&ctx, md5);
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Etapa de comprobación de integridad: comparar el MD5 de los
+ *             datos recibidos con el que anunció el Fleck y enviarle el
+ *             resultado (CHECK_OK o CHECK_KO).
+ * @Parametros: in: element = tarea recibida.
+ *              in: md5     = MD5 de los datos recibidos.
+ * @Retorno:    0 si coinciden; 1 si no.
+ *
+ **************************************************/
+int DISTORSION_checkIntegrity(listElement2* element, const char* md5) {
+    if(strcmp(element->MD5SUM, md5) == 0) {
+        TRAMA_sendMessageToSocket(element->fd, 0x06, (int16_t)strlen("CHECK_OK"), "CHECK_OK");  
+        return 0;
+    }
+    TRAMA_sendMessageToSocket(element->fd, 0x06, (int16_t)strlen("CHECK_KO"), "CHECK_KO");  
+    write(STDOUT_FILENO, "Error: CHECK_KO.\n", 18);
+    return 1;
+}
+/**************************************************
+ *
+ * @Finalidad: Etapa de distorsión: distorsionar el fichero recibido (texto,
+ *             audio o imagen) con el factor de la tarea y enviar al Fleck
+ *             el tamaño y el MD5 del resultado (trama 0x04).
+ * @Parametros: in/out: element = tarea en estado 2.
+ *              in:     pool    = pool que ayuda a distorsionar los ficheros
+ *                                grandes (o NULL para hacerlo en un hilo).
+ * @Retorno:    0 en caso de éxito;
+ *             2 si el Fleck se ha desconectado durante la distorsión (el
+ *             socket lo cierra quien llama);
+ *             1 en caso de error.
+ *
+ **************************************************/
+int DISTORSION_compressFile(listElement2* element, ThreadPool* pool) {
+    char* path = NULL;
+    asprintf(&path, "%s/%s", element->directory, element->fileName);
 
-    if(element->status == 2) {
-        write(STDOUT_FILENO, "In\n", 4); 
-        int error = 0;
-        if(strcmp(element->worker_type, "Text") == 0) {
-            error = DISTORSION_compressText(path, atoi(element->factor));
-        } else if(FILES_has_extension(element->fileName, (const char *[]) { ".wav", NULL })) {
-            write(STDOUT_FILENO, "Compressing audio file\n", 24);
+    write(STDOUT_FILENO, "In\n", 4); 
+    int error = 0;
+    if (element->fused) {
+        // El fichero ya se distorsionó mientras se recibía o sale de la caché
+        write(STDOUT_FILENO, "File already distorted\n", 23);
+    } else if(strcmp(element->worker_type, "Text") == 0) {
+        error = DISTORSION_compressText(path, atoi(element->factor), pool);
+    } else if(FILES_has_extension(element->fileName, (const char *[]) { ".wav", NULL })) {
+        write(STDOUT_FILENO, "Compressing audio file\n", 24);
 
+        error = AUDIO_compressAudio(path, atoi(element->factor));
+        if (error == ERROR_NOT_WAV) {
+            // Variantes de WAV que el motor propio no trata
             error = SO_compressAudio(path, atoi(element->factor));
-            write(STDOUT_FILENO, "Audio file compressed\n", 23);
-        } else {
-            write(STDOUT_FILENO, "Compressing image file\n", 24);
-            error = SO_compressImage(path, atoi(element->factor));
-            write(STDOUT_FILENO, "Image file compressed\n", 22);
         }
-
-        write(STDOUT_FILENO, "Out\n", 4);
-        switch (error) {
-            case 0:
-                write(STDOUT_FILENO, "The file was distorted successfully\n", 37);
-                break;
-            case -1:
-                write(STDOUT_FILENO, "The file could not be read\n", strlen("The file could not be read\n"));
-                return 1;
-            case -2:
-                write(STDOUT_FILENO, "The scaling factor is too large for the file\n", strlen("The scaling factor is too large for the file\n"));
-                return 1;
-            case -3:
-                write(STDOUT_FILENO, "Memory allocation error\n", 25);
-                return 1;
-            case -4:
-                write(STDOUT_FILENO, "Error creating the temporary file\n", 35);
-                return 1;
-            case -5:
-                write(STDOUT_FILENO, "Unsupported image format\n", 26);
-                return 1;
-            case -6:
-                write(STDOUT_FILENO, "Error creating the final file\n", 31);
-                return 1;
-            case -7:
-                write(STDOUT_FILENO, "The audio file is not a WAV file. Only WAV files are supported\n", 63);
-                return 1;
-            default:
-                break;
+        write(STDOUT_FILENO, "Audio file compressed\n", 23);
+    } else {
+        write(STDOUT_FILENO, "Compressing image file\n", 24);
+        error = IMAGE_compressImage(path, atoi(element->factor), pool);
+        if (error == ERROR_UNSUPPORTED_FORMAT) {
+            // JPEG progresivo y las variantes que el motor propio no lee
+            error = SO_compressImage(path, atoi(element->factor));
         }
-        fileSize3 = FILES_get_size_of_file(path);
-        char* distortedMd5 = DISTORSION_getMD5SUM(path);
+        write(STDOUT_FILENO, "Image file compressed\n", 22);
+    }
 
-        if(!SOCKET_isSocketOpen(element->fd)) {
-            write(STDOUT_FILENO, "Fleck socket closed. Cannot send distorted file.\n", 50);
-            close(element->fd);
-            free(path);
-            free(fileSize3);
-            free(distortedMd5);
-            return 2;
-        }
+    write(STDOUT_FILENO, "Out\n", 4);
+    if (error != 0) {
+        free(path);
+    }
+    switch (error) {
+        case 0:
+            write(STDOUT_FILENO, "The file was distorted successfully\n", 37);
+            break;
+        case -1:
+            write(STDOUT_FILENO, "The file could not be read\n", strlen("The file could not be read\n"));
+            return 1;
+        case -2:
+            write(STDOUT_FILENO, "The scaling factor is too large for the file\n", strlen("The scaling factor is too large for the file\n"));
+            return 1;
+        case -3:
+            write(STDOUT_FILENO, "Memory allocation error\n", 25);
+            return 1;
+        case -4:
+            write(STDOUT_FILENO, "Error creating the temporary file\n", 35);
+            return 1;
+        case -5:
+            write(STDOUT_FILENO, "Unsupported image format\n", 26);
+            return 1;
+        case -6:
+            write(STDOUT_FILENO, "Error creating the final file\n", 31);
+            return 1;
+        case -7:
+            write(STDOUT_FILENO, "The audio file is not a WAV file. Only WAV files are supported\n", 63);
+            return 1;
+        default:
+            // Código inesperado de los motores de respaldo ('path' ya está liberado)
+            write(STDOUT_FILENO, "The file could not be distorted\n", 32);
+            return 1;
+    }
+    char* fileSize3 = FILES_get_size_of_file(path);
+    char* distortedMd5 = DISTORSION_getMD5SUM(path);
+    free(path);
+    if (distortedMd5 == NULL) {
+        write(STDOUT_FILENO, "Error: Cannot compute MD5 of distorted file.\n", 46);
+        free(fileSize3);
+        return 1;
+    }
 
-        char* data = (char*)malloc(256 * sizeof(char));
-        sprintf(data, "%s&%s", fileSize3, distortedMd5);
-        TRAMA_sendMessageToSocket(element->fd, 0x04, (int16_t)strlen(data), data);
-        free(data);
-        element->bytes_to_writeF2 = atoi(fileSize3);
+    if(!SOCKET_isSocketOpen(element->fd)) {
+        write(STDOUT_FILENO, "Fleck socket closed. Cannot send distorted file.\n", 50);
         free(fileSize3);
         free(distortedMd5);
+        return 2;
     }
 
+    char* data = (char*)malloc(256 * sizeof(char));
+    sprintf(data, "%s&%s", fileSize3, distortedMd5);
+    TRAMA_sendMessageToSocket(element->fd, 0x04, (int16_t)strlen(data), data);
+    free(data);
+    element->bytes_to_writeF2 = atoi(fileSize3);
+    free(fileSize3);
+    free(distortedMd5);
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Etapa de envío: enviar al Fleck el fichero distorsionado,
+ *             esperar su confirmación y borrar el fichero del worker.
+ * @Parametros: in/out: element     = tarea ya distorsionada.
+ *              in:     stop_signal = si se activa, se interrumpe el envío.
+ * @Retorno:    0 si el Fleck ha recibido el fichero (estado 4, el socket
+ *             queda cerrado); 1 en caso de error.
+ *
+ **************************************************/
+int DISTORSION_sendFile(listElement2* element, volatile sig_atomic_t *stop_signal) {
+    pthread_mutex_t myMutex = PTHREAD_MUTEX_INITIALIZER;
+    struct trama htrama;
+
     if (*stop_signal) {  
         write(STDOUT_FILENO, "Stopping file reception due to signal...\n", 42);
-        free(path);
         return 1;
     }
 
+    char* path = NULL;
+    asprintf(&path, "%s/%s", element->directory, element->fileName);
     element->status = 3;
     int fd2 = open(path, O_RDONLY);
     if (fd2 < 0) {
         write(STDOUT_FILENO, "Error: Cannot open file\n", 25);
+        free(path);
         return 1;
     }
 
+    // Desde TRAMA_PROTOCOL_RESUME se continúa desde el byte que el Fleck ya
+    // tiene en disco; a un Fleck antiguo se le envía todo
     int bytes_to_write2 = element->bytes_to_writeF2, bytes_written2 = 0;
+    if (element->protocol >= TRAMA_PROTOCOL_RESUME && element->bytes_writtenF2 < bytes_to_write2) {
+        bytes_written2 = element->bytes_writtenF2;
+    }
     element->bytes_writtenF2 = bytes_written2;
-    char* buf = (char*)malloc(sizeof(char) * 247);
-    char* message = (char*)malloc(sizeof(char) * 256);
+    uint32_t dataSize = TRAMA_getDataSize(element->protocol);
+    off_t offset = bytes_written2;
+    if (lseek(fd2, offset, SEEK_SET) < 0) {
+        write(STDOUT_FILENO, "Error: Cannot open file\n", 25);
+        free(path);
+        close(fd2);
+        return 1;
+    }
+    char* buf = NULL;
+    if (element->protocol < TRAMA_PROTOCOL_STREAM) {
+        buf = (char*)malloc(sizeof(char) * dataSize);
+    }
     int sizeOfBuf = 0;
     write(STDOUT_FILENO, "Sending distorted file to Fleck...\n", 36);
     
@@ -339,28 +992,40 @@ int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_si
         if (*stop_signal) {  
             write(STDOUT_FILENO, "Stopping file reception due to signal...\n", 42);
             free(path);
+            free(buf);
             close(fd2);
             return 1;
         }
-        memset(buf, '\0', 247);
-        memset(message, '\0', 256);
-        sizeOfBuf = read(fd2, buf, 247);  
-        memcpy(message, buf, sizeOfBuf);
-        bytes_written2 += sizeOfBuf;     
-        element->bytes_writtenF2 = bytes_written2;   
+        int error = 0;
         pthread_mutex_lock(&myMutex);
-        TRAMA_sendMessageToSocket(element->fd, 0x05, sizeOfBuf, message);
+        if (element->protocol >= TRAMA_PROTOCOL_STREAM) {
+            // Los bytes van de la page cache al socket sin pasar por espacio de usuario
+            sizeOfBuf = (uint32_t)(bytes_to_write2 - bytes_written2) < dataSize ? bytes_to_write2 - bytes_written2 : (int)dataSize;
+            error = TRAMA_sendFileToSocket(element->fd, 0x05, fd2, &offset, sizeOfBuf);
+        } else {
+            sizeOfBuf = read(fd2, buf, dataSize);
+            error = sizeOfBuf <= 0 ? -1 : TRAMA_sendDataToSocket(element->fd, 0x05, sizeOfBuf, buf, element->protocol);
+        }
         pthread_mutex_unlock(&myMutex);
+        if (error < 0) {
+            write(STDOUT_FILENO, "Error: Cannot send distorted file to Fleck.\n", 45);
+            free(path);
+            free(buf);
+            close(fd2);
+            return 1;
+        }
+        bytes_written2 += sizeOfBuf;     
+        element->bytes_writtenF2 = bytes_written2;   
         usleep(1); 
     }
     close(fd2);
 
     free(buf);
-    free(message);
 
 
-    if(TRAMA_readMessageFromSocket(element->fd, &htrama) < 0) {
+    if(TRAMA_readFrame(element->reader, &htrama) != TRAMA_OK) {
         write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
+        free(path);
         return 1;
     } else if (htrama.tipo == 0x06  && strcmp((const char *)htrama.data, "CHECK_OK") == 0) {
         write(STDOUT_FILENO, "File distorted successfully.\n\n", 31);
@@ -368,7 +1033,7 @@ int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_si
         write(STDOUT_FILENO, "Error: File could not be distorted.\n", 37);
     } else {
         write(STDOUT_FILENO, "Error: Invalid trama type.\n", 27);
-        free(htrama.data);
+        free(path);
         return 1;
     } 
 
@@ -377,10 +1042,45 @@ int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_si
     } else {
         perror("Error al eliminar el archivo");
     }
-    free(htrama.data);
     free(path);
 
     element->status = 4;
     close(element->fd);
     return 0;   
-}
\ No newline at end of file
+}
+/**************************************************
+ *
+ * @Finalidad: Ejecutar la distorsión de un fichero
+ *             (imagen, audio o texto) representado por el elemento de la lista,
+ *             pasando por todas las etapas a partir de su estado actual:
+ *             recepción, comprobación de integridad, distorsión y envío.
+ * @Parametros: in/out: element     = puntero a la estructura que contiene los metadatos
+ *                                 de la tarea (nombre de fichero, tamaño total,
+ *                                 MD5 original, factor de distorsión, socket,
+ *                                 desplazamiento de bytes, etc.).
+ *              in:     stop_signal = puntero a una sig atómica que, si se activa,
+ *                                 indica interrupción inmediata del proceso.
+ *              in:     pool        = pool que ayuda a distorsionar los ficheros
+ *                                 grandes (o NULL).
+ * @Retorno:    0 en caso de éxito completo;
+ *             2 si el Fleck se ha desconectado durante la distorsión (el
+ *             socket lo cierra quien llama);
+ *             1 en caso de error
+ **************************************************/
+int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_signal, ThreadPool* pool) {
+    char md5[MD5_HEX_SIZE];
+
+    if (element->status == 0 || element->status == 1) {
+        if (DISTORSION_receiveFile(element, stop_signal, md5, NULL) != 0 ||
+            DISTORSION_checkIntegrity(element, md5) != 0) {
+            return 1;
+        }
+    }
+    if (element->status == 2) {
+        int error = DISTORSION_compressFile(element, pool);
+        if (error != 0) {
+            return error;
+        }
+    }
+    return DISTORSION_sendFile(element, stop_signal);
+}
@@ -17,12 +17,21 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include "trama.h"
 #include "string.h"
 #include "files.h"
+#include "md5.h"
 #include "distorsion.h"
 #include "so_compression.h"
+#include "image.h"
+#include "audio.h"
 #include "socket.h"
+#include "threadpool.h"
 #include <errno.h>
 #include <ctype.h>
 #include <sys/ipc.h>
@@ -36,8 +45,65 @@
 #define ERROR_INVALID_LIMIT -4
 #define ERROR_MEMORY_ALLOCATION -5
 
+#define DISTORSION_TEXT_CHUNK 65536     // Bytes que se leen del fichero de texto de cada vez
+#define DISTORSION_PARALLEL_MIN (16 * 1024 * 1024)      // Textos a partir de este tamaño se filtran en paralelo
+#define DISTORSION_PARALLEL_CHUNK (4 * 1024 * 1024)     // Tamaño aproximado de cada trozo
+#define DISTORSION_PARALLEL_UNAVAILABLE -6
+
+// Salida del filtro de texto: 'length' es la longitud del resultado y
+// 'flushed' la parte que ya está escrita en el fichero
+typedef struct {
+    int fd;                             // -1 para solo contar la longitud
+    char *buffer;                       // Bytes entre 'flushed' y 'length'
+    off_t length;
+    off_t flushed;
+    off_t base;                         // Posición del fichero donde empieza la salida
+    off_t end;                          // No se escribe a partir de aquí (-1 sin límite)
+} TextOutput;
+
+// Filtro de palabras por bloques: conserva entre bloques la palabra actual
+typedef struct {
+    TextOutput out;
+    int word_limit;
+    size_t word_length;                 // Letras de la palabra actual
+    off_t word_start;                   // Posición de la salida donde empieza
+} TextFilter;
+
+// Trozo de un texto grande que se filtra en paralelo
+typedef struct {
+    off_t start;                        // Posición en el fichero de entrada
+    size_t size;
+    off_t output;                       // Posición de su resultado en la salida
+    off_t length;                       // Longitud de su resultado
+} TextChunk;
+
+// Filtrado en paralelo de un texto grande, en dos fases: conteo y escritura
+typedef struct {
+    const char *data;                   // Fichero de entrada proyectado en memoria
+    int out;
+    int word_limit;
+    int writing;                        // 0 en la fase de conteo, 1 en la de escritura
+    TextChunk *chunks;
+    int count;
+    atomic_int next;                    // Siguiente trozo a procesar
+    atomic_int error;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    int helpers;                        // Tareas del pool que aún procesan trozos
+    ThreadPool *pool;                   // Pool de los hilos que ayudan
+} ParallelText;
+
 char* DISTORSION_getMD5SUM(const char* path);
-int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_signal);
-int DISTORSION_compressText(char *input_file, int word_limit);
+int DISTORSION_fusesOnReceive(const listElement2* element);
+int DISTORSION_receiveFile(listElement2* element, volatile sig_atomic_t *stop_signal, char md5[MD5_HEX_SIZE], int *sourceFd);
+int DISTORSION_checkIntegrity(listElement2* element, const char* md5);
+int DISTORSION_compressFile(listElement2* element, ThreadPool* pool);
+int DISTORSION_sendFile(listElement2* element, volatile sig_atomic_t *stop_signal);
+int DISTORSION_distortFile(listElement2* element, volatile sig_atomic_t *stop_signal, ThreadPool* pool);
+int DISTORSION_initTextFilter(TextFilter *filter, int fd, int word_limit);
+int DISTORSION_filterText(TextFilter *filter, const char *data, size_t size);
+int DISTORSION_finishTextFilter(TextFilter *filter);
+void DISTORSION_freeTextFilter(TextFilter *filter);
+int DISTORSION_compressText(char *input_file, int word_limit, ThreadPool *pool);
 
 #endif // FILES_H
\ No newline at end of file
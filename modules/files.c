@@ -165,4 +165,30 @@ char* FILES_get_size_of_file(char* path) {
 
     return resultString;
 }
+/**************************************************
+ *
+ * @Finalidad: Obtener cuántos bytes de un fichero a medio transferir están
+ *             ya en disco: se fuerza la escritura (fsync) antes de medirlo,
+ *             para no anunciar bytes que se podrían perder.
+ * @Parametros: in: path  = ruta del fichero.
+ *              in: limit = tamaño total de la transferencia.
+ * @Retorno:    Bytes guardados, como mucho 'limit'; 0 si el fichero no
+ *              existe o no se puede sincronizar.
+ *
+ **************************************************/
+int FILES_get_durable_size(const char* path, int limit) {
+    int fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor < 0) {
+        return 0;
+    }
 
+    off_t sizeOfFile = 0;
+    if (fsync(fileDescriptor) == 0) {
+        sizeOfFile = lseek(fileDescriptor, 0, SEEK_END);
+    }
+    close(fileDescriptor);
+    if (sizeOfFile < 0) {
+        return 0;
+    }
+    return sizeOfFile < limit ? (int)sizeOfFile : limit;
+}
@@ -21,5 +21,6 @@ int FILES_has_extension(const char *filename, const char **extensions);
 void FILES_list_files(const char *directory, const char *label);
 char* FILES_file_exists_with_type(const char *directory, const char *file_name);
 char* FILES_get_size_of_file(char* path);
+int FILES_get_durable_size(const char* path, int limit);
 
 #endif // FILES_H
@@ -0,0 +1,2767 @@
+/***********************************************
+*
+* @Proposito:  Implementa el motor de reducción de imágenes: lectura y
+*               escritura de BMP, TGA y PNG y reducción por media de bloques
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "image.h"
+
+// Árbol de Huffman canónico de deflate: códigos por longitud y símbolos
+// ordenados por código
+typedef struct {
+    uint16_t count[16];
+    uint16_t symbol[288];
+} ImageHuffman;
+
+// Estado de la descompresión de un flujo deflate
+typedef struct {
+    const uint8_t *in;
+    size_t inSize;
+    size_t inPos;
+    uint32_t bitBuf;
+    int bitCount;
+    uint8_t *out;
+    size_t outSize;
+    size_t outPos;
+} ImageInflate;
+
+// Estado de la compresión de un flujo deflate
+typedef struct {
+    uint8_t *out;
+    size_t outPos;
+    uint64_t bitBuf;
+    int bitCount;
+} ImageDeflate;
+
+// Tabla de Huffman de JPEG para decodificar: los códigos de hasta
+// IMAGE_JPEG_FAST_BITS bits se resuelven con una sola consulta
+typedef struct {
+    uint16_t fast[1 << IMAGE_JPEG_FAST_BITS];  // (longitud << 8) | símbolo; 0 si el código es más largo
+    int32_t maxCode[17];                        // Último código de cada longitud; -1 si no hay
+    int32_t valPtr[17];                         // Posición del símbolo menos el código
+    uint8_t values[256];
+    int present;
+} ImageJpegHuffman;
+
+// Componente de un JPEG y su plano de muestras decodificadas
+typedef struct {
+    int id;
+    int h, v;                           // Factores de muestreo
+    int tq;                             // Tabla de cuantización
+    int td, ta;                         // Tablas de Huffman DC y AC del barrido
+    int dcPred;                         // DC del último bloque
+    int blocksW, blocksH;               // Bloques del plano, hasta completar los MCU
+    uint8_t *plane;
+} ImageJpegComponent;
+
+// Estado de la decodificación de un JPEG
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;                         // Siguiente byte de los datos comprimidos
+    uint32_t bitBuf;                    // Bits pendientes, alineados a la izquierda
+    int bitCount;
+    int marker;                         // Marcador que ha cortado los datos comprimidos; 0 si ninguno
+    uint16_t quant[4][64];              // En orden zigzag
+    ImageJpegHuffman dc[4];
+    ImageJpegHuffman ac[4];
+    ImageJpegComponent comp[3];
+    int ncomp;
+    int width, height;
+    int hMax, vMax;
+    int mcusX, mcusY;
+    int restartInterval;
+    int adobeTransform;                 // 0 si una marca de Adobe dice que es RGB; -1 si no hay
+} ImageJpeg;
+
+// Tabla de Huffman de JPEG para codificar
+typedef struct {
+    uint16_t code[256];
+    uint8_t length[256];
+} ImageJpegCode;
+
+// Estado de la escritura de un JPEG
+typedef struct {
+    uint8_t *out;
+    size_t size;
+    size_t capacity;
+    uint32_t bitBuf;
+    int bitCount;
+    int error;
+} ImageJpegWriter;
+
+static const uint16_t IMAGE_lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t IMAGE_lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t IMAGE_distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t IMAGE_distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t IMAGE_pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static uint32_t IMAGE_crcTable[256];
+static pthread_once_t IMAGE_crcOnce = PTHREAD_ONCE_INIT;
+
+// Códigos de Huffman fijos de deflate (invertidos) y símbolo de cada
+// longitud de coincidencia, para comprimir
+static uint16_t IMAGE_fixedCode[288];
+static uint8_t IMAGE_fixedLength[288];
+static uint8_t IMAGE_fixedDistCode[30];
+static uint8_t IMAGE_lengthSymbol[259];
+static pthread_once_t IMAGE_deflateOnce = PTHREAD_ONCE_INIT;
+
+// Tamaño máximo del flujo zlib de 'size' bytes: con códigos fijos un
+// literal ocupa como mucho 9 bits y una coincidencia menos que sus literales
+#define IMAGE_deflateBound(size) (2 + (size) + (size) / 8 + 16)
+// Hash de los 3 bytes que empiezan en p
+#define IMAGE_hash3(p) ((((uint32_t)(p)[0] << 10) ^ ((uint32_t)(p)[1] << 5) ^ (p)[2]) & ((1u << IMAGE_DEFLATE_HASH_BITS) - 1))
+
+// Posición en el bloque (orden natural) de cada coeficiente en orden zigzag
+static const uint8_t IMAGE_zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+// Tablas de cuantización de luminancia y crominancia del estándar (anexo
+// K), en orden natural
+static const uint8_t IMAGE_jpegQuantBase[2][64] = {
+    {
+        16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+        14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+        18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+        49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+    },
+    {
+        17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+    }
+};
+// Tablas de Huffman típicas del estándar (anexo K): DC y AC de luminancia
+// y DC y AC de crominancia
+static const uint8_t IMAGE_jpegStdCounts[4][16] = {
+    { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D },
+    { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }
+};
+static const uint8_t IMAGE_jpegStdValues[4][162] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+    {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+        0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+        0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+        0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA
+    },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+    {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+        0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+        0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+        0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+        0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+        0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+        0xF9, 0xFA
+    }
+};
+
+// Cosenos de la DCT de 8 puntos (IMAGE_dct[x][u]), calculados al primer uso
+static float IMAGE_dct[8][8];
+static pthread_once_t IMAGE_jpegOnce = PTHREAD_ONCE_INIT;
+
+/**************************************************
+ *
+ * @Finalidad: Leer enteros de 16 y 32 bits en little y big endian.
+ * @Parametros: in: p = bytes del entero.
+ * @Retorno:    Valor leído.
+ *
+ **************************************************/
+static uint32_t IMAGE_le16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+static uint32_t IMAGE_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint32_t IMAGE_be16(const uint8_t *p) {
+    return ((uint32_t)p[0] << 8) | (uint32_t)p[1];
+}
+static uint32_t IMAGE_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir enteros de 16 y 32 bits en little y big endian.
+ * @Parametros: out: p     = destino.
+ *              in:  value = valor a escribir.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_putLe16(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+static void IMAGE_putLe32(uint8_t *p, uint32_t value) {
+    IMAGE_putLe16(p, value);
+    IMAGE_putLe16(p + 2, value >> 16);
+}
+static void IMAGE_putBe32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+/**************************************************
+ *
+ * @Finalidad: Reservar los píxeles de una imagen.
+ * @Parametros: out: image    = imagen a preparar.
+ *              in:  width    = ancho en píxeles.
+ *              in:  height   = alto en píxeles.
+ *              in:  channels = canales por píxel (3 o 4).
+ * @Retorno:    0 en caso de éxito; ERROR_DECODING_IMAGE si las medidas no
+ *              son válidas; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+static int IMAGE_alloc(Image *image, long width, long height, int channels) {
+    image->pixels = NULL;
+    if (width < 1 || height < 1 || width > IMAGE_MAX_SIDE || height > IMAGE_MAX_SIDE) {
+        return ERROR_DECODING_IMAGE;
+    }
+    image->width = (int)width;
+    image->height = (int)height;
+    image->channels = channels;
+    image->pixels = (uint8_t *)malloc((size_t)width * (size_t)height * (size_t)channels);
+    return image->pixels ? NO_ERROR : ERROR_MEM_ALLOC;
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar los píxeles de una imagen.
+ * @Parametros: in/out: image = imagen.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void IMAGE_free(Image *image) {
+    free(image->pixels);
+    image->pixels = NULL;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Leer una imagen BMP sin comprimir de 8 (con paleta), 24 o
+ *             32 bits por píxel.
+ * @Parametros: in:  data  = contenido del fichero.
+ *              in:  size  = tamaño del fichero.
+ *              out: image = imagen leída.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_decodeBmp(const uint8_t *data, size_t size, Image *image) {
+    if (size < 54 || data[0] != 'B' || data[1] != 'M') {
+        return ERROR_DECODING_IMAGE;
+    }
+    uint32_t offset = IMAGE_le32(data + 10);
+    uint32_t header = IMAGE_le32(data + 14);
+    long width = (int32_t)IMAGE_le32(data + 18);
+    long height = (int32_t)IMAGE_le32(data + 22);
+    int bpp = (int)IMAGE_le16(data + 28);
+    uint32_t compression = IMAGE_le32(data + 30);
+    if (header < 40) {
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    int topDown = height < 0;
+    if (topDown) {
+        height = -height;
+    }
+    if (compression == 3 && bpp == 32) {
+        // BITFIELDS: solo se admite la disposición BGRA habitual
+        if ((size_t)14 + 40 + 12 > size || IMAGE_le32(data + 54) != 0x00FF0000 ||
+            IMAGE_le32(data + 58) != 0x0000FF00 || IMAGE_le32(data + 62) != 0x000000FF) {
+            return ERROR_UNSUPPORTED_FORMAT;
+        }
+    } else if (compression != 0 || (bpp != 8 && bpp != 24 && bpp != 32)) {
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    int error = IMAGE_alloc(image, width, height, bpp == 32 ? 4 : 3);
+    if (error != NO_ERROR) {
+        return error;
+    }
+
+    const uint8_t *palette = data + 14 + header;
+    uint32_t colors = bpp == 8 ? IMAGE_le32(data + 46) : 0;
+    if (bpp == 8 && (colors == 0 || colors > 256)) {
+        colors = 256;
+    }
+    size_t stride = (((size_t)width * bpp + 31) / 32) * 4;
+    if (palette + colors * 4 > data + size || offset > size || (size - offset) / stride < (size_t)height) {
+        IMAGE_free(image);
+        return ERROR_DECODING_IMAGE;
+    }
+
+    for (long y = 0; y < height; y++) {
+        const uint8_t *row = data + offset + stride * (size_t)(topDown ? y : height - 1 - y);
+        uint8_t *out = image->pixels + (size_t)y * width * image->channels;
+        for (long x = 0; x < width; x++) {
+            const uint8_t *bgr = bpp == 8 ? (row[x] < colors ? palette + row[x] * 4 : palette) : row + x * (bpp / 8);
+            out[0] = bgr[2];
+            out[1] = bgr[1];
+            out[2] = bgr[0];
+            if (image->channels == 4) {
+                out[3] = bgr[3];
+            }
+            out += image->channels;
+        }
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer una imagen TGA en color (24 o 32 bits) o en escala de
+ *             grises (8 bits), sin comprimir o comprimida con RLE.
+ * @Parametros: in:  data  = contenido del fichero.
+ *              in:  size  = tamaño del fichero.
+ *              out: image = imagen leída.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_decodeTga(const uint8_t *data, size_t size, Image *image) {
+    if (size < 18) {
+        return ERROR_DECODING_IMAGE;
+    }
+    int type = data[2];
+    int bpp = data[16];
+    int descriptor = data[17];
+    int gray = type == 3 || type == 11;
+    int rle = type == 10 || type == 11;
+    if ((type != 2 && type != 3 && type != 10 && type != 11) || (descriptor & 0x10) ||
+        (gray && bpp != 8) || (!gray && bpp != 24 && bpp != 32)) {
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    // Se salta el identificador y la paleta, que una imagen en color no usa
+    size_t pos = 18 + data[0];
+    if (data[1] == 1) {
+        pos += IMAGE_le16(data + 5) * (size_t)((data[7] + 7) / 8);
+    }
+    long width = IMAGE_le16(data + 12);
+    long height = IMAGE_le16(data + 14);
+    int error = IMAGE_alloc(image, width, height, bpp == 32 ? 4 : 3);
+    if (error != NO_ERROR) {
+        return error;
+    }
+
+    int pixelSize = bpp / 8;
+    int topDown = (descriptor & 0x20) != 0;
+    long total = width * height, done = 0;
+    while (done < total) {
+        // Un paquete RLE repite un píxel 'count' veces; uno sin comprimir trae 'count' píxeles
+        long count = 1;
+        int repeat = 0;
+        if (rle) {
+            if (pos >= size) {
+                break;
+            }
+            count = (data[pos] & 0x7F) + 1;
+            repeat = (data[pos] & 0x80) != 0;
+            pos++;
+        } else {
+            count = total;
+        }
+        if (count > total - done) {
+            count = total - done;
+        }
+        if (pos + (size_t)(repeat ? 1 : count) * pixelSize > size) {
+            break;
+        }
+        for (long i = 0; i < count; i++, done++) {
+            const uint8_t *src = data + pos + (repeat ? 0 : i * pixelSize);
+            long y = done / width, x = done % width;
+            uint8_t *out = image->pixels + ((size_t)(topDown ? y : height - 1 - y) * width + x) * image->channels;
+            out[0] = gray ? src[0] : src[2];
+            out[1] = gray ? src[0] : src[1];
+            out[2] = src[0];
+            if (image->channels == 4) {
+                out[3] = src[3];
+            }
+        }
+        pos += (size_t)(repeat ? 1 : count) * pixelSize;
+    }
+    if (done < total) {
+        IMAGE_free(image);
+        return ERROR_DECODING_IMAGE;
+    }
+    return NO_ERROR;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Leer 'need' bits (hasta 16) del flujo deflate, empezando por
+ *             el bit menos significativo.
+ * @Parametros: in/out: s    = estado de la descompresión.
+ *              in:     need = número de bits.
+ * @Retorno:    Valor leído; -1 si se acaba el flujo.
+ *
+ **************************************************/
+static int IMAGE_bits(ImageInflate *s, int need) {
+    uint32_t value = s->bitBuf;
+
+    while (s->bitCount < need) {
+        if (s->inPos >= s->inSize) {
+            return -1;
+        }
+        value |= (uint32_t)s->in[s->inPos++] << s->bitCount;
+        s->bitCount += 8;
+    }
+    s->bitBuf = value >> need;
+    s->bitCount -= need;
+    return (int)(value & ((1u << need) - 1));
+}
+/**************************************************
+ *
+ * @Finalidad: Construir un árbol de Huffman canónico a partir de las
+ *             longitudes de código de cada símbolo.
+ * @Parametros: out: h       = árbol a construir.
+ *              in:  lengths = longitud del código de cada símbolo (0 si no se usa).
+ *              in:  n       = número de símbolos.
+ * @Retorno:    0 si el código es válido; -1 si tiene demasiados códigos.
+ *
+ **************************************************/
+static int IMAGE_buildHuffman(ImageHuffman *h, const uint8_t *lengths, int n) {
+    uint16_t offsets[16];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (int i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) {
+            return -1;
+        }
+    }
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++) {
+        offsets[len + 1] = offsets[len] + h->count[len];
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            h->symbol[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Decodificar un símbolo del flujo deflate con un árbol de
+ *             Huffman canónico, bit a bit.
+ * @Parametros: in/out: s = estado de la descompresión.
+ *              in:     h = árbol de Huffman.
+ * @Retorno:    Símbolo leído; -1 si el código no es válido.
+ *
+ **************************************************/
+static int IMAGE_decodeSymbol(ImageInflate *s, const ImageHuffman *h) {
+    int code = 0, first = 0, index = 0;
+
+    for (int len = 1; len < 16; len++) {
+        int bit = IMAGE_bits(s, 1);
+        if (bit < 0) {
+            return -1;
+        }
+        code |= bit;
+        int count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+/**************************************************
+ *
+ * @Finalidad: Descomprimir los símbolos de un bloque deflate con códigos
+ *             de Huffman (fijos o dinámicos) hasta el fin de bloque.
+ * @Parametros: in/out: s        = estado de la descompresión.
+ *              in:     lencode  = árbol de literales y longitudes.
+ *              in:     distcode = árbol de distancias.
+ * @Retorno:    0 en caso de éxito; -1 si los datos no son válidos.
+ *
+ **************************************************/
+static int IMAGE_inflateCodes(ImageInflate *s, const ImageHuffman *lencode, const ImageHuffman *distcode) {
+    while (1) {
+        int symbol = IMAGE_decodeSymbol(s, lencode);
+        if (symbol < 0) {
+            return -1;
+        } else if (symbol < 256) {
+            if (s->outPos >= s->outSize) {
+                return -1;
+            }
+            s->out[s->outPos++] = (uint8_t)symbol;
+        } else if (symbol == 256) {
+            return 0;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) {
+                return -1;
+            }
+            int extra = IMAGE_bits(s, IMAGE_lengthExtra[symbol]);
+            int dist = IMAGE_decodeSymbol(s, distcode);
+            if (extra < 0 || dist < 0 || dist >= 30) {
+                return -1;
+            }
+            size_t length = IMAGE_lengthBase[symbol] + (size_t)extra;
+            extra = IMAGE_bits(s, IMAGE_distExtra[dist]);
+            if (extra < 0) {
+                return -1;
+            }
+            size_t distance = IMAGE_distBase[dist] + (size_t)extra;
+            if (distance > s->outPos || length > s->outSize - s->outPos) {
+                return -1;
+            }
+            // La copia puede solaparse con lo que escribe: se hace byte a byte
+            uint8_t *dst = s->out + s->outPos;
+            for (size_t i = 0; i < length; i++) {
+                dst[i] = dst[i - distance];
+            }
+            s->outPos += length;
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Leer las tablas de un bloque deflate con códigos dinámicos
+ *             y descomprimirlo.
+ * @Parametros: in/out: s = estado de la descompresión.
+ * @Retorno:    0 en caso de éxito; -1 si los datos no son válidos.
+ *
+ **************************************************/
+static int IMAGE_inflateDynamic(ImageInflate *s) {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[320];
+    ImageHuffman lencode, distcode;
+
+    int nlen = IMAGE_bits(s, 5) + 257;
+    int ndist = IMAGE_bits(s, 5) + 1;
+    int ncode = IMAGE_bits(s, 4) + 4;
+    if (nlen < 257 || ndist < 1 || ncode < 4 || nlen > 286 || ndist > 30) {
+        return -1;
+    }
+    memset(lengths, 0, sizeof(lengths));
+    for (int i = 0; i < ncode; i++) {
+        int len = IMAGE_bits(s, 3);
+        if (len < 0) {
+            return -1;
+        }
+        lengths[order[i]] = (uint8_t)len;
+    }
+    if (IMAGE_buildHuffman(&lencode, lengths, 19) != 0) {
+        return -1;
+    }
+
+    int index = 0;
+    while (index < nlen + ndist) {
+        int symbol = IMAGE_decodeSymbol(s, &lencode);
+        if (symbol < 0) {
+            return -1;
+        }
+        if (symbol < 16) {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+        int len = 0, repeat;
+        if (symbol == 16) {
+            if (index == 0) {
+                return -1;
+            }
+            len = lengths[index - 1];
+            repeat = 3 + IMAGE_bits(s, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + IMAGE_bits(s, 3);
+        } else {
+            repeat = 11 + IMAGE_bits(s, 7);
+        }
+        if (repeat < 3 || index + repeat > nlen + ndist) {
+            return -1;
+        }
+        while (repeat--) {
+            lengths[index++] = (uint8_t)len;
+        }
+    }
+    if (lengths[256] == 0 || IMAGE_buildHuffman(&lencode, lengths, nlen) != 0 ||
+        IMAGE_buildHuffman(&distcode, lengths + nlen, ndist) != 0) {
+        return -1;
+    }
+    return IMAGE_inflateCodes(s, &lencode, &distcode);
+}
+/**************************************************
+ *
+ * @Finalidad: Descomprimir un flujo zlib (cabecera, bloques deflate y
+ *             suma Adler-32, que no se comprueba).
+ * @Parametros: in:  in      = flujo comprimido.
+ *              in:  inSize  = tamaño del flujo.
+ *              out: out     = buffer de salida.
+ *              in:  outSize = tamaño del buffer de salida.
+ * @Retorno:    Bytes descomprimidos; -1 si los datos no son válidos.
+ *
+ **************************************************/
+static long IMAGE_inflate(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize) {
+    if (inSize < 2 || (in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20)) {
+        return -1;
+    }
+    ImageInflate s = { in, inSize, 2, 0, 0, out, outSize, 0 };
+
+    int last;
+    do {
+        last = IMAGE_bits(&s, 1);
+        int type = IMAGE_bits(&s, 2);
+        int error = 0;
+        if (last < 0 || type < 0) {
+            return -1;
+        } else if (type == 0) {
+            // Bloque sin comprimir: empieza en el siguiente byte
+            s.bitBuf = 0;
+            s.bitCount = 0;
+            if (s.inPos + 4 > s.inSize) {
+                return -1;
+            }
+            size_t len = IMAGE_le16(s.in + s.inPos);
+            if (len != (~IMAGE_le16(s.in + s.inPos + 2) & 0xFFFF)) {
+                return -1;
+            }
+            s.inPos += 4;
+            if (len > s.inSize - s.inPos || len > s.outSize - s.outPos) {
+                return -1;
+            }
+            memcpy(s.out + s.outPos, s.in + s.inPos, len);
+            s.inPos += len;
+            s.outPos += len;
+        } else if (type == 1) {
+            uint8_t lengths[320];
+            ImageHuffman lencode, distcode;
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            IMAGE_buildHuffman(&lencode, lengths, 288);
+            memset(lengths, 5, 30);
+            IMAGE_buildHuffman(&distcode, lengths, 30);
+            error = IMAGE_inflateCodes(&s, &lencode, &distcode);
+        } else if (type == 2) {
+            error = IMAGE_inflateDynamic(&s);
+        } else {
+            return -1;
+        }
+        if (error != 0) {
+            return -1;
+        }
+    } while (!last);
+
+    return (long)s.outPos;
+}
+/**************************************************
+ *
+ * @Finalidad: Predictor Paeth de los filtros PNG.
+ * @Parametros: in: a = byte de la izquierda.
+ *              in: b = byte de arriba.
+ *              in: c = byte de arriba a la izquierda.
+ * @Retorno:    El que más se acerca a a + b - c.
+ *
+ **************************************************/
+static uint8_t IMAGE_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return (uint8_t)a;
+    }
+    return (uint8_t)(pb <= pc ? b : c);
+}
+/**************************************************
+ *
+ * @Finalidad: Deshacer los filtros PNG de cada fila, en el propio buffer.
+ * @Parametros: in/out: raw      = filas descomprimidas, cada una precedida
+ *                                 de su tipo de filtro.
+ *              in:     rowBytes = bytes de cada fila sin el tipo de filtro.
+ *              in:     height   = número de filas.
+ *              in:     bpp      = bytes por píxel (mínimo 1).
+ * @Retorno:    0 en caso de éxito; -1 si un filtro no es válido.
+ *
+ **************************************************/
+static int IMAGE_unfilterPng(uint8_t *raw, size_t rowBytes, long height, size_t bpp) {
+    for (long y = 0; y < height; y++) {
+        uint8_t *row = raw + (size_t)y * (rowBytes + 1) + 1;
+        const uint8_t *prev = y > 0 ? row - (rowBytes + 1) : NULL;
+        int filter = row[-1];
+
+        for (size_t i = 0; i < rowBytes; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = prev && i >= bpp ? prev[i - bpp] : 0;
+            switch (filter) {
+                case 0:
+                    break;
+                case 1:
+                    row[i] += (uint8_t)a;
+                    break;
+                case 2:
+                    row[i] += (uint8_t)b;
+                    break;
+                case 3:
+                    row[i] += (uint8_t)((a + b) / 2);
+                    break;
+                case 4:
+                    row[i] += IMAGE_paeth(a, b, c);
+                    break;
+                default:
+                    return -1;
+            }
+        }
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer una muestra de una fila PNG ya sin filtrar, de 1, 2, 4,
+ *             8 o 16 bits (de 16 bits se queda el byte alto).
+ * @Parametros: in: row   = fila.
+ *              in: index = número de muestra dentro de la fila.
+ *              in: depth = bits por muestra.
+ * @Retorno:    Valor de la muestra.
+ *
+ **************************************************/
+static int IMAGE_pngSample(const uint8_t *row, size_t index, int depth) {
+    if (depth == 8) {
+        return row[index];
+    } else if (depth == 16) {
+        return row[index * 2];
+    }
+    size_t bit = index * depth;
+    int shift = 8 - depth - (int)(bit % 8);
+    return (row[bit / 8] >> shift) & ((1 << depth) - 1);
+}
+/**************************************************
+ *
+ * @Finalidad: Leer una imagen PNG no entrelazada de cualquier tipo de
+ *             color y profundidad.
+ * @Parametros: in:  data  = contenido del fichero.
+ *              in:  size  = tamaño del fichero.
+ *              out: image = imagen leída.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_decodePng(const uint8_t *data, size_t size, Image *image) {
+    if (size < 8 || memcmp(data, IMAGE_pngSignature, 8) != 0) {
+        return ERROR_DECODING_IMAGE;
+    }
+
+    long width = 0, height = 0;
+    int depth = 0, colorType = -1, interlace = 0;
+    uint8_t palette[256][4];
+    int paletteSize = 0, paletteAlpha = 0;
+    uint8_t *idat = NULL;
+    size_t idatSize = 0;
+
+    memset(palette, 0xFF, sizeof(palette));
+    size_t pos = 8;
+    while (pos + 12 <= size) {
+        uint32_t length = IMAGE_be32(data + pos);
+        const uint8_t *type = data + pos + 4;
+        const uint8_t *chunk = data + pos + 8;
+        if (length > size - pos - 12) {
+            break;
+        }
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            width = IMAGE_be32(chunk);
+            height = IMAGE_be32(chunk + 4);
+            depth = chunk[8];
+            colorType = chunk[9];
+            interlace = chunk[12];
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            paletteSize = (int)(length / 3 > 256 ? 256 : length / 3);
+            for (int i = 0; i < paletteSize; i++) {
+                memcpy(palette[i], chunk + i * 3, 3);
+            }
+        } else if (memcmp(type, "tRNS", 4) == 0 && colorType == 3) {
+            for (uint32_t i = 0; i < length && i < 256; i++) {
+                palette[i][3] = chunk[i];
+            }
+            paletteAlpha = 1;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            uint8_t *grown = (uint8_t *)realloc(idat, idatSize + length + 1);
+            if (grown == NULL) {
+                free(idat);
+                return ERROR_MEM_ALLOC;
+            }
+            idat = grown;
+            memcpy(idat + idatSize, chunk, length);
+            idatSize += length;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + (size_t)length;
+    }
+
+    int samples = colorType == 0 ? 1 : colorType == 2 ? 3 : colorType == 3 ? 1 : colorType == 4 ? 2 : colorType == 6 ? 4 : 0;
+    int validDepth = (depth == 8) || (depth == 16 && colorType != 3) ||
+                     ((depth == 1 || depth == 2 || depth == 4) && (colorType == 0 || colorType == 3));
+    if (samples == 0 || !validDepth || interlace != 0 || (colorType == 3 && paletteSize == 0)) {
+        free(idat);
+        return colorType < 0 || idat == NULL ? ERROR_DECODING_IMAGE : ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    int channels = (colorType == 4 || colorType == 6 || paletteAlpha) ? 4 : 3;
+    int error = IMAGE_alloc(image, width, height, channels);
+    if (error != NO_ERROR) {
+        free(idat);
+        return error;
+    }
+
+    size_t rowBytes = ((size_t)width * samples * depth + 7) / 8;
+    size_t bpp = (size_t)samples * depth / 8 > 0 ? (size_t)samples * depth / 8 : 1;
+    size_t rawSize = (rowBytes + 1) * (size_t)height;
+    uint8_t *raw = (uint8_t *)malloc(rawSize);
+    if (raw == NULL) {
+        free(idat);
+        IMAGE_free(image);
+        return ERROR_MEM_ALLOC;
+    }
+    if (idat == NULL || IMAGE_inflate(idat, idatSize, raw, rawSize) != (long)rawSize ||
+        IMAGE_unfilterPng(raw, rowBytes, height, bpp) != 0) {
+        free(idat);
+        free(raw);
+        IMAGE_free(image);
+        return ERROR_DECODING_IMAGE;
+    }
+    free(idat);
+
+    int maxGray = depth < 8 ? (1 << depth) - 1 : 255;
+    for (long y = 0; y < height; y++) {
+        const uint8_t *row = raw + (size_t)y * (rowBytes + 1) + 1;
+        uint8_t *out = image->pixels + (size_t)y * width * channels;
+        for (long x = 0; x < width; x++) {
+            size_t s = (size_t)x * samples;
+            if (colorType == 3) {
+                memcpy(out, palette[IMAGE_pngSample(row, s, depth)], (size_t)channels);
+            } else if (colorType == 0 || colorType == 4) {
+                uint8_t gray = (uint8_t)(IMAGE_pngSample(row, s, depth) * 255 / maxGray);
+                out[0] = out[1] = out[2] = gray;
+                if (channels == 4) {
+                    out[3] = (uint8_t)IMAGE_pngSample(row, s + 1, depth);
+                }
+            } else {
+                for (int c = 0; c < channels; c++) {
+                    out[c] = (uint8_t)IMAGE_pngSample(row, s + c, depth);
+                }
+            }
+            out += channels;
+        }
+    }
+    free(raw);
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular la tabla de cosenos de la DCT de 8 puntos de JPEG,
+ *             ya multiplicados por sus factores de normalización.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_initJpeg(void) {
+    for (int x = 0; x < 8; x++) {
+        for (int u = 0; u < 8; u++) {
+            double scale = u == 0 ? sqrt(0.5) : 1.0;
+            IMAGE_dct[x][u] = (float)(scale * 0.5 * cos((2 * x + 1) * u * M_PI / 16));
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Construir una tabla de Huffman de JPEG para decodificar a
+ *             partir del número de códigos de cada longitud y los símbolos.
+ * @Parametros: out: h      = tabla.
+ *              in:  counts = códigos de cada longitud, de 1 a 16 bits.
+ *              in:  values = símbolos, en orden de código.
+ * @Retorno:    0 en caso de éxito; -1 si la tabla no es válida.
+ *
+ **************************************************/
+static int IMAGE_jpegBuildHuffman(ImageJpegHuffman *h, const uint8_t *counts, const uint8_t *values) {
+    int code = 0, k = 0;
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int length = 1; length <= 16; length++) {
+        h->valPtr[length] = k - code;
+        for (int i = 0; i < counts[length - 1]; i++, code++, k++) {
+            h->values[k] = values[k];
+            if (length <= IMAGE_JPEG_FAST_BITS) {
+                int shift = IMAGE_JPEG_FAST_BITS - length;
+                for (int j = 0; j < (1 << shift); j++) {
+                    h->fast[(code << shift) | j] = (uint16_t)((length << 8) | values[k]);
+                }
+            }
+        }
+        h->maxCode[length] = counts[length - 1] ? code - 1 : -1;
+        if (code > (1 << length)) {
+            return -1;
+        }
+        code <<= 1;
+    }
+    h->present = 1;
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Rellenar el buffer de bits de los datos comprimidos hasta
+ *             tener al menos 25 bits. Quita los 0x00 que siguen a cada 0xFF
+ *             y se para en el primer marcador, a partir del cual da ceros.
+ * @Parametros: in/out: j = estado de la decodificación.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegFill(ImageJpeg *j) {
+    while (j->bitCount <= 24) {
+        uint32_t byte = 0;
+        if (j->marker == 0 && j->pos < j->size) {
+            byte = j->data[j->pos];
+            if (byte != 0xFF) {
+                j->pos++;
+            } else if (j->pos + 1 < j->size && j->data[j->pos + 1] == 0x00) {
+                j->pos += 2;
+            } else {
+                // El marcador se queda sin leer para quien venga detrás
+                j->marker = j->pos + 1 < j->size ? j->data[j->pos + 1] : 0xD9;
+                byte = 0;
+            }
+        }
+        j->bitBuf |= byte << (24 - j->bitCount);
+        j->bitCount += 8;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Leer bits de los datos comprimidos, empezando por el más
+ *             significativo.
+ * @Parametros: in/out: j     = estado de la decodificación.
+ *              in:     count = número de bits (hasta 16).
+ * @Retorno:    Valor leído.
+ *
+ **************************************************/
+static int IMAGE_jpegBits(ImageJpeg *j, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    IMAGE_jpegFill(j);
+    int value = (int)(j->bitBuf >> (32 - count));
+    j->bitBuf <<= count;
+    j->bitCount -= count;
+    return value;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer un valor con signo de 'count' bits: los que empiezan
+ *             por 0 son negativos.
+ * @Parametros: in/out: j     = estado de la decodificación.
+ *              in:     count = número de bits (categoría del valor).
+ * @Retorno:    Valor leído.
+ *
+ **************************************************/
+static int IMAGE_jpegSigned(ImageJpeg *j, int count) {
+    int value = IMAGE_jpegBits(j, count);
+    if (count > 0 && value < (1 << (count - 1))) {
+        value += 1 - (1 << count);
+    }
+    return value;
+}
+/**************************************************
+ *
+ * @Finalidad: Decodificar un símbolo de Huffman.
+ * @Parametros: in/out: j = estado de la decodificación.
+ *              in:     h = tabla.
+ * @Retorno:    Símbolo; -1 si el código no existe.
+ *
+ **************************************************/
+static int IMAGE_jpegSymbol(ImageJpeg *j, const ImageJpegHuffman *h) {
+    IMAGE_jpegFill(j);
+    uint16_t entry = h->fast[j->bitBuf >> (32 - IMAGE_JPEG_FAST_BITS)];
+    if (entry != 0) {
+        j->bitBuf <<= entry >> 8;
+        j->bitCount -= entry >> 8;
+        return entry & 0xFF;
+    }
+    for (int length = IMAGE_JPEG_FAST_BITS + 1; length <= 16; length++) {
+        int32_t code = (int32_t)(j->bitBuf >> (32 - length));
+        if (code <= h->maxCode[length]) {
+            j->bitBuf <<= length;
+            j->bitCount -= length;
+            return h->values[h->valPtr[length] + code];
+        }
+    }
+    return -1;
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular la DCT inversa de un bloque de 8x8 coeficientes y
+ *             escribir las muestras, ya desplazadas a 0..255.
+ * @Parametros: in:  coef   = coeficientes en orden natural.
+ *              out: out    = primera muestra del bloque.
+ *              in:  stride = muestras por fila de out.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegIdct(const int32_t *coef, uint8_t *out, size_t stride) {
+    float tmp[64];
+
+    // Primero las filas (la mayoría solo tienen ceros) y después las columnas
+    for (int v = 0; v < 8; v++) {
+        const int32_t *row = coef + v * 8;
+        int zero = 1;
+        for (int u = 0; u < 8 && zero; u++) {
+            zero = row[u] == 0;
+        }
+        for (int x = 0; x < 8; x++) {
+            float sum = 0;
+            for (int u = 0; u < 8 && !zero; u++) {
+                sum += IMAGE_dct[x][u] * row[u];
+            }
+            tmp[v * 8 + x] = sum;
+        }
+    }
+    for (int x = 0; x < 8; x++) {
+        for (int y = 0; y < 8; y++) {
+            float sum = 128.5f;
+            for (int v = 0; v < 8; v++) {
+                sum += IMAGE_dct[y][v] * tmp[v * 8 + x];
+            }
+            out[y * stride + x] = sum <= 0 ? 0 : sum >= 255 ? 255 : (uint8_t)sum;
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Decodificar un bloque de 8x8 de una componente: coeficiente
+ *             DC (diferencia con el anterior) y AC, decuantización y DCT
+ *             inversa.
+ * @Parametros: in/out: j      = estado de la decodificación.
+ *              in/out: c      = componente.
+ *              out:    out    = primera muestra del bloque en el plano.
+ * @Retorno:    0 en caso de éxito; -1 si los datos no son válidos.
+ *
+ **************************************************/
+static int IMAGE_jpegBlock(ImageJpeg *j, ImageJpegComponent *c, uint8_t *out) {
+    const uint16_t *quant = j->quant[c->tq];
+    int32_t coef[64] = { 0 };
+
+    int category = IMAGE_jpegSymbol(j, &j->dc[c->td]);
+    if (category < 0 || category > 11) {
+        return -1;
+    }
+    c->dcPred += IMAGE_jpegSigned(j, category);
+    coef[0] = c->dcPred * quant[0];
+
+    int ac = 0;
+    for (int k = 1; k < 64; k++) {
+        int symbol = IMAGE_jpegSymbol(j, &j->ac[c->ta]);
+        if (symbol < 0) {
+            return -1;
+        }
+        int run = symbol >> 4, size = symbol & 15;
+        if (size == 0) {
+            if (run != 15) {
+                break;                  // Fin de bloque
+            }
+            k += 15;                    // 16 ceros
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            return -1;
+        }
+        coef[IMAGE_zigzag[k]] = IMAGE_jpegSigned(j, size) * quant[k];
+        ac = 1;
+    }
+
+    size_t stride = (size_t)c->blocksW * 8;
+    if (ac) {
+        IMAGE_jpegIdct(coef, out, stride);
+        return 0;
+    }
+    // Solo DC (lo habitual en zonas lisas): el bloque entero vale DC / 8,
+    // redondeado igual que en IMAGE_jpegIdct()
+    int value = (coef[0] + 128 * 8 + 4) >> 3;
+    value = value < 0 ? 0 : value > 255 ? 255 : value;
+    for (int y = 0; y < 8; y++) {
+        memset(out + y * stride, value, 8);
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Pasar un marcador de reinicio: se descartan los bits que
+ *             quedan, se salta el marcador y se reinician los DC.
+ * @Parametros: in/out: j = estado de la decodificación.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegRestart(ImageJpeg *j) {
+    j->bitBuf = 0;
+    j->bitCount = 0;
+    j->marker = 0;
+    while (j->pos + 1 < j->size && !(j->data[j->pos] == 0xFF && j->data[j->pos + 1] >= 0xD0 && j->data[j->pos + 1] <= 0xD7)) {
+        j->pos++;
+    }
+    j->pos += 2;
+    for (int i = 0; i < j->ncomp; i++) {
+        j->comp[i].dcPred = 0;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Leer la cabecera de un barrido (SOS) y decodificar sus datos,
+ *             que empiezan en j->pos. Con una sola componente los bloques
+ *             van uno a uno; con varias, por MCU.
+ * @Parametros: in/out: j      = estado de la decodificación.
+ *              in:     seg    = contenido del segmento SOS.
+ *              in:     segLen = tamaño del segmento.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_jpegScan(ImageJpeg *j, const uint8_t *seg, size_t segLen) {
+    ImageJpegComponent *scan[3];
+    int count = segLen > 0 ? seg[0] : 0;
+
+    if (count < 1 || count > j->ncomp || segLen < 4 + 2 * (size_t)count) {
+        return ERROR_DECODING_IMAGE;
+    }
+    for (int i = 0; i < count; i++) {
+        scan[i] = NULL;
+        for (int k = 0; k < j->ncomp; k++) {
+            if (j->comp[k].id == seg[1 + 2 * i]) {
+                scan[i] = &j->comp[k];
+            }
+        }
+        if (scan[i] == NULL) {
+            return ERROR_DECODING_IMAGE;
+        }
+        scan[i]->td = seg[2 + 2 * i] >> 4;
+        scan[i]->ta = seg[2 + 2 * i] & 15;
+        if (scan[i]->td > 3 || scan[i]->ta > 3 || !j->dc[scan[i]->td].present || !j->ac[scan[i]->ta].present) {
+            return ERROR_DECODING_IMAGE;
+        }
+        scan[i]->dcPred = 0;
+    }
+    const uint8_t *spectral = seg + 1 + 2 * count;
+    if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0) {
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    j->bitBuf = 0;
+    j->bitCount = 0;
+    j->marker = 0;
+
+    // Bloques (con una componente) o MCU que tiene el barrido
+    int unitsW = j->mcusX, unitsH = j->mcusY;
+    if (count == 1) {
+        int width = (j->width * scan[0]->h + j->hMax - 1) / j->hMax;
+        int height = (j->height * scan[0]->v + j->vMax - 1) / j->vMax;
+        unitsW = (width + 7) / 8;
+        unitsH = (height + 7) / 8;
+    }
+
+    long units = (long)unitsW * unitsH;
+    for (long unit = 0; unit < units; unit++) {
+        if (j->restartInterval > 0 && unit > 0 && unit % j->restartInterval == 0) {
+            IMAGE_jpegRestart(j);
+        }
+        int ux = (int)(unit % unitsW), uy = (int)(unit / unitsW);
+        for (int i = 0; i < count; i++) {
+            ImageJpegComponent *c = scan[i];
+            size_t stride = (size_t)c->blocksW * 8;
+            int blocksH = count == 1 ? 1 : c->h, blocksV = count == 1 ? 1 : c->v;
+
+            for (int by = 0; by < blocksV; by++) {
+                for (int bx = 0; bx < blocksH; bx++) {
+                    size_t x = (size_t)(ux * blocksH + bx) * 8, y = (size_t)(uy * blocksV + by) * 8;
+                    if (IMAGE_jpegBlock(j, c, c->plane + y * stride + x) != 0) {
+                        return ERROR_DECODING_IMAGE;
+                    }
+                }
+            }
+        }
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer la cabecera de la imagen (SOF0 o SOF1) y reservar el
+ *             plano de cada componente, redondeado a MCU enteros.
+ * @Parametros: in/out: j      = estado de la decodificación.
+ *              in:     seg    = contenido del segmento SOF.
+ *              in:     segLen = tamaño del segmento.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_jpegFrame(ImageJpeg *j, const uint8_t *seg, size_t segLen) {
+    if (segLen < 6) {
+        return ERROR_DECODING_IMAGE;
+    }
+    j->height = (int)IMAGE_be16(seg + 1);
+    j->width = (int)IMAGE_be16(seg + 3);
+    j->ncomp = seg[5];
+    if (seg[0] != 8 || j->height == 0 || (j->ncomp != 1 && j->ncomp != 3)) {
+        // Más de 8 bits, alto en un DNL posterior o CMYK
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+    if (j->width == 0 || segLen < 6 + 3 * (size_t)j->ncomp) {
+        return ERROR_DECODING_IMAGE;
+    }
+
+    j->hMax = j->vMax = 1;
+    for (int i = 0; i < j->ncomp; i++) {
+        ImageJpegComponent *c = &j->comp[i];
+        c->id = seg[6 + 3 * i];
+        c->h = seg[7 + 3 * i] >> 4;
+        c->v = seg[7 + 3 * i] & 15;
+        c->tq = seg[8 + 3 * i];
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->tq > 3) {
+            return ERROR_DECODING_IMAGE;
+        }
+        j->hMax = c->h > j->hMax ? c->h : j->hMax;
+        j->vMax = c->v > j->vMax ? c->v : j->vMax;
+    }
+    j->mcusX = (j->width + 8 * j->hMax - 1) / (8 * j->hMax);
+    j->mcusY = (j->height + 8 * j->vMax - 1) / (8 * j->vMax);
+
+    for (int i = 0; i < j->ncomp; i++) {
+        ImageJpegComponent *c = &j->comp[i];
+        c->blocksW = j->mcusX * c->h;
+        c->blocksH = j->mcusY * c->v;
+        c->plane = (uint8_t *)calloc((size_t)c->blocksW * 64, (size_t)c->blocksH);
+        if (c->plane == NULL) {
+            return ERROR_MEM_ALLOC;
+        }
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer las tablas de cuantización de un segmento DQT, de 8 o
+ *             16 bits, en orden zigzag.
+ * @Parametros: in/out: j      = estado de la decodificación.
+ *              in:     seg    = contenido del segmento.
+ *              in:     segLen = tamaño del segmento.
+ * @Retorno:    0 en caso de éxito; ERROR_DECODING_IMAGE si no es válido.
+ *
+ **************************************************/
+static int IMAGE_jpegQuant(ImageJpeg *j, const uint8_t *seg, size_t segLen) {
+    while (segLen > 0) {
+        int wide = seg[0] >> 4, table = seg[0] & 15;
+        size_t need = 1 + (wide ? 128 : 64);
+        if (table > 3 || wide > 1 || segLen < need) {
+            return ERROR_DECODING_IMAGE;
+        }
+        for (int k = 0; k < 64; k++) {
+            j->quant[table][k] = wide ? (uint16_t)IMAGE_be16(seg + 1 + 2 * k) : seg[1 + k];
+        }
+        seg += need;
+        segLen -= need;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer las tablas de Huffman de un segmento DHT.
+ * @Parametros: in/out: j      = estado de la decodificación.
+ *              in:     seg    = contenido del segmento.
+ *              in:     segLen = tamaño del segmento.
+ * @Retorno:    0 en caso de éxito; ERROR_DECODING_IMAGE si no es válido.
+ *
+ **************************************************/
+static int IMAGE_jpegHuffman(ImageJpeg *j, const uint8_t *seg, size_t segLen) {
+    while (segLen > 0) {
+        int type = seg[0] >> 4, table = seg[0] & 15;
+        if (type > 1 || table > 3 || segLen < 17) {
+            return ERROR_DECODING_IMAGE;
+        }
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) {
+            total += seg[1 + i];
+        }
+        if (total > 256 || segLen < 17 + total) {
+            return ERROR_DECODING_IMAGE;
+        }
+        ImageJpegHuffman *h = type ? &j->ac[table] : &j->dc[table];
+        if (IMAGE_jpegBuildHuffman(h, seg + 1, seg + 17) != 0) {
+            return ERROR_DECODING_IMAGE;
+        }
+        seg += 17 + total;
+        segLen -= 17 + total;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Pasar los planos decodificados a una imagen RGB: las
+ *             componentes submuestreadas se repiten y YCbCr se convierte a
+ *             RGB (salvo que una marca de Adobe diga que ya es RGB).
+ * @Parametros: in:  j     = estado de la decodificación.
+ *              out: image = imagen.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_jpegToRgb(const ImageJpeg *j, Image *image) {
+    int error = IMAGE_alloc(image, j->width, j->height, 3);
+    if (error != NO_ERROR) {
+        return error;
+    }
+    // Columna del plano de cada componente que toca a cada píxel
+    int *columns = (int *)malloc(sizeof(int) * 3 * j->width);
+    if (columns == NULL) {
+        IMAGE_free(image);
+        return ERROR_MEM_ALLOC;
+    }
+    for (int i = 0; i < j->ncomp; i++) {
+        for (int x = 0; x < j->width; x++) {
+            columns[i * j->width + x] = x * j->comp[i].h / j->hMax;
+        }
+    }
+    const int *cols0 = columns, *cols1 = columns + j->width, *cols2 = columns + 2 * j->width;
+
+    uint8_t *out = image->pixels;
+    for (int y = 0; y < j->height; y++) {
+        const uint8_t *rows[3];
+        for (int i = 0; i < j->ncomp; i++) {
+            const ImageJpegComponent *c = &j->comp[i];
+            rows[i] = c->plane + (size_t)(y * c->v / j->vMax) * c->blocksW * 8;
+        }
+        for (int x = 0; x < j->width; x++, out += 3) {
+            if (j->ncomp == 1) {
+                out[0] = out[1] = out[2] = rows[0][cols0[x]];
+                continue;
+            }
+            int y0 = rows[0][cols0[x]], cb = rows[1][cols1[x]], cr = rows[2][cols2[x]];
+            if (j->adobeTransform == 0) {
+                out[0] = (uint8_t)y0;
+                out[1] = (uint8_t)cb;
+                out[2] = (uint8_t)cr;
+                continue;
+            }
+            // Coeficientes de JFIF en coma fija de 16 bits
+            cb -= 128;
+            cr -= 128;
+            int r = y0 + ((91881 * cr + 32768) >> 16);
+            int g = y0 - ((22554 * cb + 46802 * cr + 32768) >> 16);
+            int b = y0 + ((116130 * cb + 32768) >> 16);
+            out[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+            out[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+            out[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+        }
+    }
+    free(columns);
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer un JPEG secuencial (baseline o extendido de 8 bits) con
+ *             codificación de Huffman, en gris o YCbCr con cualquier
+ *             submuestreo y con o sin marcadores de reinicio.
+ * @Parametros: in:  data  = contenido del fichero.
+ *              in:  size  = tamaño del fichero.
+ *              out: image = imagen leída (RGB).
+ * @Retorno:    0 en caso de éxito; ERROR_UNSUPPORTED_FORMAT con JPEG
+ *              progresivo, sin pérdidas, aritmético, CMYK o de 12 bits;
+ *              <0 si ocurrió algún otro error.
+ *
+ **************************************************/
+static int IMAGE_decodeJpeg(const uint8_t *data, size_t size, Image *image) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return ERROR_DECODING_IMAGE;
+    }
+    pthread_once(&IMAGE_jpegOnce, IMAGE_initJpeg);
+    ImageJpeg *j = (ImageJpeg *)calloc(1, sizeof(ImageJpeg));
+    if (j == NULL) {
+        return ERROR_MEM_ALLOC;
+    }
+    j->data = data;
+    j->size = size;
+    j->adobeTransform = -1;
+
+    int error = NO_ERROR, frame = 0, scans = 0;
+    size_t pos = 2;
+    while (error == NO_ERROR) {
+        // Siguiente marcador, saltando los 0xFF de relleno
+        while (pos < size && data[pos] != 0xFF) {
+            pos++;
+        }
+        while (pos < size && data[pos] == 0xFF) {
+            pos++;
+        }
+        if (pos >= size) {
+            break;                      // Sin EOI: vale lo que se haya leído
+        }
+        int marker = data[pos++];
+        if (marker == 0xD9) {
+            break;
+        }
+        if (marker == 0x00 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            continue;                   // Marcadores sin segmento
+        }
+        if (pos + 2 > size || IMAGE_be16(data + pos) < 2 || pos + IMAGE_be16(data + pos) > size) {
+            error = ERROR_DECODING_IMAGE;
+            break;
+        }
+        size_t length = IMAGE_be16(data + pos);
+        const uint8_t *seg = data + pos + 2;
+        size_t segLen = length - 2;
+
+        switch (marker) {
+            case 0xDB:
+                error = IMAGE_jpegQuant(j, seg, segLen);
+                break;
+            case 0xC4:
+                error = IMAGE_jpegHuffman(j, seg, segLen);
+                break;
+            case 0xC0:
+            case 0xC1:
+                error = frame ? ERROR_DECODING_IMAGE : IMAGE_jpegFrame(j, seg, segLen);
+                frame = 1;
+                break;
+            case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                error = ERROR_UNSUPPORTED_FORMAT;
+                break;
+            case 0xDD:
+                j->restartInterval = segLen >= 2 ? (int)IMAGE_be16(seg) : 0;
+                break;
+            case 0xEE:
+                if (segLen >= 12 && memcmp(seg, "Adobe", 5) == 0) {
+                    j->adobeTransform = seg[11];
+                }
+                break;
+            case 0xDA:
+                if (!frame) {
+                    error = ERROR_DECODING_IMAGE;
+                    break;
+                }
+                // Los datos comprimidos siguen al segmento y acaban en un marcador
+                j->pos = pos + length;
+                error = IMAGE_jpegScan(j, seg, segLen);
+                pos = j->pos;
+                length = 0;
+                scans++;
+                break;
+        }
+        pos += length;
+    }
+
+    if (error == NO_ERROR && scans == 0) {
+        error = ERROR_DECODING_IMAGE;
+    }
+    if (error == NO_ERROR) {
+        error = IMAGE_jpegToRgb(j, image);
+    }
+    for (int i = 0; i < 3; i++) {
+        free(j->comp[i].plane);
+    }
+    free(j);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer una imagen del formato indicado.
+ * @Parametros: in:  data   = contenido del fichero.
+ *              in:  size   = tamaño del fichero.
+ *              in:  format = formato del fichero.
+ *              out: image  = imagen leída.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error
+ *              (ERROR_UNSUPPORTED_FORMAT si la variante no se soporta).
+ *
+ **************************************************/
+int IMAGE_decode(const uint8_t *data, size_t size, ImageFormat format, Image *image) {
+    switch (format) {
+        case IMAGE_FORMAT_BMP:
+            return IMAGE_decodeBmp(data, size, image);
+        case IMAGE_FORMAT_TGA:
+            return IMAGE_decodeTga(data, size, image);
+        case IMAGE_FORMAT_PNG:
+            return IMAGE_decodePng(data, size, image);
+        case IMAGE_FORMAT_JPEG:
+            return IMAGE_decodeJpeg(data, size, image);
+    }
+    return ERROR_UNSUPPORTED_FORMAT;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Calcular la tabla del CRC-32 de los bloques PNG.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_initCrc(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        IMAGE_crcTable[n] = c;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un bloque PNG (longitud, tipo, datos y CRC) a la salida.
+ * @Parametros: out: p      = destino; debe tener sitio para length + 12 bytes.
+ *              in:  type   = tipo del bloque (4 letras).
+ *              in:  chunk  = datos del bloque, o NULL si ya están en p + 8.
+ *              in:  length = tamaño de los datos.
+ * @Retorno:    Bytes escritos.
+ *
+ **************************************************/
+static size_t IMAGE_putPngChunk(uint8_t *p, const char *type, const uint8_t *chunk, size_t length) {
+    IMAGE_putBe32(p, (uint32_t)length);
+    memcpy(p + 4, type, 4);
+    if (chunk != NULL) {
+        memcpy(p + 8, chunk, length);
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 4; i < length + 8; i++) {
+        crc = IMAGE_crcTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    IMAGE_putBe32(p + 8 + length, crc ^ 0xFFFFFFFFu);
+    return length + 12;
+}
+/**************************************************
+ *
+ * @Finalidad: Invertir el orden de los bits de un código de Huffman, que
+ *             deflate escribe empezando por el más significativo.
+ * @Parametros: in: code   = código.
+ *              in: length = bits del código.
+ * @Retorno:    Código invertido.
+ *
+ **************************************************/
+static uint32_t IMAGE_reverseBits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular los códigos de Huffman fijos de deflate, ya
+ *             invertidos, y el símbolo de cada longitud de coincidencia.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_initDeflate(void) {
+    for (int i = 0; i < 288; i++) {
+        if (i < 144) {
+            IMAGE_fixedLength[i] = 8;
+            IMAGE_fixedCode[i] = (uint16_t)IMAGE_reverseBits(0x30 + i, 8);
+        } else if (i < 256) {
+            IMAGE_fixedLength[i] = 9;
+            IMAGE_fixedCode[i] = (uint16_t)IMAGE_reverseBits(0x190 + i - 144, 9);
+        } else if (i < 280) {
+            IMAGE_fixedLength[i] = 7;
+            IMAGE_fixedCode[i] = (uint16_t)IMAGE_reverseBits(i - 256, 7);
+        } else {
+            IMAGE_fixedLength[i] = 8;
+            IMAGE_fixedCode[i] = (uint16_t)IMAGE_reverseBits(0xC0 + i - 280, 8);
+        }
+    }
+    for (int i = 0; i < 30; i++) {
+        IMAGE_fixedDistCode[i] = (uint8_t)IMAGE_reverseBits(i, 5);
+    }
+    for (int code = 0; code < 29; code++) {
+        int last = code == 28 ? 258 : IMAGE_lengthBase[code] + (1 << IMAGE_lengthExtra[code]) - 1;
+        for (int len = IMAGE_lengthBase[code]; len <= last; len++) {
+            IMAGE_lengthSymbol[len] = (uint8_t)code;
+        }
+    }
+    // 258 tiene su propio código aunque cabría en el 27 con extra 31
+    IMAGE_lengthSymbol[258] = 28;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir bits al flujo deflate, empezando por el menos
+ *             significativo.
+ * @Parametros: in/out: s     = estado de la compresión.
+ *              in:     bits  = valor a escribir.
+ *              in:     count = número de bits (hasta 16).
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_putBits(ImageDeflate *s, uint32_t bits, int count) {
+    s->bitBuf |= (uint64_t)bits << s->bitCount;
+    s->bitCount += count;
+    while (s->bitCount >= 8) {
+        s->out[s->outPos++] = (uint8_t)s->bitBuf;
+        s->bitBuf >>= 8;
+        s->bitCount -= 8;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una coincidencia (longitud y distancia) con los
+ *             códigos fijos.
+ * @Parametros: in/out: s        = estado de la compresión.
+ *              in:     length   = longitud (3 a 258).
+ *              in:     distance = distancia hacia atrás (1 a 32768).
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_putMatch(ImageDeflate *s, int length, int distance) {
+    int code = IMAGE_lengthSymbol[length];
+    IMAGE_putBits(s, IMAGE_fixedCode[257 + code], IMAGE_fixedLength[257 + code]);
+    IMAGE_putBits(s, (uint32_t)(length - IMAGE_lengthBase[code]), IMAGE_lengthExtra[code]);
+
+    // Los códigos de distancia van de dos en dos por cada bit de más
+    int d = distance - 1;
+    if (d < 4) {
+        code = d;
+    } else {
+        int bits = 31 - __builtin_clz((unsigned)d);
+        code = 2 * bits + ((d >> (bits - 1)) & 1);
+    }
+    IMAGE_putBits(s, IMAGE_fixedDistCode[code], 5);
+    IMAGE_putBits(s, (uint32_t)(distance - IMAGE_distBase[code]), IMAGE_distExtra[code]);
+}
+/**************************************************
+ *
+ * @Finalidad: Comprimir un bloque en formato zlib: un solo bloque deflate
+ *             con códigos de Huffman fijos, y LZ77 con una tabla hash de
+ *             cadenas de 3 bytes que busca la coincidencia más larga en
+ *             las últimas IMAGE_DEFLATE_CHAIN posiciones con el mismo hash.
+ * @Parametros: in:  in   = datos.
+ *              in:  size = tamaño de los datos.
+ *              out: out  = destino; debe tener IMAGE_deflateBound(size) bytes.
+ * @Retorno:    Bytes escritos; -1 si no hay memoria.
+ *
+ **************************************************/
+static long IMAGE_deflate(const uint8_t *in, size_t size, uint8_t *out) {
+    pthread_once(&IMAGE_deflateOnce, IMAGE_initDeflate);
+
+    int64_t *head = (int64_t *)malloc(sizeof(int64_t) << IMAGE_DEFLATE_HASH_BITS);
+    int64_t *prev = (int64_t *)malloc(sizeof(int64_t) * IMAGE_DEFLATE_WINDOW);
+    if (head == NULL || prev == NULL) {
+        free(head);
+        free(prev);
+        return -1;
+    }
+    memset(head, 0xFF, sizeof(int64_t) << IMAGE_DEFLATE_HASH_BITS);
+
+    ImageDeflate s = { out, 0, 0, 0 };
+    out[s.outPos++] = 0x78;
+    out[s.outPos++] = 0x01;
+    IMAGE_putBits(&s, 1, 1);            // Último bloque
+    IMAGE_putBits(&s, 1, 2);            // Códigos fijos
+
+    size_t pos = 0;
+    while (pos < size) {
+        int bestLen = 0, bestDist = 0;
+
+        if (pos + 3 <= size) {
+            int max = size - pos < 258 ? (int)(size - pos) : 258;
+            int nice = max < IMAGE_DEFLATE_NICE ? max : IMAGE_DEFLATE_NICE;
+            int64_t candidate = head[IMAGE_hash3(in + pos)];
+
+            for (int chain = IMAGE_DEFLATE_CHAIN; candidate >= 0 && chain > 0; chain--) {
+                if ((int64_t)pos - candidate > IMAGE_DEFLATE_WINDOW) {
+                    break;
+                }
+                const uint8_t *a = in + candidate, *b = in + pos;
+                if (a[bestLen] == b[bestLen] && a[0] == b[0]) {
+                    int len = 1;
+                    while (len < max && a[len] == b[len]) {
+                        len++;
+                    }
+                    if (len > bestLen) {
+                        bestLen = len;
+                        bestDist = (int)(pos - candidate);
+                        if (len >= nice) {
+                            break;
+                        }
+                    }
+                }
+                candidate = prev[candidate & (IMAGE_DEFLATE_WINDOW - 1)];
+            }
+        }
+
+        size_t next = pos + 1;
+        if (bestLen >= 3) {
+            IMAGE_putMatch(&s, bestLen, bestDist);
+            next = pos + bestLen;
+        } else {
+            IMAGE_putBits(&s, IMAGE_fixedCode[in[pos]], IMAGE_fixedLength[in[pos]]);
+        }
+        // Todas las posiciones recorridas entran en la tabla hash
+        for (; pos < next; pos++) {
+            if (pos + 3 <= size) {
+                uint32_t hash = IMAGE_hash3(in + pos);
+                prev[pos & (IMAGE_DEFLATE_WINDOW - 1)] = head[hash];
+                head[hash] = (int64_t)pos;
+            }
+        }
+    }
+    free(head);
+    free(prev);
+
+    IMAGE_putBits(&s, IMAGE_fixedCode[256], IMAGE_fixedLength[256]);
+    if (s.bitCount > 0) {
+        IMAGE_putBits(&s, 0, 8 - s.bitCount);
+    }
+
+    // Adler-32, reduciendo módulo 65521 cada 5552 bytes (no desborda antes)
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size;) {
+        size_t end = size - i < 5552 ? size : i + 5552;
+        for (; i < end; i++) {
+            a += in[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    IMAGE_putBe32(out + s.outPos, (b << 16) | a);
+    return (long)(s.outPos + 4);
+}
+/**************************************************
+ *
+ * @Finalidad: Aplicar un filtro PNG a una fila.
+ * @Parametros: out: dst      = fila filtrada (sin el tipo de filtro).
+ *              in:  row      = fila de la imagen.
+ *              in:  prev     = fila anterior, o NULL en la primera.
+ *              in:  rowBytes = bytes de la fila.
+ *              in:  bpp      = bytes por píxel.
+ *              in:  filter   = tipo de filtro (0 a 4).
+ * @Retorno:    Suma de los valores absolutos de los bytes filtrados, vistos
+ *              con signo: cuanto menor, mejor se comprime la fila.
+ *
+ **************************************************/
+static uint64_t IMAGE_filterRow(uint8_t *dst, const uint8_t *row, const uint8_t *prev, size_t rowBytes, size_t bpp, int filter) {
+    uint64_t cost = 0;
+
+    for (size_t i = 0; i < rowBytes; i++) {
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int b = prev ? prev[i] : 0;
+        int c = prev && i >= bpp ? prev[i - bpp] : 0;
+        uint8_t predicted = 0;
+        switch (filter) {
+            case 1:
+                predicted = (uint8_t)a;
+                break;
+            case 2:
+                predicted = (uint8_t)b;
+                break;
+            case 3:
+                predicted = (uint8_t)((a + b) / 2);
+                break;
+            case 4:
+                predicted = IMAGE_paeth(a, b, c);
+                break;
+        }
+        dst[i] = (uint8_t)(row[i] - predicted);
+        cost += (uint64_t)abs((int8_t)dst[i]);
+    }
+    return cost;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una imagen como PNG RGB o RGBA de 8 bits. Cada fila
+ *             lleva el filtro que deja los bytes más cerca de cero y el
+ *             resultado se comprime con IMAGE_deflate().
+ * @Parametros: in:  image = imagen.
+ *              out: data  = fichero generado (memoria dinámica).
+ *              out: size  = tamaño del fichero.
+ * @Retorno:    0 en caso de éxito; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+static int IMAGE_encodePng(const Image *image, uint8_t **data, size_t *size) {
+    pthread_once(&IMAGE_crcOnce, IMAGE_initCrc);
+
+    size_t rowBytes = (size_t)image->width * image->channels;
+    size_t rawSize = (rowBytes + 1) * image->height;
+    uint8_t *raw = (uint8_t *)malloc(rawSize + rowBytes);
+    uint8_t *out = (uint8_t *)malloc(8 + 25 + 12 + IMAGE_deflateBound(rawSize) + 12);
+    if (raw == NULL || out == NULL) {
+        free(raw);
+        free(out);
+        return ERROR_MEM_ALLOC;
+    }
+
+    // Se prueba cada filtro en el buffer del final y el mejor se copia a
+    // su fila
+    uint8_t *scratch = raw + rawSize;
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *row = image->pixels + (size_t)y * rowBytes;
+        const uint8_t *prev = y > 0 ? row - rowBytes : NULL;
+        uint8_t *dst = raw + (size_t)y * (rowBytes + 1);
+        uint64_t best = UINT64_MAX;
+
+        for (int filter = 0; filter < 5; filter++) {
+            uint64_t cost = IMAGE_filterRow(scratch, row, prev, rowBytes, image->channels, filter);
+            if (cost < best) {
+                best = cost;
+                dst[0] = (uint8_t)filter;
+                memcpy(dst + 1, scratch, rowBytes);
+            }
+        }
+    }
+
+    size_t pos = 0;
+    memcpy(out, IMAGE_pngSignature, 8);
+    pos += 8;
+    uint8_t header[13];
+    IMAGE_putBe32(header, (uint32_t)image->width);
+    IMAGE_putBe32(header + 4, (uint32_t)image->height);
+    header[8] = 8;
+    header[9] = image->channels == 4 ? 6 : 2;
+    header[10] = header[11] = header[12] = 0;
+    pos += IMAGE_putPngChunk(out + pos, "IHDR", header, 13);
+
+    // El flujo zlib se escribe directamente dentro del bloque IDAT
+    long zlibSize = IMAGE_deflate(raw, rawSize, out + pos + 8);
+    free(raw);
+    if (zlibSize < 0) {
+        free(out);
+        return ERROR_MEM_ALLOC;
+    }
+    pos += IMAGE_putPngChunk(out + pos, "IDAT", NULL, (size_t)zlibSize);
+    pos += IMAGE_putPngChunk(out + pos, "IEND", NULL, 0);
+
+    *data = out;
+    *size = pos;
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una imagen como BMP sin comprimir de 24 bits (RGB)
+ *             o 32 bits (RGBA), con las filas de abajo arriba.
+ * @Parametros: in:  image = imagen.
+ *              out: data  = fichero generado (memoria dinámica).
+ *              out: size  = tamaño del fichero.
+ * @Retorno:    0 en caso de éxito; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+static int IMAGE_encodeBmp(const Image *image, uint8_t **data, size_t *size) {
+    size_t stride = (((size_t)image->width * image->channels * 8 + 31) / 32) * 4;
+    size_t total = 54 + stride * image->height;
+    uint8_t *out = (uint8_t *)calloc(1, total);
+    if (out == NULL) {
+        return ERROR_MEM_ALLOC;
+    }
+
+    out[0] = 'B';
+    out[1] = 'M';
+    IMAGE_putLe32(out + 2, (uint32_t)total);
+    IMAGE_putLe32(out + 10, 54);
+    IMAGE_putLe32(out + 14, 40);
+    IMAGE_putLe32(out + 18, (uint32_t)image->width);
+    IMAGE_putLe32(out + 22, (uint32_t)image->height);
+    IMAGE_putLe16(out + 26, 1);
+    IMAGE_putLe16(out + 28, (uint32_t)image->channels * 8);
+    IMAGE_putLe32(out + 34, (uint32_t)(stride * image->height));
+    IMAGE_putLe32(out + 38, 2835);      // 72 ppp
+    IMAGE_putLe32(out + 42, 2835);
+
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *src = image->pixels + (size_t)y * image->width * image->channels;
+        uint8_t *row = out + 54 + stride * (size_t)(image->height - 1 - y);
+        for (int x = 0; x < image->width; x++) {
+            row[0] = src[2];
+            row[1] = src[1];
+            row[2] = src[0];
+            if (image->channels == 4) {
+                row[3] = src[3];
+            }
+            row += image->channels;
+            src += image->channels;
+        }
+    }
+    *data = out;
+    *size = total;
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una imagen como TGA sin comprimir de 24 o 32 bits,
+ *             con las filas de arriba abajo.
+ * @Parametros: in:  image = imagen.
+ *              out: data  = fichero generado (memoria dinámica).
+ *              out: size  = tamaño del fichero.
+ * @Retorno:    0 en caso de éxito; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+static int IMAGE_encodeTga(const Image *image, uint8_t **data, size_t *size) {
+    size_t pixels = (size_t)image->width * image->height;
+    size_t total = 18 + pixels * image->channels;
+    uint8_t *out = (uint8_t *)calloc(1, total);
+    if (out == NULL) {
+        return ERROR_MEM_ALLOC;
+    }
+
+    out[2] = 2;
+    IMAGE_putLe16(out + 12, (uint32_t)image->width);
+    IMAGE_putLe16(out + 14, (uint32_t)image->height);
+    out[16] = (uint8_t)(image->channels * 8);
+    out[17] = (uint8_t)(0x20 | (image->channels == 4 ? 8 : 0));
+
+    const uint8_t *src = image->pixels;
+    uint8_t *dst = out + 18;
+    for (size_t i = 0; i < pixels; i++) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        if (image->channels == 4) {
+            dst[3] = src[3];
+        }
+        dst += image->channels;
+        src += image->channels;
+    }
+    *data = out;
+    *size = total;
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un byte al JPEG que se está escribiendo, ampliando el
+ *             buffer si hace falta.
+ * @Parametros: in/out: w    = estado de la escritura.
+ *              in:     byte = byte a añadir.
+ * @Retorno:    ----. Si no hay memoria se marca w->error.
+ *
+ **************************************************/
+static void IMAGE_jpegPutByte(ImageJpegWriter *w, uint8_t byte) {
+    if (w->size == w->capacity) {
+        size_t capacity = w->capacity * 2;
+        uint8_t *out = (uint8_t *)realloc(w->out, capacity);
+        if (out == NULL) {
+            w->error = ERROR_MEM_ALLOC;
+            return;
+        }
+        w->out = out;
+        w->capacity = capacity;
+    }
+    w->out[w->size++] = byte;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un segmento de cabecera: marcador, longitud y datos.
+ * @Parametros: in/out: w      = estado de la escritura.
+ *              in:     marker = segundo byte del marcador.
+ *              in:     seg    = datos del segmento.
+ *              in:     segLen = tamaño de los datos.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegPutSegment(ImageJpegWriter *w, uint8_t marker, const uint8_t *seg, size_t segLen) {
+    IMAGE_jpegPutByte(w, 0xFF);
+    IMAGE_jpegPutByte(w, marker);
+    IMAGE_jpegPutByte(w, (uint8_t)((segLen + 2) >> 8));
+    IMAGE_jpegPutByte(w, (uint8_t)(segLen + 2));
+    for (size_t i = 0; i < segLen; i++) {
+        IMAGE_jpegPutByte(w, seg[i]);
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir bits a los datos comprimidos, empezando por el más
+ *             significativo, con un 0x00 detrás de cada 0xFF.
+ * @Parametros: in/out: w     = estado de la escritura.
+ *              in:     bits  = valor a escribir.
+ *              in:     count = número de bits (hasta 16).
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegPutBits(ImageJpegWriter *w, uint32_t bits, int count) {
+    w->bitBuf = (w->bitBuf << count) | (bits & ((1u << count) - 1));
+    w->bitCount += count;
+    while (w->bitCount >= 8) {
+        uint8_t byte = (uint8_t)(w->bitBuf >> (w->bitCount - 8));
+        IMAGE_jpegPutByte(w, byte);
+        if (byte == 0xFF) {
+            IMAGE_jpegPutByte(w, 0x00);
+        }
+        w->bitCount -= 8;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular los códigos de una tabla de Huffman de JPEG a
+ *             partir del número de códigos de cada longitud y los símbolos.
+ * @Parametros: out: table  = código y longitud de cada símbolo.
+ *              in:  counts = códigos de cada longitud, de 1 a 16 bits.
+ *              in:  values = símbolos, en orden de código.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegBuildCode(ImageJpegCode *table, const uint8_t *counts, const uint8_t *values) {
+    int code = 0, k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < counts[length - 1]; i++, code++, k++) {
+            table->code[values[k]] = (uint16_t)code;
+            table->length[values[k]] = (uint8_t)length;
+        }
+        code <<= 1;
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Leer un bloque de 8x8 muestras de una componente de la
+ *             imagen, convertida a YCbCr y centrada en 0. Con submuestreo
+ *             cada muestra es la media de 'sub' x 'sub' píxeles; fuera de
+ *             la imagen se repite el último píxel.
+ * @Parametros: in:  image     = imagen.
+ *              in:  component = 0 (Y), 1 (Cb) o 2 (Cr).
+ *              in:  x0, y0    = primera muestra del bloque en la componente.
+ *              in:  sub       = submuestreo de la componente (1 o 2).
+ *              out: block     = muestras del bloque.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegFetch(const Image *image, int component, int x0, int y0, int sub, float *block) {
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0;
+            for (int dy = 0; dy < sub; dy++) {
+                int py = (y0 + y) * sub + dy;
+                py = py < image->height ? py : image->height - 1;
+                for (int dx = 0; dx < sub; dx++) {
+                    int px = (x0 + x) * sub + dx;
+                    px = px < image->width ? px : image->width - 1;
+                    const uint8_t *p = image->pixels + ((size_t)py * image->width + px) * image->channels;
+                    switch (component) {
+                        case 0:
+                            sum += 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+                            break;
+                        case 1:
+                            sum += -0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2] + 128;
+                            break;
+                        default:
+                            sum += 0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2] + 128;
+                            break;
+                    }
+                }
+            }
+            block[y * 8 + x] = sum / (sub * sub) - 128;
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular la categoría de un coeficiente: los bits de su
+ *             valor absoluto.
+ * @Parametros: in: value = coeficiente.
+ * @Retorno:    Categoría (0 si el coeficiente es 0).
+ *
+ **************************************************/
+static int IMAGE_jpegCategory(int value) {
+    unsigned magnitude = (unsigned)(value < 0 ? -value : value);
+    return magnitude ? 32 - __builtin_clz(magnitude) : 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Comprimir un bloque de 8x8 muestras: DCT, cuantización y
+ *             codificación de Huffman del DC (diferencia con el anterior)
+ *             y de las series de ceros y valores AC.
+ * @Parametros: in/out: w      = estado de la escritura.
+ *              in:     block  = muestras centradas en 0.
+ *              in:     quant  = tabla de cuantización en orden zigzag.
+ *              in:     dc, ac = tablas de Huffman de la componente.
+ *              in/out: dcPred = DC del bloque anterior de la componente.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_jpegEncodeBlock(ImageJpegWriter *w, const float *block, const uint8_t *quant, const ImageJpegCode *dc,
+                                  const ImageJpegCode *ac, int *dcPred) {
+    float tmp[64], coef[64];
+    int values[64];
+
+    // DCT por filas y por columnas: la matriz es ortonormal, así que es la
+    // traspuesta de la que usa la inversa
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int x = 0; x < 8; x++) {
+                sum += IMAGE_dct[x][u] * block[y * 8 + x];
+            }
+            tmp[y * 8 + u] = sum;
+        }
+    }
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            float sum = 0;
+            for (int y = 0; y < 8; y++) {
+                sum += IMAGE_dct[y][v] * tmp[y * 8 + u];
+            }
+            coef[v * 8 + u] = sum;
+        }
+    }
+    for (int k = 0; k < 64; k++) {
+        float value = coef[IMAGE_zigzag[k]] / quant[k];
+        values[k] = value >= 0 ? (int)(value + 0.5f) : -(int)(0.5f - value);
+    }
+
+    // Los negativos van como su complemento a uno en 'category' bits
+    int diff = values[0] - *dcPred;
+    int category = IMAGE_jpegCategory(diff);
+    IMAGE_jpegPutBits(w, dc->code[category], dc->length[category]);
+    IMAGE_jpegPutBits(w, (uint32_t)(diff < 0 ? diff - 1 : diff), category);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        if (values[k] == 0) {
+            run++;
+            continue;
+        }
+        for (; run > 15; run -= 16) {
+            IMAGE_jpegPutBits(w, ac->code[0xF0], ac->length[0xF0]);
+        }
+        category = IMAGE_jpegCategory(values[k]);
+        int symbol = (run << 4) | category;
+        IMAGE_jpegPutBits(w, ac->code[symbol], ac->length[symbol]);
+        IMAGE_jpegPutBits(w, (uint32_t)(values[k] < 0 ? values[k] - 1 : values[k]), category);
+        run = 0;
+    }
+    if (run > 0) {
+        IMAGE_jpegPutBits(w, ac->code[0x00], ac->length[0x00]);     // Fin de bloque
+    }
+    *dcPred = values[0];
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una imagen como JPEG baseline de calidad
+ *             IMAGE_JPEG_QUALITY: en gris si todos los píxeles lo son y si
+ *             no en YCbCr 4:2:0. El canal alfa se pierde.
+ * @Parametros: in:  image = imagen.
+ *              out: data  = fichero generado (memoria dinámica).
+ *              out: size  = tamaño del fichero.
+ * @Retorno:    0 en caso de éxito; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+static int IMAGE_encodeJpeg(const Image *image, uint8_t **data, size_t *size) {
+    pthread_once(&IMAGE_jpegOnce, IMAGE_initJpeg);
+
+    size_t pixels = (size_t)image->width * image->height;
+    int gray = 1;
+    for (size_t i = 0; i < pixels && gray; i++) {
+        const uint8_t *p = image->pixels + i * image->channels;
+        gray = p[0] == p[1] && p[1] == p[2];
+    }
+    int ncomp = gray ? 1 : 3, tables = gray ? 1 : 2;
+
+    ImageJpegWriter w = { NULL, 0, 4096 + pixels / 2, 0, 0, NO_ERROR };
+    w.out = (uint8_t *)malloc(w.capacity);
+    if (w.out == NULL) {
+        return ERROR_MEM_ALLOC;
+    }
+
+    IMAGE_jpegPutByte(&w, 0xFF);
+    IMAGE_jpegPutByte(&w, 0xD8);
+    static const uint8_t jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    IMAGE_jpegPutSegment(&w, 0xE0, jfif, sizeof(jfif));
+
+    // Tablas de cuantización del estándar escaladas como las de IJG
+    int scale = IMAGE_JPEG_QUALITY < 50 ? 5000 / IMAGE_JPEG_QUALITY : 200 - 2 * IMAGE_JPEG_QUALITY;
+    uint8_t quant[2][64], dqt[2 * 65];
+    for (int t = 0; t < tables; t++) {
+        dqt[t * 65] = (uint8_t)t;
+        for (int k = 0; k < 64; k++) {
+            int value = (IMAGE_jpegQuantBase[t][IMAGE_zigzag[k]] * scale + 50) / 100;
+            quant[t][k] = (uint8_t)(value < 1 ? 1 : value > 255 ? 255 : value);
+            dqt[t * 65 + 1 + k] = quant[t][k];
+        }
+    }
+    IMAGE_jpegPutSegment(&w, 0xDB, dqt, (size_t)tables * 65);
+
+    uint8_t sof[6 + 9] = { 8, (uint8_t)(image->height >> 8), (uint8_t)image->height,
+                           (uint8_t)(image->width >> 8), (uint8_t)image->width, (uint8_t)ncomp,
+                           1, gray ? 0x11 : 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    IMAGE_jpegPutSegment(&w, 0xC0, sof, 6 + 3 * (size_t)ncomp);
+
+    // Tablas de Huffman típicas del estándar (anexo K)
+    ImageJpegCode codes[4];
+    uint8_t dht[4 * (17 + 162)];
+    size_t dhtLen = 0;
+    for (int t = 0; t < 2 * tables; t++) {
+        const uint8_t *counts = IMAGE_jpegStdCounts[t], *values = IMAGE_jpegStdValues[t];
+        int total = 0;
+        for (int i = 0; i < 16; i++) {
+            total += counts[i];
+        }
+        dht[dhtLen++] = (uint8_t)(((t & 1) << 4) | (t >> 1));
+        memcpy(dht + dhtLen, counts, 16);
+        memcpy(dht + dhtLen + 16, values, (size_t)total);
+        dhtLen += 16 + (size_t)total;
+        IMAGE_jpegBuildCode(&codes[t], counts, values);
+    }
+    IMAGE_jpegPutSegment(&w, 0xC4, dht, dhtLen);
+
+    uint8_t sos[1 + 6 + 3] = { (uint8_t)ncomp, 1, 0x00, 2, 0x11, 3, 0x11 };
+    memcpy(sos + 1 + 2 * ncomp, (const uint8_t[]) { 0, 63, 0 }, 3);
+    IMAGE_jpegPutSegment(&w, 0xDA, sos, 1 + 2 * (size_t)ncomp + 3);
+
+    // MCU de 8x8 en gris; de 16x16 en color: 4 bloques Y, uno Cb y uno Cr
+    int mcu = gray ? 8 : 16;
+    int mcusX = (image->width + mcu - 1) / mcu, mcusY = (image->height + mcu - 1) / mcu;
+    int dcPred[3] = { 0, 0, 0 };
+    float block[64];
+    for (int my = 0; my < mcusY && w.error == NO_ERROR; my++) {
+        for (int mx = 0; mx < mcusX; mx++) {
+            for (int by = 0; by < mcu / 8; by++) {
+                for (int bx = 0; bx < mcu / 8; bx++) {
+                    IMAGE_jpegFetch(image, 0, mx * mcu + bx * 8, my * mcu + by * 8, 1, block);
+                    IMAGE_jpegEncodeBlock(&w, block, quant[0], &codes[0], &codes[1], &dcPred[0]);
+                }
+            }
+            for (int c = 1; c < ncomp; c++) {
+                IMAGE_jpegFetch(image, c, mx * 8, my * 8, 2, block);
+                IMAGE_jpegEncodeBlock(&w, block, quant[1], &codes[2], &codes[3], &dcPred[c]);
+            }
+        }
+    }
+    // El último byte se completa con unos
+    if (w.bitCount > 0) {
+        IMAGE_jpegPutBits(&w, 0x7F, 8 - w.bitCount);
+    }
+    IMAGE_jpegPutByte(&w, 0xFF);
+    IMAGE_jpegPutByte(&w, 0xD9);
+
+    if (w.error != NO_ERROR) {
+        free(w.out);
+        return w.error;
+    }
+    *data = w.out;
+    *size = w.size;
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir una imagen en el formato indicado.
+ * @Parametros: in:  image  = imagen.
+ *              in:  format = formato del fichero.
+ *              out: data   = fichero generado (memoria dinámica).
+ *              out: size   = tamaño del fichero.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+int IMAGE_encode(const Image *image, ImageFormat format, uint8_t **data, size_t *size) {
+    switch (format) {
+        case IMAGE_FORMAT_BMP:
+            return IMAGE_encodeBmp(image, data, size);
+        case IMAGE_FORMAT_TGA:
+            return IMAGE_encodeTga(image, data, size);
+        case IMAGE_FORMAT_PNG:
+            return IMAGE_encodePng(image, data, size);
+        case IMAGE_FORMAT_JPEG:
+            return IMAGE_encodeJpeg(image, data, size);
+    }
+    return ERROR_UNSUPPORTED_FORMAT;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Sumar una fila de bytes a los acumuladores de 32 bits de la
+ *             reducción.
+ * @Parametros: in/out: sums = acumuladores, uno por byte de la fila.
+ *              in:     row  = fila de la imagen.
+ *              in:     size = bytes de la fila.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_sumRowScalar(uint32_t *sums, const uint8_t *row, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        sums[i] += row[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_HAVE_X86 1
+
+/**************************************************
+ *
+ * @Finalidad: Sumar una fila de bytes a los acumuladores de 16 en 16 con
+ *             SSE2 (los bytes se amplían a 16 y luego a 32 bits).
+ * @Parametros: in/out: sums = acumuladores, uno por byte de la fila.
+ *              in:     row  = fila de la imagen.
+ *              in:     size = bytes de la fila.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+__attribute__((target("sse2")))
+static void IMAGE_sumRowSse2(uint32_t *sums, const uint8_t *row, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128i *acc = (__m128i *)(sums + i);
+        _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), _mm_unpacklo_epi16(low, zero)));
+        _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), _mm_unpackhi_epi16(low, zero)));
+        _mm_storeu_si128(acc + 2, _mm_add_epi32(_mm_loadu_si128(acc + 2), _mm_unpacklo_epi16(high, zero)));
+        _mm_storeu_si128(acc + 3, _mm_add_epi32(_mm_loadu_si128(acc + 3), _mm_unpackhi_epi16(high, zero)));
+    }
+    IMAGE_sumRowScalar(sums + i, row + i, size - i);
+}
+/**************************************************
+ *
+ * @Finalidad: Sumar una fila de bytes a los acumuladores de 8 en 8 con
+ *             AVX2.
+ * @Parametros: in/out: sums = acumuladores, uno por byte de la fila.
+ *              in:     row  = fila de la imagen.
+ *              in:     size = bytes de la fila.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+__attribute__((target("avx2")))
+static void IMAGE_sumRowAvx2(uint32_t *sums, const uint8_t *row, size_t size) {
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(row + i)));
+        __m256i *acc = (__m256i *)(sums + i);
+        _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), bytes));
+    }
+    _mm256_zeroupper();
+    IMAGE_sumRowScalar(sums + i, row + i, size - i);
+}
+#endif
+
+// Suma de filas elegida según la CPU en la primera llamada
+static void (*IMAGE_sumRowKernel)(uint32_t *, const uint8_t *, size_t) = IMAGE_sumRowScalar;
+
+#ifdef IMAGE_HAVE_X86
+static pthread_once_t IMAGE_sumRowOnce = PTHREAD_ONCE_INIT;
+
+/**************************************************
+ *
+ * @Finalidad: Escoger la implementación más rápida de la suma de filas
+ *             que soporte la CPU en la que se ejecuta el programa.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_selectSumRowKernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        IMAGE_sumRowKernel = IMAGE_sumRowAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        IMAGE_sumRowKernel = IMAGE_sumRowSse2;
+    }
+}
+#endif
+/**************************************************
+ *
+ * @Finalidad: Calcular unas filas de la imagen reducida. Cada píxel es la
+ *             media redondeada del bloque de factor x factor píxeles de la
+ *             imagen original que le corresponde: primero se suman las
+ *             filas del bloque y después las columnas. Las filas se
+ *             recorren por tramos de IMAGE_TILE_BYTES bytes para que los
+ *             acumuladores quepan en la caché.
+ * @Parametros: in:     src    = imagen original.
+ *              in/out: dst    = imagen reducida.
+ *              in:     factor = factor de reducción.
+ *              in:     first  = primera fila de dst a calcular.
+ *              in:     last   = fila de dst donde se para (no incluida).
+ *              in/out: sums   = acumuladores de IMAGE_tileSums() valores.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_scaleRows(const Image *src, Image *dst, int factor, int first, int last, uint32_t *sums) {
+    int channels = src->channels;
+    size_t rowSize = (size_t)src->width * channels;
+    size_t block = (size_t)factor * channels;
+    uint64_t area = (uint64_t)factor * factor;
+    int tile = IMAGE_TILE_BYTES / block > 0 ? (int)(IMAGE_TILE_BYTES / block) : 1;
+
+    for (int y = first; y < last; y++) {
+        const uint8_t *rows = src->pixels + (size_t)y * factor * rowSize;
+        uint8_t *out = dst->pixels + (size_t)y * dst->width * channels;
+
+        for (int x0 = 0; x0 < dst->width; x0 += tile) {
+            int x1 = x0 + tile < dst->width ? x0 + tile : dst->width;
+            size_t segment = (size_t)(x1 - x0) * block;
+            memset(sums, 0, segment * sizeof(uint32_t));
+            for (int k = 0; k < factor; k++) {
+                IMAGE_sumRowKernel(sums, rows + (size_t)k * rowSize + (size_t)x0 * block, segment);
+            }
+
+            for (int x = x0; x < x1; x++) {
+                const uint32_t *column = sums + (size_t)(x - x0) * block;
+                uint64_t acc[4] = { 0, 0, 0, 0 };
+                for (int k = 0; k < factor; k++) {
+                    for (int c = 0; c < channels; c++) {
+                        acc[c] += column[k * channels + c];
+                    }
+                }
+                for (int c = 0; c < channels; c++) {
+                    out[c] = (uint8_t)((acc[c] + area / 2) / area);
+                }
+                out += channels;
+            }
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular cuántos acumuladores necesita IMAGE_scaleRows.
+ * @Parametros: in: src    = imagen original.
+ *              in: dst    = imagen reducida.
+ *              in: factor = factor de reducción.
+ * @Retorno:    Número de acumuladores de 32 bits.
+ *
+ **************************************************/
+static size_t IMAGE_tileSums(const Image *src, const Image *dst, int factor) {
+    size_t block = (size_t)factor * src->channels;
+    size_t tile = IMAGE_TILE_BYTES / block > 0 ? IMAGE_TILE_BYTES / block : 1;
+    return (tile < (size_t)dst->width ? tile : (size_t)dst->width) * block;
+}
+/**************************************************
+ *
+ * @Finalidad: Repartir las franjas pendientes de una reducción en
+ *             paralelo. Lo ejecutan a la vez los hilos del pool y el hilo
+ *             que espera el resultado, cada uno con sus acumuladores.
+ * @Parametros: in/out: job = reducción en paralelo.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_drainBands(ParallelScale *job) {
+    uint32_t *sums = (uint32_t *)malloc(IMAGE_tileSums(job->src, job->dst, job->factor) * sizeof(uint32_t));
+    if (sums == NULL) {
+        // Las franjas se las quedan los demás hilos
+        atomic_store(&job->error, ERROR_MEM_ALLOC);
+        return;
+    }
+
+    int index;
+    while ((index = atomic_fetch_add(&job->next, 1)) < job->count) {
+        int first = index * job->bandRows;
+        int last = first + job->bandRows < job->dst->height ? first + job->bandRows : job->dst->height;
+        IMAGE_scaleRows(job->src, job->dst, job->factor, first, last, sums);
+        atomic_fetch_add(&job->finished, 1);
+    }
+    free(sums);
+}
+/**************************************************
+ *
+ * @Finalidad: Tarea del pool que ayuda a reducir las franjas de una imagen
+ *             grande y avisa al terminar.
+ * @Parametros: in: arg = ParallelScale de la reducción.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void IMAGE_bandTask(void *arg) {
+    ParallelScale *job = (ParallelScale *)arg;
+
+    IMAGE_drainBands(job);
+
+    pthread_mutex_lock(&job->mutex);
+    job->helpers--;
+    pthread_cond_signal(&job->done);
+    pthread_mutex_unlock(&job->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Reducir una imagen grande en paralelo, por franjas de filas
+ *             de la imagen reducida. Cada franja lee unos IMAGE_BAND_BYTES
+ *             bytes seguidos de la original y escribe filas propias de dst,
+ *             así los hilos no comparten datos. Se piden tantos ayudantes
+ *             como hilos libres tenga el pool; el hilo que llama también
+ *             reduce franjas, así termina aunque el pool esté ocupado.
+ * @Parametros: in:     src    = imagen original.
+ *              in/out: dst    = imagen reducida, ya reservada.
+ *              in:     factor = factor de reducción.
+ *              in:     pool   = pool de los hilos que ayudan (o NULL).
+ * @Retorno:    0 en caso de éxito; IMAGE_PARALLEL_UNAVAILABLE si hay que
+ *              reducirla en un solo hilo; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_scaleParallel(const Image *src, Image *dst, int factor, ThreadPool *pool) {
+    int free_threads = pool != NULL ? pool->numThreads - THREADPOOL_pending(pool) : 0;
+    if (pool == NULL || pool->numThreads < 2 || free_threads < 1) {
+        return IMAGE_PARALLEL_UNAVAILABLE;
+    }
+
+    // Franjas de unos IMAGE_BAND_BYTES, y al menos 4 por hilo para repartir bien
+    size_t bandSource = (size_t)factor * src->width * src->channels;
+    int bandRows = IMAGE_BAND_BYTES / bandSource > 0 ? (int)(IMAGE_BAND_BYTES / bandSource) : 1;
+    int balanced = dst->height / ((free_threads + 1) * 4);
+    if (balanced < bandRows) {
+        bandRows = balanced > 0 ? balanced : 1;
+    }
+
+    ParallelScale job;
+    job.src = src;
+    job.dst = dst;
+    job.factor = factor;
+    job.bandRows = bandRows;
+    job.count = (dst->height + bandRows - 1) / bandRows;
+    atomic_init(&job.next, 0);
+    atomic_init(&job.finished, 0);
+    atomic_init(&job.error, NO_ERROR);
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.done, NULL);
+    job.helpers = 0;
+
+    int wanted = job.count - 1 < free_threads ? job.count - 1 : free_threads;
+    for (int i = 0; i < wanted; i++) {
+        pthread_mutex_lock(&job.mutex);
+        job.helpers++;
+        pthread_mutex_unlock(&job.mutex);
+        if (THREADPOOL_submit(pool, IMAGE_bandTask, &job) != THREADPOOL_OK) {
+            pthread_mutex_lock(&job.mutex);
+            job.helpers--;
+            pthread_mutex_unlock(&job.mutex);
+            break;
+        }
+    }
+
+    IMAGE_drainBands(&job);
+
+    pthread_mutex_lock(&job.mutex);
+    while (job.helpers > 0) {
+        pthread_cond_wait(&job.done, &job.mutex);
+    }
+    pthread_mutex_unlock(&job.mutex);
+    pthread_mutex_destroy(&job.mutex);
+    pthread_cond_destroy(&job.done);
+
+    // Un hilo sin memoria deja sus franjas a los demás: solo falla si quedan sin hacer
+    if (atomic_load(&job.finished) < job.count) {
+        return atomic_load(&job.error) != NO_ERROR ? atomic_load(&job.error) : ERROR_MEM_ALLOC;
+    }
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Reducir una imagen por un factor: el resultado mide
+ *             width / factor x height / factor (división entera) y las
+ *             filas y columnas que sobran del borde se descartan, como
+ *             en SO_compressImage. Las imágenes de IMAGE_PARALLEL_MIN
+ *             bytes o más se reducen por franjas en paralelo si hay pool.
+ * @Parametros: in:  src          = imagen original.
+ *              in:  scale_factor = factor (1 <= factor <= min(ancho, alto)).
+ *              out: dst          = imagen reducida.
+ *              in:  pool         = pool que ayuda con las imágenes grandes;
+ *                                  con NULL se reducen en un solo hilo.
+ * @Retorno:    0 en caso de éxito; ERROR_SCALING_FACTOR si el factor no es
+ *              válido; ERROR_MEM_ALLOC si no hay memoria.
+ *
+ **************************************************/
+int IMAGE_scale(const Image *src, int scale_factor, Image *dst, ThreadPool *pool) {
+#ifdef IMAGE_HAVE_X86
+    pthread_once(&IMAGE_sumRowOnce, IMAGE_selectSumRowKernel);
+#endif
+    if (scale_factor < 1 || scale_factor > src->width || scale_factor > src->height) {
+        return ERROR_SCALING_FACTOR;
+    }
+
+    int error = IMAGE_alloc(dst, src->width / scale_factor, src->height / scale_factor, src->channels);
+    if (error != NO_ERROR) {
+        return error;
+    }
+
+    error = IMAGE_PARALLEL_UNAVAILABLE;
+    if ((size_t)src->width * src->height * src->channels >= IMAGE_PARALLEL_MIN) {
+        error = IMAGE_scaleParallel(src, dst, scale_factor, pool);
+    }
+    if (error == IMAGE_PARALLEL_UNAVAILABLE) {
+        uint32_t *sums = (uint32_t *)malloc(IMAGE_tileSums(src, dst, scale_factor) * sizeof(uint32_t));
+        if (sums == NULL) {
+            error = ERROR_MEM_ALLOC;
+        } else {
+            IMAGE_scaleRows(src, dst, scale_factor, 0, dst->height, sums);
+            free(sums);
+            error = NO_ERROR;
+        }
+    }
+    if (error != NO_ERROR) {
+        IMAGE_free(dst);
+    }
+    return error;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Leer un fichero entero en memoria.
+ * @Parametros: in:  path = ruta del fichero.
+ *              out: data = contenido (memoria dinámica).
+ *              out: size = tamaño del contenido.
+ *              out: mode = permisos del fichero.
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_readFile(const char *path, uint8_t **data, size_t *size, mode_t *mode) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ERROR_DECODING_IMAGE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return ERROR_DECODING_IMAGE;
+    }
+    *data = (uint8_t *)malloc((size_t)info.st_size + 1);
+    if (*data == NULL) {
+        close(fd);
+        return ERROR_MEM_ALLOC;
+    }
+
+    size_t done = 0;
+    while (done < (size_t)info.st_size) {
+        ssize_t n = read(fd, *data + done, (size_t)info.st_size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+    *size = done;
+    *mode = info.st_mode & 0777;
+    return NO_ERROR;
+}
+/**************************************************
+ *
+ * @Finalidad: Sustituir un fichero por un contenido nuevo: se escribe en
+ *             un temporal de la misma carpeta que después se renombra.
+ * @Parametros: in: path = ruta del fichero.
+ *              in: data = contenido nuevo.
+ *              in: size = tamaño del contenido.
+ *              in: mode = permisos del fichero.
+ * @Retorno:    0 en caso de éxito; ERROR_CREATING_TMP_FILE o
+ *              ERROR_CREATING_FINAL_FILE si ocurrió algún error.
+ *
+ **************************************************/
+static int IMAGE_writeFile(const char *path, const uint8_t *data, size_t size, mode_t mode) {
+    char *tmp_path = NULL;
+    if (asprintf(&tmp_path, "%s.XXXXXX", path) == -1) {
+        return ERROR_MEM_ALLOC;
+    }
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        free(tmp_path);
+        return ERROR_CREATING_TMP_FILE;
+    }
+
+    int error = NO_ERROR;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            error = ERROR_CREATING_TMP_FILE;
+            break;
+        }
+        done += (size_t)n;
+    }
+    if (fchmod(fd, mode) != 0 && error == NO_ERROR) {
+        error = ERROR_CREATING_TMP_FILE;
+    }
+    if (close(fd) != 0 && error == NO_ERROR) {
+        error = ERROR_CREATING_TMP_FILE;
+    }
+    if (error == NO_ERROR && rename(tmp_path, path) != 0) {
+        error = ERROR_CREATING_FINAL_FILE;
+    }
+    if (error != NO_ERROR) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Reducir una imagen por un factor, con la misma semántica que
+ *             SO_compressImage: se lee, se reduce en memoria y se escribe
+ *             en el mismo formato sobre el fichero original. El formato se
+ *             reconoce por la firma (PNG, JPEG, BMP) o por la extensión
+ *             (TGA).
+ * @Parametros: in: input_image  = ruta de la imagen.
+ *              in: scale_factor = factor (1 <= factor <= min(ancho, alto)).
+ *              in: pool         = pool que ayuda con las imágenes grandes (o NULL).
+ * @Retorno:    0 en caso de éxito; <0 si ocurrió algún error. Con
+ *              ERROR_UNSUPPORTED_FORMAT (p. ej. JPEG progresivo o PNG
+ *              entrelazado) se puede recurrir a SO_compressImage.
+ *
+ **************************************************/
+int IMAGE_compressImage(char *input_image, int scale_factor, ThreadPool *pool) {
+    uint8_t *data = NULL;
+    size_t size = 0;
+    mode_t mode = 0644;
+
+    int error = IMAGE_readFile(input_image, &data, &size, &mode);
+    if (error != NO_ERROR) {
+        return error;
+    }
+
+    ImageFormat format;
+    if (size >= 8 && memcmp(data, IMAGE_pngSignature, 8) == 0) {
+        format = IMAGE_FORMAT_PNG;
+    } else if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+        format = IMAGE_FORMAT_JPEG;
+    } else if (size >= 2 && data[0] == 'B' && data[1] == 'M') {
+        format = IMAGE_FORMAT_BMP;
+    } else if (FILES_has_extension(input_image, (const char *[]) { ".tga", NULL })) {
+        format = IMAGE_FORMAT_TGA;
+    } else {
+        free(data);
+        return ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    Image src, dst;
+    error = IMAGE_decode(data, size, format, &src);
+    free(data);
+    if (error != NO_ERROR) {
+        return error;
+    }
+    error = IMAGE_scale(&src, scale_factor, &dst, pool);
+    IMAGE_free(&src);
+    if (error != NO_ERROR) {
+        return error;
+    }
+
+    error = IMAGE_encode(&dst, format, &data, &size);
+    IMAGE_free(&dst);
+    if (error != NO_ERROR) {
+        return error;
+    }
+    error = IMAGE_writeFile(input_image, data, size, mode);
+    free(data);
+    return error;
+}
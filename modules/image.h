@@ -0,0 +1,80 @@
+/***********************************************
+*
+* @Proposito:  Declara el motor de reducción de imágenes: lectura y
+*               escritura de BMP, TGA, PNG y JPEG y reducción por media de
+*               bloques
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "so_compression.h"
+#include "files.h"
+#include "threadpool.h"
+
+// Los errores son los de SO_compressImage (so_compression.h)
+#define IMAGE_MAX_SIDE 65535            // Ancho y alto máximos que se aceptan
+#define IMAGE_PARALLEL_MIN (4 * 1024 * 1024)    // Imágenes (bytes de píxeles) a partir de este tamaño se reducen en paralelo
+#define IMAGE_BAND_BYTES (1024 * 1024)          // Bytes de la imagen original que lee cada franja, aproximadamente
+#define IMAGE_TILE_BYTES (16 * 1024)            // Bytes de cada fila original que se suman de una vez
+#define IMAGE_PARALLEL_UNAVAILABLE -8
+#define IMAGE_DEFLATE_WINDOW 32768              // Distancia máxima de una coincidencia
+#define IMAGE_DEFLATE_HASH_BITS 15
+#define IMAGE_DEFLATE_CHAIN 32                  // Candidatos que se prueban por posición
+#define IMAGE_DEFLATE_NICE 128                  // Coincidencia que se da por buena sin buscar más
+#define IMAGE_JPEG_FAST_BITS 9                  // Códigos de Huffman que se decodifican con una consulta
+#define IMAGE_JPEG_QUALITY 90                   // Calidad (1-100) con la que se vuelve a escribir un JPEG
+
+typedef enum {
+    IMAGE_FORMAT_BMP,
+    IMAGE_FORMAT_TGA,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_JPEG
+} ImageFormat;
+
+// Imagen en memoria: filas seguidas de width * channels bytes, en orden
+// RGB o RGBA
+typedef struct {
+    int width;
+    int height;
+    int channels;                       // 3 o 4
+    uint8_t *pixels;
+} Image;
+
+// Reducción en paralelo de una imagen grande, por franjas de filas de la
+// imagen reducida
+typedef struct {
+    const Image *src;
+    Image *dst;
+    int factor;
+    int bandRows;                       // Filas de dst de cada franja
+    int count;                          // Número de franjas
+    atomic_int next;                    // Siguiente franja a reducir
+    atomic_int finished;                // Franjas ya reducidas
+    atomic_int error;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    int helpers;                        // Tareas del pool que aún reducen franjas
+} ParallelScale;
+
+int IMAGE_decode(const uint8_t *data, size_t size, ImageFormat format, Image *image);
+int IMAGE_encode(const Image *image, ImageFormat format, uint8_t **data, size_t *size);
+int IMAGE_scale(const Image *src, int scale_factor, Image *dst, ThreadPool *pool);
+void IMAGE_free(Image *image);
+int IMAGE_compressImage(char *input_image, int scale_factor, ThreadPool *pool);
+
+#endif // IMAGE_H
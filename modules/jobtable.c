@@ -0,0 +1,357 @@
+/***********************************************
+*
+* @Proposito:  Implementa la tabla de tareas en memoria compartida POSIX de
+*               los workers de un mismo tipo en una misma máquina
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "jobtable.h"
+#include "trama.h"
+#include <sched.h>
+
+// Bytes de datos de un hueco: de 'status' al final
+#define JOBTABLE_DATA_SIZE (sizeof(JobSlot) - offsetof(JobSlot, status))
+
+/**************************************************
+ *
+ * @Finalidad: Saber si el proceso dueño de una tarea sigue vivo.
+ * @Parametros: in: pid = pid del dueño.
+ * @Retorno:    1 si está vivo (o no se puede saber); 0 si no existe.
+ *
+ **************************************************/
+static int JOBTABLE_alive(pid_t pid) {
+    return pid == getpid() || kill(pid, 0) == 0 || errno != ESRCH;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer los datos de un hueco sin bloquear al dueño: se
+ *             repite la copia si el dueño los estaba modificando, hasta
+ *             JOBTABLE_READ_RETRIES veces (un dueño que se cae a medias
+ *             deja la secuencia impar para siempre).
+ * @Parametros: in:  slot = hueco.
+ *              out: copy = copia de los datos.
+ * @Retorno:    JOBTABLE_OK o JOBTABLE_ERROR_BUSY.
+ *
+ **************************************************/
+static int JOBTABLE_read(JobSlot *slot, JobSlot *copy) {
+    uint32_t before, after;
+    int retries = 0;
+    do {
+        if (retries++ == JOBTABLE_READ_RETRIES) {
+            return JOBTABLE_ERROR_BUSY;
+        }
+        if (retries > 1) {
+            sched_yield();
+        }
+        before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        memcpy(&copy->status, &slot->status, JOBTABLE_DATA_SIZE);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    copy->username[JOBTABLE_NAME_SIZE - 1] = '\0';
+    copy->fileName[JOBTABLE_FILE_SIZE - 1] = '\0';
+    copy->factor[JOBTABLE_FACTOR_SIZE - 1] = '\0';
+    copy->MD5SUM[JOBTABLE_MD5_SIZE - 1] = '\0';
+    return JOBTABLE_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Leer un hueco y, si no se puede porque su dueño se cayó
+ *             mientras lo modificaba, repararlo: la secuencia vuelve a ser
+ *             par y los datos se dan por buenos tal como quedaron (los
+ *             bytes transferidos se vuelven a calcular al reanudar).
+ * @Parametros: in:  slot = hueco.
+ *              out: copy = copia de los datos.
+ * @Retorno:    JOBTABLE_OK o JOBTABLE_ERROR_BUSY.
+ *
+ **************************************************/
+static int JOBTABLE_readOrRepair(JobSlot *slot, JobSlot *copy) {
+    if (JOBTABLE_read(slot, copy) == JOBTABLE_OK) {
+        return JOBTABLE_OK;
+    }
+    int32_t owner = atomic_load(&slot->owner);
+    uint32_t sequence = atomic_load(&slot->sequence);
+    if (owner == 0 || JOBTABLE_alive(owner) || (sequence & 1) == 0) {
+        return JOBTABLE_ERROR_BUSY;
+    }
+    // Solo lo repara uno: el que cambia la secuencia
+    atomic_compare_exchange_strong(&slot->sequence, &sequence, sequence + 1);
+    return JOBTABLE_read(slot, copy);
+}
+/**************************************************
+ *
+ * @Finalidad: Copiar una tarea en un hueco propio.
+ * @Parametros: out: slot    = hueco del que este worker es dueño.
+ *              in:  element = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void JOBTABLE_write(JobSlot *slot, const listElement2 *element) {
+    atomic_fetch_add_explicit(&slot->sequence, 1, memory_order_acq_rel);
+    atomic_thread_fence(memory_order_release);
+    slot->status = element->status;
+    slot->fused = element->fused;
+    slot->bytes_to_writeF1 = element->bytes_to_writeF1;
+    slot->bytes_writtenF1 = element->bytes_writtenF1;
+    slot->bytes_to_writeF2 = element->bytes_to_writeF2;
+    slot->bytes_writtenF2 = element->bytes_writtenF2;
+    strcpy(slot->username, element->username);
+    strcpy(slot->fileName, element->fileName);
+    strcpy(slot->factor, element->factor);
+    strcpy(slot->MD5SUM, element->MD5SUM);
+    atomic_fetch_add_explicit(&slot->sequence, 1, memory_order_release);
+}
+/**************************************************
+ *
+ * @Finalidad: Buscar el hueco de una tarea que tiene este worker.
+ * @Parametros: in: table    = tabla abierta.
+ *              in: username = usuario de Fleck.
+ *              in: fileName = fichero.
+ * @Retorno:    El hueco; NULL si no está.
+ *
+ **************************************************/
+static JobSlot *JOBTABLE_mine(JobTable *table, const char *username, const char *fileName) {
+    for (int i = 0; i < JOBTABLE_SLOTS; i++) {
+        JobSlot *slot = &table->memory->slots[i];
+        if (atomic_load(&slot->state) == JOBTABLE_READY && atomic_load(&slot->owner) == getpid() &&
+            strcmp(slot->username, username) == 0 && strcmp(slot->fileName, fileName) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Abrir (o crear) la tabla de los workers de un tipo que
+ *             comparten carpeta en esta máquina.
+ * @Parametros: out: table      = tabla.
+ *              in:  directory  = carpeta del worker.
+ *              in:  workerType = tipo de worker.
+ * @Retorno:    JOBTABLE_OK o JOBTABLE_ERROR_OPEN. Con error la tabla queda
+ *              desactivada y el resto de funciones no hacen nada.
+ *
+ **************************************************/
+int JOBTABLE_open(JobTable *table, const char *directory, const char *workerType) {
+    memset(table, 0, sizeof(JobTable));
+    struct stat info;
+    char *name = NULL;
+    if (stat(directory, &info) != 0 ||
+        asprintf(&name, "%s_%s_%lx_%lx", JOBTABLE_PREFIX, workerType,
+                 (unsigned long)info.st_dev, (unsigned long)info.st_ino) == -1) {
+        return JOBTABLE_ERROR_OPEN;
+    }
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+    free(name);
+    if (fd < 0) {
+        return JOBTABLE_ERROR_OPEN;
+    }
+
+    // Un objeto nuevo mide 0 bytes; si dos workers lo crean a la vez, los
+    // dos le dan el mismo tamaño
+    if (fstat(fd, &info) != 0 ||
+        ((size_t)info.st_size < sizeof(JobTableMemory) && ftruncate(fd, sizeof(JobTableMemory)) != 0)) {
+        close(fd);
+        return JOBTABLE_ERROR_OPEN;
+    }
+    JobTableMemory *memory = mmap(NULL, sizeof(JobTableMemory), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return JOBTABLE_ERROR_OPEN;
+    }
+
+    uint32_t magic = 0;
+    if (!atomic_compare_exchange_strong(&memory->magic, &magic, JOBTABLE_MAGIC) && magic != JOBTABLE_MAGIC) {
+        munmap(memory, sizeof(JobTableMemory));
+        return JOBTABLE_ERROR_OPEN;
+    }
+    table->memory = memory;
+    table->directory = strdup(directory);
+    table->workerType = strdup(workerType);
+    return JOBTABLE_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Cerrar la tabla. El objeto de memoria compartida se conserva
+ *             para los demás workers.
+ * @Parametros: in/out: table = tabla.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void JOBTABLE_close(JobTable *table) {
+    if (table->memory != NULL) {
+        munmap(table->memory, sizeof(JobTableMemory));
+        table->memory = NULL;
+    }
+    free(table->directory);
+    free(table->workerType);
+    table->directory = NULL;
+    table->workerType = NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Publicar el estado actual de una tarea de este worker. Si
+ *             aún no está en la tabla se reserva un hueco libre.
+ * @Parametros: in/out: table   = tabla.
+ *              in:     element = tarea.
+ * @Retorno:    JOBTABLE_OK o un error JOBTABLE_ERROR_*.
+ *
+ **************************************************/
+int JOBTABLE_publish(JobTable *table, const listElement2 *element) {
+    if (table->memory == NULL) {
+        return JOBTABLE_ERROR_OPEN;
+    }
+    if (strlen(element->username) >= JOBTABLE_NAME_SIZE || strlen(element->fileName) >= JOBTABLE_FILE_SIZE ||
+        strlen(element->factor) >= JOBTABLE_FACTOR_SIZE || strlen(element->MD5SUM) >= JOBTABLE_MD5_SIZE) {
+        return JOBTABLE_ERROR_SIZE;
+    }
+
+    JobSlot *slot = JOBTABLE_mine(table, element->username, element->fileName);
+    if (slot != NULL) {
+        JOBTABLE_write(slot, element);
+        return JOBTABLE_OK;
+    }
+    for (int i = 0; i < JOBTABLE_SLOTS && slot == NULL; i++) {
+        JobSlot *candidate = &table->memory->slots[i];
+        uint32_t state = JOBTABLE_FREE;
+        if (atomic_compare_exchange_strong(&candidate->state, &state, JOBTABLE_WRITING)) {
+            atomic_store(&candidate->owner, getpid());
+            slot = candidate;
+        } else if (state == JOBTABLE_WRITING) {
+            // Hueco de un worker que se cayó mientras lo rellenaba
+            int32_t owner = atomic_load(&candidate->owner);
+            if (owner != 0 && !JOBTABLE_alive(owner) && atomic_compare_exchange_strong(&candidate->owner, &owner, getpid())) {
+                slot = candidate;
+            }
+        }
+    }
+    if (slot == NULL) {
+        return JOBTABLE_ERROR_FULL;
+    }
+    JOBTABLE_write(slot, element);
+    atomic_store(&slot->state, JOBTABLE_READY);
+    return JOBTABLE_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Quitar de la tabla una tarea de este worker que ha
+ *             terminado (o se ha abandonado).
+ * @Parametros: in/out: table   = tabla.
+ *              in:     element = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void JOBTABLE_remove(JobTable *table, const listElement2 *element) {
+    if (table->memory == NULL) {
+        return;
+    }
+    JobSlot *slot = JOBTABLE_mine(table, element->username, element->fileName);
+    uint32_t state = JOBTABLE_READY;
+    if (slot != NULL && atomic_compare_exchange_strong(&slot->state, &state, JOBTABLE_WRITING)) {
+        atomic_store(&slot->owner, 0);
+        atomic_store(&slot->state, JOBTABLE_FREE);
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Dejar libres todas las tareas de este worker al cerrarse,
+ *             para que otro las reclame enseguida.
+ * @Parametros: in/out: table = tabla.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void JOBTABLE_release(JobTable *table) {
+    if (table->memory == NULL) {
+        return;
+    }
+    for (int i = 0; i < JOBTABLE_SLOTS; i++) {
+        JobSlot *slot = &table->memory->slots[i];
+        int32_t owner = getpid();
+        if (atomic_load(&slot->state) == JOBTABLE_READY) {
+            atomic_compare_exchange_strong(&slot->owner, &owner, 0);
+        }
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Reclamar una tarea de la tabla para continuarla. Solo se
+ *             puede si está libre o si su dueño ya no existe. El hueco
+ *             pasa a ser de este worker con un compare-and-swap, así que
+ *             si dos workers la reclaman a la vez solo uno la obtiene. Los
+ *             ficheros están en la carpeta compartida y se continúan tal
+ *             como están, sin copiarlos.
+ * @Parametros: in/out: table    = tabla.
+ *              in:     username = usuario de Fleck.
+ *              in:     fileName = fichero.
+ *              out:    element  = tarea reclamada (memoria dinámica, como
+ *                                 las de la lista).
+ * @Retorno:    JOBTABLE_OK si se ha reclamado; JOBTABLE_ERROR_MISS si no
+ *              está; JOBTABLE_ERROR_BUSY si la tiene otro worker vivo o su
+ *              hueco no se ha podido leer.
+ *
+ **************************************************/
+int JOBTABLE_claim(JobTable *table, const char *username, const char *fileName, listElement2 **element) {
+    *element = NULL;
+    if (table->memory == NULL) {
+        return JOBTABLE_ERROR_MISS;
+    }
+    int busy = 0;
+    for (int i = 0; i < JOBTABLE_SLOTS; i++) {
+        JobSlot *slot = &table->memory->slots[i];
+        JobSlot copy;
+        if (atomic_load(&slot->state) != JOBTABLE_READY) {
+            continue;
+        }
+        if (JOBTABLE_readOrRepair(slot, &copy) != JOBTABLE_OK) {
+            busy = 1;       // Puede ser la tarea buscada: no se sabe
+            continue;
+        }
+        if (strcmp(copy.username, username) != 0 || strcmp(copy.fileName, fileName) != 0) {
+            continue;
+        }
+        int32_t owner = atomic_load(&slot->owner);
+        if (owner != 0 && JOBTABLE_alive(owner) && owner != getpid()) {
+            return JOBTABLE_ERROR_BUSY;
+        }
+        if (!atomic_compare_exchange_strong(&slot->owner, &owner, getpid())) {
+            return JOBTABLE_ERROR_BUSY;    // Otro worker la ha reclamado antes
+        }
+
+        // El hueco puede haberse liberado y reutilizado antes de reclamarlo
+        if (JOBTABLE_read(slot, &copy) != JOBTABLE_OK || atomic_load(&slot->state) != JOBTABLE_READY ||
+            strcmp(copy.username, username) != 0 || strcmp(copy.fileName, fileName) != 0) {
+            int32_t mine = getpid();
+            atomic_compare_exchange_strong(&slot->owner, &mine, owner);
+            continue;
+        }
+
+        listElement2 *claimed = malloc(sizeof(listElement2));
+        if (claimed == NULL) {
+            atomic_store(&slot->owner, owner);
+            return JOBTABLE_ERROR_BUSY;
+        }
+        claimed->username = strdup(copy.username);
+        claimed->fileName = strdup(copy.fileName);
+        claimed->worker_type = strdup(table->workerType);
+        claimed->factor = strdup(copy.factor);
+        claimed->MD5SUM = strdup(copy.MD5SUM);
+        claimed->directory = strdup(table->directory);
+        claimed->distortedMd5 = NULL;
+        claimed->bytes_to_writeF1 = copy.bytes_to_writeF1;
+        claimed->bytes_writtenF1 = copy.bytes_writtenF1;
+        claimed->bytes_to_writeF2 = copy.bytes_to_writeF2;
+        claimed->bytes_writtenF2 = copy.bytes_writtenF2;
+        claimed->status = copy.status;
+        claimed->fused = copy.fused;
+        claimed->fd = -1;
+        claimed->reader = NULL;
+        claimed->thread_id = 0;
+        claimed->protocol = TRAMA_PROTOCOL_LEGACY; // Se renegocia al reconectar el Fleck
+        claimed->inPipeline = 0;
+        *element = claimed;
+        return JOBTABLE_OK;
+    }
+    return busy ? JOBTABLE_ERROR_BUSY : JOBTABLE_ERROR_MISS;
+}
@@ -0,0 +1,89 @@
+/***********************************************
+*
+* @Proposito:  Declara la tabla de tareas en memoria compartida POSIX de los
+*               workers de un mismo tipo en una misma máquina, para que uno
+*               continúe enseguida las tareas de otro que se cierra o se cae
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef JOBTABLE_H
+#define JOBTABLE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../linkedlist/linkedlist2.h"
+
+#define JOBTABLE_PREFIX "/so2025_jobs"  // Nombre del objeto: prefijo, tipo y carpeta
+#define JOBTABLE_MAGIC 0x4A544142U      // "JTAB"
+#define JOBTABLE_SLOTS 128
+#define JOBTABLE_NAME_SIZE 64
+#define JOBTABLE_FILE_SIZE 256
+#define JOBTABLE_FACTOR_SIZE 16
+#define JOBTABLE_MD5_SIZE 64
+#define JOBTABLE_READ_RETRIES 1000      // Intentos de leer un hueco que su dueño está modificando
+
+// Estado de un hueco de la tabla
+#define JOBTABLE_FREE 0
+#define JOBTABLE_WRITING 1              // Reservado, el dueño aún lo está rellenando
+#define JOBTABLE_READY 2
+
+#define JOBTABLE_OK 0
+#define JOBTABLE_ERROR_OPEN -1
+#define JOBTABLE_ERROR_FULL -2
+#define JOBTABLE_ERROR_SIZE -3          // Algún campo no cabe: la tarea queda solo en el diario
+#define JOBTABLE_ERROR_MISS -4
+#define JOBTABLE_ERROR_BUSY -5          // La tiene otro worker o no se ha podido leer
+
+// Tarea de la tabla. Los huecos se reservan y se reclaman con
+// compare-and-swap; los datos se leen con un número de secuencia que es
+// impar mientras el dueño los modifica (seqlock)
+typedef struct {
+    _Atomic uint32_t state;
+    _Atomic int32_t owner;              // pid del worker que la tiene; 0 si está libre
+    _Atomic uint32_t sequence;
+    int32_t status;
+    int32_t fused;
+    int32_t bytes_to_writeF1;
+    int32_t bytes_writtenF1;
+    int32_t bytes_to_writeF2;
+    int32_t bytes_writtenF2;
+    char username[JOBTABLE_NAME_SIZE];
+    char fileName[JOBTABLE_FILE_SIZE];
+    char factor[JOBTABLE_FACTOR_SIZE];
+    char MD5SUM[JOBTABLE_MD5_SIZE];
+} JobSlot;
+
+// Contenido del objeto de memoria compartida. Al crearse está a cero, que
+// es una tabla vacía, así que no hace falta inicializarla
+typedef struct {
+    _Atomic uint32_t magic;
+    JobSlot slots[JOBTABLE_SLOTS];
+} JobTableMemory;
+
+typedef struct {
+    JobTableMemory *memory;             // NULL si la tabla está desactivada
+    char *directory;
+    char *workerType;
+} JobTable;
+
+int JOBTABLE_open(JobTable *table, const char *directory, const char *workerType);
+void JOBTABLE_close(JobTable *table);
+int JOBTABLE_publish(JobTable *table, const listElement2 *element);
+void JOBTABLE_remove(JobTable *table, const listElement2 *element);
+void JOBTABLE_release(JobTable *table);
+int JOBTABLE_claim(JobTable *table, const char *username, const char *fileName, listElement2 **element);
+
+#endif // JOBTABLE_H
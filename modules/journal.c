@@ -0,0 +1,686 @@
+/***********************************************
+*
+* @Proposito:  Implementa el diario de tareas del worker: un fichero de solo
+*               añadir, proyectado en memoria, con los cambios de estado de
+*               cada distorsión para que otro worker pueda continuarlas
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "journal.h"
+#include "trama.h"
+
+#define JOURNAL_VERSION 1
+#define JOURNAL_FIELDS 7                // usuario, fichero, tipo, factor, MD5, carpeta, máquina
+
+/**************************************************
+ *
+ * @Finalidad: Calcular el checksum FNV-1a de un bloque de bytes.
+ * @Parametros: in: data = bytes.
+ *              in: size = número de bytes.
+ * @Retorno:    Checksum.
+ *
+ **************************************************/
+static uint32_t JOURNAL_hash(const uint8_t *data, size_t size) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619U;
+    }
+    return hash;
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular el checksum de un registro (todo lo que va detrás
+ *             del campo checksum).
+ * @Parametros: in: record = registro con 'length' ya rellenado.
+ * @Retorno:    Checksum.
+ *
+ **************************************************/
+static uint32_t JOURNAL_recordHash(const JournalRecord *record) {
+    size_t skip = offsetof(JournalRecord, owner);
+    return JOURNAL_hash((const uint8_t *)record + skip, record->length - skip);
+}
+/**************************************************
+ *
+ * @Finalidad: Volver a proyectar el fichero si otro proceso lo ha hecho
+ *             crecer. Se llama con el diario bloqueado.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    JOURNAL_OK o JOURNAL_ERROR_MAP.
+ *
+ **************************************************/
+static int JOURNAL_remap(JobJournal *journal) {
+    struct stat info;
+    if (fstat(journal->fd, &info) != 0 || (size_t)info.st_size < sizeof(JournalHeader)) {
+        return JOURNAL_ERROR_MAP;
+    }
+    if ((size_t)info.st_size == journal->mapSize) {
+        return JOURNAL_OK;
+    }
+    if (journal->map != NULL) {
+        munmap(journal->map, journal->mapSize);
+    }
+    journal->map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+    if (journal->map == MAP_FAILED) {
+        journal->map = NULL;
+        journal->mapSize = 0;
+        return JOURNAL_ERROR_MAP;
+    }
+    journal->mapSize = info.st_size;
+    return JOURNAL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Dejar de usar el fichero abierto y pasar a otro, ya
+ *             bloqueado, que lo sustituye.
+ * @Parametros: in/out: journal = diario bloqueado.
+ *              in:     fd      = fichero nuevo, bloqueado.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void JOURNAL_switch(JobJournal *journal, int fd) {
+    if (journal->map != NULL) {
+        munmap(journal->map, journal->mapSize);
+        journal->map = NULL;
+        journal->mapSize = 0;
+    }
+    flock(journal->fd, LOCK_UN);
+    close(journal->fd);
+    journal->fd = fd;
+}
+/**************************************************
+ *
+ * @Finalidad: Asegurar que el fichero bloqueado es el diario actual. Al
+ *             compactar, otro proceso puede haber puesto uno nuevo en su
+ *             lugar mientras se esperaba el bloqueo: entonces se abre el
+ *             nuevo, se bloquea y se vuelve a comprobar.
+ * @Parametros: in/out: journal = diario bloqueado.
+ * @Retorno:    JOURNAL_OK o JOURNAL_ERROR_OPEN.
+ *
+ **************************************************/
+static int JOURNAL_follow(JobJournal *journal) {
+    struct stat current, opened;
+    while (stat(journal->path, &current) == 0 && fstat(journal->fd, &opened) == 0 &&
+           (current.st_ino != opened.st_ino || current.st_dev != opened.st_dev)) {
+        int fd = open(journal->path, O_RDWR);
+        if (fd < 0) {
+            return JOURNAL_ERROR_OPEN;
+        }
+        flock(fd, LOCK_EX);
+        JOURNAL_switch(journal, fd);
+    }
+    return JOURNAL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Bloquear el diario frente a los hilos de este proceso y los
+ *             demás workers que comparten la carpeta.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    JOURNAL_OK; si hay error el diario queda desbloqueado.
+ *
+ **************************************************/
+static int JOURNAL_lock(JobJournal *journal) {
+    pthread_mutex_lock(&journal->mutex);
+    if (journal->fd < 0) {
+        pthread_mutex_unlock(&journal->mutex);
+        return JOURNAL_ERROR_OPEN;
+    }
+    flock(journal->fd, LOCK_EX);
+    if (JOURNAL_follow(journal) != JOURNAL_OK || JOURNAL_remap(journal) != JOURNAL_OK) {
+        flock(journal->fd, LOCK_UN);
+        pthread_mutex_unlock(&journal->mutex);
+        return JOURNAL_ERROR_MAP;
+    }
+    return JOURNAL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Desbloquear el diario.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void JOURNAL_unlock(JobJournal *journal) {
+    flock(journal->fd, LOCK_UN);
+    pthread_mutex_unlock(&journal->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Obtener el registro que empieza en un desplazamiento y sus
+ *             campos de texto, comprobando que está entero.
+ * @Parametros: in:  journal = diario bloqueado.
+ *              in:  offset  = desplazamiento dentro de la zona de registros.
+ *              out: fields  = campos de texto (JOURNAL_FIELDS).
+ * @Retorno:    El registro; NULL si no es válido (fin del diario útil).
+ *
+ **************************************************/
+static JournalRecord *JOURNAL_parse(JobJournal *journal, uint64_t offset, const char *fields[JOURNAL_FIELDS]) {
+    JournalHeader *header = (JournalHeader *)journal->map;
+    if (offset + sizeof(JournalRecord) > header->used) {
+        return NULL;
+    }
+    JournalRecord *record = (JournalRecord *)(journal->map + sizeof(JournalHeader) + offset);
+    if (record->magic != JOURNAL_RECORD_MAGIC || record->length < sizeof(JournalRecord) ||
+        record->length % 8 != 0 || offset + record->length > header->used ||
+        record->checksum != JOURNAL_recordHash(record)) {
+        return NULL;
+    }
+
+    const char *text = (const char *)(record + 1);
+    const char *end = (const char *)record + record->length;
+    for (int i = 0; i < JOURNAL_FIELDS; i++) {
+        const char *nul = memchr(text, '\0', end - text);
+        if (nul == NULL) {
+            return NULL;
+        }
+        fields[i] = text;
+        text = nul + 1;
+    }
+    return record;
+}
+/**************************************************
+ *
+ * @Finalidad: Construir un registro en memoria dinámica.
+ * @Parametros: in:  element = tarea.
+ *              in:  owner   = pid del dueño (0 si queda libre).
+ *              in:  status  = estado a guardar.
+ *              in:  host    = máquina del dueño.
+ * @Retorno:    El registro; NULL si no hay memoria.
+ *
+ **************************************************/
+static JournalRecord *JOURNAL_build(const listElement2 *element, int owner, int status, const char *host) {
+    const char *fields[JOURNAL_FIELDS] = {
+        element->username, element->fileName, element->worker_type, element->factor,
+        element->MD5SUM, element->directory, host
+    };
+    size_t length = sizeof(JournalRecord);
+    for (int i = 0; i < JOURNAL_FIELDS; i++) {
+        length += strlen(fields[i]) + 1;
+    }
+    length = (length + 7) & ~(size_t)7;
+
+    JournalRecord *record = calloc(1, length);
+    if (record == NULL) {
+        return NULL;
+    }
+    record->magic = JOURNAL_RECORD_MAGIC;
+    record->length = length;
+    record->owner = owner;
+    record->status = status;
+    record->fused = element->fused;
+    record->bytes_to_writeF1 = element->bytes_to_writeF1;
+    record->bytes_writtenF1 = element->bytes_writtenF1;
+    record->bytes_to_writeF2 = element->bytes_to_writeF2;
+    record->bytes_writtenF2 = element->bytes_writtenF2;
+    char *text = (char *)(record + 1);
+    for (int i = 0; i < JOURNAL_FIELDS; i++) {
+        size_t size = strlen(fields[i]) + 1;
+        memcpy(text, fields[i], size);
+        text += size;
+    }
+    record->checksum = JOURNAL_recordHash(record);
+    return record;
+}
+/**************************************************
+ *
+ * @Finalidad: Comprobar si dos registros son de la misma tarea.
+ * @Parametros: in: a = campos de un registro.
+ *              in: b = campos de otro registro.
+ * @Retorno:    1 si lo son; 0 si no.
+ *
+ **************************************************/
+static int JOURNAL_sameJob(const char *a[JOURNAL_FIELDS], const char *b[JOURNAL_FIELDS]) {
+    return strcmp(a[0], b[0]) == 0 && strcmp(a[1], b[1]) == 0 && strcmp(a[2], b[2]) == 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Obtener el último registro de cada tarea que sigue viva. Se
+ *             llama con el diario bloqueado.
+ * @Parametros: in:  journal = diario.
+ *              out: count   = número de tareas vivas.
+ *              out: valid   = bytes de registros válidos (lo que haya
+ *                             detrás es un registro a medias).
+ * @Retorno:    Desplazamientos de los registros (memoria dinámica, NULL si
+ *              no hay ninguno o no hay memoria).
+ *
+ **************************************************/
+static uint64_t *JOURNAL_live(JobJournal *journal, int *count, uint64_t *valid) {
+    uint64_t *offsets = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    uint64_t offset = 0;
+    const char *fields[JOURNAL_FIELDS];
+    JournalRecord *record;
+    while ((record = JOURNAL_parse(journal, offset, fields)) != NULL) {
+        int found = -1;
+        for (int i = 0; i < *count && found < 0; i++) {
+            const char *other[JOURNAL_FIELDS];
+            JOURNAL_parse(journal, offsets[i], other);
+            if (JOURNAL_sameJob(fields, other)) {
+                found = i;
+            }
+        }
+        if (found >= 0 && record->status == JOURNAL_REMOVED) {
+            offsets[found] = offsets[--(*count)];
+        } else if (found >= 0) {
+            offsets[found] = offset;
+        } else if (record->status != JOURNAL_REMOVED) {
+            if (*count == capacity) {
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                uint64_t *grown = realloc(offsets, capacity * sizeof(uint64_t));
+                if (grown == NULL) {
+                    break;
+                }
+                offsets = grown;
+            }
+            offsets[(*count)++] = offset;
+        }
+        offset += record->length;
+    }
+    *valid = offset;
+    return offsets;
+}
+/**************************************************
+ *
+ * @Finalidad: Reescribir el diario con solo el último registro de cada
+ *             tarea viva. Se escriben en un fichero nuevo que después
+ *             sustituye al diario con rename: hasta entonces el diario
+ *             sigue entero, así que si el proceso cae a medias no se
+ *             pierde ninguna tarea. Se llama con el diario bloqueado.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    JOURNAL_OK (aunque no se haya podido compactar, el diario
+ *              sigue siendo válido) o JOURNAL_ERROR_MAP si el nuevo no se
+ *              ha podido proyectar.
+ *
+ **************************************************/
+static int JOURNAL_compact(JobJournal *journal) {
+    JournalHeader *header = (JournalHeader *)journal->map;
+    int count;
+    uint64_t valid;
+    uint64_t *offsets = JOURNAL_live(journal, &count, &valid);
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += ((JournalRecord *)(journal->map + sizeof(JournalHeader) + offsets[i]))->length;
+    }
+    uint8_t *copy = malloc(sizeof(JournalHeader) + total);
+    char *tmpPath = NULL;
+    int fd = -1;
+    if (copy != NULL && asprintf(&tmpPath, "%s.XXXXXX", journal->path) != -1) {
+        fd = mkstemp(tmpPath);
+    }
+    if (fd < 0) {
+        // Sin fichero nuevo solo se descarta lo que hay detrás del último registro válido
+        header->used = valid;
+        free(tmpPath);
+        free(copy);
+        free(offsets);
+        return JOURNAL_OK;
+    }
+
+    // Se copian en el orden en que se escribieron
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && offsets[j - 1] > offsets[j]; j--) {
+            uint64_t swap = offsets[j];
+            offsets[j] = offsets[j - 1];
+            offsets[j - 1] = swap;
+        }
+    }
+    JournalHeader *compacted = (JournalHeader *)copy;
+    compacted->magic = JOURNAL_MAGIC;
+    compacted->version = JOURNAL_VERSION;
+    compacted->used = total;
+    size_t position = sizeof(JournalHeader);
+    for (int i = 0; i < count; i++) {
+        JournalRecord *record = (JournalRecord *)(journal->map + sizeof(JournalHeader) + offsets[i]);
+        memcpy(copy + position, record, record->length);
+        position += record->length;
+    }
+    free(offsets);
+
+    // El nuevo se bloquea antes de ponerlo en su lugar: quien lo abra
+    // después del rename espera a que se termine de añadir el registro
+    flock(fd, LOCK_EX);
+    struct stat info;
+    int written = fstat(journal->fd, &info) == 0 && fchmod(fd, info.st_mode & 0777) == 0 &&
+                  ftruncate(fd, journal->mapSize) == 0 &&
+                  pwrite(fd, copy, position, 0) == (ssize_t)position && fsync(fd) == 0 &&
+                  rename(tmpPath, journal->path) == 0;
+    free(copy);
+    if (!written) {
+        unlink(tmpPath);
+        free(tmpPath);
+        close(fd);
+        header->used = valid;
+        return JOURNAL_OK;
+    }
+    free(tmpPath);
+
+    JOURNAL_switch(journal, fd);
+    return JOURNAL_remap(journal);
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un registro al final del diario. Si no cabe se
+ *             compacta y, si aún no cabe, el fichero crece. Se llama con
+ *             el diario bloqueado.
+ * @Parametros: in/out: journal = diario.
+ *              in:     record  = registro.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*.
+ *
+ **************************************************/
+static int JOURNAL_append(JobJournal *journal, const JournalRecord *record) {
+    JournalHeader *header = (JournalHeader *)journal->map;
+    if (sizeof(JournalHeader) + header->used + record->length > journal->mapSize) {
+        if (JOURNAL_compact(journal) != JOURNAL_OK) {
+            return JOURNAL_ERROR_FULL;
+        }
+        header = (JournalHeader *)journal->map;
+    }
+    size_t needed = sizeof(JournalHeader) + header->used + record->length;
+    if (needed > journal->mapSize) {
+        size_t size = (needed + JOURNAL_CHUNK - 1) / JOURNAL_CHUNK * JOURNAL_CHUNK;
+        if (ftruncate(journal->fd, size) != 0 || JOURNAL_remap(journal) != JOURNAL_OK) {
+            return JOURNAL_ERROR_FULL;
+        }
+        header = (JournalHeader *)journal->map;
+    }
+
+    // Primero el registro y después 'used': uno a medias nunca se lee
+    memcpy(journal->map + sizeof(JournalHeader) + header->used, record, record->length);
+    __atomic_store_n(&header->used, header->used + record->length, __ATOMIC_RELEASE);
+    return JOURNAL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir al diario el estado de una tarea.
+ * @Parametros: in/out: journal = diario.
+ *              in:     element = tarea.
+ *              in:     owner   = pid del dueño (0 si queda libre).
+ *              in:     status  = estado a guardar.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*.
+ *
+ **************************************************/
+static int JOURNAL_write(JobJournal *journal, const listElement2 *element, int owner, int status) {
+    JournalRecord *record = JOURNAL_build(element, owner, status, journal->host);
+    if (record == NULL) {
+        return JOURNAL_ERROR_FULL;
+    }
+    int error = JOURNAL_lock(journal);
+    if (error == JOURNAL_OK) {
+        error = JOURNAL_append(journal, record);
+        JOURNAL_unlock(journal);
+    }
+    free(record);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Borrar los ficheros nuevos que dejara a medias un proceso
+ *             que cayó mientras compactaba. Se llama con el diario
+ *             bloqueado: nadie más puede estar escribiendo uno.
+ * @Parametros: in: directory = carpeta del worker.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void JOURNAL_sweep(const char *directory) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    size_t prefix = strlen(JOURNAL_FILE);
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, JOURNAL_FILE, prefix) == 0 && entry->d_name[prefix] == '.') {
+            char *path = NULL;
+            if (asprintf(&path, "%s/%s", directory, entry->d_name) != -1) {
+                unlink(path);
+                free(path);
+            }
+        }
+    }
+    closedir(dir);
+}
+/**************************************************
+ *
+ * @Finalidad: Abrir (o crear) el diario de la carpeta de un worker. Al
+ *             abrirlo se compacta y se descarta un registro que quedara a
+ *             medias, y también una compactación que quedara a medias.
+ * @Parametros: out: journal   = diario.
+ *              in:  directory = carpeta del worker.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*. Con error el diario
+ *              queda desactivado y el resto de funciones no hacen nada.
+ *
+ **************************************************/
+int JOURNAL_open(JobJournal *journal, const char *directory) {
+    memset(journal, 0, sizeof(JobJournal));
+    pthread_mutex_init(&journal->mutex, NULL);
+    journal->fd = -1;
+    if (gethostname(journal->host, sizeof(journal->host) - 1) != 0) {
+        strcpy(journal->host, "localhost");
+    }
+
+    if (asprintf(&journal->path, "%s/%s", directory, JOURNAL_FILE) == -1) {
+        journal->path = NULL;
+        return JOURNAL_ERROR_OPEN;
+    }
+    journal->fd = open(journal->path, O_RDWR | O_CREAT, 0666);
+    if (journal->fd < 0) {
+        free(journal->path);
+        journal->path = NULL;
+        return JOURNAL_ERROR_OPEN;
+    }
+
+    flock(journal->fd, LOCK_EX);
+    int error = JOURNAL_follow(journal);
+    JOURNAL_sweep(directory);
+    int fd = journal->fd;
+    struct stat info;
+    if (error == JOURNAL_OK && fstat(fd, &info) != 0) {
+        error = JOURNAL_ERROR_OPEN;
+    }
+    JournalHeader header;
+    if (error == JOURNAL_OK && ((size_t)info.st_size < sizeof(JournalHeader) ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION ||
+        sizeof(JournalHeader) + header.used > (uint64_t)info.st_size)) {
+        // Diario nuevo (o de otra versión): se empieza vacío
+        header.magic = JOURNAL_MAGIC;
+        header.version = JOURNAL_VERSION;
+        header.used = 0;
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, JOURNAL_CHUNK) != 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            error = JOURNAL_ERROR_OPEN;
+        }
+    }
+    if (error == JOURNAL_OK) {
+        error = JOURNAL_remap(journal);
+    }
+    if (error == JOURNAL_OK) {
+        error = JOURNAL_compact(journal);
+    }
+    // Al compactar se pasa al fichero nuevo
+    flock(journal->fd, LOCK_UN);
+    if (error != JOURNAL_OK) {
+        if (journal->map != NULL) {
+            munmap(journal->map, journal->mapSize);
+            journal->map = NULL;
+        }
+        close(journal->fd);
+        journal->fd = -1;
+        free(journal->path);
+        journal->path = NULL;
+    }
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Cerrar el diario. El fichero se conserva.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void JOURNAL_close(JobJournal *journal) {
+    pthread_mutex_lock(&journal->mutex);
+    if (journal->map != NULL) {
+        msync(journal->map, journal->mapSize, MS_SYNC);
+        munmap(journal->map, journal->mapSize);
+        journal->map = NULL;
+    }
+    if (journal->fd >= 0) {
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    free(journal->path);
+    journal->path = NULL;
+    pthread_mutex_unlock(&journal->mutex);
+    pthread_mutex_destroy(&journal->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Anotar el estado actual de una tarea de este worker. Una
+ *             tarea completada (estado 4) se da por terminada.
+ * @Parametros: in/out: journal = diario.
+ *              in:     element = tarea.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*.
+ *
+ **************************************************/
+int JOURNAL_record(JobJournal *journal, const listElement2 *element) {
+    int status = element->status >= 4 ? JOURNAL_REMOVED : element->status;
+    return JOURNAL_write(journal, element, getpid(), status);
+}
+/**************************************************
+ *
+ * @Finalidad: Anotar que una tarea ha terminado (o se ha abandonado) y
+ *             nadie debe continuarla.
+ * @Parametros: in/out: journal = diario.
+ *              in:     element = tarea.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*.
+ *
+ **************************************************/
+int JOURNAL_remove(JobJournal *journal, const listElement2 *element) {
+    return JOURNAL_write(journal, element, getpid(), JOURNAL_REMOVED);
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar todas las tareas vivas de este worker al cerrarse,
+ *             para que otro las pueda continuar enseguida.
+ * @Parametros: in/out: journal = diario.
+ * @Retorno:    JOURNAL_OK o un error JOURNAL_ERROR_*.
+ *
+ **************************************************/
+int JOURNAL_release(JobJournal *journal) {
+    int error = JOURNAL_lock(journal);
+    if (error != JOURNAL_OK) {
+        return error;
+    }
+
+    int count;
+    uint64_t valid;
+    uint64_t *offsets = JOURNAL_live(journal, &count, &valid);
+    JournalRecord **released = count > 0 ? calloc(count, sizeof(JournalRecord *)) : NULL;
+    int releasedCount = 0;
+    for (int i = 0; i < count && released != NULL; i++) {
+        const char *fields[JOURNAL_FIELDS];
+        JournalRecord *record = JOURNAL_parse(journal, offsets[i], fields);
+        if (record->owner == getpid() && strcmp(fields[6], journal->host) == 0) {
+            JournalRecord *copy = malloc(record->length);
+            if (copy != NULL) {
+                memcpy(copy, record, record->length);
+                copy->owner = 0;
+                copy->checksum = JOURNAL_recordHash(copy);
+                released[releasedCount++] = copy;
+            }
+        }
+    }
+    free(offsets);
+
+    // Se añaden después de recorrerlo: al añadir se puede compactar
+    for (int i = 0; i < releasedCount; i++) {
+        if (error == JOURNAL_OK) {
+            error = JOURNAL_append(journal, released[i]);
+        }
+        free(released[i]);
+    }
+    free(released);
+    msync(journal->map, journal->mapSize, MS_SYNC);
+    JOURNAL_unlock(journal);
+    return error;
+}
+/**************************************************
+ *
+ * @Finalidad: Reclamar una tarea del diario para continuarla. Solo se
+ *             puede si está libre o si su dueño era un proceso de esta
+ *             máquina que ya no existe (un worker que se ha caído).
+ * @Parametros: in/out: journal    = diario.
+ *              in:     username   = usuario de Fleck.
+ *              in:     fileName   = fichero.
+ *              in:     workerType = tipo de worker.
+ * @Retorno:    Tarea reclamada (memoria dinámica, como las de la lista);
+ *              NULL si no está o la tiene otro worker vivo.
+ *
+ **************************************************/
+listElement2 *JOURNAL_claim(JobJournal *journal, const char *username, const char *fileName, const char *workerType) {
+    if (JOURNAL_lock(journal) != JOURNAL_OK) {
+        return NULL;
+    }
+
+    // El último registro de la tarea es el que vale
+    const char *wanted[JOURNAL_FIELDS] = { username, fileName, workerType };
+    const char *fields[JOURNAL_FIELDS];
+    JournalRecord *record, *last = NULL;
+    uint64_t offset = 0;
+    while ((record = JOURNAL_parse(journal, offset, fields)) != NULL) {
+        if (JOURNAL_sameJob(fields, wanted)) {
+            last = record;
+        }
+        offset += record->length;
+    }
+    if (last == NULL || last->status == JOURNAL_REMOVED) {
+        JOURNAL_unlock(journal);
+        return NULL;
+    }
+    const char *lastFields[JOURNAL_FIELDS];
+    JOURNAL_parse(journal, (uint8_t *)last - journal->map - sizeof(JournalHeader), lastFields);
+    int sameHost = strcmp(lastFields[6], journal->host) == 0;
+    int free_ = last->owner == 0 || (sameHost && (last->owner == getpid() || (kill(last->owner, 0) == -1 && errno == ESRCH)));
+    if (!free_) {
+        JOURNAL_unlock(journal);
+        return NULL;
+    }
+
+    listElement2 *element = malloc(sizeof(listElement2));
+    if (element == NULL) {
+        JOURNAL_unlock(journal);
+        return NULL;
+    }
+    element->username = strdup(lastFields[0]);
+    element->fileName = strdup(lastFields[1]);
+    element->worker_type = strdup(lastFields[2]);
+    element->factor = strdup(lastFields[3]);
+    element->MD5SUM = strdup(lastFields[4]);
+    element->directory = strdup(lastFields[5]);
+    element->distortedMd5 = NULL;
+    element->bytes_to_writeF1 = last->bytes_to_writeF1;
+    element->bytes_writtenF1 = last->bytes_writtenF1;
+    element->bytes_to_writeF2 = last->bytes_to_writeF2;
+    element->bytes_writtenF2 = last->bytes_writtenF2;
+    element->status = last->status;
+    element->fused = last->fused;
+    element->fd = -1;
+    element->reader = NULL;
+    element->thread_id = 0;
+    element->protocol = TRAMA_PROTOCOL_LEGACY; // Se renegocia al reconectar el Fleck
+    element->inPipeline = 0;
+
+    // Desde ahora la tarea es de este worker
+    JournalRecord *claim = JOURNAL_build(element, getpid(), element->status, journal->host);
+    if (claim != NULL) {
+        JOURNAL_append(journal, claim);
+        free(claim);
+    }
+    JOURNAL_unlock(journal);
+    return element;
+}
@@ -0,0 +1,85 @@
+/***********************************************
+*
+* @Proposito:  Declara el diario de tareas del worker: un fichero de solo
+*               añadir, proyectado en memoria, con los cambios de estado de
+*               cada distorsión para que otro worker pueda continuarlas
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../linkedlist/linkedlist2.h"
+
+#define JOURNAL_FILE ".jobs.journal"       // En la carpeta del worker
+#define JOURNAL_MAGIC 0x4A4F424AU          // "JOBJ"
+#define JOURNAL_RECORD_MAGIC 0x4A524543U   // "JREC"
+#define JOURNAL_CHUNK (1024 * 1024)        // El fichero crece en bloques de este tamaño
+#define JOURNAL_HOST_SIZE 64
+
+// Estado de un registro que da la tarea por terminada
+#define JOURNAL_REMOVED -1
+
+#define JOURNAL_OK 0
+#define JOURNAL_ERROR_OPEN -1
+#define JOURNAL_ERROR_MAP -2
+#define JOURNAL_ERROR_FULL -3
+
+// Cabecera del fichero. Los registros empiezan detrás y 'used' solo se
+// actualiza cuando el registro está entero: uno a medias no se lee
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t used;                      // Bytes de registros
+} JournalHeader;
+
+// Registro de un cambio de estado, seguido de usuario, fichero, tipo,
+// factor, MD5, carpeta y máquina del dueño, terminados en '\0'
+typedef struct {
+    uint32_t magic;
+    uint32_t length;                    // Bytes del registro, múltiplo de 8
+    uint32_t checksum;                  // FNV-1a de lo que va detrás
+    int32_t owner;                      // pid del worker que la tiene; 0 si está libre
+    int32_t status;                     // Estado de la tarea o JOURNAL_REMOVED
+    int32_t fused;
+    int32_t bytes_to_writeF1;
+    int32_t bytes_writtenF1;
+    int32_t bytes_to_writeF2;
+    int32_t bytes_writtenF2;
+} JournalRecord;
+
+// Diario abierto. El flock ordena a los procesos que comparten la carpeta
+// y el mutex a los hilos de este
+typedef struct {
+    int fd;
+    char *path;                         // Para seguir al fichero si otro proceso lo compacta
+    uint8_t *map;
+    size_t mapSize;
+    char host[JOURNAL_HOST_SIZE];
+    pthread_mutex_t mutex;
+} JobJournal;
+
+int JOURNAL_open(JobJournal *journal, const char *directory);
+void JOURNAL_close(JobJournal *journal);
+int JOURNAL_record(JobJournal *journal, const listElement2 *element);
+int JOURNAL_remove(JobJournal *journal, const listElement2 *element);
+int JOURNAL_release(JobJournal *journal);
+listElement2 *JOURNAL_claim(JobJournal *journal, const char *username, const char *fileName, const char *workerType);
+
+#endif // JOURNAL_H
@@ -0,0 +1,358 @@
+/***********************************************
+*
+* @Proposito:  Implementa el cálculo del hash MD5 (RFC 1321) de bloques
+*               de memoria y ficheros sin depender de herramientas externas
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "md5.h"
+
+// Funciones auxiliares de cada ronda
+#define MD5_ROUND_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_ROUND_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_ROUND_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_ROUND_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+    (a) += f((b), (c), (d)) + (x) + (uint32_t)(t); \
+    (a) = ((a) << (s)) | ((a) >> (32 - (s))); \
+    (a) += (b);
+
+// Lectura de una palabra de 32 bits en little-endian, sea cual sea la máquina
+#define MD5_LOAD(p) \
+    ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+/**************************************************
+ *
+ * @Finalidad: Procesar bloques completos de 64 bytes actualizando el estado.
+ *             Se compila optimizado aunque el resto del proyecto no lo esté:
+ *             sin optimizar es varias veces más lento que md5sum.
+ * @Parametros: in/out: ctx    = estado del cálculo.
+ *              in:     data   = bloques a procesar.
+ *              in:     blocks = número de bloques de 64 bytes.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+__attribute__((optimize("O2")))
+static void MD5_transform(Md5Context *ctx, const unsigned char *data, size_t blocks) {
+    uint32_t a = ctx->state[0];
+    uint32_t b = ctx->state[1];
+    uint32_t c = ctx->state[2];
+    uint32_t d = ctx->state[3];
+    uint32_t x[16];
+
+    while (blocks-- > 0) {
+        uint32_t sa = a, sb = b, sc = c, sd = d;
+
+        for (int i = 0; i < 16; i++) {
+            x[i] = MD5_LOAD(data + i * 4);
+        }
+
+        // Ronda 1
+        MD5_STEP(MD5_ROUND_F, a, b, c, d, x[0], 0xd76aa478, 7)
+        MD5_STEP(MD5_ROUND_F, d, a, b, c, x[1], 0xe8c7b756, 12)
+        MD5_STEP(MD5_ROUND_F, c, d, a, b, x[2], 0x242070db, 17)
+        MD5_STEP(MD5_ROUND_F, b, c, d, a, x[3], 0xc1bdceee, 22)
+        MD5_STEP(MD5_ROUND_F, a, b, c, d, x[4], 0xf57c0faf, 7)
+        MD5_STEP(MD5_ROUND_F, d, a, b, c, x[5], 0x4787c62a, 12)
+        MD5_STEP(MD5_ROUND_F, c, d, a, b, x[6], 0xa8304613, 17)
+        MD5_STEP(MD5_ROUND_F, b, c, d, a, x[7], 0xfd469501, 22)
+        MD5_STEP(MD5_ROUND_F, a, b, c, d, x[8], 0x698098d8, 7)
+        MD5_STEP(MD5_ROUND_F, d, a, b, c, x[9], 0x8b44f7af, 12)
+        MD5_STEP(MD5_ROUND_F, c, d, a, b, x[10], 0xffff5bb1, 17)
+        MD5_STEP(MD5_ROUND_F, b, c, d, a, x[11], 0x895cd7be, 22)
+        MD5_STEP(MD5_ROUND_F, a, b, c, d, x[12], 0x6b901122, 7)
+        MD5_STEP(MD5_ROUND_F, d, a, b, c, x[13], 0xfd987193, 12)
+        MD5_STEP(MD5_ROUND_F, c, d, a, b, x[14], 0xa679438e, 17)
+        MD5_STEP(MD5_ROUND_F, b, c, d, a, x[15], 0x49b40821, 22)
+
+        // Ronda 2
+        MD5_STEP(MD5_ROUND_G, a, b, c, d, x[1], 0xf61e2562, 5)
+        MD5_STEP(MD5_ROUND_G, d, a, b, c, x[6], 0xc040b340, 9)
+        MD5_STEP(MD5_ROUND_G, c, d, a, b, x[11], 0x265e5a51, 14)
+        MD5_STEP(MD5_ROUND_G, b, c, d, a, x[0], 0xe9b6c7aa, 20)
+        MD5_STEP(MD5_ROUND_G, a, b, c, d, x[5], 0xd62f105d, 5)
+        MD5_STEP(MD5_ROUND_G, d, a, b, c, x[10], 0x02441453, 9)
+        MD5_STEP(MD5_ROUND_G, c, d, a, b, x[15], 0xd8a1e681, 14)
+        MD5_STEP(MD5_ROUND_G, b, c, d, a, x[4], 0xe7d3fbc8, 20)
+        MD5_STEP(MD5_ROUND_G, a, b, c, d, x[9], 0x21e1cde6, 5)
+        MD5_STEP(MD5_ROUND_G, d, a, b, c, x[14], 0xc33707d6, 9)
+        MD5_STEP(MD5_ROUND_G, c, d, a, b, x[3], 0xf4d50d87, 14)
+        MD5_STEP(MD5_ROUND_G, b, c, d, a, x[8], 0x455a14ed, 20)
+        MD5_STEP(MD5_ROUND_G, a, b, c, d, x[13], 0xa9e3e905, 5)
+        MD5_STEP(MD5_ROUND_G, d, a, b, c, x[2], 0xfcefa3f8, 9)
+        MD5_STEP(MD5_ROUND_G, c, d, a, b, x[7], 0x676f02d9, 14)
+        MD5_STEP(MD5_ROUND_G, b, c, d, a, x[12], 0x8d2a4c8a, 20)
+
+        // Ronda 3
+        MD5_STEP(MD5_ROUND_H, a, b, c, d, x[5], 0xfffa3942, 4)
+        MD5_STEP(MD5_ROUND_H, d, a, b, c, x[8], 0x8771f681, 11)
+        MD5_STEP(MD5_ROUND_H, c, d, a, b, x[11], 0x6d9d6122, 16)
+        MD5_STEP(MD5_ROUND_H, b, c, d, a, x[14], 0xfde5380c, 23)
+        MD5_STEP(MD5_ROUND_H, a, b, c, d, x[1], 0xa4beea44, 4)
+        MD5_STEP(MD5_ROUND_H, d, a, b, c, x[4], 0x4bdecfa9, 11)
+        MD5_STEP(MD5_ROUND_H, c, d, a, b, x[7], 0xf6bb4b60, 16)
+        MD5_STEP(MD5_ROUND_H, b, c, d, a, x[10], 0xbebfbc70, 23)
+        MD5_STEP(MD5_ROUND_H, a, b, c, d, x[13], 0x289b7ec6, 4)
+        MD5_STEP(MD5_ROUND_H, d, a, b, c, x[0], 0xeaa127fa, 11)
+        MD5_STEP(MD5_ROUND_H, c, d, a, b, x[3], 0xd4ef3085, 16)
+        MD5_STEP(MD5_ROUND_H, b, c, d, a, x[6], 0x04881d05, 23)
+        MD5_STEP(MD5_ROUND_H, a, b, c, d, x[9], 0xd9d4d039, 4)
+        MD5_STEP(MD5_ROUND_H, d, a, b, c, x[12], 0xe6db99e5, 11)
+        MD5_STEP(MD5_ROUND_H, c, d, a, b, x[15], 0x1fa27cf8, 16)
+        MD5_STEP(MD5_ROUND_H, b, c, d, a, x[2], 0xc4ac5665, 23)
+
+        // Ronda 4
+        MD5_STEP(MD5_ROUND_I, a, b, c, d, x[0], 0xf4292244, 6)
+        MD5_STEP(MD5_ROUND_I, d, a, b, c, x[7], 0x432aff97, 10)
+        MD5_STEP(MD5_ROUND_I, c, d, a, b, x[14], 0xab9423a7, 15)
+        MD5_STEP(MD5_ROUND_I, b, c, d, a, x[5], 0xfc93a039, 21)
+        MD5_STEP(MD5_ROUND_I, a, b, c, d, x[12], 0x655b59c3, 6)
+        MD5_STEP(MD5_ROUND_I, d, a, b, c, x[3], 0x8f0ccc92, 10)
+        MD5_STEP(MD5_ROUND_I, c, d, a, b, x[10], 0xffeff47d, 15)
+        MD5_STEP(MD5_ROUND_I, b, c, d, a, x[1], 0x85845dd1, 21)
+        MD5_STEP(MD5_ROUND_I, a, b, c, d, x[8], 0x6fa87e4f, 6)
+        MD5_STEP(MD5_ROUND_I, d, a, b, c, x[15], 0xfe2ce6e0, 10)
+        MD5_STEP(MD5_ROUND_I, c, d, a, b, x[6], 0xa3014314, 15)
+        MD5_STEP(MD5_ROUND_I, b, c, d, a, x[13], 0x4e0811a1, 21)
+        MD5_STEP(MD5_ROUND_I, a, b, c, d, x[4], 0xf7537e82, 6)
+        MD5_STEP(MD5_ROUND_I, d, a, b, c, x[11], 0xbd3af235, 10)
+        MD5_STEP(MD5_ROUND_I, c, d, a, b, x[2], 0x2ad7d2bb, 15)
+        MD5_STEP(MD5_ROUND_I, b, c, d, a, x[9], 0xeb86d391, 21)
+
+        a += sa;
+        b += sb;
+        c += sc;
+        d += sd;
+        data += 64;
+    }
+
+    ctx->state[0] = a;
+    ctx->state[1] = b;
+    ctx->state[2] = c;
+    ctx->state[3] = d;
+}
+/**************************************************
+ *
+ * @Finalidad: Inicializar el estado de un cálculo MD5.
+ * @Parametros: out: ctx = estado a inicializar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void MD5_init(Md5Context *ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un bloque de datos al cálculo. Se puede llamar tantas
+ *             veces como se quiera con trozos de cualquier tamaño.
+ * @Parametros: in/out: ctx  = estado del cálculo.
+ *              in:     data = datos a añadir.
+ *              in:     size = número de bytes de 'data'.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void MD5_update(Md5Context *ctx, const void *data, size_t size) {
+    const unsigned char *input = (const unsigned char *)data;
+    size_t used = ctx->length & 63;
+
+    ctx->length += size;
+
+    // Completar primero el bloque pendiente de la llamada anterior
+    if (used > 0) {
+        size_t missing = 64 - used;
+        if (size < missing) {
+            memcpy(ctx->buffer + used, input, size);
+            return;
+        }
+        memcpy(ctx->buffer + used, input, missing);
+        MD5_transform(ctx, ctx->buffer, 1);
+        input += missing;
+        size -= missing;
+    }
+
+    // Los bloques completos se procesan directamente, sin copiarlos
+    if (size >= 64) {
+        MD5_transform(ctx, input, size / 64);
+        input += size & ~(size_t)63;
+        size &= 63;
+    }
+
+    memcpy(ctx->buffer, input, size);
+}
+/**************************************************
+ *
+ * @Finalidad: Terminar el cálculo añadiendo el relleno y la longitud,
+ *             y obtener el hash.
+ * @Parametros: in/out: ctx    = estado del cálculo (queda inservible).
+ *              out:    digest = los 16 bytes del hash.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void MD5_final(Md5Context *ctx, unsigned char digest[MD5_DIGEST_SIZE]) {
+    uint64_t bits = ctx->length << 3;
+    size_t used = ctx->length & 63;
+    unsigned char padding[72];
+
+    // Un bit a 1, ceros hasta 56 (mod 64) y la longitud en bits en little-endian
+    size_t padLength = (used < 56) ? 56 - used : 120 - used;
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        padding[padLength + i] = (unsigned char)(bits >> (8 * i));
+    }
+    MD5_update(ctx, padding, padLength + 8);
+
+    for (int i = 0; i < 4; i++) {
+        digest[i * 4] = (unsigned char)ctx->state[i];
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 3] = (unsigned char)(ctx->state[i] >> 24);
+    }
+}
+/**************************************************
+ *
+ * @Finalidad: Terminar el cálculo y obtener el hash como cadena de
+ *             32 caracteres hexadecimales en minúscula (formato de md5sum).
+ * @Parametros: in/out: ctx = estado del cálculo (queda inservible).
+ *              out:    hex = buffer de MD5_HEX_SIZE bytes.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void MD5_finalHex(Md5Context *ctx, char hex[MD5_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    unsigned char digest[MD5_DIGEST_SIZE];
+
+    MD5_final(ctx, digest);
+    for (int i = 0; i < MD5_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0F];
+    }
+    hex[MD5_HEX_SIZE - 1] = '\0';
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular el MD5 de un descriptor leyendo en bloques grandes,
+ *             para ficheros que no se pueden proyectar en memoria.
+ * @Parametros: in:     fd  = descriptor abierto en lectura.
+ *              in/out: ctx = estado del cálculo.
+ * @Retorno:    MD5_OK si se leyó hasta el final; MD5_ERROR_READ en caso de error.
+ *
+ **************************************************/
+static int MD5_hashDescriptor(int fd, Md5Context *ctx) {
+    char *buffer = (char *)malloc(MD5_READ_SIZE);
+    if (!buffer) {
+        perror("Error allocating memory for MD5");
+        return MD5_ERROR_READ;
+    }
+
+    ssize_t n;
+    while ((n = read(fd, buffer, MD5_READ_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error reading file for MD5");
+            free(buffer);
+            return MD5_ERROR_READ;
+        }
+        MD5_update(ctx, buffer, n);
+    }
+
+    free(buffer);
+    return MD5_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular el MD5 de un fichero sin crear procesos: se proyecta
+ *             en memoria y, si no es posible, se lee en bloques grandes.
+ * @Parametros: in:  path = ruta del fichero (admite cualquier carácter).
+ *              out: hex  = buffer de MD5_HEX_SIZE bytes para el hash.
+ * @Retorno:    MD5_OK si se calculó el hash; MD5_ERROR_OPEN o MD5_ERROR_READ
+ *              en caso de error.
+ *
+ **************************************************/
+int MD5_hashFile(const char *path, char hex[MD5_HEX_SIZE]) {
+    Md5Context ctx;
+    struct stat st;
+    int result = MD5_OK;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file for MD5");
+        return MD5_ERROR_OPEN;
+    }
+
+    MD5_init(&ctx);
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        MD5_update(&ctx, map, st.st_size);
+        munmap(map, st.st_size);
+    } else {
+        result = MD5_hashDescriptor(fd, &ctx);
+    }
+    close(fd);
+
+    if (result == MD5_OK) {
+        MD5_finalHex(&ctx, hex);
+    }
+    return result;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir a un cálculo incremental los primeros 'length' bytes
+ *             de un fichero, por ejemplo la parte ya recibida al reanudar
+ *             una transferencia. No mueve la posición del descriptor.
+ * @Parametros: in/out: ctx    = estado del cálculo.
+ *              in:     fd     = descriptor abierto en lectura.
+ *              in:     length = bytes a procesar desde el principio.
+ * @Retorno:    MD5_OK si se han procesado todos; MD5_ERROR_READ si el
+ *              fichero es más corto o no se puede leer.
+ *
+ **************************************************/
+int MD5_updateFromFile(Md5Context *ctx, int fd, off_t length) {
+    struct stat st;
+    if (length <= 0) {
+        return MD5_OK;
+    } else if (fstat(fd, &st) != 0 || st.st_size < length) {
+        return MD5_ERROR_READ;
+    }
+    void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+        madvise(map, length, MADV_SEQUENTIAL);
+        MD5_update(ctx, map, length);
+        munmap(map, length);
+        return MD5_OK;
+    }
+
+    char *buffer = (char *)malloc(MD5_READ_SIZE);
+    if (!buffer) {
+        perror("Error allocating memory for MD5");
+        return MD5_ERROR_READ;
+    }
+    off_t done = 0;
+    while (done < length) {
+        size_t size = length - done < MD5_READ_SIZE ? (size_t)(length - done) : MD5_READ_SIZE;
+        ssize_t n = pread(fd, buffer, size, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            free(buffer);
+            return MD5_ERROR_READ;
+        }
+        MD5_update(ctx, buffer, n);
+        done += n;
+    }
+    free(buffer);
+    return MD5_OK;
+}
@@ -0,0 +1,47 @@
+/***********************************************
+*
+* @Proposito:  Declara el cálculo del hash MD5 (RFC 1321) de bloques
+*               de memoria y ficheros sin depender de herramientas externas
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef MD5_H
+#define MD5_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MD5_DIGEST_SIZE 16
+#define MD5_HEX_SIZE 33
+
+// Tamaño de las lecturas cuando el fichero no se puede proyectar en memoria
+#define MD5_READ_SIZE (1024 * 1024)
+
+#define MD5_OK 0
+#define MD5_ERROR_OPEN -1
+#define MD5_ERROR_READ -2
+
+// Estado de un cálculo incremental
+typedef struct md5_context {
+    uint32_t state[4];
+    uint64_t length;                // Bytes procesados en total
+    unsigned char buffer[64];       // Bloque incompleto pendiente
+} Md5Context;
+
+void MD5_init(Md5Context *ctx);
+void MD5_update(Md5Context *ctx, const void *data, size_t size);
+void MD5_final(Md5Context *ctx, unsigned char digest[MD5_DIGEST_SIZE]);
+void MD5_finalHex(Md5Context *ctx, char hex[MD5_HEX_SIZE]);
+int MD5_hashFile(const char *path, char hex[MD5_HEX_SIZE]);
+int MD5_updateFromFile(Md5Context *ctx, int fd, off_t length);
+
+#endif // MD5_H
@@ -19,5 +19,13 @@
 #include "readconfig.h"
 #include "so_compression.h"
 #include "distorsion.h"
+#include "md5.h"
+#include "registry.h"
+#include "threadpool.h"
+#include "image.h"
+#include "audio.h"
+#include "cache.h"
+#include "journal.h"
+#include "jobtable.h"
 
 #endif // PROJECT_H
\ No newline at end of file
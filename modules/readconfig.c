@@ -83,6 +83,7 @@ GothamConfig READCONFIG_read_config_gotham(const char *config_file) {
  *                                4. Puerto de escucha del worker
  *                                5. Ruta de la carpeta de trabajo
  *                                6. Tipo de worker (Media o Text)
+ *                                7. (Opcional) Máximo de distorsiones simultáneas
  * @Retorno:    Estructura WorkerConfig con todos los campos inicializados
  *             según el contenido del fichero.
  *
@@ -151,6 +152,17 @@ WorkerConfig READCONFIG_read_config_worker(const char *config_file) {
         }
     }
 
+    // Las configuraciones antiguas no tienen la línea: una distorsión por core
+    char *max_jobs = STRING_readUntil(fd, '\n');
+    config.max_jobs = max_jobs != NULL ? atoi(max_jobs) : 0;
+    free(max_jobs);
+    if (config.max_jobs <= 0) {
+        config.max_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (config.max_jobs <= 0) {
+            config.max_jobs = 1;
+        }
+    }
+
     close(fd);
     return config;
 }
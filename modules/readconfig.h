@@ -37,6 +37,7 @@ typedef struct {
     char *worker_server_port;
     char *directory;
     char *worker_type;
+    int max_jobs;               // Distorsiones simultáneas (opcional, por defecto una por core)
 } WorkerConfig;
 
 GothamConfig READCONFIG_read_config_gotham(const char *config_file);
@@ -0,0 +1,330 @@
+/***********************************************
+*
+* @Proposito:  Implementa el registro concurrente de workers de Gotham,
+*               indexado por tipo de worker
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "registry.h"
+
+/**************************************************
+ *
+ * @Finalidad: Inicializar un registro de workers vacío.
+ * @Parametros: out: registry = registro a inicializar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void REGISTRY_init(WorkerRegistry *registry) {
+    memset(registry, 0, sizeof(WorkerRegistry));
+    pthread_mutex_init(&registry->mutex, NULL);
+    atomic_init(&registry->numTypes, 0);
+}
+/**************************************************
+ *
+ * @Finalidad: Liberar los recursos del registro. No cierra los sockets
+ *             de los workers.
+ * @Parametros: in/out: registry = registro a liberar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void REGISTRY_destroy(WorkerRegistry *registry) {
+    pthread_mutex_destroy(&registry->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Buscar el índice de un tipo de worker. Los tipos solo se
+ *             añaden, nunca se quitan, por lo que se puede buscar sin bloqueo.
+ * @Parametros: in: registry = registro de workers.
+ *              in: type     = nombre del tipo (Media, Text...).
+ * @Retorno:    Índice del tipo; -1 si no existe.
+ *
+ **************************************************/
+static int REGISTRY_findType(WorkerRegistry *registry, const char *type) {
+    int numTypes = atomic_load_explicit(&registry->numTypes, memory_order_acquire);
+
+    for (int i = 0; i < numTypes; i++) {
+        if (strcmp(registry->types[i].name, type) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+/**************************************************
+ *
+ * @Finalidad: Empezar una modificación de un tipo: mientras el contador
+ *             es impar los lectores saben que deben reintentar.
+ * @Parametros: in/out: workers = tipo de worker que se modifica.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void REGISTRY_writeBegin(RegistryType *workers) {
+    unsigned int seq = atomic_load_explicit(&workers->seq, memory_order_relaxed);
+    atomic_store_explicit(&workers->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+/**************************************************
+ *
+ * @Finalidad: Terminar una modificación de un tipo, publicando los cambios.
+ * @Parametros: in/out: workers = tipo de worker modificado.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void REGISTRY_writeEnd(RegistryType *workers) {
+    unsigned int seq = atomic_load_explicit(&workers->seq, memory_order_relaxed);
+    atomic_store_explicit(&workers->seq, seq + 1, memory_order_release);
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un worker al conjunto de workers que atienden Flecks.
+ * @Parametros: in/out: workers = tipo de worker.
+ *              in:     slot    = slot del worker.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void REGISTRY_setReady(RegistryType *workers, int slot) {
+    workers->slots[slot].readyPos = workers->readyCount;
+    workers->ready[workers->readyCount++] = slot;
+}
+/**************************************************
+ *
+ * @Finalidad: Quitar un worker del conjunto de workers que atienden Flecks,
+ *             moviendo el último a su posición para no dejar huecos.
+ * @Parametros: in/out: workers = tipo de worker.
+ *              in:     slot    = slot del worker.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void REGISTRY_unsetReady(RegistryType *workers, int slot) {
+    int pos = workers->slots[slot].readyPos;
+    if (pos < 0) {
+        return;
+    }
+    int last = workers->ready[--workers->readyCount];
+    workers->ready[pos] = last;
+    workers->slots[last].readyPos = pos;
+    workers->slots[slot].readyPos = -1;
+}
+/**************************************************
+ *
+ * @Finalidad: Registrar un worker. Todos los workers de un tipo atienden
+ *             Flecks, por lo que pasa directamente al conjunto ready.
+ * @Parametros: in/out: registry = registro de workers.
+ *              in:     type     = tipo del worker.
+ *              in:     ip       = IP en la que el worker atiende a los Flecks.
+ *              in:     port     = puerto en el que el worker atiende a los Flecks.
+ *              in:     sockfd   = socket de la conexión del worker con Gotham.
+ * @Retorno:    Identificador del worker en el registro (>= 0);
+ *              REGISTRY_ERROR_FULL si no caben más tipos o workers.
+ *
+ **************************************************/
+int REGISTRY_add(WorkerRegistry *registry, const char *type, const char *ip, const char *port, int sockfd) {
+    pthread_mutex_lock(&registry->mutex);
+
+    int index = REGISTRY_findType(registry, type);
+    if (index < 0) {
+        index = atomic_load_explicit(&registry->numTypes, memory_order_relaxed);
+        if (index == REGISTRY_MAX_TYPES) {
+            pthread_mutex_unlock(&registry->mutex);
+            return REGISTRY_ERROR_FULL;
+        }
+        RegistryType *workers = &registry->types[index];
+        snprintf(workers->name, sizeof(workers->name), "%s", type);
+        // El tipo se publica cuando ya está inicializado
+        atomic_store_explicit(&registry->numTypes, index + 1, memory_order_release);
+    }
+
+    RegistryType *workers = &registry->types[index];
+    int slot = 0;
+    while (slot < REGISTRY_MAX_WORKERS && workers->slots[slot].used) {
+        slot++;
+    }
+    if (slot == REGISTRY_MAX_WORKERS) {
+        pthread_mutex_unlock(&registry->mutex);
+        return REGISTRY_ERROR_FULL;
+    }
+
+    REGISTRY_writeBegin(workers);
+    RegistryWorker *worker = &workers->slots[slot];
+    memset(worker, 0, sizeof(RegistryWorker));
+    worker->used = 1;
+    worker->sockfd = sockfd;
+    worker->readyPos = -1;
+    snprintf(worker->type, sizeof(worker->type), "%s", type);
+    snprintf(worker->ip, sizeof(worker->ip), "%s", ip);
+    snprintf(worker->port, sizeof(worker->port), "%s", port);
+    atomic_store_explicit(&workers->assigned[slot], 0, memory_order_relaxed);
+    workers->count++;
+    REGISTRY_setReady(workers, slot);
+    REGISTRY_writeEnd(workers);
+
+    pthread_mutex_unlock(&registry->mutex);
+    return index * REGISTRY_MAX_WORKERS + slot;
+}
+/**************************************************
+ *
+ * @Finalidad: Eliminar un worker del registro.
+ * @Parametros: in/out: registry = registro de workers.
+ *              in:     handle   = identificador devuelto por REGISTRY_add.
+ *              out:    removed  = copia del worker eliminado.
+ * @Retorno:    REGISTRY_OK si se ha eliminado;
+ *              REGISTRY_ERROR_NOT_FOUND si no existe.
+ *
+ **************************************************/
+int REGISTRY_remove(WorkerRegistry *registry, int handle, RegistryWorker *removed) {
+    int index = handle / REGISTRY_MAX_WORKERS;
+    int slot = handle % REGISTRY_MAX_WORKERS;
+
+    if (handle < 0 || index >= REGISTRY_MAX_TYPES) {
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&registry->mutex);
+    RegistryType *workers = &registry->types[index];
+    if (!workers->slots[slot].used) {
+        pthread_mutex_unlock(&registry->mutex);
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+
+    REGISTRY_writeBegin(workers);
+    *removed = workers->slots[slot];
+    REGISTRY_unsetReady(workers, slot);
+    workers->slots[slot].used = 0;
+    workers->count--;
+    REGISTRY_writeEnd(workers);
+
+    pthread_mutex_unlock(&registry->mutex);
+    return REGISTRY_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Guardar el último informe de carga de un worker. Los Flecks
+ *             asignados desde el informe anterior ya están incluidos en él.
+ * @Parametros: in/out: registry    = registro de workers.
+ *              in:     handle      = identificador devuelto por REGISTRY_add.
+ *              in:     activeJobs  = distorsiones en curso en el worker.
+ *              in:     queuedBytes = bytes pendientes de esas distorsiones.
+ *              in:     load        = carga de CPU del worker (% de los cores).
+ *              in:     capacity    = distorsiones que admite el worker (0 si
+ *                                    no lo informa).
+ * @Retorno:    REGISTRY_OK si se ha actualizado;
+ *              REGISTRY_ERROR_NOT_FOUND si el worker no existe.
+ *
+ **************************************************/
+int REGISTRY_updateLoad(WorkerRegistry *registry, int handle, int activeJobs, long long queuedBytes, int load, int capacity) {
+    int index = handle / REGISTRY_MAX_WORKERS;
+    int slot = handle % REGISTRY_MAX_WORKERS;
+
+    if (handle < 0 || index >= REGISTRY_MAX_TYPES) {
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&registry->mutex);
+    RegistryType *workers = &registry->types[index];
+    if (!workers->slots[slot].used) {
+        pthread_mutex_unlock(&registry->mutex);
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+
+    REGISTRY_writeBegin(workers);
+    workers->slots[slot].activeJobs = activeJobs;
+    workers->slots[slot].queuedBytes = queuedBytes;
+    workers->slots[slot].load = load;
+    workers->slots[slot].capacity = capacity;
+    atomic_store_explicit(&workers->assigned[slot], 0, memory_order_relaxed);
+    REGISTRY_writeEnd(workers);
+
+    pthread_mutex_unlock(&registry->mutex);
+    return REGISTRY_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Comparar la carga de dos workers: primero si alguno está
+ *             saturado, luego los trabajos pendientes (los del informe más
+ *             los asignados después), los bytes en cola y la carga de CPU.
+ * @Parametros: in: a, b = workers a comparar.
+ *              in: assignedA, assignedB = Flecks asignados a cada uno desde
+ *                                         su último informe.
+ * @Retorno:    1 si 'b' está menos cargado que 'a'; 0 si no.
+ *
+ **************************************************/
+static int REGISTRY_isLighter(const RegistryWorker *a, unsigned int assignedA, const RegistryWorker *b, unsigned int assignedB) {
+    long long jobsA = a->activeJobs + (long long)assignedA;
+    long long jobsB = b->activeJobs + (long long)assignedB;
+    int fullA = a->capacity > 0 && jobsA >= a->capacity;
+    int fullB = b->capacity > 0 && jobsB >= b->capacity;
+
+    if (fullA != fullB) {
+        return fullA;
+    }
+    if (jobsA != jobsB) {
+        return jobsB < jobsA;
+    }
+    if (a->queuedBytes != b->queuedBytes) {
+        return b->queuedBytes < a->queuedBytes;
+    }
+    return b->load < a->load;
+}
+/**************************************************
+ *
+ * @Finalidad: Escoger, en tiempo constante y sin bloquear, uno de los workers
+ *             de un tipo que atienden Flecks. Se comparan dos candidatos al
+ *             azar y se queda el menos cargado (power of two choices), lo que
+ *             evita enviar todos los Flecks al mismo worker entre dos informes.
+ * @Parametros: in/out: registry = registro de workers.
+ *              in:     type     = tipo de worker buscado.
+ *              out:    worker   = copia del worker escogido.
+ * @Retorno:    REGISTRY_OK si se ha encontrado un worker;
+ *              REGISTRY_ERROR_NOT_FOUND si no hay ninguno disponible.
+ *
+ **************************************************/
+int REGISTRY_select(WorkerRegistry *registry, const char *type, RegistryWorker *worker) {
+    int index = REGISTRY_findType(registry, type);
+    if (index < 0) {
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+
+    RegistryType *workers = &registry->types[index];
+    unsigned int turn = atomic_fetch_add_explicit(&workers->next, 1, memory_order_relaxed);
+    // Dispersión multiplicativa del turno para obtener dos candidatos al azar
+    unsigned int hash = (turn + 1) * 2654435761u;
+    unsigned int begin, end;
+    int found, slot = -1;
+
+    // Lectura con seqlock: si un registro o una baja coincide, se repite
+    do {
+        begin = atomic_load_explicit(&workers->seq, memory_order_acquire);
+        if (begin & 1) {
+            sched_yield();
+            continue;
+        }
+        found = 0;
+        int readyCount = workers->readyCount;
+        if (readyCount > 0 && readyCount <= REGISTRY_MAX_WORKERS) {
+            int first = (int)(hash % (unsigned int)readyCount);
+            slot = workers->ready[first];
+            if (readyCount > 1) {
+                int second = (first + 1 + (int)((hash >> 16) % (unsigned int)(readyCount - 1))) % readyCount;
+                int other = workers->ready[second];
+                unsigned int assignedSlot = atomic_load_explicit(&workers->assigned[slot], memory_order_relaxed);
+                unsigned int assignedOther = atomic_load_explicit(&workers->assigned[other], memory_order_relaxed);
+                if (REGISTRY_isLighter(&workers->slots[slot], assignedSlot, &workers->slots[other], assignedOther)) {
+                    slot = other;
+                }
+            }
+            *worker = workers->slots[slot];
+            found = 1;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(&workers->seq, memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+
+    if (!found) {
+        return REGISTRY_ERROR_NOT_FOUND;
+    }
+    // Hasta el próximo informe, se cuenta el Fleck enviado como carga del worker
+    atomic_fetch_add_explicit(&workers->assigned[slot], 1, memory_order_relaxed);
+    return REGISTRY_OK;
+}
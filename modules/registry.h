@@ -0,0 +1,70 @@
+/***********************************************
+*
+* @Proposito:  Declara el registro concurrente de workers de Gotham,
+*               indexado por tipo de worker
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define REGISTRY_MAX_TYPES 8
+#define REGISTRY_MAX_WORKERS 64       // Workers por tipo
+#define REGISTRY_TYPE_SIZE 16
+#define REGISTRY_IP_SIZE 46
+#define REGISTRY_PORT_SIZE 8
+
+#define REGISTRY_OK 0
+#define REGISTRY_ERROR_FULL -1
+#define REGISTRY_ERROR_NOT_FOUND -2
+
+// Datos de un worker, guardados por valor para poder copiarlos sin bloqueos
+typedef struct {
+    int used;
+    int sockfd;
+    int readyPos;                       // Posición en el conjunto ready (-1 si no está)
+    int activeJobs;                     // Último informe de carga (trama 0x12)
+    long long queuedBytes;
+    int load;                           // Carga de CPU en % de los cores
+    int capacity;                       // Distorsiones que admite (0 si no lo informa)
+    char type[REGISTRY_TYPE_SIZE];
+    char ip[REGISTRY_IP_SIZE];
+    char port[REGISTRY_PORT_SIZE];
+} RegistryWorker;
+
+// Workers de un tipo. Las escrituras van con el mutex del registro y las
+// lecturas con el seqlock 'seq' (impar mientras se modifica), sin bloquear
+typedef struct {
+    char name[REGISTRY_TYPE_SIZE];
+    atomic_uint seq;
+    atomic_uint next;                   // Turno de selección
+    int count;
+    int readyCount;
+    int ready[REGISTRY_MAX_WORKERS];    // Slots que atienden Flecks, sin huecos
+    atomic_uint assigned[REGISTRY_MAX_WORKERS];  // Flecks enviados desde el último informe
+    RegistryWorker slots[REGISTRY_MAX_WORKERS];
+} RegistryType;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    atomic_int numTypes;
+    RegistryType types[REGISTRY_MAX_TYPES];
+} WorkerRegistry;
+
+void REGISTRY_init(WorkerRegistry *registry);
+void REGISTRY_destroy(WorkerRegistry *registry);
+int REGISTRY_add(WorkerRegistry *registry, const char *type, const char *ip, const char *port, int sockfd);
+int REGISTRY_remove(WorkerRegistry *registry, int handle, RegistryWorker *removed);
+int REGISTRY_updateLoad(WorkerRegistry *registry, int handle, int activeJobs, long long queuedBytes, int load, int capacity);
+int REGISTRY_select(WorkerRegistry *registry, const char *type, RegistryWorker *worker);
+
+#endif // REGISTRY_H
@@ -60,7 +60,7 @@ int SOCKET_initSocket(char* incoming_Port, char* incoming_IP) {
         exit (EXIT_FAILURE);
     }
 
-    if(listen (sockfd, 5) < 0) {
+    if(listen (sockfd, SOMAXCONN) < 0) {
         write(STDOUT_FILENO, "Error: Cannot listen on socket\n", 31);
         exit (EXIT_FAILURE);
     }
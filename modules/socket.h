@@ -20,6 +20,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 
 int SOCKET_initSocket(char *incoming_Port, char *incoming_IP);
 int SOCKET_createSocket(char *incoming_Port, char *incoming_IP);
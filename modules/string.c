@@ -241,12 +241,13 @@ char* STRING_getXFromMessage(const char* message, int x) {
     strncpy(temp, message, 246); // Copia hasta 246 caracteres
     temp[246] = '\0';
 
-    // Inicializar el primer token
-    char *token = strtok(temp, "&");
+    // Inicializar el primer token (strtok_r: se llama desde varios hilos)
+    char *saveptr = NULL;
+    char *token = strtok_r(temp, "&", &saveptr);
 
     // Avanzar a través de los tokens hasta llegar al `x`-ésimo token
     for (int i = 0; i < x; i++) {
-        token = strtok(NULL, "&");
+        token = strtok_r(NULL, "&", &saveptr);
         if (token == NULL) {
             return NULL; // Si no hay suficientes tokens, retorna NULL
         }
@@ -0,0 +1,332 @@
+/***********************************************
+*
+* @Proposito:  Implementa un pool de hilos reutilizables con una cola por
+*               hilo y robo de tareas entre colas (work stealing)
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#define _GNU_SOURCE
+#include "threadpool.h"
+
+typedef struct {
+    ThreadPool *pool;
+    int index;
+} ThreadPoolStart;
+
+// Pool y cola del hilo actual, si es uno de los hilos de un pool
+static __thread ThreadPool *currentPool = NULL;
+static __thread int currentIndex = -1;
+
+/**************************************************
+ *
+ * @Finalidad: Añadir una tarea al final de una cola.
+ * @Parametros: in/out: deque    = cola destino.
+ *              in:     capacity = tamaño del buffer de la cola.
+ *              in:     task     = tarea a añadir.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void THREADPOOL_push(ThreadPoolDeque *deque, int capacity, ThreadPoolTask task) {
+    pthread_mutex_lock(&deque->mutex);
+    deque->tasks[(deque->head + deque->count) % capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Sacar una tarea de una cola, por delante (la más antigua) o
+ *             por detrás (la más reciente, cuando la roba otro hilo).
+ * @Parametros: in/out: deque    = cola origen.
+ *              in:     capacity = tamaño del buffer de la cola.
+ *              in:     steal    = 1 para sacar por detrás.
+ *              out:    task     = tarea extraída.
+ * @Retorno:    1 si se ha extraído una tarea; 0 si la cola estaba vacía.
+ *
+ **************************************************/
+static int THREADPOOL_pop(ThreadPoolDeque *deque, int capacity, int steal, ThreadPoolTask *task) {
+    int found = 0;
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        if (steal) {
+            *task = deque->tasks[(deque->head + deque->count - 1) % capacity];
+        } else {
+            *task = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) % capacity;
+        }
+        deque->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+/**************************************************
+ *
+ * @Finalidad: Bucle de cada hilo del pool: espera a que haya tareas, saca
+ *             primero las de su cola y, si está vacía, roba de las demás.
+ *             Al cerrar el pool termina las tareas pendientes antes de salir.
+ * @Parametros: in: arg = ThreadPoolStart con el pool y el índice del hilo.
+ * @Retorno:    NULL.
+ *
+ **************************************************/
+static void *THREADPOOL_run(void *arg) {
+    ThreadPoolStart *start = (ThreadPoolStart *)arg;
+    ThreadPool *pool = start->pool;
+    int index = start->index;
+    free(start);
+
+    // Las señales las atienden los hilos del programa, no los del pool
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    currentPool = pool;
+    currentIndex = index;
+
+    while (1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->available == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->workAvailable, &pool->mutex);
+        }
+        if (pool->available == 0) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        // Hay al menos una tarea en las colas reservada para este hilo
+        pool->available--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        ThreadPoolTask task;
+        int found = THREADPOOL_pop(&pool->deques[index], pool->capacity, 0, &task);
+        while (!found) {
+            for (int i = 1; i < pool->numThreads && !found; i++) {
+                int victim = (index + i) % pool->numThreads;
+                found = THREADPOOL_pop(&pool->deques[victim], pool->capacity, 1, &task);
+            }
+            if (!found) {
+                // La tarea reservada aún se está añadiendo a su cola
+                sched_yield();
+                found = THREADPOOL_pop(&pool->deques[index], pool->capacity, 0, &task);
+            }
+        }
+
+        task.function(task.arg);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->pending--;
+        pthread_cond_signal(&pool->spaceAvailable);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return NULL;
+}
+/**************************************************
+ *
+ * @Finalidad: Crear un pool de hilos. Los hilos se crean una sola vez y se
+ *             reutilizan para todas las tareas.
+ * @Parametros: in: numThreads = número de hilos del pool (>= 1).
+ *              in: capacity   = máximo de tareas pendientes, en cola o en
+ *                               ejecución (>= numThreads).
+ * @Retorno:    El pool creado; NULL si no se ha podido crear.
+ *
+ **************************************************/
+ThreadPool *THREADPOOL_create(int numThreads, int capacity) {
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+    if (capacity < numThreads) {
+        capacity = numThreads;
+    }
+
+    ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(ThreadPool));
+    pool->numThreads = numThreads;
+    pool->capacity = capacity;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workAvailable, NULL);
+    pthread_cond_init(&pool->spaceAvailable, NULL);
+
+    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numThreads);
+    pool->deques = (ThreadPoolDeque *)calloc(numThreads, sizeof(ThreadPoolDeque));
+    if (pool->threads == NULL || pool->deques == NULL) {
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    int allocated = 1;
+    for (int i = 0; i < numThreads; i++) {
+        pthread_mutex_init(&pool->deques[i].mutex, NULL);
+        // Cada cola puede llegar a guardar todas las tareas pendientes
+        pool->deques[i].tasks = (ThreadPoolTask *)malloc(sizeof(ThreadPoolTask) * capacity);
+        allocated = allocated && pool->deques[i].tasks != NULL;
+    }
+    if (!allocated) {
+        for (int i = 0; i < numThreads; i++) {
+            pthread_mutex_destroy(&pool->deques[i].mutex);
+            free(pool->deques[i].tasks);
+        }
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        ThreadPoolStart *start = (ThreadPoolStart *)malloc(sizeof(ThreadPoolStart));
+        if (start != NULL) {
+            start->pool = pool;
+            start->index = i;
+        }
+        if (start == NULL || pthread_create(&pool->threads[i], NULL, THREADPOOL_run, start) != 0) {
+            // Se sigue con los hilos que sí se han podido crear
+            free(start);
+            for (int j = i; j < numThreads; j++) {
+                pthread_mutex_destroy(&pool->deques[j].mutex);
+                free(pool->deques[j].tasks);
+            }
+            pthread_mutex_lock(&pool->mutex);
+            pool->numThreads = i;
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+    }
+    if (pool->numThreads == 0) {
+        THREADPOOL_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir una tarea aceptada a una cola y despertar a un hilo.
+ *             Un hilo del pool la añade a su propia cola; el resto se
+ *             reparten entre las colas por turnos.
+ * @Parametros: in/out: pool     = pool de hilos.
+ *              in:     function = función a ejecutar.
+ *              in:     arg      = argumento de la función.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void THREADPOOL_enqueue(ThreadPool *pool, ThreadPoolFunction function, void *arg) {
+    ThreadPoolTask task = { function, arg };
+    int index = currentIndex;
+
+    if (currentPool != pool) {
+        pthread_mutex_lock(&pool->mutex);
+        index = (int)(pool->nextDeque++ % (unsigned int)pool->numThreads);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    THREADPOOL_push(&pool->deques[index], pool->capacity, task);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->available++;
+    pthread_cond_signal(&pool->workAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+}
+/**************************************************
+ *
+ * @Finalidad: Enviar una tarea al pool sin bloquear.
+ * @Parametros: in/out: pool     = pool de hilos.
+ *              in:     function = función a ejecutar.
+ *              in:     arg      = argumento de la función.
+ * @Retorno:    THREADPOOL_OK si se ha aceptado; THREADPOOL_ERROR_FULL si ya
+ *              hay 'capacity' tareas pendientes; THREADPOOL_ERROR_SHUTDOWN
+ *              si el pool se está cerrando.
+ *
+ **************************************************/
+int THREADPOOL_submit(ThreadPool *pool, ThreadPoolFunction function, void *arg) {
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->mutex);
+        return THREADPOOL_ERROR_SHUTDOWN;
+    }
+    if (pool->pending >= pool->capacity) {
+        pthread_mutex_unlock(&pool->mutex);
+        return THREADPOOL_ERROR_FULL;
+    }
+    pool->pending++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    THREADPOOL_enqueue(pool, function, arg);
+    return THREADPOOL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Enviar una tarea al pool esperando, si está lleno, a que
+ *             termine alguna de las pendientes.
+ * @Parametros: in/out: pool     = pool de hilos.
+ *              in:     function = función a ejecutar.
+ *              in:     arg      = argumento de la función.
+ * @Retorno:    THREADPOOL_OK si se ha aceptado; THREADPOOL_ERROR_SHUTDOWN
+ *              si el pool se está cerrando.
+ *
+ **************************************************/
+int THREADPOOL_submitWait(ThreadPool *pool, ThreadPoolFunction function, void *arg) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending >= pool->capacity && !pool->shutdown) {
+        pthread_cond_wait(&pool->spaceAvailable, &pool->mutex);
+    }
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->mutex);
+        return THREADPOOL_ERROR_SHUTDOWN;
+    }
+    pool->pending++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    THREADPOOL_enqueue(pool, function, arg);
+    return THREADPOOL_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Consultar las tareas pendientes del pool.
+ * @Parametros: in: pool = pool de hilos.
+ * @Retorno:    Tareas aceptadas que aún no han terminado (en cola o en
+ *              ejecución).
+ *
+ **************************************************/
+int THREADPOOL_pending(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    int pending = pool->pending;
+    pthread_mutex_unlock(&pool->mutex);
+    return pending;
+}
+/**************************************************
+ *
+ * @Finalidad: Cerrar el pool: deja de aceptar tareas, espera a que los
+ *             hilos terminen las pendientes y libera los recursos. No se
+ *             puede llamar desde uno de los hilos del pool.
+ * @Parametros: in/out: pool = pool de hilos.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void THREADPOOL_destroy(ThreadPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->workAvailable);
+    pthread_cond_broadcast(&pool->spaceAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->numThreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->numThreads; i++) {
+        pthread_mutex_destroy(&pool->deques[i].mutex);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->workAvailable);
+    pthread_cond_destroy(&pool->spaceAvailable);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+}
@@ -0,0 +1,59 @@
+/***********************************************
+*
+* @Proposito:  Declara un pool de hilos reutilizables con una cola por hilo
+*               y robo de tareas entre colas (work stealing)
+* @Autor/es: Ignacio Giral, Marti Farre (ignacio.giral, marti.farre)
+* @Data creacion: 17/10/2026
+* @Data ultima modificacion: 17/10/2026
+*
+************************************************/
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+
+#define THREADPOOL_OK 0
+#define THREADPOOL_ERROR_FULL -1
+#define THREADPOOL_ERROR_SHUTDOWN -2
+
+typedef void (*ThreadPoolFunction)(void *arg);
+
+typedef struct {
+    ThreadPoolFunction function;
+    void *arg;
+} ThreadPoolTask;
+
+// Cola de un hilo del pool: su hilo saca las tareas por delante (orden de
+// llegada) y los demás las roban por detrás
+typedef struct {
+    pthread_mutex_t mutex;
+    ThreadPoolTask *tasks;              // Buffer circular de 'capacity' tareas
+    int head;
+    int count;
+} ThreadPoolDeque;
+
+typedef struct threadpool {
+    int numThreads;
+    int capacity;                       // Máximo de tareas pendientes (en cola o ejecutándose)
+    pthread_t *threads;
+    ThreadPoolDeque *deques;
+    pthread_mutex_t mutex;              // Protege los contadores y las esperas
+    pthread_cond_t workAvailable;
+    pthread_cond_t spaceAvailable;
+    int pending;                        // Tareas aceptadas y no terminadas
+    int available;                      // Tareas en las colas sin hilo asignado
+    unsigned int nextDeque;             // Reparto rotatorio de las tareas externas
+    int shutdown;
+} ThreadPool;
+
+ThreadPool *THREADPOOL_create(int numThreads, int capacity);
+int THREADPOOL_submit(ThreadPool *pool, ThreadPoolFunction function, void *arg);
+int THREADPOOL_submitWait(ThreadPool *pool, ThreadPoolFunction function, void *arg);
+int THREADPOOL_pending(ThreadPool *pool);
+void THREADPOOL_destroy(ThreadPool *pool);
+
+#endif // THREADPOOL_H
@@ -9,6 +9,209 @@
 ************************************************/
 #define _GNU_SOURCE
 #include "trama.h"
+#include <errno.h>
+/**************************************************
+ *
+ * @Finalidad: Sumar byte a byte un bloque de memoria, acumulando
+ *             sobre una suma parcial previa (versión escalar de referencia).
+ * @Parametros: in: sum  = suma parcial acumulada hasta el momento.
+ *              in: data = puntero al bloque de bytes.
+ *              in: size = número de bytes a sumar.
+ * @Retorno:    Nueva suma parcial.
+ *
+ **************************************************/
+static uint64_t TRAMA_sumBytesScalar(uint64_t sum, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        sum += (unsigned char)data[i];
+    }
+    return sum;
+}
+/**************************************************
+ *
+ * @Finalidad: Sumar los bytes de un bloque de 8 en 8 (SWAR): cada palabra de
+ *             64 bits se separa en bytes pares e impares que se acumulan en
+ *             cuatro carriles de 16 bits, que se vacían antes de desbordar.
+ * @Parametros: in: sum  = suma parcial acumulada hasta el momento.
+ *              in: data = puntero al bloque de bytes.
+ *              in: size = número de bytes a sumar.
+ * @Retorno:    Nueva suma parcial.
+ *
+ **************************************************/
+static uint64_t TRAMA_sumBytesSwar(uint64_t sum, const char *data, size_t size) {
+    const uint64_t mask = 0x00FF00FF00FF00FFULL;
+
+    while (size >= 8) {
+        // Cada iteración suma como mucho 2 * 255 por carril: 128 caben en 16 bits
+        size_t words = size / 8 < 128 ? size / 8 : 128;
+        uint64_t lanes = 0;
+
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            lanes += (word & mask) + ((word >> 8) & mask);
+            data += 8;
+        }
+        size -= words * 8;
+
+        lanes = (lanes & 0x0000FFFF0000FFFFULL) + ((lanes >> 16) & 0x0000FFFF0000FFFFULL);
+        sum += (lanes & 0xFFFFFFFFULL) + (lanes >> 32);
+    }
+
+    return TRAMA_sumBytesScalar(sum, data, size);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <pthread.h>
+#define TRAMA_HAVE_X86 1
+
+/**************************************************
+ *
+ * @Finalidad: Sumar los bytes de un bloque de 16 en 16 con SSE2
+ *             (_mm_sad_epu8 contra cero da la suma horizontal de cada mitad).
+ * @Parametros: in: sum  = suma parcial acumulada hasta el momento.
+ *              in: data = puntero al bloque de bytes.
+ *              in: size = número de bytes a sumar.
+ * @Retorno:    Nueva suma parcial.
+ *
+ **************************************************/
+__attribute__((target("sse2")))
+static uint64_t TRAMA_sumBytesSse2(uint64_t sum, const char *data, size_t size) {
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+
+    while (size >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)data);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(block, zero));
+        data += 16;
+        size -= 16;
+    }
+
+    uint64_t parts[2];
+    _mm_storeu_si128((__m128i *)parts, acc);
+    return TRAMA_sumBytesSwar(sum + parts[0] + parts[1], data, size);
+}
+/**************************************************
+ *
+ * @Finalidad: Sumar los bytes de un bloque de 32 en 32 con AVX2.
+ * @Parametros: in: sum  = suma parcial acumulada hasta el momento.
+ *              in: data = puntero al bloque de bytes.
+ *              in: size = número de bytes a sumar.
+ * @Retorno:    Nueva suma parcial.
+ *
+ **************************************************/
+__attribute__((target("avx2")))
+static uint64_t TRAMA_sumBytesAvx2(uint64_t sum, const char *data, size_t size) {
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (size >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)data);
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(block, zero));
+        data += 32;
+        size -= 32;
+    }
+
+    uint64_t parts[4];
+    _mm256_storeu_si256((__m256i *)parts, acc);
+    sum += parts[0] + parts[1] + parts[2] + parts[3];
+
+    // Se evita llamar al núcleo SSE2 para el resto: mezclar código AVX con
+    // SSE sin VEX penaliza cada transición
+    if (size >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)data);
+        _mm_storeu_si128((__m128i *)parts, _mm_sad_epu8(block, _mm_setzero_si128()));
+        sum += parts[0] + parts[1];
+        data += 16;
+        size -= 16;
+    }
+    _mm256_zeroupper();
+    return TRAMA_sumBytesSwar(sum, data, size);
+}
+#endif
+
+// Implementación de la suma elegida según la CPU en la primera llamada
+static uint64_t (*TRAMA_sumKernel)(uint64_t, const char *, size_t) = TRAMA_sumBytesSwar;
+
+#ifdef TRAMA_HAVE_X86
+static pthread_once_t TRAMA_sumOnce = PTHREAD_ONCE_INIT;
+
+/**************************************************
+ *
+ * @Finalidad: Escoger la implementación más rápida de la suma de bytes
+ *             que soporte la CPU en la que se ejecuta el programa.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void TRAMA_selectSumKernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        TRAMA_sumKernel = TRAMA_sumBytesAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        TRAMA_sumKernel = TRAMA_sumBytesSse2;
+    }
+}
+#endif
+/**************************************************
+ *
+ * @Finalidad: Sumar los bytes de un bloque de memoria, acumulando sobre
+ *             una suma parcial previa, con la implementación de la CPU.
+ * @Parametros: in: sum  = suma parcial acumulada hasta el momento.
+ *              in: data = puntero al bloque de bytes.
+ *              in: size = número de bytes a sumar.
+ * @Retorno:    Nueva suma parcial.
+ *
+ **************************************************/
+static uint64_t TRAMA_sumBytes(uint64_t sum, const char *data, size_t size) {
+#ifdef TRAMA_HAVE_X86
+    pthread_once(&TRAMA_sumOnce, TRAMA_selectSumKernel);
+#endif
+    return TRAMA_sumKernel(sum, data, size);
+}
+/**************************************************
+ *
+ * @Finalidad: Obtener todas las implementaciones de la suma de bytes, la
+ *             escalar de referencia la primera, para poder medirlas y
+ *             comprobar que dan el mismo resultado.
+ * @Parametros: out: count = número de implementaciones.
+ * @Retorno:    Tabla de implementaciones (estática, no se libera).
+ *
+ **************************************************/
+const TramaSumKernel *TRAMA_getSumKernels(int *count) {
+    static TramaSumKernel kernels[] = {
+        { "scalar", TRAMA_sumBytesScalar, 1 },
+        { "swar", TRAMA_sumBytesSwar, 1 },
+#ifdef TRAMA_HAVE_X86
+        { "sse2", TRAMA_sumBytesSse2, 0 },
+        { "avx2", TRAMA_sumBytesAvx2, 0 },
+#endif
+    };
+#ifdef TRAMA_HAVE_X86
+    __builtin_cpu_init();
+    kernels[2].supported = __builtin_cpu_supports("sse2") != 0;
+    kernels[3].supported = __builtin_cpu_supports("avx2") != 0;
+#endif
+    *count = sizeof(kernels) / sizeof(kernels[0]);
+    return kernels;
+}
+/**************************************************
+ *
+ * @Finalidad: Reducir una suma parcial a 16 bits y devolver su
+ *             complemento a uno.
+ * @Parametros: in: sum = suma acumulada de los bytes.
+ * @Retorno:    Valor del checksum.
+ *
+ **************************************************/
+static uint16_t TRAMA_foldChecksum(uint64_t sum) {
+    // Reducimos la suma a 16 bits
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    // Retornamos el complemento a uno del checksum
+    return (uint16_t)~sum;
+}
 /**************************************************
  *
  * @Finalidad: Calcular el checksum de una trama .
@@ -17,99 +220,405 @@
  *
  **************************************************/
 uint16_t TRAMA_calculate_checksum(const char *trama) {
-    uint32_t sum = 0;
-
     // Asumimos que la trama tiene 256 bytes
-    for (int i = 0; i < 250; i++) { // Solo calculamos sobre los primeros 250 bytes
-        sum += (unsigned char)trama[i];
+    // Solo calculamos sobre los primeros 250 bytes
+    return TRAMA_foldChecksum(TRAMA_sumBytes(0, trama, 250));
+}
+/**************************************************
+ *
+ * @Finalidad: Inicializar un checksum incremental.
+ * @Parametros: out: ctx = estado del checksum.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void TRAMA_checksumInit(TramaChecksum *ctx) {
+    ctx->sum = 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Añadir un bloque de bytes a un checksum incremental. Trocear
+ *             los datos en varias llamadas da el mismo resultado que sumarlos
+ *             de una vez.
+ * @Parametros: in/out: ctx  = estado del checksum.
+ *              in:     data = bloque de bytes.
+ *              in:     size = número de bytes del bloque.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void TRAMA_checksumUpdate(TramaChecksum *ctx, const void *data, size_t size) {
+    ctx->sum = TRAMA_sumBytes(ctx->sum, (const char *)data, size);
+}
+/**************************************************
+ *
+ * @Finalidad: Obtener el checksum de todos los bytes añadidos.
+ * @Parametros: in: ctx = estado del checksum.
+ * @Retorno:    Valor del checksum.
+ *
+ **************************************************/
+uint16_t TRAMA_checksumFinal(const TramaChecksum *ctx) {
+    return TRAMA_foldChecksum(ctx->sum);
+}
+/**************************************************
+ *
+ * @Finalidad: Calcular el checksum de una trama grande: cabecera
+ *             (con el campo de checksum a cero) más todos sus datos.
+ * @Parametros: in: header = cabecera de TRAMA_LARGE_HEADER_SIZE bytes.
+ *              in: data   = datos de la trama.
+ *              in: size   = número de bytes de datos.
+ * @Retorno:    Valor del checksum.
+ *
+ **************************************************/
+static uint16_t TRAMA_calculateLargeChecksum(const char *header, const char *data, uint32_t size) {
+    TramaChecksum ctx;
+
+    TRAMA_checksumInit(&ctx);
+    TRAMA_checksumUpdate(&ctx, header, 5);
+    TRAMA_checksumUpdate(&ctx, header + 7, TRAMA_LARGE_HEADER_SIZE - 7);
+    TRAMA_checksumUpdate(&ctx, data, size);
+    return TRAMA_checksumFinal(&ctx);
+}
+/**************************************************
+ *
+ * @Finalidad: Crear un lector de tramas con buffer para una conexión.
+ *             El lector lee del socket en bloques grandes y entrega
+ *             tramas completas, reensamblando las lecturas parciales.
+ * @Parametros: in: fd = descriptor del socket del que se leerán las tramas.
+ * @Retorno:    Puntero al lector creado; NULL si falla la reserva de memoria.
+ *
+ **************************************************/
+TramaReader* TRAMA_createReader(int fd) {
+    TramaReader *reader = (TramaReader *)malloc(sizeof(TramaReader));
+    if (!reader) {
+        perror("Error allocating memory for trama reader");
+        return NULL;
     }
 
-    // Reducimos la suma a 16 bits
-    uint16_t checksum = (sum & 0xFFFF) + (sum >> 16);
+    reader->buffer = (char *)malloc(TRAMA_READER_SIZE);
+    if (!reader->buffer) {
+        perror("Error allocating memory for trama reader");
+        free(reader);
+        return NULL;
+    }
 
-    // Retornamos el complemento a uno del checksum
-    return ~checksum;
+    reader->fd = fd;
+    reader->start = 0;
+    reader->end = 0;
+    reader->capacity = TRAMA_READER_SIZE;
+    return reader;
 }
 /**************************************************
  *
- * @Finalidad: Leer del socket un una trama completa de 256 Bytes,
- *             validar su checksum y extraer el contenido en la estructura destino.
- * @Parametros: in:  sockfd = descriptor del socket conectado de donde se leerá la trama.
- *              out: trama  = puntero a la estructura donde se guardarán los campos de la trama.
- * @Retorno:    >0  = número de bytes leídos (debe coincidir con FRAME_SIZE) si la trama
- *                 se recibió y validó correctamente.
- *             ==0  = conexión cerrada (EOF).
- *             <0  = error:
- *                   -1 si falla la lectura del socket,
- *                   -2 si el checksum no coincide,
- *                   -3 en otros errores de validación o protocolo.
- *
- **************************************************/
-int TRAMA_readMessageFromSocket(int sockfd, struct trama *trama) {
-    char buffer[256];
-    int checksum = 0;
+ * @Finalidad: Liberar un lector de tramas y su buffer. No cierra el socket.
+ * @Parametros: in: reader = lector a liberar (puede ser NULL).
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void TRAMA_destroyReader(TramaReader *reader) {
+    if (!reader) {
+        return;
+    }
+    free(reader->buffer);
+    free(reader);
+}
+/**************************************************
+ *
+ * @Finalidad: Asegurar que el buffer del lector contiene al menos 'needed'
+ *             bytes pendientes, leyendo del socket en bloques tan grandes
+ *             como permita el espacio libre del buffer.
+ * @Parametros: in/out: reader = lector de tramas.
+ *              in:     needed = bytes contiguos que se necesitan.
+ * @Retorno:    TRAMA_OK si hay suficientes bytes; TRAMA_EOF si el socket se
+ *              cerró antes; TRAMA_WOULD_BLOCK si el socket es no bloqueante y
+ *              aún no hay datos; TRAMA_ERROR_READ si falla la lectura o la reserva.
+ *
+ **************************************************/
+static int TRAMA_fillReader(TramaReader *reader, size_t needed) {
+    if (reader->end - reader->start >= needed) {
+        return TRAMA_OK;
+    }
 
-    // Leer los datos del socket
-    int bytes_leidos = read(sockfd, buffer, 256);
-    
-    if(bytes_leidos == 3 && strcmp(buffer, "OUT") == 0) {
-        return -2;
+    // Mover los bytes pendientes al inicio para dejar sitio contiguo
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
     }
 
-    if (bytes_leidos != 256) {
-        perror("Error reading from socket, size was not 256 bytes");
-        return -1;
+    // Las tramas grandes pueden no caber: el buffer crece y se reutiliza después
+    if (needed > reader->capacity) {
+        char *aux = (char *)realloc(reader->buffer, needed);
+        if (!aux) {
+            perror("Error allocating memory for trama reader");
+            return TRAMA_ERROR_READ;
+        }
+        reader->buffer = aux;
+        reader->capacity = needed;
     }
 
-    // Asignar memoria para los datos de la trama
-    trama->data = malloc(247);  // Reservar espacio para los datos
-    if (!trama->data) {
-        perror("Error allocating memory for trama->data");
-        return -1;
+    while (reader->end < needed) {
+        ssize_t n = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return TRAMA_WOULD_BLOCK;
+            return TRAMA_ERROR_READ;
+        }
+        if (n == 0) {
+            return TRAMA_EOF;
+        }
+        reader->end += n;
     }
 
-    // Extraer tipo y longitud de la trama
-    trama->tipo = buffer[0];
-    trama->longitud = ((unsigned char)buffer[1] << 8 | (unsigned char)buffer[2]);
+    return TRAMA_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Traducir el resultado de TRAMA_fillReader al código de retorno
+ *             de una lectura de trama, distinguiendo un cierre limpio entre
+ *             tramas de un cierre a mitad de trama.
+ * @Parametros: in: reader = lector de tramas.
+ *              in: result = resultado de TRAMA_fillReader.
+ * @Retorno:    TRAMA_EOF, TRAMA_WOULD_BLOCK, TRAMA_ERROR_READ, TRAMA_ERROR_OUT
+ *              o TRAMA_ERROR_CLOSED.
+ *
+ **************************************************/
+static int TRAMA_fillError(TramaReader *reader, int result) {
+    size_t pending = reader->end - reader->start;
 
-    // Validar longitud de los datos
-    if (trama->longitud > 247) {
-        perror("Error: Invalid trama length");
-        free(trama->data);
-        trama->data = NULL;
-        return -1;
+    if (result == TRAMA_WOULD_BLOCK) {
+        return result;
+    }
+    if (result != TRAMA_EOF) {
+        perror("Error reading from socket");
+        return result;
+    }
+    if (pending == 0) {
+        return TRAMA_EOF;
+    }
+    if (pending == 3 && strncmp(reader->buffer + reader->start, "OUT", 3) == 0) {
+        return TRAMA_ERROR_OUT;
     }
 
-    // Copiar los datos a trama->data
-    for (int i = 0; i < trama->longitud; i++) {
-        trama->data[i] = buffer[3 + i];
+    write(STDOUT_FILENO, "Error: Connection closed in the middle of a trama\n", 50);
+    return TRAMA_ERROR_CLOSED;
+}
+/**************************************************
+ *
+ * @Finalidad: Extraer y validar una trama grande que ya está completa
+ *             en el buffer del lector.
+ * @Parametros: in:  header = inicio de la trama dentro del buffer.
+ *              out: trama  = estructura donde se guardan los campos.
+ * @Retorno:    TRAMA_OK si la trama es válida; código de error en otro caso.
+ *
+ **************************************************/
+static int TRAMA_parseLargeFrame(char *header, struct trama *trama) {
+    // Los datos se entregan sin copiar, apuntando al buffer del lector.
+    // Son binarios y no se terminan en '\0': el byte siguiente ya puede
+    // pertenecer a la próxima trama
+    trama->data = (uint8_t *)header + TRAMA_LARGE_HEADER_SIZE;
+
+    trama->checksum = ((unsigned char)header[5] << 8 | (unsigned char)header[6]);
+    trama->timestamp = ((uint32_t)(unsigned char)header[7] << 24 |
+                        (uint32_t)(unsigned char)header[8] << 16 |
+                        (uint32_t)(unsigned char)header[9] << 8 |
+                        (uint32_t)(unsigned char)header[10]);
+
+    // En las tramas de streaming el checksum solo protege la cabecera
+    uint32_t checked = ((unsigned char)header[0] & TRAMA_STREAM_FLAG) ? 0 : trama->longitud;
+    if (TRAMA_calculateLargeChecksum(header, (const char *)trama->data, checked) != trama->checksum) {
+        perror("Error: Checksum validation failed");
+        trama->data = NULL;
+        return TRAMA_ERROR_CHECKSUM;
     }
 
-    // Si los datos son tratados como cadena, agregar terminador nulo
-    if (trama->longitud < 247) {
-        trama->data[trama->longitud] = '\0';  // Solo escribir '\0' si hay espacio
+    return TRAMA_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Extraer y validar una trama clásica de 256 bytes que ya está
+ *             completa en el buffer del lector.
+ * @Parametros: in:  buffer = inicio de la trama dentro del buffer.
+ *              out: trama  = estructura donde se guardan los campos.
+ * @Retorno:    TRAMA_OK si la trama es válida; código de error en otro caso.
+ *
+ **************************************************/
+static int TRAMA_parseFrame(char *buffer, struct trama *trama) {
+    // Extraer tipo y longitud de la trama
+    trama->tipo = buffer[0];
+    trama->longitud = ((unsigned char)buffer[1] << 8 | (unsigned char)buffer[2]);
+
+    // Validar longitud de los datos
+    if (trama->longitud > TRAMA_DATA_SIZE) {
+        write(STDOUT_FILENO, "Error: Invalid trama length\n", 28);
+        return TRAMA_ERROR_PROTOCOL;
     }
 
     // Extraer checksum y timestamp
     trama->checksum = ((unsigned char)buffer[250] << 8 | (unsigned char)buffer[251]);
-    trama->timestamp = ((unsigned char)buffer[252] << 24 |
+    trama->timestamp = ((uint32_t)(unsigned char)buffer[252] << 24 |
                         (unsigned char)buffer[253] << 16 |
                         (unsigned char)buffer[254] << 8 |
                         (unsigned char)buffer[255]);
 
     // Calcular y validar el checksum
-    checksum = TRAMA_calculate_checksum(buffer);
-    if (checksum != trama->checksum) {
+    if (TRAMA_calculate_checksum(buffer) != trama->checksum) {
         perror("Error: Checksum validation failed");
-        return -1;
+        return TRAMA_ERROR_CHECKSUM;
+    }
+
+    // Los datos se entregan sin copiar, apuntando al buffer del lector.
+    // Como el checksum ya está validado, el terminador nulo puede pisar el
+    // relleno (o el propio checksum) de la trama ya consumida
+    trama->data = (uint8_t *)buffer + 3;
+    trama->data[trama->longitud] = '\0';
+
+    return TRAMA_OK;
+}
+/**************************************************
+ *
+ * @Finalidad: Obtener la siguiente trama completa de la conexión del lector,
+ *             validar su checksum y extraer el contenido en la estructura destino.
+ *             Acepta tramas clásicas de 256 bytes y tramas grandes
+ *             (primer byte con TRAMA_LARGE_FLAG).
+ * @Parametros: in/out: reader = lector de tramas asociado al socket.
+ *              out:    trama  = puntero a la estructura donde se guardarán los campos de la trama.
+ * @Retorno:    TRAMA_OK (1) si la trama se recibió y validó correctamente.
+ *              TRAMA_EOF (0) si la conexión se cerró limpiamente entre tramas.
+ *              TRAMA_WOULD_BLOCK (2) si el socket es no bloqueante y la trama
+ *                   aún no está completa; se debe reintentar cuando haya datos.
+ *              <0 en caso de error:
+ *                   TRAMA_ERROR_READ si falla la lectura del socket,
+ *                   TRAMA_ERROR_OUT si se recibe el aviso "OUT" de cierre,
+ *                   TRAMA_ERROR_CHECKSUM si el checksum no coincide,
+ *                   TRAMA_ERROR_CLOSED si la conexión se cerró a mitad de trama,
+ *                   TRAMA_ERROR_PROTOCOL si la trama está truncada o es inválida.
+ *
+ **************************************************/
+int TRAMA_readFrame(TramaReader *reader, struct trama *trama) {
+    int result;
+
+    trama->data = NULL;
+    if (!reader) {
+        return TRAMA_ERROR_READ;
+    }
+
+    result = TRAMA_fillReader(reader, 1);
+    if (result != TRAMA_OK) {
+        return TRAMA_fillError(reader, result);
     }
 
-    return 1;  // Éxito
+    // Tramas clásicas de tamaño fijo
+    if (!((unsigned char)reader->buffer[reader->start] & TRAMA_LARGE_FLAG)) {
+        result = TRAMA_fillReader(reader, TRAMA_FRAME_SIZE);
+        if (result != TRAMA_OK) {
+            return TRAMA_fillError(reader, result);
+        }
+
+        result = TRAMA_parseFrame(reader->buffer + reader->start, trama);
+        reader->start += TRAMA_FRAME_SIZE;
+        return result;
+    }
+
+    // Tramas grandes: primero la cabecera para conocer la longitud
+    result = TRAMA_fillReader(reader, TRAMA_LARGE_HEADER_SIZE);
+    if (result != TRAMA_OK) {
+        return TRAMA_fillError(reader, result);
+    }
+
+    const char *header = reader->buffer + reader->start;
+    trama->tipo = (uint8_t)header[0] & ~(TRAMA_LARGE_FLAG | TRAMA_STREAM_FLAG);
+    trama->longitud = ((uint32_t)(unsigned char)header[1] << 24 |
+                       (uint32_t)(unsigned char)header[2] << 16 |
+                       (uint32_t)(unsigned char)header[3] << 8 |
+                       (uint32_t)(unsigned char)header[4]);
+
+    if (trama->longitud > TRAMA_LARGE_MAX_DATA) {
+        write(STDOUT_FILENO, "Error: Invalid large trama length\n", 34);
+        return TRAMA_ERROR_PROTOCOL;
+    }
+
+    size_t frameSize = TRAMA_LARGE_HEADER_SIZE + trama->longitud;
+    result = TRAMA_fillReader(reader, frameSize);
+    if (result != TRAMA_OK) {
+        return TRAMA_fillError(reader, result);
+    }
+
+    result = TRAMA_parseLargeFrame(reader->buffer + reader->start, trama);
+    reader->start += frameSize;
+    return result;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Escribir directamente en un descriptor los primeros 'size'
+ *             bytes de datos de una trama leída, sin copias intermedias.
+ * @Parametros: in: fd    = descriptor de destino (normalmente un fichero).
+ *              in: trama = trama cuyos datos se escriben.
+ *              in: size  = bytes a escribir (<= trama->longitud).
+ * @Retorno:    0 si se escribieron todos los bytes; -1 en caso de error.
+ *
+ **************************************************/
+int TRAMA_writeData(int fd, const struct trama *trama, uint32_t size) {
+    const uint8_t *data = trama->data;
+
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error writing trama data");
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+
+    return 0;
 }
 
 /**************************************************
  *
- * @Finalidad: Construir una trama con los campos especificados 
+ * @Finalidad: Esperar a que un socket no bloqueante vuelva a admitir datos.
+ * @Parametros: in: sockfd = descriptor del socket.
+ * @Retorno:    0 si se puede volver a escribir; -1 en caso de error.
+ *
+ **************************************************/
+static int TRAMA_waitWritable(int sockfd) {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            perror("Error waiting for socket");
+            return -1;
+        }
+    }
+    return 0;
+}
+/**************************************************
+ *
+ * @Finalidad: Escribir un buffer completo en un socket, reintentando las
+ *             escrituras parciales y esperando si el socket es no bloqueante.
+ * @Parametros: in: sockfd = descriptor del socket.
+ *              in: buffer = bytes a escribir.
+ *              in: size   = número de bytes.
+ * @Retorno:    0 si se escribió todo; -1 en caso de error.
+ *
+ **************************************************/
+static int TRAMA_writeAll(int sockfd, const char *buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(sockfd, buffer, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && TRAMA_waitWritable(sockfd) == 0) continue;
+            return -1;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Construir una trama con los campos especificados
  *             (tipo, longitud de datos, datos, checksum y timestamp)
  *             y enviarla íntegramente al socket indicado.
  * @Parametros: in: sockfd = descriptor del socket por el que se enviará la trama.
@@ -145,5 +654,198 @@ void TRAMA_sendMessageToSocket(int sockfd, char type, int16_t size, char *data)
     trama[250] = (checksum >> 8) & 0xFF;
     trama[251] = checksum & 0xFF;
 
-    write(sockfd, trama, 256);
-}
\ No newline at end of file
+    TRAMA_writeAll(sockfd, trama, 256);
+}
+
+/**************************************************
+ *
+ * @Finalidad: Rellenar la cabecera de una trama grande (tipo con flags,
+ *             longitud, checksum y timestamp).
+ * @Parametros: out: header  = buffer de TRAMA_LARGE_HEADER_SIZE bytes.
+ *              in:  type    = código de tipo con TRAMA_LARGE_FLAG (y TRAMA_STREAM_FLAG) activados.
+ *              in:  size    = longitud de los datos de la trama.
+ *              in:  data    = datos que cubre el checksum.
+ *              in:  checked = bytes de 'data' incluidos en el checksum.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+static void TRAMA_buildLargeHeader(char *header, char type, uint32_t size, const char *data, uint32_t checked) {
+    uint32_t timestamp = time(NULL);
+
+    header[0] = type;
+    header[1] = (size >> 24) & 0xFF;
+    header[2] = (size >> 16) & 0xFF;
+    header[3] = (size >> 8) & 0xFF;
+    header[4] = size & 0xFF;
+    header[5] = 0;
+    header[6] = 0;
+    header[7] = (timestamp >> 24) & 0xFF;
+    header[8] = (timestamp >> 16) & 0xFF;
+    header[9] = (timestamp >> 8) & 0xFF;
+    header[10] = timestamp & 0xFF;
+
+    uint16_t checksum = TRAMA_calculateLargeChecksum(header, data, checked);
+    header[5] = (checksum >> 8) & 0xFF;
+    header[6] = checksum & 0xFF;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Construir una trama grande de longitud variable
+ *             (cabecera de TRAMA_LARGE_HEADER_SIZE bytes seguida de los datos)
+ *             y enviarla íntegramente al socket con una única llamada writev.
+ * @Parametros: in: sockfd = descriptor del socket por el que se enviará la trama.
+ *              in: type   = código de tipo de trama.
+ *              in: size   = número de bytes válidos en 'data' (<= TRAMA_LARGE_MAX_DATA).
+ *              in: data   = puntero al bloque de datos a incluir en la trama.
+ * @Retorno:    0 si la trama se envió completa; -1 en caso de error.
+ *
+ **************************************************/
+int TRAMA_sendLargeMessageToSocket(int sockfd, char type, uint32_t size, char *data) {
+    char header[TRAMA_LARGE_HEADER_SIZE];
+
+    if (size > TRAMA_LARGE_MAX_DATA) {
+        write(STDOUT_FILENO, "Error: Large trama too big\n", 27);
+        return -1;
+    }
+    TRAMA_buildLargeHeader(header, type | TRAMA_LARGE_FLAG, size, data, size);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = TRAMA_LARGE_HEADER_SIZE;
+    iov[1].iov_base = data;
+    iov[1].iov_len = size;
+
+    int iovcnt = 2;
+    struct iovec *current = iov;
+    while (iovcnt > 0) {
+        ssize_t n = writev(sockfd, current, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && TRAMA_waitWritable(sockfd) == 0) continue;
+            perror("Error writing large trama to socket");
+            return -1;
+        }
+        // Avanzar sobre los vectores ya enviados (escrituras parciales)
+        while (iovcnt > 0 && (size_t)n >= current->iov_len) {
+            n -= current->iov_len;
+            current++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            current->iov_base = (char *)current->iov_base + n;
+            current->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Enviar 'size' bytes de un fichero como una trama de streaming
+ *             sin copiarlos a espacio de usuario: la cabecera sale con
+ *             MSG_MORE y los datos pasan de la page cache al socket con sendfile.
+ * @Parametros: in:     sockfd  = descriptor del socket.
+ *              in:     type    = código de tipo de trama.
+ *              in:     file_fd = descriptor del fichero de origen.
+ *              in/out: offset  = posición del fichero desde la que se envía;
+ *                                se avanza con los bytes enviados.
+ *              in:     size    = número de bytes del fichero a enviar.
+ * @Retorno:    0 si la trama se envió completa; -1 en caso de error
+ *              (la conexión queda inservible porque la trama está a medias).
+ *
+ **************************************************/
+int TRAMA_sendFileToSocket(int sockfd, char type, int file_fd, off_t *offset, uint32_t size) {
+    char header[TRAMA_LARGE_HEADER_SIZE];
+
+    if (size > TRAMA_LARGE_MAX_DATA) {
+        write(STDOUT_FILENO, "Error: Large trama too big\n", 27);
+        return -1;
+    }
+    TRAMA_buildLargeHeader(header, type | TRAMA_LARGE_FLAG | TRAMA_STREAM_FLAG, size, NULL, 0);
+
+    size_t sent = 0;
+    while (sent < TRAMA_LARGE_HEADER_SIZE) {
+        ssize_t n = send(sockfd, header + sent, TRAMA_LARGE_HEADER_SIZE - sent, MSG_MORE | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && TRAMA_waitWritable(sockfd) == 0) continue;
+            perror("Error writing stream trama header to socket");
+            return -1;
+        }
+        sent += n;
+    }
+
+    uint32_t remaining = size;
+    while (remaining > 0) {
+        ssize_t n = sendfile(sockfd, file_fd, offset, remaining);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && TRAMA_waitWritable(sockfd) == 0) continue;
+            perror("Error sending file data to socket");
+            return -1;
+        }
+        if (n == 0) {
+            write(STDOUT_FILENO, "Error: File ended before the trama was complete\n", 49);
+            return -1;
+        }
+        remaining -= n;
+    }
+
+    return 0;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Enviar un bloque de datos de fichero (fases 0x03 y 0x05)
+ *             con el formato de trama que corresponde a la versión de
+ *             protocolo negociada con el otro extremo.
+ * @Parametros: in: sockfd   = descriptor del socket.
+ *              in: type     = código de tipo de trama.
+ *              in: size     = bytes válidos en 'data' (<= TRAMA_getDataSize(protocol)).
+ *              in: data     = datos a enviar.
+ *              in: protocol = versión de protocolo negociada.
+ * @Retorno:    0 si se envió correctamente; -1 en caso de error.
+ *
+ **************************************************/
+int TRAMA_sendDataToSocket(int sockfd, char type, uint32_t size, char *data, int protocol) {
+    if (protocol >= 2) {
+        return TRAMA_sendLargeMessageToSocket(sockfd, type, size, data);
+    }
+    TRAMA_sendMessageToSocket(sockfd, type, (int16_t)size, data);
+    return 0;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Obtener el número máximo de bytes de datos por trama
+ *             en las fases de transferencia de fichero.
+ * @Parametros: in: protocol = versión de protocolo negociada.
+ * @Retorno:    Bytes de datos por trama.
+ *
+ **************************************************/
+uint32_t TRAMA_getDataSize(int protocol) {
+    return protocol >= 2 ? TRAMA_LARGE_DATA_SIZE : TRAMA_DATA_SIZE;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Determinar la versión de protocolo a usar a partir de la
+ *             versión anunciada por el otro extremo.
+ * @Parametros: in: version = cadena con la versión anunciada, o NULL/vacía
+ *                            si el otro extremo no anuncia ninguna (versión 1).
+ * @Retorno:    Versión común más alta soportada por ambos extremos.
+ *
+ **************************************************/
+int TRAMA_negotiateProtocol(const char *version) {
+    if (version == NULL || version[0] == '\0') {
+        return TRAMA_PROTOCOL_LEGACY;
+    }
+
+    int peer = atoi(version);
+    if (peer < TRAMA_PROTOCOL_LEGACY) {
+        return TRAMA_PROTOCOL_LEGACY;
+    }
+    return peer < TRAMA_PROTOCOL_VERSION ? peer : TRAMA_PROTOCOL_VERSION;
+}
@@ -16,17 +16,104 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+
+// Tramas clásicas de tamaño fijo (control y protocolo versión 1)
+#define TRAMA_FRAME_SIZE 256
+#define TRAMA_DATA_SIZE 247
+
+// Tramas grandes de longitud variable (protocolo versión >= 2):
+// [tipo | TRAMA_LARGE_FLAG (1)] [longitud (4)] [checksum (2)] [timestamp (4)] [datos]
+#define TRAMA_LARGE_FLAG 0x80
+// Trama grande cuyo checksum solo cubre la cabecera: los datos se envían
+// directamente desde la page cache (sendfile) y su integridad la garantiza el MD5 final
+#define TRAMA_STREAM_FLAG 0x40
+#define TRAMA_LARGE_HEADER_SIZE 11
+#define TRAMA_LARGE_DATA_SIZE (64 * 1024)
+#define TRAMA_LARGE_MAX_DATA (1024 * 1024)
+
+// Versiones del protocolo negociadas en la petición 0x03 entre Fleck y worker
+#define TRAMA_PROTOCOL_LEGACY 1
+#define TRAMA_PROTOCOL_STREAM 3
+#define TRAMA_PROTOCOL_CACHE 4
+#define TRAMA_PROTOCOL_RESUME 5
+#define TRAMA_PROTOCOL_VERSION 5
+
+// Respuesta 0x03 de un worker que no admite más distorsiones (protocolo >= 2;
+// a los Flecks antiguos se les responde CON_KO)
+#define TRAMA_BUSY "BUSY"
+
+// Segundo campo de la respuesta 0x03 (protocolo >= 4) cuando el worker ya
+// tiene el resultado o el fichero de origen: el Fleck no envía el fichero y
+// espera la trama 0x04
+#define TRAMA_HAVE_IT "HAVE_IT"
+
+// Segundo campo de la respuesta 0x03 (protocolo >= 5) al reanudar una
+// subida; el tercero es el byte desde el que el Fleck debe continuar
+#define TRAMA_RESUME "RESUME"
+
+// Tamaño inicial del buffer de los lectores de tramas
+#define TRAMA_READER_SIZE (64 * 1024)
+
+// Códigos de retorno de TRAMA_readFrame
+#define TRAMA_OK 1
+#define TRAMA_EOF 0
+#define TRAMA_ERROR_READ -1
+#define TRAMA_ERROR_OUT -2
+#define TRAMA_ERROR_CHECKSUM -3
+#define TRAMA_ERROR_PROTOCOL -4
+#define TRAMA_ERROR_CLOSED -5        // El otro extremo se cerró a mitad de una trama
+// Socket no bloqueante sin una trama completa: los bytes leídos se conservan
+#define TRAMA_WOULD_BLOCK 2
 
 struct trama {
     uint8_t tipo;        // Campo de tipo (1 byte)
-    uint16_t longitud;   // Campo de longitud (2 bytes)
-    uint8_t *data;       // Puntero a los datos (variable, longitud dada por `longitud`)
+    uint32_t longitud;   // Campo de longitud (2 bytes, 4 bytes en tramas grandes)
+    uint8_t *data;       // Datos dentro del buffer del lector (válidos hasta la siguiente lectura)
     uint16_t checksum;   // Campo de checksum (2 bytes)
     uint32_t timestamp;  // Campo de timestamp (4 bytes)
 };
 
+// Lector con buffer asociado a una conexión: todas las lecturas de tramas de
+// un socket deben pasar por el mismo lector, que no es seguro entre hilos.
+typedef struct trama_reader {
+    int fd;
+    char *buffer;
+    size_t start;       // Primer byte pendiente de entregar
+    size_t end;         // Fin de los bytes leídos del socket
+    size_t capacity;
+} TramaReader;
+
+// Checksum incremental (suma de bytes en complemento a uno) para bloques de
+// cualquier tamaño; es el mismo que usan las tramas
+typedef struct trama_checksum {
+    uint64_t sum;
+} TramaChecksum;
+
+// Implementación de la suma de bytes del checksum, para compararlas (bench/)
+typedef struct {
+    const char *name;
+    uint64_t (*sum)(uint64_t sum, const char *data, size_t size);
+    int supported;      // 1 si la CPU en la que se ejecuta la soporta
+} TramaSumKernel;
+
 uint16_t TRAMA_calculate_checksum(const char *trama);
-int TRAMA_readMessageFromSocket(int fd, struct trama *trama);
+const TramaSumKernel *TRAMA_getSumKernels(int *count);
+void TRAMA_checksumInit(TramaChecksum *ctx);
+void TRAMA_checksumUpdate(TramaChecksum *ctx, const void *data, size_t size);
+uint16_t TRAMA_checksumFinal(const TramaChecksum *ctx);
+TramaReader* TRAMA_createReader(int fd);
+void TRAMA_destroyReader(TramaReader *reader);
+int TRAMA_readFrame(TramaReader *reader, struct trama *trama);
+int TRAMA_writeData(int fd, const struct trama *trama, uint32_t size);
 void TRAMA_sendMessageToSocket(int fd, char type, int16_t data_length, char *data);
+int TRAMA_sendLargeMessageToSocket(int fd, char type, uint32_t data_length, char *data);
+int TRAMA_sendDataToSocket(int fd, char type, uint32_t data_length, char *data, int protocol);
+int TRAMA_sendFileToSocket(int fd, char type, int file_fd, off_t *offset, uint32_t data_length);
+uint32_t TRAMA_getDataSize(int protocol);
+int TRAMA_negotiateProtocol(const char *version);
 
 #endif // TRAMA_H
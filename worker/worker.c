@@ -9,10 +9,13 @@
 #define _GNU_SOURCE
 #include "../modules/project.h"
 
-#define MEDIA 0
-#define TEXT 1
+#define TELEMETRY_PERIOD 1      // Segundos entre informes de carga a Gotham
 
-#define WORKER_FILE "worker_count"
+// Resultado de pedir hueco para una distorsión
+#define JOB_ACCEPTED 0
+#define JOB_BUSY -1
+
+#define CHECK_THREADS 1         // La comprobación del MD5 solo compara y responde
 
 // Variable global para almacenar la configuración
 WorkerConfig config;
@@ -20,26 +23,61 @@ WorkerConfig config;
 volatile sig_atomic_t *stop_signal = NULL;
 
 int fleckSock = -1, sockfd = -1, fleck_connecter_fd = -1;
+TramaReader *gothamReader = NULL;
+
+// Protege 'sockfd' entre el informe de carga y su cierre
+pthread_mutex_t gotham_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Carga que se informa periódicamente a Gotham (trama 0x12)
+atomic_int active_jobs = 0;
+atomic_llong queued_bytes = 0;
+
+// Despiertan al hilo de telemetría para que informe antes de su periodo.
+// El hilo principal no envía nada a Gotham: si lo interrumpiera SIGINT con
+// gotham_mutex tomado, doLogout se bloquearía esperándolo
+pthread_mutex_t telemetry_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t telemetry_wake = PTHREAD_COND_INITIALIZER;
+int telemetry_pending = 0;
+
+// Etapas del pipeline de distorsión, cada una con su pool y su cola acotada.
+// La de recepción admite config.max_jobs tareas en curso y otras tantas en
+// cola (cola de admisión) antes de rechazar peticiones
+ThreadPool *receive_pool = NULL;
+ThreadPool *check_pool = NULL;
+ThreadPool *distort_pool = NULL;
+ThreadPool *send_pool = NULL;
+
+// Hilos que ayudan a la etapa de distorsión con las imágenes y los textos
+// grandes, uno por core y compartidos por todas sus tareas
+ThreadPool *helper_pool = NULL;
+
+// Resultados ya distorsionados, en <carpeta del worker>/.cache
+ResultCache result_cache;
+
+// Estado de las tareas en <carpeta del worker>/.jobs.journal, compartido con
+// los demás workers del mismo tipo para que continúen las que queden a medias
+JobJournal job_journal;
+
+// Las mismas tareas en memoria compartida, para los workers de esta máquina
+JobTable job_table;
+
+// Tarea que recorre el pipeline
+typedef struct {
+    listElement2* element;
+    long long pendingBytes;             // Bytes por recibir contados en queued_bytes
+    int replyPending;                   // Falta la respuesta 0x03 al Fleck
+    char md5[MD5_HEX_SIZE];             // MD5 de los datos recibidos
+    char cacheKey[CACHE_KEY_SIZE];      // Clave del resultado ("" si no se guarda)
+    int haveIt;                         // El worker ya tiene el fichero: el Fleck no lo envía
+    int cachedResult;                   // El resultado sale de la caché
+    char* sourcePath;                   // Copia completa del origen aún por guardar (o NULL)
+} WorkerJob;
 
 LinkedList2 listE;
 LinkedList2 listH;
 
-typedef struct {
-    long message_type;
-    char filename[256];  // Ajusta el tamaño según lo necesario
-    char username[64]; 
-    char worker_type[64]; 
-    char factor[64]; 
-    int bytes_writtenF1;
-    int bytes_to_writeF1;
-    int bytes_writtenF2;
-    int bytes_to_writeF2;
-    int fd;
-    char MD5SUM[64];
-    char directory[256];
-    pthread_t thread_id;
-    int status; // 0: No empezada, 1: Transfiriendo1 , 2: Distorsionando, 3: Transfiriendo2, 4: Completada
-} MessageQueueElement;
+// Protege las listas de tareas y el campo 'inPipeline' de sus elementos
+pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /***********************************************
 *
@@ -59,342 +97,737 @@ void free_config() {
 
 /**************************************************
  *
- * @Finalidad: Leer mensajes de la cola de comunicación (message queue)
- *             e insertar cada nueva tarea en la lista linkedlist.
- *             Se utiliza para procesar eventos entrantes de distintos tipos.
- * @Parametros: in/out: listW = instancia de LinkedList2 donde agregar los elementos
- *                             recibidos de la cola.
- *              in:     type  = entero que indica la categoría de mensaje a leer
- *                             (p. ej. 0 para eventos de medios, 1 para texto).
- * @Retorno:    ---.
+ * @Finalidad: Liberar una tarea y la memoria asociada a ella.
+ * @Parametros: in: element = tarea a liberar (ya fuera de la lista).
+ * @Retorno:    ----.
  *
  **************************************************/
-void read_from_msq(LinkedList2 listW, int type) {
-    write(STDOUT_FILENO, "[DEBUG] Iniciando `read_from_msq`...\n", 37);
-
-    key_t key = ftok("worker.c", type);
+void freeJob(listElement2* element) {
+    free(element->fileName);
+    free(element->username);
+    free(element->worker_type);
+    free(element->factor);
+    free(element->MD5SUM);
+    free(element->directory);
+    TRAMA_destroyReader(element->reader);
+    free(element);
+}
 
-    int msqid = msgget(key, IPC_CREAT | 0666);
-    if (msqid == -1) {
-        perror("[ERROR] msgget failed");
-        return;
-    }
+/**************************************************
+ *
+ * @Finalidad: Anotar el estado actual de una tarea en el diario y en la
+ *             tabla compartida.
+ * @Parametros: in: element = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void recordJob(listElement2* element) {
+    JOURNAL_record(&job_journal, element);
+    JOBTABLE_publish(&job_table, element);
+}
 
-    MessageQueueElement msg;
-    while (1) {
+/**************************************************
+ *
+ * @Finalidad: Anotar una tarea con el estado en que entra una etapa,
+ *             antes de que la etapa lo cambie.
+ * @Parametros: in: element = tarea.
+ *              in: status  = estado a anotar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void journalJob(listElement2* element, int status) {
+    listElement2 entry = *element;
+    entry.status = status;
+    recordJob(&entry);
+}
 
-        if (msgrcv(msqid, &msg, sizeof(MessageQueueElement) - sizeof(long), 0, IPC_NOWAIT) == -1) {
-            if (errno == ENOMSG) {
-                write(STDOUT_FILENO, "[DEBUG] No hay más mensajes en la cola.\n", 40);
-                break;
-            } else {
-                perror("[ERROR] msgrcv failed");
-            }
-        } else {
-            // Verificar si los campos clave son válidos
-            if (msg.filename[0] == '\0' || msg.username[0] == '\0' || msg.worker_type[0] == '\0') {
-                continue; // Ignorar este mensaje y continuar con el siguiente
-            }
-            write(STDOUT_FILENO, "[DEBUG] Mensaje recibido de la cola.\n", 37);
+/**************************************************
+ *
+ * @Finalidad: Dar por terminada una tarea en el diario y en la tabla
+ *             compartida, para que nadie la continúe.
+ * @Parametros: in: element = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void forgetJob(listElement2* element) {
+    JOURNAL_remove(&job_journal, element);
+    JOBTABLE_remove(&job_table, element);
+}
 
-            listElement2* newWorker = malloc(sizeof(listElement2));
-            if (!newWorker) {
-                perror("[ERROR] Memory allocation failed");
-                continue;
-            }
+/**************************************************
+ *
+ * @Finalidad: Quitar una tarea de la lista de tareas del worker.
+ * @Parametros: in/out: list    = lista de tareas.
+ *              in:     element = tarea a quitar.
+ * @Retorno:    1 si se ha encontrado y quitado; 0 si no estaba.
+ *
+ **************************************************/
+int removeJob(LinkedList2 list, listElement2* element) {
+    LINKEDLIST2_goToHead(list);
+    while (!LINKEDLIST2_isAtEnd(list)) {
+        if (LINKEDLIST2_get(list) == element) {
+            LINKEDLIST2_remove(list);
+            return 1;
+        }
+        LINKEDLIST2_next(list);
+    }
+    return 0;
+}
 
-            newWorker->username = strdup(msg.username);
-            newWorker->worker_type = strdup(msg.worker_type);
-            newWorker->factor = strdup(msg.factor);
-            newWorker->MD5SUM = strdup(msg.MD5SUM);
-            newWorker->directory = strdup(msg.directory);
-            newWorker->fileName = strdup(msg.filename);
-
-            newWorker->bytes_writtenF1 = msg.bytes_writtenF1;
-            newWorker->bytes_to_writeF1 = msg.bytes_to_writeF1;
-            newWorker->bytes_writtenF2 = msg.bytes_writtenF2;
-            newWorker->bytes_to_writeF2 = msg.bytes_to_writeF2;
-            newWorker->fd = msg.fd;
-            newWorker->thread_id = msg.thread_id;
-            newWorker->status = msg.status;
-
-            
-            LINKEDLIST2_add(listW, newWorker);
-            write(STDOUT_FILENO, "[DEBUG] Mensaje añadido a la lista.\n", 36);
+/**************************************************
+ *
+ * @Finalidad: Buscar en la lista la tarea de un usuario sobre un fichero.
+ * @Parametros: in: list     = lista de tareas.
+ *              in: fileName = nombre del fichero.
+ *              in: userName = nombre del usuario de Fleck.
+ * @Retorno:    La tarea encontrada; NULL si no existe.
+ *
+ **************************************************/
+listElement2* findJob(LinkedList2 list, const char* fileName, const char* userName) {
+    LINKEDLIST2_goToHead(list);
+    while (!LINKEDLIST2_isAtEnd(list)) {
+        listElement2* element = LINKEDLIST2_get(list);
+        if (strcmp(element->fileName, fileName) == 0 && strcmp(element->username, userName) == 0) {
+            return element;
         }
+        LINKEDLIST2_next(list);
     }
+    return NULL;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Buscar en la lista la tarea que un Fleck quiere reanudar y
+ *             reservarla para esta petición. Si aún está en el pipeline
+ *             (por ejemplo, la conexión anterior todavía no se ha dado por
+ *             perdida) una etapa puede estar usando su socket y su lector:
+ *             se rechaza sin esperar y el Fleck lo reintenta.
+ * @Parametros: in:  list     = lista de tareas.
+ *              in:  fileName = nombre del fichero.
+ *              in:  userName = nombre del usuario de Fleck.
+ *              out: found    = la tarea, ya marcada como en el pipeline
+ *                              (NULL si no existe o si sigue en él).
+ * @Retorno:    JOB_ACCEPTED; JOB_BUSY si sigue en el pipeline.
+ *
+ **************************************************/
+int acquireJob(LinkedList2 list, const char* fileName, const char* userName, listElement2** found) {
+    pthread_mutex_lock(&jobs_mutex);
+    listElement2* element = findJob(list, fileName, userName);
+    int result = JOB_ACCEPTED;
+    if (element != NULL && element->inPipeline) {
+        element = NULL;
+        result = JOB_BUSY;
+    } else if (element != NULL) {
+        element->inPipeline = 1;
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+    *found = element;
+    return result;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Calcular los bytes que faltan por recibir de una tarea, que
+ *             es lo que se informa a Gotham como trabajo pendiente.
+ * @Parametros: in: element = tarea.
+ * @Retorno:    Bytes pendientes (>= 0).
+ *
+ **************************************************/
+long long jobBytes(listElement2* element) {
+    long long pending = (long long)element->bytes_to_writeF1 - element->bytes_writtenF1;
+    return pending < 0 ? 0 : pending;
+}
 
-    // 🔹 Definir `buf` antes de usarlo
-    struct msqid_ds buf;  
-    msgctl(msqid, IPC_STAT, &buf);
-    if (buf.msg_qnum == 0) { // Solo eliminar si ya no hay mensajes
-        // Intentar cerrar la cola antes de eliminarla
-        if (msgctl(msqid, IPC_RMID, NULL) == 0) {
-            write(STDOUT_FILENO, "[DEBUG] Cola de mensajes eliminada.\n", 36);
+/**************************************************
+ *
+ * @Finalidad: Indicar al Fleck que puede empezar a enviar el fichero. Un
+ *             Fleck antiguo no anuncia versión y recibe la respuesta vacía
+ *             de siempre; uno nuevo recibe la versión acordada y, si el
+ *             worker ya tiene el resultado o el origen, TRAMA_HAVE_IT para
+ *             que no lo envíe, o TRAMA_RESUME y el byte desde el que
+ *             continuar si ya tiene una parte.
+ * @Parametros: in: element = tarea que empieza.
+ *              in: haveIt  = 1 si el worker ya tiene el resultado.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void sendJobReply(listElement2* element, int haveIt) {
+    if (element->protocol >= 2) {
+        char versionReply[32];
+        if (haveIt) {
+            snprintf(versionReply, sizeof(versionReply), "%d&%s", element->protocol, TRAMA_HAVE_IT);
+        } else if (element->protocol >= TRAMA_PROTOCOL_RESUME && element->status == 1 && element->bytes_writtenF1 > 0) {
+            snprintf(versionReply, sizeof(versionReply), "%d&%s&%d", element->protocol, TRAMA_RESUME, element->bytes_writtenF1);
         } else {
-            perror("[ERROR] No se pudo eliminar la cola");
+            snprintf(versionReply, sizeof(versionReply), "%d", element->protocol);
         }
+        TRAMA_sendMessageToSocket(element->fd, 0x03, (int16_t)strlen(versionReply), versionReply);
     } else {
-        write(STDOUT_FILENO, "[WARNING] La cola aún tiene mensajes, no se eliminó.\n", 53);
+        TRAMA_sendMessageToSocket(element->fd, 0x03, 0, "");
     }
-    write(STDOUT_FILENO, "[DEBUG] `read_from_msq` finalizado.\n", 36);
 }
 
 /**************************************************
  *
- * @Finalidad: Encolar una tarea representada por ‘element’ 
- *             en la cola de mensajes correspondiente al tipo de trabajador,
- *             para que Gotham o un worker lo procese posteriormente.
- * @Parametros: in: element    = puntero a la estructura listElement2 que contiene
- *                              los datos de la tarea 
- *              in: workerType = indica el tipo de worker
- 
- * @Retorno:    --- (void). Cualquier fallo en la operación se registra
- *             internamente en la estructura de error de la cola o lista.
+ * @Finalidad: Rechazar la petición de distorsión de un Fleck y cerrar su
+ *             conexión. Un Fleck nuevo recibe TRAMA_BUSY y pide otro worker
+ *             a Gotham; uno antiguo recibe CON_KO.
+ * @Parametros: in: sock     = socket del Fleck.
+ *              in: reader   = lector de tramas del socket.
+ *              in: protocol = versión de protocolo acordada.
+ * @Retorno:    ----.
  *
  **************************************************/
-void send_to_msq(listElement2* element, int workerType) {
-    if (element == NULL) {
-        write(STDOUT_FILENO, "[ERROR] NULL element in send_to_message_queue.\n", 47);
-        return;
+void rejectFleck(int sock, TramaReader* reader, int protocol) {
+    if (protocol >= 2) {
+        TRAMA_sendMessageToSocket(sock, 0x03, (int16_t)strlen(TRAMA_BUSY), TRAMA_BUSY);
+    } else {
+        TRAMA_sendMessageToSocket(sock, 0x03, (int16_t)strlen("CON_KO"), "CON_KO");
     }
+    TRAMA_destroyReader(reader);
+    close(sock);
+}
 
-    write(STDOUT_FILENO, "[DEBUG] Iniciando `send_to_msq`...\n", 35);
+/**************************************************
+ *
+ * @Finalidad: Descartar la copia del fichero de origen de una tarea.
+ * @Parametros: in/out: job = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void dropSource(WorkerJob* job) {
+    if (job->sourcePath != NULL) {
+        unlink(job->sourcePath);
+        free(job->sourcePath);
+        job->sourcePath = NULL;
+    }
+}
 
-    key_t key = ftok("worker.c", workerType);
+/**************************************************
+ *
+ * @Finalidad: Guardar en la caché la copia del fichero de origen de una
+ *             tarea, ya validada con su MD5, para no tener que recibirlo
+ *             otra vez.
+ * @Parametros: in/out: job = tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void storeSource(WorkerJob* job) {
+    char sourceKey[CACHE_KEY_SIZE];
+    if (job->sourcePath != NULL && CACHE_makeSourceKey(sourceKey, job->element->MD5SUM) == CACHE_OK) {
+        CACHE_store(&result_cache, sourceKey, job->sourcePath);
+    }
+    dropSource(job);
+}
 
-    int msqid = msgget(key, IPC_CREAT | 0666);
-    if (msqid == -1) {
-        perror("[ERROR] Error creating/getting message queue");
+/**************************************************
+ *
+ * @Finalidad: Terminar una tarea al salir del pipeline y, si ha acabado
+ *             (o el Fleck se ha ido), quitarla de la lista y liberarla.
+ *             Si el worker se está cerrando, doLogout se encarga de ella.
+ * @Parametros: in: job    = tarea que sale del pipeline.
+ *              in: result = 0 si se ha completado; 2 si el Fleck se ha
+ *                           desconectado; 1 en caso de error.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void finishJob(WorkerJob* job, int result) {
+    listElement2* element = job->element;
+
+    dropSource(job);
+    atomic_fetch_sub(&queued_bytes, job->pendingBytes);
+    atomic_fetch_sub(&active_jobs, 1);
+    free(job);
+    if (result == 0) {
+        element->fd = -1;   // Cerrado al completar la distorsión
+    }
+    if (*stop_signal) {
         return;
     }
 
-    MessageQueueElement msg;
-    memset(&msg, 0, sizeof(MessageQueueElement));
-
-    msg.message_type = 1;
-
-    strncpy(msg.filename, element->fileName, sizeof(msg.filename) - 1);
-    msg.filename[sizeof(msg.filename) - 1] = '\0';
-
-    strncpy(msg.username, element->username, sizeof(msg.username) - 1);
-    msg.username[sizeof(msg.username) - 1] = '\0';
-
-    strncpy(msg.worker_type, element->worker_type, sizeof(msg.worker_type) - 1);
-    msg.worker_type[sizeof(msg.worker_type) - 1] = '\0';
-
-    strncpy(msg.factor, element->factor, sizeof(msg.factor) - 1);
-    msg.factor[sizeof(msg.factor) - 1] = '\0';
-
-    strncpy(msg.MD5SUM, element->MD5SUM, sizeof(msg.MD5SUM) - 1);
-    msg.MD5SUM[sizeof(msg.MD5SUM) - 1] = '\0';
-
-    strncpy(msg.directory, element->directory, sizeof(msg.directory) - 1);
-    msg.directory[sizeof(msg.directory) - 1] = '\0';
+    if (result == 0 || result == 2) {
+        forgetJob(element);
+        LinkedList2 targetList = (strcmp(element->worker_type, "Media") == 0) ? listH : listE;
+        pthread_mutex_lock(&jobs_mutex);
+        int removed = removeJob(targetList, element);
+        pthread_mutex_unlock(&jobs_mutex);
+        if (removed) {
+            write(STDOUT_FILENO, "[DEBUG] finishJob: Element removed from list.\n", 46);
+            if (element->fd >= 0) {
+                close(element->fd);
+            }
+            freeJob(element);
+        } else {
+            write(STDOUT_FILENO, "[DEBUG] finishJob: List is empty, nothing to remove.\n", 53);
+        }
+    } else {
+        write(STDOUT_FILENO, "[ERROR] finishJob: Distortion failed.\n", 38);
+        // Se queda en la lista para que el Fleck la pueda reanudar, pero sin
+        // su conexión: al cerrarla el Fleck la da por perdida y vuelve con otra
+        pthread_mutex_lock(&jobs_mutex);
+        if (element->fd >= 0) {
+            close(element->fd);
+            element->fd = -1;
+        }
+        element->inPipeline = 0;
+        pthread_mutex_unlock(&jobs_mutex);
+    }
+}
 
-    msg.bytes_writtenF1 = element->bytes_writtenF1;
-    msg.bytes_to_writeF1 = element->bytes_to_writeF1;
-    msg.bytes_writtenF2 = element->bytes_writtenF2;
-    msg.bytes_to_writeF2 = element->bytes_to_writeF2;
-    msg.fd = -1; // Lo forzamos a -1
-    msg.thread_id = element->thread_id;
-    msg.status = element->status;
+/**************************************************
+ *
+ * @Finalidad: Pasar una tarea a la siguiente etapa del pipeline. Si la
+ *             cola de la etapa está llena se espera a que haya sitio, de
+ *             modo que una etapa lenta frena a las anteriores.
+ * @Parametros: in: pool     = pool de la etapa siguiente.
+ *              in: function = tarea de la etapa siguiente.
+ *              in: job      = tarea a pasar.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void forwardJob(ThreadPool* pool, ThreadPoolFunction function, WorkerJob* job) {
+    if (*stop_signal || THREADPOOL_submitWait(pool, function, job) != THREADPOOL_OK) {
+        finishJob(job, 1);
+    }
+}
 
-    write(STDOUT_FILENO, "[DEBUG] Enviando mensaje a la cola...\n", 38);
+/**************************************************
+ *
+ * @Finalidad: Comprobar, al empezar una etapa, si el worker se está
+ *             cerrando y, si es la primera etapa que ejecuta la tarea,
+ *             avisar al Fleck de que puede continuar. El Fleck ha esperado
+ *             la respuesta mientras la tarea estaba en la cola de admisión.
+ * @Parametros: in: job = tarea que empieza la etapa.
+ * @Retorno:    0 si la etapa debe ejecutarse; -1 si la tarea ya ha salido
+ *              del pipeline.
+ *
+ **************************************************/
+int startStage(WorkerJob* job) {
+    if (*stop_signal) {
+        finishJob(job, 1);
+        return -1;
+    }
+    if (job->replyPending) {
+        sendJobReply(job->element, job->haveIt);
+        job->replyPending = 0;
+    }
+    return 0;
+}
 
-    if (msgsnd(msqid, &msg, sizeof(MessageQueueElement) - sizeof(long), 0) == -1) {
-        perror("[ERROR] Error sending message to queue");
-    } else {
-        write(STDOUT_FILENO, "[DEBUG] Message successfully sent to queue.\n", 44);
+/**************************************************
+ *
+ * @Finalidad: Etapa de envío: enviar el fichero distorsionado al Fleck.
+ * @Parametros: in: arg = WorkerJob de la tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void sendStage(void* arg) {
+    WorkerJob* job = (WorkerJob*)arg;
+    if (startStage(job) != 0) {
+        return;
     }
+    journalJob(job->element, 3);
+    finishJob(job, DISTORSION_sendFile(job->element, stop_signal));
+    write(STDOUT_FILENO, "[DEBUG] sendStage: Task finished.\n\n", 35);
 }
 
 /**************************************************
  *
- * @Finalidad: Comprobar que el fichero  de trabajo
- *             asignado al worker existe; en caso contrario, crearlo.
- * @Parametros: ----.
+ * @Finalidad: Etapa de distorsión: distorsionar el fichero recibido y
+ *             pasarlo a la etapa de envío.
+ * @Parametros: in: arg = WorkerJob de la tarea.
  * @Retorno:    ----.
+ *
  **************************************************/
-void ensure_worker_file_exists() {
-    if (access(WORKER_FILE, F_OK) == -1) {
-        // El archivo no existe, lo creamos
-        FILE *f = fopen(WORKER_FILE, "w");
-        if (f == NULL) {
-            perror("[ERROR] Cannot create worker_count file");
-            exit(1);
+void distortStage(void* arg) {
+    WorkerJob* job = (WorkerJob*)arg;
+    if (startStage(job) != 0) {
+        return;
+    }
+    int result = DISTORSION_compressFile(job->element, helper_pool);
+    if (result != 0) {
+        finishJob(job, result);
+        return;
+    }
+    // En disco ya está el resultado: quien continúe la tarea no lo repite
+    job->element->fused = 1;
+    recordJob(job->element);
+    if (!job->cachedResult && job->cacheKey[0] != '\0') {
+        char* path = NULL;
+        if (asprintf(&path, "%s/%s", job->element->directory, job->element->fileName) != -1) {
+            CACHE_store(&result_cache, job->cacheKey, path);
+            free(path);
         }
-        fclose(f);
     }
+    forwardJob(send_pool, sendStage, job);
 }
 
 /**************************************************
  *
- * @Finalidad: Obtener el número de trabajadores (workers)
- *             actualmente registrados en la cola de mensajes (MSQ),
- *             diferenciando por tipo si fuera necesario.
- * @Parametros: ----.
- * @Retorno:    Entero que indica la cantidad de workers disponibles en la MSQ:
- *              >= 0 si la consulta fue exitosa;
- *              -1 si ocurrió un error al acceder o consultar la cola.
+ * @Finalidad: Etapa de comprobación de integridad: validar el MD5 de los
+ *             datos recibidos y pasar la tarea a la etapa de distorsión.
+ *             Ya no quedan bytes por recibir de la tarea.
+ * @Parametros: in: arg = WorkerJob de la tarea.
+ * @Retorno:    ----.
  *
  **************************************************/
-int get_worker_count_msq() {
-    ensure_worker_file_exists(); // Asegurar que el archivo existe
+void checkStage(void* arg) {
+    WorkerJob* job = (WorkerJob*)arg;
+    if (startStage(job) != 0) {
+        return;
+    }
+    atomic_fetch_sub(&queued_bytes, job->pendingBytes);
+    job->pendingBytes = 0;
+    if (DISTORSION_checkIntegrity(job->element, job->md5) != 0) {
+        finishJob(job, 1);
+        return;
+    }
+    recordJob(job->element);
+    storeSource(job);
+    forwardJob(distort_pool, distortStage, job);
+}
 
-    key_t key = ftok(WORKER_FILE, 1); // Clave única basada en el archivo
-    if (key == -1) {
-        perror("[ERROR] ftok failed");
-        exit(1);
+/**************************************************
+ *
+ * @Finalidad: Etapa de recepción: recibir el fichero del Fleck y pasarlo
+ *             a la etapa de comprobación de integridad. Si el origen cabe
+ *             en la caché, se copia tal cual mientras llega.
+ * @Parametros: in: arg = WorkerJob de la tarea.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void receiveStage(void* arg) {
+    WorkerJob* job = (WorkerJob*)arg;
+    if (startStage(job) != 0) {
+        return;
     }
+    write(STDOUT_FILENO, "[DEBUG] receiveStage: Task started.\n", 36);
+    // Si se distorsiona al recibirla, lo que haya en disco no se puede continuar
+    listElement2 entry = *job->element;
+    entry.fused = entry.status == 0 ? DISTORSION_fusesOnReceive(&entry) : entry.fused;
+    journalJob(&entry, 1);
+    // Una subida reanudada con TRAMA_PROTOCOL_RESUME no trae el principio del fichero
+    int sourceFd = -1, partial = job->element->protocol >= TRAMA_PROTOCOL_RESUME && job->element->bytes_writtenF1 > 0;
+    if (job->cacheKey[0] != '\0' && !partial && job->element->bytes_to_writeF1 <= CACHE_MAX_BYTES) {
+        sourceFd = CACHE_createIncoming(&result_cache, &job->sourcePath);
+    }
+    int error = DISTORSION_receiveFile(job->element, stop_signal, job->md5, &sourceFd);
+    if (sourceFd >= 0) {
+        close(sourceFd);
+    } else {
+        dropSource(job);
+    }
+    if (error != 0) {
+        finishJob(job, 1);
+        return;
+    }
+    forwardJob(check_pool, checkStage, job);
+}
 
-    int msqid = msgget(key, IPC_CREAT | 0666);
-    if (msqid == -1) {
-        perror("[ERROR] Error creating/getting worker count MSQ");
-        exit(1);
+/**************************************************
+ *
+ * @Finalidad: Preparar una tarea que se reanuda para continuar cada
+ *             transferencia desde el byte exacto en que se quedó. Una
+ *             subida sigue tras los bytes que están en disco (tras un
+ *             fsync), salvo si se distorsiona al recibirla, que vuelve a
+ *             empezar. Una descarga sigue desde los bytes que el Fleck
+ *             dice tener, si su protocolo lo permite.
+ * @Parametros: in/out: element    = tarea que se reanuda.
+ *              in:     downloaded = bytes del resultado que tiene el Fleck.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void resumeJob(listElement2* element, int downloaded) {
+    if (element->status == 1) {
+        char* path = NULL;
+        if (element->fused || asprintf(&path, "%s/%s", element->directory, element->fileName) == -1) {
+            element->bytes_writtenF1 = 0;
+        } else {
+            element->bytes_writtenF1 = FILES_get_durable_size(path, element->bytes_to_writeF1);
+            free(path);
+        }
+    } else if (element->status == 3) {
+        int valid = element->protocol >= TRAMA_PROTOCOL_RESUME && downloaded > 0 && downloaded <= element->bytes_to_writeF2;
+        element->bytes_writtenF2 = valid ? downloaded : 0;
     }
-    return msqid;
 }
+
 /**************************************************
  *
- * @Finalidad: Incrementar en uno el contador interno
- *             que lleva la cuenta de trabajadores activos,
- *             utilizado para gestionar la disponibilidad
- *             de workers en el sistema.
- * @Parametros: ----.
+ * @Finalidad: Buscar en la caché el resultado de una tarea nueva o, si no
+ *             está, su fichero de origen. Lo que se encuentre se deja en la
+ *             carpeta del worker y la tarea pasa a estado 2 sin recibir el
+ *             fichero: ya distorsionada o pendiente de distorsionar. Solo
+ *             lo entienden los Flecks con protocolo TRAMA_PROTOCOL_CACHE o
+ *             posterior.
+ * @Parametros: in/out: job = tarea nueva.
  * @Retorno:    ----.
  *
  **************************************************/
-void increment_worker_count() {
-    int msqid = get_worker_count_msq();
-    struct {
-        long message_type;
-    } msg = {1}; // Mensaje genérico con tipo 1
+void lookupJob(WorkerJob* job) {
+    listElement2* element = job->element;
+    if (element->protocol < TRAMA_PROTOCOL_CACHE || job->cacheKey[0] == '\0') {
+        return;
+    }
+    char* path = NULL;
+    if (asprintf(&path, "%s/%s", element->directory, element->fileName) == -1) {
+        return;
+    }
+    char sourceKey[CACHE_KEY_SIZE];
+    if (CACHE_lookup(&result_cache, job->cacheKey, path) == CACHE_OK) {
+        write(STDOUT_FILENO, "Result found in cache.\n", 23);
+        element->fused = 1;
+        job->cachedResult = 1;
+        job->haveIt = 1;
+    } else if (CACHE_makeSourceKey(sourceKey, element->MD5SUM) == CACHE_OK &&
+               CACHE_fetch(&result_cache, sourceKey, path) == CACHE_OK) {
+        write(STDOUT_FILENO, "Source file found in cache.\n", 28);
+        element->fused = 0;
+        job->haveIt = 1;
+    }
+    if (job->haveIt) {
+        element->status = 2;
+        element->bytes_writtenF1 = element->bytes_to_writeF1;
+    }
+    free(path);
+}
 
-    if (msgsnd(msqid, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
-        perror("[ERROR] increment_worker_count: msgsnd failed");
-    } 
+/**************************************************
+ *
+ * @Finalidad: Pedir hueco en el pipeline para una distorsión. Una tarea
+ *             nueva entra en la etapa de recepción (o en la de distorsión
+ *             si el worker ya tiene el resultado o el origen): empieza si
+ *             hay menos de config.max_jobs recibiendo, espera en la cola de
+ *             admisión si cabe, o se rechaza si el worker está saturado. Una
+ *             tarea que se reanuda entra en la etapa que corresponde a su
+ *             estado si cabe en su cola; si no, también se rechaza y el
+ *             Fleck lo reintenta. Nunca se espera: se llama desde el bucle
+ *             que acepta conexiones.
+ * @Parametros: in: element = tarea a admitir.
+ *              in: resumed = 1 si la tarea ya existía en el worker.
+ * @Retorno:    JOB_ACCEPTED si se ha admitido; JOB_BUSY si se rechaza.
+ *
+ **************************************************/
+int admitJob(listElement2* element, int resumed) {
+    WorkerJob* job = malloc(sizeof(WorkerJob));
+    if (job == NULL) {
+        return JOB_BUSY;
+    }
+    job->element = element;
+    job->replyPending = 1;
+    job->md5[0] = '\0';
+    job->haveIt = 0;
+    job->cachedResult = 0;
+    job->sourcePath = NULL;
+    if (CACHE_makeKey(job->cacheKey, element->MD5SUM, element->worker_type, element->factor, element->fileName) != CACHE_OK) {
+        job->cacheKey[0] = '\0';
+    }
+    if (!resumed) {
+        lookupJob(job);
+    }
+    job->pendingBytes = element->status < 2 ? jobBytes(element) : 0;
+
+    recordJob(element);
+
+    atomic_fetch_add(&active_jobs, 1);
+    atomic_fetch_add(&queued_bytes, job->pendingBytes);
+    int result;
+    if (job->haveIt) {
+        result = THREADPOOL_submit(distort_pool, distortStage, job);
+    } else if (element->status < 2) {
+        result = THREADPOOL_submit(receive_pool, receiveStage, job);
+    } else if (element->status == 2) {
+        result = THREADPOOL_submit(distort_pool, distortStage, job);
+    } else {
+        result = THREADPOOL_submit(send_pool, sendStage, job);
+    }
+    if (result != THREADPOOL_OK) {
+        if (!resumed) {
+            forgetJob(element);
+        }
+        atomic_fetch_sub(&queued_bytes, job->pendingBytes);
+        atomic_fetch_sub(&active_jobs, 1);
+        free(job);
+        return JOB_BUSY;
+    }
+    return JOB_ACCEPTED;
 }
+
 /**************************************************
  *
- * @Finalidad: Reducir en uno el contador interno
- *             que lleva la cuenta de trabajadores activos,
- *             utilizado para gestionar la disponibilidad
- *             de workers en el sistema.
+ * @Finalidad: Cerrar las etapas del pipeline de la primera a la última,
+ *             esperando a que cada una termine sus tareas pendientes, y
+ *             después los hilos que ayudan a la de distorsión.
  * @Parametros: ----.
  * @Retorno:    ----.
  *
  **************************************************/
-void decrement_worker_count() {
-    int msqid = get_worker_count_msq();
-    struct {
-        long message_type;
-    } msg;
-
-    if (msgrcv(msqid, &msg, sizeof(msg) - sizeof(long), 1, 0) == -1) {
-        perror("[ERROR] decrement_worker_count: msgrcv failed");
-    } 
+void destroyPipeline() {
+    THREADPOOL_destroy(receive_pool);
+    receive_pool = NULL;
+    THREADPOOL_destroy(check_pool);
+    check_pool = NULL;
+    THREADPOOL_destroy(distort_pool);
+    distort_pool = NULL;
+    THREADPOOL_destroy(send_pool);
+    send_pool = NULL;
+    // Ya no queda ninguna distorsión que le pida ayuda
+    THREADPOOL_destroy(helper_pool);
+    helper_pool = NULL;
 }
+
 /**************************************************
  *
- * @Finalidad: Recuperar el número actual de trabajadores activos
- *             registrados en el sistema.
- * @Parametros: --- (no recibe argumentos)
- * @Retorno:    Entero ≥ 0 con la cantidad de workers disponibles.
- *             Devuelve 0 si no hay ninguno.
+ * @Finalidad: Crear los pools de las etapas del pipeline: recepción,
+ *             comprobación de integridad, distorsión y envío. Cada etapa
+ *             admite el doble de tareas que hilos tiene. También el de los
+ *             hilos que ayudan a distorsionar los ficheros grandes.
+ * @Parametros: ----.
+ * @Retorno:    0 si se han creado todos; -1 en caso de error.
  *
  **************************************************/
-int get_worker_count() {
-    int msqid = get_worker_count_msq();
-    struct msqid_ds buf;
-    if (msgctl(msqid, IPC_STAT, &buf) == -1) {
-        perror("[ERROR] get_worker_count: msgctl failed");
-        return 0;
+int createPipeline() {
+    receive_pool = THREADPOOL_create(config.max_jobs, config.max_jobs * 2);
+    check_pool = THREADPOOL_create(CHECK_THREADS, config.max_jobs * 2);
+    distort_pool = THREADPOOL_create(config.max_jobs, config.max_jobs * 2);
+    send_pool = THREADPOOL_create(config.max_jobs, config.max_jobs * 2);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
     }
-    return buf.msg_qnum; // Número de mensajes en la cola
+    helper_pool = THREADPOOL_create((int)cores, (int)cores * 4);
+    if (receive_pool == NULL || check_pool == NULL || distort_pool == NULL || send_pool == NULL || helper_pool == NULL) {
+        destroyPipeline();
+        return -1;
+    }
+    return 0;
 }
+
 /**************************************************
  *
- * @Finalidad: Eliminar la cola de mensajes.
+ * @Finalidad: Mostrar las tareas pendientes (en cola o en curso) de cada
+ *             etapa del pipeline cuando cambian, para ajustar el tamaño
+ *             de las etapas.
  * @Parametros: ----.
  * @Retorno:    ----.
  *
  **************************************************/
-void delete_worker_count_msq() {
-    int msqid = get_worker_count_msq();
-    if (msgctl(msqid, IPC_RMID, NULL) == -1) {
-        perror("[ERROR] delete_worker_count_msq: msgctl failed");
-    } 
+void logStageDepths() {
+    static int last[4] = { -1, -1, -1, -1 };
+    int depth[4] = {
+        THREADPOOL_pending(receive_pool),
+        THREADPOOL_pending(check_pool),
+        THREADPOOL_pending(distort_pool),
+        THREADPOOL_pending(send_pool)
+    };
+
+    if (memcmp(depth, last, sizeof(depth)) != 0) {
+        memcpy(last, depth, sizeof(depth));
+        char *data = NULL;
+        if (asprintf(&data, "[DEBUG] Stages: receive=%d check=%d distort=%d send=%d\n", depth[0], depth[1], depth[2], depth[3]) != -1) {
+            write(STDOUT_FILENO, data, strlen(data));
+            free(data);
+        }
+    }
 }
+
 /**************************************************
  *
- * @Finalidad: Función diseñada para ejecutarse como hilo (pthread) 
- *             y encargarse de gestionar de forma asíncrona la distorsión 
- *             completa de un fichero. Toma los parámetros de la tarea, 
- *             invoca la lógica de transferencia de tramas y de compresión, 
- *             actualiza el estado en la lista de tareas y notifica al cliente.
- * @Parametros: in: arg = puntero a una estructura (p. ej. listElement2*) 
- *                     que contiene todos los metadatos de la tarea:
- *                     nombre de fichero, factor de distorsión, socket,
- *                     desplazamientos ya transferidos, MD5 original, etc.
- * @Retorno:    Devuelve NULL al finalizar.
+ * @Finalidad: Informar a Gotham (trama 0x12) de la carga del worker:
+ *             distorsiones admitidas, bytes pendientes de recibir de ellas,
+ *             carga de CPU (% de los cores) y cuántas distorsiones admite
+ *             (en curso más en cola). Gotham lo usa para repartir los Flecks
+ *             entre los workers de un tipo.
+ * @Parametros: ----.
+ * @Retorno:    0 si se ha enviado; -1 si ya no hay conexión con Gotham.
  *
  **************************************************/
-void* distortFileThread(void* arg) {
-    listElement2* element = (listElement2*)arg;
-    if (element == NULL) {
-        write(STDOUT_FILENO, "[ERROR] distortFileThread: NULL element received.\n", 50);
-        return NULL;
+int sendTelemetry() {
+    static long cores = 0;
+    if (cores <= 0) {
+        cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores < 1) {
+            cores = 1;
+        }
     }
 
-    // Asignar el ID del hilo actual
-    element->thread_id = pthread_self();
-    write(STDOUT_FILENO, "[DEBUG] distortFileThread: Thread started.\n", 43);
-    int i = 0;
-    i = DISTORSION_distortFile(element, stop_signal);
-    // Llamar a la función de distorsión
-    if (i == 0 || i == 2) {
-        // Determinar la lista objetivo
-        LinkedList2 targetList = (strcmp(element->worker_type, "Media") == 0) ? listH : listE;
-        if (!LINKEDLIST2_isEmpty(targetList)) {
-            LINKEDLIST2_goToHead(targetList);
-            while (!LINKEDLIST2_isAtEnd(targetList)) {
-                listElement2* current = LINKEDLIST2_get(targetList);
-                if (current == element) {
-                    LINKEDLIST2_remove(targetList);
-                    write(STDOUT_FILENO, "[DEBUG] distortFileThread: Element removed from list.\n", 54);
-
-                    // Liberar memoria asociada al elemento
-                    free(element->fileName);
-                    free(element->username);
-                    free(element->worker_type);
-                    free(element->factor);
-                    free(element->MD5SUM);
-                    free(element->directory);
-                    free(element);
-
-                    break;
-                }
-                LINKEDLIST2_next(targetList);
-            }
-        } else {
-            write(STDOUT_FILENO, "[DEBUG] distortFileThread: List is empty, nothing to remove.\n", 61);
-        }
-    } else {
-        write(STDOUT_FILENO, "[ERROR] distortFileThread: Distortion failed.\n", 46);
+    double loadavg;
+    int load = 0;
+    if (getloadavg(&loadavg, 1) == 1) {
+        load = (int)(loadavg * 100 / cores);
     }
 
-    write(STDOUT_FILENO, "[DEBUG] distortFileThread: Thread exiting.\n\n", 44);
+    char data[128];
+    snprintf(data, sizeof(data), "%d&%lld&%d&%d", atomic_load(&active_jobs), atomic_load(&queued_bytes), load, config.max_jobs * 2);
+
+    pthread_mutex_lock(&gotham_mutex);
+    if (sockfd < 0) {
+        pthread_mutex_unlock(&gotham_mutex);
+        return -1;
+    }
+    TRAMA_sendMessageToSocket(sockfd, 0x12, (int16_t)strlen(data), data);
+    pthread_mutex_unlock(&gotham_mutex);
+    return 0;
+}
+
+/**************************************************
+ *
+ * @Finalidad: Hilo que informa periódicamente a Gotham de la carga del
+ *             worker mientras dura la conexión.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void *telemetry_reporter() {
+    // SIGINT no se atiende en este hilo: el manejador toma gotham_mutex
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (sendTelemetry() == 0) {
+        logStageDepths();
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += TELEMETRY_PERIOD;
+
+        pthread_mutex_lock(&telemetry_mutex);
+        int timedOut = 0;
+        while (!telemetry_pending && !timedOut) {
+            timedOut = pthread_cond_timedwait(&telemetry_wake, &telemetry_mutex, &deadline) == ETIMEDOUT;
+        }
+        telemetry_pending = 0;
+        pthread_mutex_unlock(&telemetry_mutex);
+    }
     return NULL;
 }
 
+/**************************************************
+ *
+ * @Finalidad: Pedir al hilo de telemetría que informe a Gotham de la carga
+ *             sin esperar a que acabe su periodo.
+ * @Parametros: ----.
+ * @Retorno:    ----.
+ *
+ **************************************************/
+void requestTelemetry() {
+    pthread_mutex_lock(&telemetry_mutex);
+    telemetry_pending = 1;
+    pthread_cond_signal(&telemetry_wake);
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
 /**************************************************
  *
  * @Finalidad: Inicializar el socket de servidor del worker,
  *             creando y configurando el socket TCP para escuchar
  *             en la IP y el puerto definidos en su configuración.
  *             Prepara la cola de conexiones entrantes para
- *             que el worker pueda aceptar peticiones de Fleck.
+ *             que el worker pueda aceptar peticiones de Fleck. Cada
+ *             petición ocupa un hueco de distorsión, espera en la cola
+ *             de admisión o se rechaza con BUSY si el worker está saturado.
  * @Parametros: ----.
  * @Retorno:    ----.
  *
@@ -402,22 +835,20 @@ void* distortFileThread(void* arg) {
 void initServer() {
     struct trama wtrama;
 
-    if(TRAMA_readMessageFromSocket(sockfd, &wtrama) < 0) {
+    if(TRAMA_readFrame(gothamReader, &wtrama) != TRAMA_OK) {
         write(STDOUT_FILENO, "Error: Reading from socket.\n", 29);
-        free(wtrama.data);
         return;
     } else if(wtrama.tipo != 0x08) {
         write(STDOUT_FILENO, "Error: I'm not the principal what is this.\n", 44);
-        free(wtrama.data);
         return;
     } else if(wtrama.tipo == 0x08) {
         write(STDOUT_FILENO, "I'm the principal worker.\n\n", 27);
-        free(wtrama.data);
     }
 
     fleck_connecter_fd = SOCKET_initSocket(config.worker_server_port, config.worker_server_ip);
     struct sockaddr_in c_addr;
     socklen_t c_len = sizeof(c_addr);
+    LinkedList2 targetList = (strcmp(config.worker_type, "Media") == 0) ? listH : listE;
 
     while (1) {
         fleckSock = accept(fleck_connecter_fd, (void *)&c_addr, &c_len);
@@ -426,18 +857,11 @@ void initServer() {
             exit(EXIT_FAILURE);
         }
 
-        sleep(3);   
-
-        if(strcmp(config.worker_type, "Media") == 0) {
-            read_from_msq(listH, MEDIA);
-        } else if(strcmp(config.worker_type, "Text") == 0) {
-            read_from_msq(listE, TEXT);
-        }
-
         struct trama wtrama;
-        if (TRAMA_readMessageFromSocket(fleckSock, &wtrama) < 0) {
+        TramaReader *fleckReader = TRAMA_createReader(fleckSock);
+        if (TRAMA_readFrame(fleckReader, &wtrama) != TRAMA_OK) {
             write(STDOUT_FILENO, "Error: Reading distortion info from fleck.\n", 44);
-            free(wtrama.data);
+            TRAMA_destroyReader(fleckReader);
             close(fleckSock);
             fleckSock = -1;
             continue; // Saltar al siguiente ciclo del bucle
@@ -448,65 +872,123 @@ void initServer() {
         char* fileSize = STRING_getXFromMessage((const char *)wtrama.data, 2);
         char* MD5SUM = STRING_getXFromMessage((const char *)wtrama.data, 3);
         char* factor = STRING_getXFromMessage((const char *)wtrama.data, 4);
+        char* version = STRING_getXFromMessage((const char *)wtrama.data, 5);
+        char* downloaded = STRING_getXFromMessage((const char *)wtrama.data, 6);
+        int protocol = TRAMA_negotiateProtocol(version);
 
         char *data = NULL;
         if (asprintf(&data, "Fleck name: %s File received: %s\n", userName, fileName) == -1) return;
         write(STDOUT_FILENO, data, strlen(data));
         free(data);
 
-        LinkedList2 targetList = (strcmp(config.worker_type, "Media") == 0) ? listH : listE;
-
+        // Un worker que se cierra libera sus tareas antes de avisar al
+        // Fleck, y las de uno que se ha caído quedan anotadas con su pid: si
+        // el Fleck viene a reanudar una, se reclama de la tabla compartida
+        // o, si no está (otra máquina o campos demasiado largos), del diario
         listElement2* existingElement = NULL;
-        int found = 0;
-
-        if (!LINKEDLIST2_isEmpty(targetList)) {
-            write(STDOUT_FILENO, "List not empty...\n", 19);
-            LINKEDLIST2_goToHead(targetList);
-            while (!LINKEDLIST2_isAtEnd(targetList)) {
-                listElement2* element = LINKEDLIST2_get(targetList);
-                if (strcmp(element->fileName, fileName) == 0 && strcmp(element->username, userName) == 0) {
-                    existingElement = element;
-                    existingElement->fd = fleckSock;
-                    found = 1;
-                    write (STDOUT_FILENO, "Element found...\n", 18);
-                    break;
+        int busy = acquireJob(targetList, fileName, userName, &existingElement) == JOB_BUSY;
+        if (!busy && existingElement == NULL) {
+            int claimed = JOBTABLE_claim(&job_table, userName, fileName, &existingElement);
+            if (claimed == JOBTABLE_OK) {
+                write(STDOUT_FILENO, "Job taken over from the shared table.\n", 38);
+            } else if (claimed == JOBTABLE_ERROR_BUSY) {
+                busy = 1;
+            } else {
+                existingElement = JOURNAL_claim(&job_journal, userName, fileName, config.worker_type);
+                if (existingElement != NULL) {
+                    write(STDOUT_FILENO, "Job taken over from the journal.\n", 33);
                 }
-                LINKEDLIST2_next(targetList);
+            }
+            if (existingElement != NULL) {
+                existingElement->inPipeline = 1;
+                pthread_mutex_lock(&jobs_mutex);
+                LINKEDLIST2_add(targetList, existingElement);
+                pthread_mutex_unlock(&jobs_mutex);
             }
         }
-
-        listElement2* newElement = NULL;
-        if (!found) {
-            newElement = malloc(sizeof(listElement2));
-            newElement->fileName = strdup(fileName);
-            newElement->username = strdup(userName);
-            newElement->worker_type = strdup(config.worker_type);
-            newElement->factor = strdup(factor);
-            newElement->MD5SUM = strdup(MD5SUM);
-            newElement->directory = strdup(config.directory);
-            newElement->bytes_to_writeF1 = atoi(fileSize);
-            newElement->bytes_writtenF1 = 0;
-            newElement->bytes_to_writeF2 = 0;
-            newElement->bytes_writtenF2 = 0;
-            newElement->fd = fleckSock;
-            newElement->status = 0;
-
-            LINKEDLIST2_add(targetList, newElement);
+        if (busy) {
+            // Sigue en curso aquí o en otro worker (o no se ha podido leer
+            // la tabla): el Fleck lo reintentará
+            write(STDOUT_FILENO, "Job still in progress, distortion rejected.\n", 44);
+            rejectFleck(fleckSock, fleckReader, protocol);
+            fleckSock = -1;
+            free(userName);
+            free(fileName);
+            free(fileSize);
+            free(MD5SUM);
+            free(factor);
+            free(version);
+            free(downloaded);
+            continue;
         }
 
-        TRAMA_sendMessageToSocket(fleckSock, 0x03, 0, ""); // Indicar que se puede empezar a enviar el archivo.
-        // TRAMA_sendMessageToSocket(fleckSock, 0x03, (int16_t)strlen("CON_KO"), "CON_KO"); // Error, no se puede enviar archivo.
+        listElement2* element = existingElement;
+        if (existingElement != NULL) {
+            write (STDOUT_FILENO, "Element found...\n", 18);
+            // La conexión anterior del Fleck ya no se usa: ninguna etapa tiene la tarea
+            if (existingElement->fd >= 0 && existingElement->fd != fleckSock) {
+                close(existingElement->fd);
+            }
+            existingElement->fd = fleckSock;
+            TRAMA_destroyReader(existingElement->reader);
+            existingElement->reader = fleckReader;
+            existingElement->protocol = protocol;
+            resumeJob(existingElement, downloaded != NULL ? atoi(downloaded) : 0);
+        } else {
+            element = malloc(sizeof(listElement2));
+            element->fileName = strdup(fileName);
+            element->username = strdup(userName);
+            element->worker_type = strdup(config.worker_type);
+            element->factor = strdup(factor);
+            element->MD5SUM = strdup(MD5SUM);
+            element->directory = strdup(config.directory);
+            element->bytes_to_writeF1 = atoi(fileSize);
+            element->bytes_writtenF1 = 0;
+            element->bytes_to_writeF2 = 0;
+            element->bytes_writtenF2 = 0;
+            element->fd = fleckSock;
+            element->reader = fleckReader;
+            element->thread_id = 0;
+            element->protocol = protocol;
+            element->status = 0;
+            element->fused = 0;
+            element->inPipeline = 1;
+
+            pthread_mutex_lock(&jobs_mutex);
+            LINKEDLIST2_add(targetList, element);
+            pthread_mutex_unlock(&jobs_mutex);
+        }
 
-        pthread_t thread_id;
-        pthread_create(&thread_id, NULL, distortFileThread, found ? existingElement : newElement);
-        pthread_detach(thread_id);
+        // Si no hay hueco libre, el Fleck espera la respuesta 0x03 en la cola de admisión
+        if (admitJob(element, existingElement != NULL) == JOB_BUSY) {
+            // Saturado: el Fleck pedirá otro worker a Gotham, que recibe la carga enseguida
+            write(STDOUT_FILENO, "Worker busy, distortion rejected.\n", 34);
+            pthread_mutex_lock(&jobs_mutex);
+            if (existingElement != NULL) {
+                // Una tarea que se reanuda sigue en la lista para el próximo intento
+                existingElement->fd = -1;
+                existingElement->reader = NULL;
+                existingElement->inPipeline = 0;
+            } else {
+                removeJob(targetList, element);
+            }
+            pthread_mutex_unlock(&jobs_mutex);
+            if (existingElement == NULL) {
+                element->reader = NULL;
+                freeJob(element);
+            }
+            rejectFleck(fleckSock, fleckReader, protocol);
+            fleckSock = -1;
+            requestTelemetry();
+        }
 
         free(userName);
         free(fileName);
         free(fileSize);
         free(MD5SUM);
         free(factor);
-        free(wtrama.data);
+        free(version);
+        free(downloaded);
     }
 }
 
@@ -522,21 +1004,45 @@ void initServer() {
  *
  **************************************************/
 void doLogout() {
+    pthread_mutex_lock(&gotham_mutex);
     if (SOCKET_isSocketOpen(sockfd)) {
         write(STDOUT_FILENO, "Sending logout message to Gotham server...\n", 43);
         TRAMA_sendMessageToSocket(sockfd, 0x07, (int16_t)strlen(config.worker_type), config.worker_type);
         close(sockfd);
+        sockfd = -1;
     }
+    pthread_mutex_unlock(&gotham_mutex);
 
     write(STDOUT_FILENO, "Stopping all active threads...\n", 32);
     LinkedList2 targetList = (strcmp(config.worker_type, "Media") == 0) ? listH : listE;
 
+    // Despertar a las tareas que esperan datos del Fleck, sin avisar todavía al
+    // Fleck, y esperar a que el pipeline las termine todas
+    LINKEDLIST2_goToHead(targetList);
+    while (!LINKEDLIST2_isAtEnd(targetList)) {
+        listElement2* element = LINKEDLIST2_get(targetList);
+        if (element->fd >= 0) {
+            shutdown(element->fd, SHUT_RD);
+        }
+        LINKEDLIST2_next(targetList);
+    }
+    // Las etapas se cierran en orden, así las tareas que pasan de una a
+    // la siguiente todavía encuentran abierta la etapa de destino
+    write(STDOUT_FILENO, "Stopping thread...\n", 20);
+    destroyPipeline();
+
+    // Las tareas a medias (recibiendo, distorsionando o enviando) quedan
+    // libres: otro worker las continúa desde donde se quedaron
+    JOURNAL_release(&job_journal);
+    JOBTABLE_release(&job_table);
+
     if (!LINKEDLIST2_isEmpty(targetList)) {
         write(STDOUT_FILENO, "List not empty...\n", 19);
         LINKEDLIST2_goToHead(targetList);
         while (!LINKEDLIST2_isAtEnd(targetList)) {
             listElement2* element = LINKEDLIST2_get(targetList);
-            write(STDOUT_FILENO, "Stopping thread...\n", 20);
+
+            // La tarea ya está libre en el diario: el Fleck puede reanudarla en otro worker
             if (element->fd >= 0) {
                 write(STDOUT_FILENO, "Closing fleck socket...\n", 25);
                 if (element->status != 1) {
@@ -547,45 +1053,9 @@ void doLogout() {
                 element->fd = -1;
                 write(STDOUT_FILENO, "[DEBUG] doLogout: Worker socket closed.\n", 40);
             }
-            write(STDOUT_FILENO, "Stopping thread...\n", 19);
-
-            if (element->thread_id != 0) {
-                pthread_join(element->thread_id, NULL); 
-            }
-            
-            // Verificar si es el último Worker conectado
-            int worker_count = get_worker_count();
-            if (worker_count == 1) {
-                delete_worker_count_msq(); // Eliminar la cola de mensajes
-                write(STDOUT_FILENO, "[DEBUG] Last Worker disconnecting. Deleting MSQ.\n", 49);
-            } else {
-                if (strcmp(config.worker_type, "Media") == 0 && element->status == 2) {
-                    send_to_msq(element, MEDIA);
-                } else if (strcmp(config.worker_type, "Text") == 0 && element->status == 2) {
-                    send_to_msq(element, TEXT);
-                }
-                decrement_worker_count(); // Reducir el contador de Workers
-                write(STDOUT_FILENO, "[DEBUG] Other Workers still connected. Decrementing count.\n", 59);
-            }
 
             LINKEDLIST2_remove(targetList);
-
-            free(element->fileName);
-            free(element->username);
-            free(element->worker_type);
-            free(element->factor);
-            free(element->MD5SUM);
-            free(element->directory);
-            free(element);
-        }
-    } else {
-        int worker_count = get_worker_count();
-        if (worker_count == 1) {
-            write(STDOUT_FILENO, "[DEBUG] Last Worker disconnecting. Deleting MSQ.\n", 49);
-            delete_worker_count_msq();
-        } else {
-            write(STDOUT_FILENO, "[DEBUG] Other Workers still connected. Decrementing count.\n", 59);
-            decrement_worker_count();
+            freeJob(element);
         }
     }
 
@@ -607,8 +1077,11 @@ void CTRLC(int signum) {
     write(STDOUT_FILENO, "\nInterrupt signal CTRL+C received. Stopping worker...\n", 54);
     *stop_signal = 1; 
     doLogout(); 
+    JOURNAL_close(&job_journal);
+    JOBTABLE_close(&job_table);
 
     close(fleck_connecter_fd);
+    TRAMA_destroyReader(gothamReader);
     free_config();
     LINKEDLIST2_destroy(&listE);
     LINKEDLIST2_destroy(&listH);
@@ -632,7 +1105,10 @@ void *connection_watcher() {
     while (1) {
         if (!SOCKET_isSocketOpen(sockfd)) {
             write(STDOUT_FILENO, "[DEBUG] connection_watcher: Connection to Gotham lost.\n", 55);
+            pthread_mutex_lock(&gotham_mutex);
             close(sockfd);
+            sockfd = -1;
+            pthread_mutex_unlock(&gotham_mutex);
 
             // Entramos en bucle para revisar el fleckSock
             while (1) {
@@ -660,7 +1136,8 @@ void *connection_watcher() {
  *               de trabajo y el tipo de worker.
  *             - Conectar al servidor Gotham y registrarse como worker activo.
  *             - Crear y gestionar la lista de tareas pendientes.
- *             - Lanzar un hilo de vigilancia de conexión (connection_watcher).
+ *             - Lanzar un hilo de vigilancia de conexión (connection_watcher)
+ *               y otro que informa a Gotham de la carga (telemetry_reporter).
  *             - Iniciar el servidor para recivir peticiones de Fleck mediante initServer().
  *             - Al terminar, enviar logout ordenado, limpiar recursos y salir.
  * @Parametros: in: argc = número de argumentos de línea de comandos (debe ser 2).
@@ -688,6 +1165,20 @@ int main(int argc, char *argv[]) {
     char *data = (char *)malloc(sizeof(char) * 256);
 
     config = READCONFIG_read_config_worker(argv[1]);
+    if (createPipeline() != 0) {
+        write(STDOUT_FILENO, "Error: Cannot create thread pool\n", 33);
+        free_config();
+        exit(1);
+    }
+    if (CACHE_init(&result_cache, config.directory) != CACHE_OK) {
+        write(STDOUT_FILENO, "Warning: Result cache disabled\n", 31);
+    }
+    if (JOURNAL_open(&job_journal, config.directory) != JOURNAL_OK) {
+        write(STDOUT_FILENO, "Warning: Job journal disabled\n", 30);
+    }
+    if (JOBTABLE_open(&job_table, config.directory, config.worker_type) != JOBTABLE_OK) {
+        write(STDOUT_FILENO, "Warning: Shared job table disabled\n", 35);
+    }
     
     write(STDOUT_FILENO, "\nWorker initialized\n\n", 22);
 
@@ -708,14 +1199,13 @@ int main(int argc, char *argv[]) {
     TRAMA_sendMessageToSocket(sockfd, 0x02, (int16_t)strlen(data), data);    
     free(data);
 
-    increment_worker_count();
+    gothamReader = TRAMA_createReader(sockfd);
     struct trama wtrama;
-    if(TRAMA_readMessageFromSocket(sockfd, &wtrama) < 0) {
+    if(TRAMA_readFrame(gothamReader, &wtrama) != TRAMA_OK) {
         write(STDOUT_FILENO, "Error: Checksum not validated.\n", 32);
     } else if(strcmp((const char *)wtrama.data, "CON_KO") == 0) {
         write(STDOUT_FILENO, "Error: Connection not validated.\n", 34);
     }
-    free(wtrama.data);
 
     pthread_t watcher_thread;
     if(pthread_create(&watcher_thread, NULL, connection_watcher, NULL) != 0) {
@@ -725,11 +1215,26 @@ int main(int argc, char *argv[]) {
         perror("Error detaching thread");
     }
 
+    pthread_t telemetry_thread;
+    if(pthread_create(&telemetry_thread, NULL, telemetry_reporter, NULL) != 0) {
+        write(STDOUT_FILENO, "Error: Cannot create thread\n", 29);
+    } else {
+        pthread_detach(telemetry_thread);
+    }
+
     initServer();
+    pthread_mutex_lock(&gotham_mutex);
     close(sockfd);
+    sockfd = -1;
+    pthread_mutex_unlock(&gotham_mutex);
+    TRAMA_destroyReader(gothamReader);
     free_config();
     LINKEDLIST2_destroy(&listE);
     LINKEDLIST2_destroy(&listH);
+    destroyPipeline();
+    CACHE_destroy(&result_cache);
+    JOURNAL_close(&job_journal);
+    JOBTABLE_close(&job_table);
 
     return 0;
 }
\ No newline at end of file